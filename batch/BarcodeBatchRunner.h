@@ -0,0 +1,87 @@
+//
+//  BarcodeBatchRunner.h
+//  SmallBarcodeReader
+//
+//  Headless sweeps and batch decoding for the command-line tool
+//
+
+#import <Foundation/Foundation.h>
+
+#import "BarcodeDecoder.h"
+
+@class BarcodeEncoder;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Sweep specification keys (JSON object in a spec file)
+extern NSString * const BarcodeBatchSpecName;         // String, session name
+extern NSString * const BarcodeBatchSpecPayloads;     // Array of strings
+extern NSString * const BarcodeBatchSpecSymbologies;  // Array of symbology IDs
+extern NSString * const BarcodeBatchSpecDistortions;  // Array of distortion type IDs or names
+extern NSString * const BarcodeBatchSpecIntensities;  // Grid (see below)
+extern NSString * const BarcodeBatchSpecStrengths;    // Grid (see below)
+extern NSString * const BarcodeBatchSpecWorkers;      // Number, 0 = one per processor
+extern NSString * const BarcodeBatchSpecOutput;       // String, result file path
+
+/// A grid is either an array of numbers or an object
+/// {"from": 0.0, "to": 1.0, "steps": 11} of evenly spaced values.
+/// Result files ending in .csv are written as CSV, .jsonl as JSON Lines and
+/// anything else except .json as a binary session file (BarcodeSessionFile.h).
+/// Results stream to the file as the run goes and are not kept in memory.
+@interface BarcodeBatchRunner : NSObject {
+    BarcodeEncoder *encoder;
+    BarcodeDecoder *decoder;
+    NSUInteger workerCount;
+    BOOL verbose;
+}
+
+/// Worker threads (0, the default, uses one per processor)
+@property (assign, nonatomic) NSUInteger workerCount;
+
+/// Log progress to stderr
+@property (assign, nonatomic) BOOL verbose;
+
+/// How the decoder scans each image (full resolution by default; see
+/// -[BarcodeDecoder decodeStrategy]). Sweep rasters are mostly below the
+/// pyramid threshold, so this matters for decodeImagesInDirectory:.
+@property (assign, nonatomic) BarcodeDecodeStrategy decodeStrategy;
+
+/// How the decoder's registered backends share each scan (primary backend
+/// only by default; see -[BarcodeDecoder decodePolicy])
+@property (assign, nonatomic) BarcodeDecodePolicy decodePolicy;
+
+/// Symbols each image is expected to hold, for the pyramid strategy's early
+/// exit and the cascade policy (0, the default, scans every candidate region)
+@property (assign, nonatomic) NSInteger expectedSymbolCount;
+
+/// Initialize with auto-detected encoder and decoder backends
+- (instancetype)init;
+
+/// Read a sweep specification
+/// @param path JSON spec file
+/// @param error Receives the reason on failure (may be NULL)
+/// @return Specification, or nil if the file is missing or malformed
++ (NSDictionary *)specificationWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+/// Run a sweep
+/// @param specification Parsed spec; its workers entry is used while workerCount is 0
+/// @param outputPath Result file, or nil to use the spec's output entry
+/// @param error Receives the reason on failure (may be NULL)
+/// @return NO if the sweep could not run or its results could not be written
+- (BOOL)runSweep:(NSDictionary *)specification outputPath:(NSString *)outputPath error:(NSError **)error;
+
+/// Decode every image file in a directory (not recursive). Writes one CSV row
+/// per barcode found, in file name order: File,Barcode Type,Decoded Data,
+/// Conversion ms,Scan ms (the decoder's BarcodeDecodeTiming for the file,
+/// empty while timing is off); files with no barcode get a row with empty
+/// type and data. With verbose on, per-backend statistics and pyramid
+/// decodes are summarized on stderr.
+/// @param directory Directory of images
+/// @param outputPath CSV file, or nil for stdout
+/// @param error Receives the reason on failure (may be NULL)
+/// @return NO if the directory could not be read or the output not written
+- (BOOL)decodeImagesInDirectory:(NSString *)directory outputPath:(NSString *)outputPath error:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,593 @@
+//
+//  BarcodeBatchRunner.m
+//  SmallBarcodeReader
+//
+//  Headless sweeps and batch decoding implementation
+//
+
+#import "BarcodeBatchRunner.h"
+#import "BarcodeEncoder.h"
+#import "BarcodeDecoder.h"
+#import "BarcodeTester.h"
+#import "BarcodeTestExecutor.h"
+#import "BarcodeTestResult.h"
+#import "BarcodeResultSink.h"
+#import "BarcodeSessionFile.h"
+#import "ImageDistorter.h"
+#import "ImagePixelFormat.h"
+#import <pthread.h>
+#import <stdio.h>
+#import <string.h>
+
+NSString * const BarcodeBatchSpecName = @"name";
+NSString * const BarcodeBatchSpecPayloads = @"payloads";
+NSString * const BarcodeBatchSpecSymbologies = @"symbologies";
+NSString * const BarcodeBatchSpecDistortions = @"distortions";
+NSString * const BarcodeBatchSpecIntensities = @"intensities";
+NSString * const BarcodeBatchSpecStrengths = @"strengths";
+NSString * const BarcodeBatchSpecWorkers = @"workers";
+NSString * const BarcodeBatchSpecOutput = @"output";
+
+static NSString * const BarcodeBatchErrorDomain = @"BarcodeBatchRunner";
+
+static BOOL failWithMessage(NSError **error, NSInteger code, NSString *message) {
+    if (error) {
+        *error = [NSError errorWithDomain:BarcodeBatchErrorDomain code:code userInfo:
+            [NSDictionary dictionaryWithObject:message forKey:NSLocalizedDescriptionKey]];
+    }
+    return NO;
+}
+
+// Expand a grid entry (array of numbers or {from, to, steps}) into NSNumbers
+static NSArray *gridValues(id grid, NSArray *defaultValues) {
+    if (!grid) {
+        return defaultValues;
+    }
+    if ([grid isKindOfClass:[NSArray class]]) {
+        NSEnumerator *enumerator = [grid objectEnumerator];
+        id value;
+        while ((value = [enumerator nextObject])) {
+            if (![value isKindOfClass:[NSNumber class]]) {
+                return nil;
+            }
+        }
+        return [grid count] > 0 ? grid : nil;
+    }
+    if ([grid isKindOfClass:[NSDictionary class]]) {
+        float from = [[grid objectForKey:@"from"] floatValue];
+        float to = [[grid objectForKey:@"to"] floatValue];
+        NSInteger steps = [[grid objectForKey:@"steps"] integerValue];
+        if (steps < 1) {
+            return nil;
+        }
+        NSMutableArray *values = [NSMutableArray arrayWithCapacity:steps];
+        NSInteger i;
+        for (i = 0; i < steps; i++) {
+            float value = steps == 1 ? from : from + (to - from) * (float)i / (float)(steps - 1);
+            [values addObject:[NSNumber numberWithFloat:value]];
+        }
+        return values;
+    }
+    return nil;
+}
+
+// Distortion types given as IDs or names (as in nameForDistortionType:)
+static NSArray *distortionTypeValues(id entry) {
+    NSArray *known = [[NSArray arrayWithObject:[NSNumber numberWithInt:DistortionTypeNone]]
+                         arrayByAddingObjectsFromArray:[ImageDistorter availableDistortionTypes]];
+    if (!entry) {
+        return [ImageDistorter availableDistortionTypes];
+    }
+    if (![entry isKindOfClass:[NSArray class]] || [entry count] == 0) {
+        return nil;
+    }
+
+    NSMutableArray *types = [NSMutableArray arrayWithCapacity:[entry count]];
+    NSEnumerator *enumerator = [entry objectEnumerator];
+    id value;
+    while ((value = [enumerator nextObject])) {
+        NSNumber *type = nil;
+        NSUInteger i;
+        for (i = 0; i < known.count; i++) {
+            NSNumber *candidate = [known objectAtIndex:i];
+            if ([value isKindOfClass:[NSNumber class]] ? [value intValue] == [candidate intValue] :
+                ([value isKindOfClass:[NSString class]] &&
+                 [value caseInsensitiveCompare:[ImageDistorter nameForDistortionType:[candidate intValue]]] == NSOrderedSame)) {
+                type = candidate;
+                break;
+            }
+        }
+        if (!type) {
+            return nil;
+        }
+        [types addObject:type];
+    }
+    return types;
+}
+
+// Sink writing the given path, chosen by extension
+static id<BarcodeResultSink> sinkForPath(NSString *path) {
+    NSString *extension = [[path pathExtension] lowercaseString];
+    if ([extension isEqualToString:@"csv"]) {
+        return [[[BarcodeStreamResultSink alloc] initWithPath:path format:BarcodeResultFormatCSV] autorelease];
+    }
+    if ([extension isEqualToString:@"jsonl"]) {
+        return [[[BarcodeStreamResultSink alloc] initWithPath:path format:BarcodeResultFormatJSONLines] autorelease];
+    }
+    return [[[BarcodeSessionFileWriter alloc] initWithPath:path] autorelease];
+}
+
+// Append one RFC 4180 quoted field
+static void appendCSVField(NSMutableString *line, NSString *field) {
+    [line appendString:@"\""];
+    if (field) {
+        [line appendString:[field stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""]];
+    }
+    [line appendString:@"\""];
+}
+
+// Timing column: empty when not timed
+static void appendMilliseconds(NSMutableString *line, double milliseconds) {
+    if (milliseconds >= 0.0) {
+        [line appendFormat:@",%.3f", milliseconds];
+    } else {
+        [line appendString:@","];
+    }
+}
+
+// Decode an image file, going straight from the bitmap's pixels to the
+// decoder when the layout allows it. timing receives the decode call's split,
+// or -1 for both when the file could not be read and the decoder never ran.
+static NSArray *decodeImageFile(BarcodeDecoder *decoder, NSString *path, BarcodeDecodeTiming *timing) {
+    timing->conversionMilliseconds = -1.0;
+    timing->scanMilliseconds = -1.0;
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (!data) {
+        return nil;
+    }
+    NSArray *results = nil;
+    NSBitmapImageRep *bitmap = [NSBitmapImageRep imageRepWithData:data];
+    if (bitmap && ![bitmap isPlanar] && [bitmap bitsPerSample] == 8) {
+        int bitsPerPixel = (int)[bitmap bitsPerPixel];
+        ImagePixelFormat format = ImagePixelFormatGray8;
+        BOOL direct = YES;
+        if (bitsPerPixel == 24) {
+            format = ImagePixelFormatRGB24;
+        } else if (bitsPerPixel == 32) {
+            format = ([bitmap bitmapFormat] & NSAlphaFirstBitmapFormat) ? ImagePixelFormatARGB32 : ImagePixelFormatRGBA32;
+        } else if (bitsPerPixel != 8) {
+            direct = NO;
+        }
+        if (direct) {
+            results = [decoder decodeBarcodesFromPixels:[bitmap bitmapData]
+                                                  width:(int)[bitmap pixelsWide]
+                                                 height:(int)[bitmap pixelsHigh]
+                                                 stride:(int)[bitmap bytesPerRow]
+                                                 format:format
+                                          originalInput:nil];
+            *timing = [decoder lastDecodeTiming];
+            return results;
+        }
+    }
+    results = [decoder decodeBarcodesFromImageData:data];
+    *timing = [decoder lastDecodeTiming];
+    return results;
+}
+
+// Backends whose statistics a batch decode reports
+enum { BatchMaximumBackends = 16 };
+
+// Shared by the workers of one batch decode
+typedef struct {
+    BarcodeDecoder *decoder;   // Prototype; each worker decodes with a copy
+    NSArray *paths;
+    NSMutableArray *lines;     // One CSV chunk per path
+    NSUInteger nextPath;
+    pthread_mutex_t lock;      // Guards nextPath, lines and pyramid
+    NSConditionLock *finishedWorkers;
+    BarcodePyramidStatistics pyramid; // Summed over the workers' decoders
+    BarcodeBackendStatistics backends[BatchMaximumBackends]; // Same, per entry of -allBackends
+} BatchDecodeContext;
+
+static void addBackendStatistics(BarcodeBackendStatistics *total, BarcodeBackendStatistics part) {
+    total->scans += part.scans;
+    total->successes += part.successes;
+    total->wins += part.wins;
+    total->abandoned += part.abandoned;
+    total->timedScans += part.timedScans;
+    total->totalMilliseconds += part.totalMilliseconds;
+}
+
+// How often each backend found symbols, won and was left behind
+static void printBackendStatistics(NSArray *backends, const BarcodeBackendStatistics *statistics) {
+    NSUInteger i;
+    for (i = 0; i < backends.count && i < BatchMaximumBackends; i++) {
+        const BarcodeBackendStatistics *backend = &statistics[i];
+        if (backend->scans == 0) {
+            continue;
+        }
+        fprintf(stderr, "Backend %s: %lu scan(s), %lu found symbols, %lu won, %lu abandoned",
+                [[[[backends objectAtIndex:i] class] backendName] UTF8String], backend->scans, backend->successes,
+                backend->wins, backend->abandoned);
+        if (backend->timedScans > 0) {
+            fprintf(stderr, ", %.2f ms mean", backend->totalMilliseconds / (double)backend->timedScans);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+static void addPyramidStatistics(BarcodePyramidStatistics *total, BarcodePyramidStatistics part) {
+    int level;
+    total->decodes += part.decodes;
+    total->earlyExits += part.earlyExits;
+    total->fallbacks += part.fallbacks;
+    total->regionsScanned += part.regionsScanned;
+    for (level = 0; level < ImagePyramidMaximumLevels; level++) {
+        total->levelHits[level] += part.levelHits[level];
+        total->levelMilliseconds[level] += part.levelMilliseconds[level];
+    }
+    total->buildMilliseconds += part.buildMilliseconds;
+    total->framePixels += part.framePixels;
+    total->pixelsScanned += part.pixelsScanned;
+}
+
+// Where pyramid decodes found their symbols and how much they scanned
+static void printPyramidStatistics(const BarcodePyramidStatistics *statistics) {
+    fprintf(stderr, "Pyramid: %lu image(s), %lu early exit(s), %lu full-frame fallback(s), %lu region(s) scanned\n",
+            statistics->decodes, statistics->earlyExits, statistics->fallbacks, statistics->regionsScanned);
+    fprintf(stderr, "  scanned %.1f%% of the pixels a full-resolution pass would; build %.1f ms\n",
+            statistics->framePixels ? 100.0 * (double)statistics->pixelsScanned / (double)statistics->framePixels : 0.0,
+            statistics->buildMilliseconds);
+    int level;
+    for (level = 0; level < ImagePyramidMaximumLevels; level++) {
+        if (statistics->levelHits[level] > 0 || statistics->levelMilliseconds[level] > 0.0) {
+            fprintf(stderr, "  level %d (1/%d): %lu symbol(s), %.1f ms\n", level, 1 << level,
+                    statistics->levelHits[level], statistics->levelMilliseconds[level]);
+        }
+    }
+}
+
+static void batchDecodeWorker(BatchDecodeContext *context) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BarcodeDecoder *decoder = [context->decoder copy];
+
+    while (YES) {
+        pthread_mutex_lock(&context->lock);
+        NSUInteger index = context->nextPath++;
+        pthread_mutex_unlock(&context->lock);
+        if (index >= context->paths.count) {
+            break;
+        }
+
+        NSAutoreleasePool *filePool = [[NSAutoreleasePool alloc] init];
+        NSString *path = [context->paths objectAtIndex:index];
+        BarcodeDecodeTiming timing;
+        NSArray *results = decodeImageFile(decoder, path, &timing);
+        NSString *name = [path lastPathComponent];
+        NSMutableString *lines = [NSMutableString string];
+        NSUInteger i;
+        for (i = 0; i == 0 || i < results.count; i++) {
+            BarcodeResult *result = i < results.count ? [results objectAtIndex:i] : nil;
+            appendCSVField(lines, name);
+            [lines appendString:@","];
+            appendCSVField(lines, result.type);
+            [lines appendString:@","];
+            appendCSVField(lines, result.data);
+            appendMilliseconds(lines, timing.conversionMilliseconds);
+            appendMilliseconds(lines, timing.scanMilliseconds);
+            [lines appendString:@"\n"];
+        }
+
+        pthread_mutex_lock(&context->lock);
+        [context->lines replaceObjectAtIndex:index withObject:lines];
+        pthread_mutex_unlock(&context->lock);
+        [filePool release];
+    }
+
+    // Race losers may still be scanning the last files; their abandoned
+    // scans only count once they finish
+    [decoder waitUntilBackendsIdle];
+    pthread_mutex_lock(&context->lock);
+    addPyramidStatistics(&context->pyramid, [decoder pyramidStatistics]);
+    NSArray *backends = [decoder allBackends];
+    NSUInteger b;
+    for (b = 0; b < backends.count && b < BatchMaximumBackends; b++) {
+        addBackendStatistics(&context->backends[b], [decoder statisticsForBackend:[backends objectAtIndex:b]]);
+    }
+    pthread_mutex_unlock(&context->lock);
+    [decoder release];
+    [pool release];
+}
+
+// Wall time a group of cells took, from its timed total stage
+static double groupSeconds(const BarcodeOutcomeCounters *counters) {
+    const BarcodeRunningMoments *total = &counters->stageMilliseconds[BarcodeTestStageTotal];
+    return total->mean * (double)total->count / 1000.0;
+}
+
+// Indices of the slowest groups, slowest first
+static int slowestGroups(const BarcodeOutcomeCounters *groups, int count, int *indices, int limit) {
+    int found = 0, i, j;
+    for (i = 0; i < count; i++) {
+        if (groups[i].stageMilliseconds[BarcodeTestStageTotal].count == 0) continue;
+        double seconds = groupSeconds(&groups[i]);
+        // Insertion into the sorted list; the fastest entry drops off when full
+        j = found < limit ? found++ : limit;
+        while (j > 0 && groupSeconds(&groups[indices[j - 1]]) < seconds) {
+            if (j < limit) indices[j] = indices[j - 1];
+            j--;
+        }
+        if (j < limit) indices[j] = i;
+    }
+    return found;
+}
+
+// Symbologies and distortions that dominated the sweep's wall time
+static void printSlowestGroups(const BarcodeTestStatistics *statistics) {
+    int indices[5], count, i;
+    count = slowestGroups(statistics->bySymbology, BarcodeTestStatisticsSymbologySlots, indices, 5);
+    for (i = 0; i < count; i++) {
+        const BarcodeOutcomeCounters *group = &statistics->bySymbology[indices[i]];
+        fprintf(stderr, "  symbology %d: %.2f s (decode %.3f ms mean)\n", indices[i], groupSeconds(group),
+                group->stageMilliseconds[BarcodeTestStageDecode].mean);
+    }
+    count = slowestGroups(statistics->byDistortion, BarcodeTestStatisticsDistortionSlots, indices, 5);
+    for (i = 0; i < count; i++) {
+        const BarcodeOutcomeCounters *group = &statistics->byDistortion[indices[i]];
+        fprintf(stderr, "  %s: %.2f s (distort %.3f ms mean)\n",
+                [[ImageDistorter nameForDistortionType:(DistortionType)indices[i]] UTF8String], groupSeconds(group),
+                group->stageMilliseconds[BarcodeTestStageDistort].mean);
+    }
+}
+
+@implementation BarcodeBatchRunner
+
+@synthesize workerCount;
+@synthesize verbose;
+
+- (void)setDecodeStrategy:(BarcodeDecodeStrategy)strategy {
+    decoder.decodeStrategy = strategy;
+}
+
+- (BarcodeDecodeStrategy)decodeStrategy {
+    return decoder.decodeStrategy;
+}
+
+- (void)setDecodePolicy:(BarcodeDecodePolicy)policy {
+    decoder.decodePolicy = policy;
+}
+
+- (BarcodeDecodePolicy)decodePolicy {
+    return decoder.decodePolicy;
+}
+
+- (void)setExpectedSymbolCount:(NSInteger)count {
+    decoder.expectedSymbolCount = count;
+}
+
+- (NSInteger)expectedSymbolCount {
+    return decoder.expectedSymbolCount;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        encoder = [[BarcodeEncoder alloc] init];
+        decoder = [[BarcodeDecoder alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [encoder release];
+    [decoder release];
+    [super dealloc];
+}
+
+- (void)decodeWorkerMain:(NSValue *)contextPointer {
+    BatchDecodeContext *context = (BatchDecodeContext *)[contextPointer pointerValue];
+    batchDecodeWorker(context);
+    [context->finishedWorkers lock];
+    [context->finishedWorkers unlockWithCondition:[context->finishedWorkers condition] + 1];
+}
+
+- (NSUInteger)effectiveWorkerCount:(NSUInteger)count {
+    return count > 0 ? count : [BarcodeTestExecutor defaultWorkerCount];
+}
+
++ (NSDictionary *)specificationWithContentsOfFile:(NSString *)path error:(NSError **)error {
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (!data) {
+        failWithMessage(error, 1, [NSString stringWithFormat:@"Cannot read %@", path]);
+        return nil;
+    }
+    id specification = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+    if (![specification isKindOfClass:[NSDictionary class]]) {
+        failWithMessage(error, 2, [NSString stringWithFormat:@"%@ is not a JSON object", path]);
+        return nil;
+    }
+    return specification;
+}
+
+- (BOOL)runSweep:(NSDictionary *)specification outputPath:(NSString *)outputPath error:(NSError **)error {
+    if (![encoder hasBackend] || ![decoder hasBackend]) {
+        return failWithMessage(error, 3, @"No encoder or decoder backend available");
+    }
+
+    NSArray *payloads = [specification objectForKey:BarcodeBatchSpecPayloads];
+    NSArray *symbologies = gridValues([specification objectForKey:BarcodeBatchSpecSymbologies], nil);
+    NSArray *distortions = distortionTypeValues([specification objectForKey:BarcodeBatchSpecDistortions]);
+    NSArray *intensities = gridValues([specification objectForKey:BarcodeBatchSpecIntensities],
+                                      gridValues([NSDictionary dictionaryWithObjectsAndKeys:
+                                                  [NSNumber numberWithFloat:0.0f], @"from",
+                                                  [NSNumber numberWithFloat:1.0f], @"to",
+                                                  [NSNumber numberWithInt:11], @"steps", nil], nil));
+    NSArray *strengths = gridValues([specification objectForKey:BarcodeBatchSpecStrengths],
+                                    [NSArray arrayWithObject:[NSNumber numberWithFloat:0.5f]]);
+
+    if (![payloads isKindOfClass:[NSArray class]] || payloads.count == 0) {
+        return failWithMessage(error, 4, @"Spec needs a non-empty payloads array");
+    }
+    NSEnumerator *enumerator = [payloads objectEnumerator];
+    id payload;
+    while ((payload = [enumerator nextObject])) {
+        if (![payload isKindOfClass:[NSString class]]) {
+            return failWithMessage(error, 4, @"Payloads must be strings");
+        }
+    }
+    if (!symbologies) {
+        return failWithMessage(error, 4, @"Spec needs a non-empty symbologies array");
+    }
+    if (!distortions) {
+        return failWithMessage(error, 4, @"Unknown or empty distortions entry");
+    }
+    if (!intensities || !strengths) {
+        return failWithMessage(error, 4, @"Malformed intensities or strengths grid");
+    }
+
+    if (!outputPath) {
+        outputPath = [specification objectForKey:BarcodeBatchSpecOutput];
+    }
+    if (![outputPath isKindOfClass:[NSString class]] || outputPath.length == 0) {
+        return failWithMessage(error, 5, @"No output file given");
+    }
+    if ([[[outputPath pathExtension] lowercaseString] isEqualToString:@"json"]) {
+        // One object per line is not a JSON document; keep the name honest
+        return failWithMessage(error, 5, [NSString stringWithFormat:@"%@: results are JSON Lines, name the file .jsonl", outputPath]);
+    }
+    id<BarcodeResultSink> sink = sinkForPath(outputPath);
+    if (!sink) {
+        return failWithMessage(error, 5, [NSString stringWithFormat:@"Cannot create %@", outputPath]);
+    }
+
+    NSUInteger workers = workerCount;
+    if (workers == 0 && [specification objectForKey:BarcodeBatchSpecWorkers]) {
+        workers = (NSUInteger)MAX(0, [[specification objectForKey:BarcodeBatchSpecWorkers] integerValue]);
+    }
+    workers = [self effectiveWorkerCount:workers];
+
+    NSString *name = [specification objectForKey:BarcodeBatchSpecName];
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:
+                                   [name isKindOfClass:[NSString class]] ? name : [[outputPath lastPathComponent] stringByDeletingPathExtension]];
+    session.retainsResults = NO;
+    [session addSink:sink];
+
+    if (verbose) {
+        fprintf(stderr, "Sweeping %lu cells on %lu worker(s) into %s\n",
+                (unsigned long)(payloads.count * symbologies.count * distortions.count * intensities.count * strengths.count),
+                (unsigned long)workers, [outputPath fileSystemRepresentation]);
+    }
+
+    BarcodeTester *tester = [[BarcodeTester alloc] initWithEncoder:encoder decoder:decoder];
+    tester.workerCount = workers;
+    [tester runComprehensiveTestSuite:payloads
+                          symbologies:symbologies
+                       distortionTypes:distortions
+                        intensityLevels:intensities
+                          strengthLevels:strengths
+                                session:session];
+    [tester release];
+
+    BOOL success;
+    if ([(id)sink isKindOfClass:[BarcodeSessionFileWriter class]]) {
+        success = [(BarcodeSessionFileWriter *)sink close];
+    } else {
+        success = [sink flush];
+        [(BarcodeStreamResultSink *)sink close];
+        success = success && ![(BarcodeStreamResultSink *)sink hasFailed];
+    }
+
+    BarcodeTestStatistics *statistics = verbose ? (BarcodeTestStatistics *)malloc(sizeof(BarcodeTestStatistics)) : NULL;
+    if (statistics) {
+        [session copyStatistics:statistics];
+        fprintf(stderr, "%lu results, %lu decoded\n", statistics->overall.total, statistics->overall.successes);
+        printSlowestGroups(statistics);
+        free(statistics);
+    }
+    [session release];
+
+    if (!success) {
+        return failWithMessage(error, 6, [NSString stringWithFormat:@"Writing %@ failed", outputPath]);
+    }
+    return YES;
+}
+
+- (BOOL)decodeImagesInDirectory:(NSString *)directory outputPath:(NSString *)outputPath error:(NSError **)error {
+    if (![decoder hasBackend]) {
+        return failWithMessage(error, 3, @"No decoder backend available");
+    }
+
+    NSArray *names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directory error:NULL];
+    if (!names) {
+        return failWithMessage(error, 1, [NSString stringWithFormat:@"Cannot read directory %@", directory]);
+    }
+    NSArray *imageTypes = [NSArray arrayWithObjects:@"png", @"jpg", @"jpeg", @"tif", @"tiff", @"bmp", @"gif", nil];
+    NSMutableArray *paths = [NSMutableArray array];
+    NSEnumerator *enumerator = [[names sortedArrayUsingSelector:@selector(compare:)] objectEnumerator];
+    NSString *name;
+    while ((name = [enumerator nextObject])) {
+        if ([imageTypes containsObject:[[name pathExtension] lowercaseString]]) {
+            [paths addObject:[directory stringByAppendingPathComponent:name]];
+        }
+    }
+
+    FILE *output = outputPath ? fopen([outputPath fileSystemRepresentation], "w") : stdout;
+    if (!output) {
+        return failWithMessage(error, 5, [NSString stringWithFormat:@"Cannot create %@", outputPath]);
+    }
+
+    BatchDecodeContext context;
+    context.decoder = decoder;
+    context.paths = paths;
+    context.lines = [NSMutableArray arrayWithCapacity:paths.count];
+    context.nextPath = 0;
+    context.finishedWorkers = nil;
+    memset(&context.pyramid, 0, sizeof(context.pyramid));
+    memset(context.backends, 0, sizeof(context.backends));
+    pthread_mutex_init(&context.lock, NULL);
+    NSUInteger i;
+    for (i = 0; i < paths.count; i++) {
+        [context.lines addObject:@""];
+    }
+
+    NSUInteger workers = MIN([self effectiveWorkerCount:workerCount], MAX(paths.count, (NSUInteger)1));
+    if (verbose) {
+        fprintf(stderr, "Decoding %lu image(s) on %lu worker(s)\n", (unsigned long)paths.count, (unsigned long)workers);
+    }
+    if (workers <= 1) {
+        batchDecodeWorker(&context);
+    } else {
+        context.finishedWorkers = [[NSConditionLock alloc] initWithCondition:0];
+        for (i = 0; i < workers; i++) {
+            [NSThread detachNewThreadSelector:@selector(decodeWorkerMain:)
+                                     toTarget:self
+                                   withObject:[NSValue valueWithPointer:&context]];
+        }
+        [context.finishedWorkers lockWhenCondition:(NSInteger)workers];
+        [context.finishedWorkers unlock];
+        [context.finishedWorkers release];
+    }
+    pthread_mutex_destroy(&context.lock);
+    if (verbose) {
+        printBackendStatistics([decoder allBackends], context.backends);
+    }
+    if (verbose && context.pyramid.decodes > 0) {
+        printPyramidStatistics(&context.pyramid);
+    }
+
+    BOOL success = fputs("File,Barcode Type,Decoded Data,Conversion ms,Scan ms\n", output) >= 0;
+    for (i = 0; success && i < context.lines.count; i++) {
+        success = fputs([[context.lines objectAtIndex:i] UTF8String], output) >= 0;
+    }
+    if (output != stdout) {
+        success = (fclose(output) == 0) && success;
+    } else {
+        success = (fflush(output) == 0) && success;
+    }
+    if (!success) {
+        return failWithMessage(error, 6, [NSString stringWithFormat:@"Writing %@ failed", outputPath ? outputPath : @"output"]);
+    }
+    return YES;
+}
+
+@end
@@ -0,0 +1,130 @@
+//
+//  BatchMain.m
+//  SmallBarcodeReader
+//
+//  Entry point for the headless batch tool. Never starts an application or
+//  opens a window, so it runs on build servers without a display.
+//
+//  Usage: BarcodeBatch sweep [-j workers] [-o output] [-T] [-v] spec.json
+//         BarcodeBatch decode [-j workers] [-o output.csv] [-P] [-p policy] [-n symbols]
+//                             [-T] [-v] directory
+//
+
+#import <Foundation/Foundation.h>
+#import "BarcodeBatchRunner.h"
+#import "BarcodeTiming.h"
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "usage: %s sweep [-j workers] [-o output] [-T] [-v] spec.json\n", program);
+    fprintf(stderr, "       %s decode [-j workers] [-o output.csv] [-P] [-p policy] [-n symbols] [-T] [-v] directory\n", program);
+    fprintf(stderr, "  -j  worker threads (default: one per processor)\n");
+    fprintf(stderr, "  -o  result file; sweeps write .csv, .jsonl or a binary session file\n");
+    fprintf(stderr, "      by extension, decode writes CSV (default stdout)\n");
+    fprintf(stderr, "  -P  decode large images coarse-to-fine through a resolution pyramid\n");
+    fprintf(stderr, "  -p  how loaded backends share a scan: primary (default), cascade, race\n");
+    fprintf(stderr, "      or consensus\n");
+    fprintf(stderr, "  -n  symbols per image; -P and cascade stop looking once this many are found\n");
+    fprintf(stderr, "  -T  skip stage timing (timing columns are left empty)\n");
+    fprintf(stderr, "  -v  report progress on stderr\n");
+}
+
+static BOOL parsePolicy(const char *name, BarcodeDecodePolicy *policy) {
+    static const struct {
+        const char *name;
+        BarcodeDecodePolicy policy;
+    } policies[] = {
+        {"primary", BarcodeDecodePolicyPrimary},
+        {"cascade", BarcodeDecodePolicyCascade},
+        {"race", BarcodeDecodePolicyRace},
+        {"consensus", BarcodeDecodePolicyConsensus}
+    };
+    size_t i;
+    for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        if (strcmp(name, policies[i].name) == 0) {
+            *policy = policies[i].policy;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || (strcmp(argv[1], "sweep") != 0 && strcmp(argv[1], "decode") != 0)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    BOOL sweep = strcmp(argv[1], "sweep") == 0;
+
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [BarcodeDecoder setDynamicFallbackEnabled:YES];
+    BarcodeBatchRunner *runner = [[BarcodeBatchRunner alloc] init];
+    NSString *outputPath = nil;
+
+    // Options follow the mode
+    optind = 2;
+    int option;
+    BarcodeDecodePolicy policy;
+    while ((option = getopt(argc, argv, "j:o:Pp:n:Tv")) != -1) {
+        switch (option) {
+            case 'j':
+                runner.workerCount = (NSUInteger)MAX(0, atoi(optarg));
+                break;
+            case 'o':
+                outputPath = [NSString stringWithUTF8String:optarg];
+                break;
+            case 'P':
+                runner.decodeStrategy = BarcodeDecodeStrategyPyramid;
+                break;
+            case 'p':
+                if (!parsePolicy(optarg, &policy)) {
+                    printUsage(argv[0]);
+                    [runner release];
+                    [pool release];
+                    return 2;
+                }
+                runner.decodePolicy = policy;
+                break;
+            case 'n':
+                runner.expectedSymbolCount = MAX(0, atoi(optarg));
+                break;
+            case 'T':
+                BarcodeTimingSetEnabled(NO);
+                break;
+            case 'v':
+                runner.verbose = YES;
+                break;
+            default:
+                printUsage(argv[0]);
+                [runner release];
+                [pool release];
+                return 2;
+        }
+    }
+    if (argc - optind != 1) {
+        printUsage(argv[0]);
+        [runner release];
+        [pool release];
+        return 2;
+    }
+    NSString *input = [NSString stringWithUTF8String:argv[optind]];
+
+    NSError *error = nil;
+    BOOL success;
+    if (sweep) {
+        NSDictionary *specification = [BarcodeBatchRunner specificationWithContentsOfFile:input error:&error];
+        success = specification && [runner runSweep:specification outputPath:outputPath error:&error];
+    } else {
+        success = [runner decodeImagesInDirectory:input outputPath:outputPath error:&error];
+    }
+    if (!success) {
+        fprintf(stderr, "%s: %s\n", argv[0], error ? [[error localizedDescription] UTF8String] : "failed");
+    }
+
+    [runner release];
+    [pool release];
+    return success ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+//
+//  BarcodeBenchmark.h
+//  SmallBarcodeReader
+//
+//  Microbenchmarks of the image, encode and decode hot paths, with JSON
+//  results and a baseline comparison for regression checks
+//
+
+#import <Foundation/Foundation.h>
+
+@class BarcodeEncoder;
+@class BarcodeDecoder;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// One call of the code under test
+typedef void (*BarcodeBenchmarkBody)(void *context);
+
+/// How a benchmark is sampled
+typedef struct {
+    int repetitions;            // Timed samples (at least 2 for an interval)
+    double warmUpMilliseconds;  // Untimed calls first; also sizes the samples
+    double sampleMilliseconds;  // Target length of one sample
+} BarcodeBenchmarkOptions;
+
+/// Timing of one benchmark, in nanoseconds per unit (pixel or operation)
+typedef struct {
+    double mean;
+    double deviation;   // Sample standard deviation of the per-sample means
+    double confidence;  // Half-width of the 95% confidence interval of the mean
+    double minimum;
+    int repetitions;
+    long iterations;    // Calls per sample
+} BarcodeBenchmarkMeasurement;
+
+/// Result dictionary keys (also the JSON field names)
+extern NSString * const BarcodeBenchmarkKeyName;        // String, e.g. "convolve/gaussian/9"
+extern NSString * const BarcodeBenchmarkKeyUnit;        // "ns/pixel" or "ns/op"
+extern NSString * const BarcodeBenchmarkKeyMean;        // Number
+extern NSString * const BarcodeBenchmarkKeyConfidence;  // Number, 95% half-width
+extern NSString * const BarcodeBenchmarkKeyDeviation;   // Number
+extern NSString * const BarcodeBenchmarkKeyMinimum;     // Number
+extern NSString * const BarcodeBenchmarkKeyThroughput;  // Number, pixels or operations per second
+extern NSString * const BarcodeBenchmarkKeyRepetitions; // Number
+extern NSString * const BarcodeBenchmarkKeyIterations;  // Number
+
+/// Defaults: 10 samples of about 50 ms after 200 ms of warm-up
+/// @return Options
+BarcodeBenchmarkOptions BarcodeBenchmarkDefaultOptions(void);
+
+/// Two-sided 95% Student t quantile
+/// @param degreesOfFreedom Samples minus one
+/// @return Quantile (1.96 in the limit)
+double BarcodeBenchmarkStudentT95(int degreesOfFreedom);
+
+/// Time a body: warm up, then take repeated samples of enough calls to last
+/// sampleMilliseconds each
+/// @param body Code under test
+/// @param context Passed to body
+/// @param unitsPerCall Pixels (or operations) one call processes
+/// @param options Sampling options
+/// @return Per-unit timing
+BarcodeBenchmarkMeasurement BarcodeBenchmarkMeasure(BarcodeBenchmarkBody body, void *context,
+                                                    double unitsPerCall, BarcodeBenchmarkOptions options);
+
+/// The benchmark suite. Fixtures are generated from fixed seeds and payloads,
+/// so two runs on one machine time the same work. Image kernels run on one
+/// thread unless the caller raises ImageParallelSetMaximumThreads.
+/// Encode, decode and cell benchmarks are skipped when no backend is present.
+@interface BarcodeBenchmarkSuite : NSObject {
+    BarcodeEncoder *encoder;
+    BarcodeDecoder *decoder;
+    BarcodeBenchmarkOptions options;
+    NSString *filter;
+    BOOL verbose;
+}
+
+/// Sampling options (BarcodeBenchmarkDefaultOptions by default)
+@property (assign, nonatomic) BarcodeBenchmarkOptions options;
+
+/// Only run benchmarks whose name contains this string (nil runs all)
+@property (copy, nonatomic) NSString *filter;
+
+/// Log each benchmark to stderr as it finishes
+@property (assign, nonatomic) BOOL verbose;
+
+/// Initialize with auto-detected encoder and decoder backends
+- (instancetype)init;
+
+/// Names of the encoder and decoder backends, or "none"
+- (NSString *)encoderName;
+- (NSString *)decoderName;
+
+/// Run every selected benchmark
+/// @return Result dictionaries in run order
+- (NSArray *)run;
+
+/// Write results as a JSON document {"benchmarks": [...], ...}
+/// @param results Result dictionaries from run
+/// @param path File to write
+/// @param error Receives the reason on failure (may be NULL)
+/// @return NO if the file could not be written
+- (BOOL)writeResults:(NSArray *)results toFile:(NSString *)path error:(NSError **)error;
+
+/// Read the results of a JSON document written by writeResults:
+/// @param path File to read
+/// @param error Receives the reason on failure (may be NULL)
+/// @return Result dictionaries, or nil if the file is missing or malformed
++ (NSArray *)resultsWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+/// Benchmarks that got slower than a baseline. A benchmark regressed when
+/// even the fast end of its confidence interval is more than threshold
+/// slower than the baseline mean, so noise alone does not fail a run.
+/// Benchmarks missing from either side are ignored.
+/// @param results Candidate results
+/// @param baseline Baseline results
+/// @param threshold Allowed slowdown, e.g. 0.1 for 10%
+/// @return Dictionaries with the name, "baseline" and "candidate" means and
+///         their "ratio", in candidate order
++ (NSArray *)regressionsInResults:(NSArray *)results baseline:(NSArray *)baseline threshold:(double)threshold;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,620 @@
+//
+//  BarcodeBenchmark.m
+//  SmallBarcodeReader
+//
+//  Microbenchmarks of the image, encode and decode hot paths implementation
+//
+
+#import "BarcodeBenchmark.h"
+#import "BarcodeEncoder.h"
+#import "BarcodeDecoder.h"
+#import "BarcodeTester.h"
+#import "ImageDistorter.h"
+#import "ImageBuffer.h"
+#import "ImageMatrix.h"
+#import "ImageConvolution.h"
+#import "ImagePixelFormat.h"
+#import "ImagePyramid.h"
+#import "ImageParallel.h"
+#import <AppKit/AppKit.h>
+#import <math.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <time.h>
+
+NSString * const BarcodeBenchmarkKeyName = @"name";
+NSString * const BarcodeBenchmarkKeyUnit = @"unit";
+NSString * const BarcodeBenchmarkKeyMean = @"mean";
+NSString * const BarcodeBenchmarkKeyConfidence = @"ci95";
+NSString * const BarcodeBenchmarkKeyDeviation = @"deviation";
+NSString * const BarcodeBenchmarkKeyMinimum = @"minimum";
+NSString * const BarcodeBenchmarkKeyThroughput = @"throughput";
+NSString * const BarcodeBenchmarkKeyRepetitions = @"repetitions";
+NSString * const BarcodeBenchmarkKeyIterations = @"iterations";
+
+static NSString * const BarcodeBenchmarkErrorDomain = @"BarcodeBenchmark";
+
+// Fixtures: a camera-sized frame and fixed payloads, so every run times the
+// same work
+#define BenchmarkImageWidth 640
+#define BenchmarkImageHeight 480
+#define BenchmarkSeed 20240601u
+
+static NSString * const BenchmarkPayload = @"SBR-BENCH-0042";
+static NSString * const BenchmarkNumericPayload = @"12345678901"; // EAN/UPC take digits only
+
+static BOOL failWithMessage(NSError **error, NSInteger code, NSString *message) {
+    if (error) {
+        *error = [NSError errorWithDomain:BarcodeBenchmarkErrorDomain code:code userInfo:
+            [NSDictionary dictionaryWithObject:message forKey:NSLocalizedDescriptionKey]];
+    }
+    return NO;
+}
+
+static double monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1.0e9 + (double)now.tv_nsec;
+}
+
+BarcodeBenchmarkOptions BarcodeBenchmarkDefaultOptions(void) {
+    BarcodeBenchmarkOptions defaults;
+    defaults.repetitions = 10;
+    defaults.warmUpMilliseconds = 200.0;
+    defaults.sampleMilliseconds = 50.0;
+    return defaults;
+}
+
+double BarcodeBenchmarkStudentT95(int degreesOfFreedom) {
+    static const double quantiles[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (degreesOfFreedom < 1) {
+        return INFINITY;
+    }
+    if (degreesOfFreedom <= 30) {
+        return quantiles[degreesOfFreedom - 1];
+    }
+    return 1.96 + 2.5 / degreesOfFreedom; // Within 0.002 of the exact value past 30
+}
+
+BarcodeBenchmarkMeasurement BarcodeBenchmarkMeasure(BarcodeBenchmarkBody body, void *context,
+                                                    double unitsPerCall, BarcodeBenchmarkOptions options) {
+    BarcodeBenchmarkMeasurement measurement;
+    memset(&measurement, 0, sizeof(measurement));
+    int repetitions = options.repetitions > 0 ? options.repetitions : 1;
+    if (unitsPerCall <= 0.0) {
+        unitsPerCall = 1.0;
+    }
+
+    // Warm caches, the scratch pool and lazy backend setup; the calls it
+    // takes give the cost of one call
+    long warmUpCalls = 0;
+    double started = monotonicNanoseconds(), elapsed;
+    do {
+        body(context);
+        warmUpCalls++;
+        elapsed = monotonicNanoseconds() - started;
+    } while (elapsed < options.warmUpMilliseconds * 1.0e6);
+    double perCall = elapsed / (double)warmUpCalls;
+    long iterations = (long)ceil(options.sampleMilliseconds * 1.0e6 / (perCall > 1.0 ? perCall : 1.0));
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    double *samples = (double *)malloc((size_t)repetitions * sizeof(double));
+    if (!samples) {
+        return measurement;
+    }
+    double sum = 0.0;
+    int r;
+    long i;
+    for (r = 0; r < repetitions; r++) {
+        started = monotonicNanoseconds();
+        for (i = 0; i < iterations; i++) {
+            body(context);
+        }
+        samples[r] = (monotonicNanoseconds() - started) / ((double)iterations * unitsPerCall);
+        sum += samples[r];
+    }
+
+    measurement.mean = sum / repetitions;
+    measurement.minimum = samples[0];
+    double squares = 0.0;
+    for (r = 0; r < repetitions; r++) {
+        double difference = samples[r] - measurement.mean;
+        squares += difference * difference;
+        if (samples[r] < measurement.minimum) {
+            measurement.minimum = samples[r];
+        }
+    }
+    if (repetitions > 1) {
+        measurement.deviation = sqrt(squares / (repetitions - 1));
+        measurement.confidence = BarcodeBenchmarkStudentT95(repetitions - 1) * measurement.deviation / sqrt((double)repetitions);
+    }
+    measurement.repetitions = repetitions;
+    measurement.iterations = iterations;
+    free(samples);
+    return measurement;
+}
+
+#pragma mark - Benchmark bodies
+
+typedef struct {
+    const unsigned char *source;
+    unsigned char *dest;
+    int width;
+    int height;
+    ImageMatrix kernel;
+} ConvolveCase;
+
+static void runConvolve(void *context) {
+    ConvolveCase *c = (ConvolveCase *)context;
+    ImageConvolveInto(c->source, c->dest, c->width, c->height, c->kernel);
+}
+
+typedef struct {
+    const unsigned char *pixels;
+    int width;
+    int height;
+    int stride;
+    ImagePixelFormat format;
+} GrayPixelsCase;
+
+// What the decoder does with caller pixels
+static void runGrayPixels(void *context) {
+    GrayPixelsCase *c = (GrayPixelsCase *)context;
+    ImageBuffer gray = ImageBufferFromPixels(c->pixels, c->width, c->height, c->stride, c->format);
+    ImageBufferFree(&gray);
+}
+
+static void runGrayImage(void *context) {
+    ImageBuffer gray = ImageBufferFromImage((NSImage *)context);
+    ImageBufferFree(&gray);
+}
+
+typedef struct {
+    ImageBuffer source;
+    ImageBuffer half;
+} PyramidCase;
+
+static void runDownsample(void *context) {
+    PyramidCase *c = (PyramidCase *)context;
+    ImageDownsampleInto(c->source, c->half);
+}
+
+// Candidate search as the pyramid decode runs it, on the half-size level
+static void runRegions(void *context) {
+    PyramidCase *c = (PyramidCase *)context;
+    ImageRegion regions[64];
+    ImageFindTexturedRegions(c->half, 8.0f, 2, regions, 64);
+}
+
+typedef struct {
+    BarcodeEncoder *encoder;
+    NSString *payload;
+    int symbology;
+} EncodeCase;
+
+static void runEncode(void *context) {
+    EncodeCase *c = (EncodeCase *)context;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    ImageBuffer raster = [c->encoder encodeBufferFromData:c->payload symbology:c->symbology options:nil];
+    ImageBufferFree(&raster);
+    [pool release];
+}
+
+typedef struct {
+    BarcodeDecoder *decoder;
+    ImageBuffer raster;
+    NSString *payload;
+} DecodeCase;
+
+static void runDecode(void *context) {
+    DecodeCase *c = (DecodeCase *)context;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [c->decoder decodeBarcodesFromBuffer:c->raster originalInput:c->payload];
+    [pool release];
+}
+
+typedef struct {
+    BarcodeTester *tester;
+    NSString *payload;
+    int symbology;
+} CellCase;
+
+// One sweep cell as the executor runs it
+static void runCell(void *context) {
+    CellCase *c = (CellCase *)context;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [c->tester runTestWithData:c->payload symbology:c->symbology distortionType:DistortionTypeGaussianBlur
+                     intensity:0.4f strength:0.5f seed:BenchmarkSeed];
+    [pool release];
+}
+
+// Lower-case name with spaces as dashes, for benchmark names
+static NSString *slug(NSString *name) {
+    return [[[name lowercaseString] componentsSeparatedByString:@" "] componentsJoinedByString:@"-"];
+}
+
+@implementation BarcodeBenchmarkSuite
+
+@synthesize options;
+@synthesize filter;
+@synthesize verbose;
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        encoder = [[BarcodeEncoder alloc] init];
+        decoder = [[BarcodeDecoder alloc] init];
+        options = BarcodeBenchmarkDefaultOptions();
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [encoder release];
+    [decoder release];
+    [filter release];
+    [super dealloc];
+}
+
+- (NSString *)encoderName {
+    return [encoder hasBackend] ? [encoder backendName] : @"none";
+}
+
+- (NSString *)decoderName {
+    return [decoder hasBackend] ? [decoder backendName] : @"none";
+}
+
+- (BOOL)wantsBenchmark:(NSString *)name {
+    return !filter || [filter length] == 0 || [name rangeOfString:filter].location != NSNotFound;
+}
+
+- (void)measure:(NSString *)name unit:(NSString *)unit body:(BarcodeBenchmarkBody)body
+        context:(void *)context units:(double)units into:(NSMutableArray *)results {
+    BarcodeBenchmarkMeasurement measurement = BarcodeBenchmarkMeasure(body, context, units, options);
+    NSDictionary *result = [NSDictionary dictionaryWithObjectsAndKeys:
+        name, BarcodeBenchmarkKeyName,
+        unit, BarcodeBenchmarkKeyUnit,
+        [NSNumber numberWithDouble:measurement.mean], BarcodeBenchmarkKeyMean,
+        [NSNumber numberWithDouble:measurement.confidence], BarcodeBenchmarkKeyConfidence,
+        [NSNumber numberWithDouble:measurement.deviation], BarcodeBenchmarkKeyDeviation,
+        [NSNumber numberWithDouble:measurement.minimum], BarcodeBenchmarkKeyMinimum,
+        [NSNumber numberWithDouble:measurement.mean > 0.0 ? 1.0e9 / measurement.mean : 0.0], BarcodeBenchmarkKeyThroughput,
+        [NSNumber numberWithInt:measurement.repetitions], BarcodeBenchmarkKeyRepetitions,
+        [NSNumber numberWithLong:measurement.iterations], BarcodeBenchmarkKeyIterations,
+        nil];
+    [results addObject:result];
+    if (verbose) {
+        fprintf(stderr, "%s: %.3f +- %.3f %s\n", [name UTF8String], measurement.mean, measurement.confidence, [unit UTF8String]);
+    }
+}
+
+- (void)runConvolutionBenchmarks:(const unsigned char *)frame into:(NSMutableArray *)results {
+    static const struct {
+        const char *family;
+        int size;
+    } kernels[] = {
+        {"gaussian", 3}, {"gaussian", 5}, {"gaussian", 9}, {"gaussian", 15}, {"gaussian", 31},
+        {"box", 3}, {"box", 9}, {"box", 15},
+        {"motion", 9}, {"motion", 21}, {"motion", 41},
+        {"sharpen", 3}, {"edge", 3}, {"laplacian", 3}
+    };
+    int pixels = BenchmarkImageWidth * BenchmarkImageHeight;
+    unsigned char *dest = (unsigned char *)malloc(pixels);
+    if (!dest) {
+        return;
+    }
+
+    size_t k;
+    for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        NSString *name = [NSString stringWithFormat:@"convolve/%s/%d", kernels[k].family, kernels[k].size];
+        if (![self wantsBenchmark:name]) {
+            continue;
+        }
+        int size = kernels[k].size;
+        ImageMatrix kernel;
+        if (strcmp(kernels[k].family, "gaussian") == 0) {
+            kernel = ImageMatrixGaussianBlur(size, size / 6.0f);
+        } else if (strcmp(kernels[k].family, "box") == 0) {
+            kernel = ImageMatrixBoxBlur(size);
+        } else if (strcmp(kernels[k].family, "motion") == 0) {
+            kernel = ImageMatrixMotionBlur(size, 30.0f);
+        } else if (strcmp(kernels[k].family, "sharpen") == 0) {
+            kernel = ImageMatrixSharpen();
+        } else if (strcmp(kernels[k].family, "edge") == 0) {
+            kernel = ImageMatrixEdgeDetection(0);
+        } else {
+            kernel = ImageMatrixLaplacian();
+        }
+        ConvolveCase c = {frame, dest, BenchmarkImageWidth, BenchmarkImageHeight, kernel};
+        [self measure:name unit:@"ns/pixel" body:runConvolve context:&c units:pixels into:results];
+        ImageMatrixFree(&kernel);
+    }
+    free(dest);
+}
+
+- (void)runPyramidBenchmarks:(const unsigned char *)frame into:(NSMutableArray *)results {
+    int width = BenchmarkImageWidth, height = BenchmarkImageHeight;
+    PyramidCase c;
+    c.source = ImageBufferWrap((unsigned char *)frame, width, height, width);
+    c.half = ImageBufferCreate(width / 2, height / 2);
+    if (!ImageBufferIsValid(c.half)) {
+        return;
+    }
+    ImageDownsampleInto(c.source, c.half);
+    if ([self wantsBenchmark:@"pyramid/downsample"]) {
+        [self measure:@"pyramid/downsample" unit:@"ns/pixel" body:runDownsample context:&c units:width * height into:results];
+    }
+    if ([self wantsBenchmark:@"pyramid/regions"]) {
+        [self measure:@"pyramid/regions" unit:@"ns/pixel" body:runRegions context:&c
+                units:c.half.width * c.half.height into:results];
+    }
+    ImageBufferFree(&c.half);
+}
+
+- (void)runGrayscaleBenchmarks:(const unsigned char *)frame into:(NSMutableArray *)results {
+    int width = BenchmarkImageWidth, height = BenchmarkImageHeight;
+    int pixels = width * height;
+
+    // Colour frames derived from the gray fixture, one per layout the
+    // decoder accepts from callers
+    static const struct {
+        const char *name;
+        ImagePixelFormat format;
+    } formats[] = {
+        {"rgb24", ImagePixelFormatRGB24},
+        {"rgba32", ImagePixelFormatRGBA32},
+        {"bgra32", ImagePixelFormatBGRA32},
+        {"argb32", ImagePixelFormatARGB32}
+    };
+    unsigned char *colour = (unsigned char *)malloc((size_t)pixels * 4);
+    if (!colour) {
+        return;
+    }
+    int i;
+    for (i = 0; i < pixels; i++) {
+        colour[4 * i] = frame[i];
+        colour[4 * i + 1] = (unsigned char)(frame[i] ^ 0x5a);
+        colour[4 * i + 2] = (unsigned char)(255 - frame[i]);
+        colour[4 * i + 3] = 255;
+    }
+    size_t f;
+    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        NSString *name = [NSString stringWithFormat:@"gray/pixels/%s", formats[f].name];
+        if ([self wantsBenchmark:name]) {
+            int stride = width * ImagePixelFormatBytesPerPixel(formats[f].format);
+            GrayPixelsCase c = {colour, width, height, stride, formats[f].format};
+            [self measure:name unit:@"ns/pixel" body:runGrayPixels context:&c units:pixels into:results];
+        }
+    }
+
+    // The NSImage boundary: TIFF round trip plus conversion
+    NSString *name = @"gray/image/rgb24";
+    if ([self wantsBenchmark:name]) {
+        NSBitmapImageRep *bitmapRep = [[NSBitmapImageRep alloc]
+            initWithBitmapDataPlanes:NULL
+            pixelsWide:width
+            pixelsHigh:height
+            bitsPerSample:8
+            samplesPerPixel:3
+            hasAlpha:NO
+            isPlanar:NO
+            colorSpaceName:NSCalibratedRGBColorSpace
+            bytesPerRow:width * 3
+            bitsPerPixel:24];
+        if (bitmapRep) {
+            unsigned char *bitmapData = [bitmapRep bitmapData];
+            NSInteger bytesPerRow = [bitmapRep bytesPerRow];
+            int y, x;
+            for (y = 0; y < height; y++) {
+                for (x = 0; x < width; x++) {
+                    memcpy(bitmapData + y * bytesPerRow + x * 3, colour + 4 * ((size_t)y * width + x), 3);
+                }
+            }
+            NSImage *image = [[NSImage alloc] initWithSize:NSMakeSize(width, height)];
+            [image addRepresentation:bitmapRep];
+            [bitmapRep release];
+            [self measure:name unit:@"ns/pixel" body:runGrayImage context:image units:pixels into:results];
+            [image release];
+        }
+    }
+    free(colour);
+}
+
+// Payload the symbology accepts, or nil if it encodes neither fixture
+- (NSString *)payloadForSymbology:(int)symbology {
+    NSString *payloads[] = {BenchmarkPayload, BenchmarkNumericPayload};
+    int p;
+    for (p = 0; p < 2; p++) {
+        ImageBuffer raster = [encoder encodeBufferFromData:payloads[p] symbology:symbology options:nil];
+        BOOL encoded = ImageBufferIsValid(raster);
+        ImageBufferFree(&raster);
+        if (encoded) {
+            return payloads[p];
+        }
+    }
+    return nil;
+}
+
+- (void)runBackendBenchmarksInto:(NSMutableArray *)results {
+    if (![encoder hasBackend]) {
+        fprintf(stderr, "no encoder backend: skipping encode, decode and cell benchmarks\n");
+        return;
+    }
+    NSString *encoderSlug = slug([encoder backendName]);
+    NSString *decoderSlug = [decoder hasBackend] ? slug([decoder backendName]) : nil;
+    if (!decoderSlug) {
+        fprintf(stderr, "no decoder backend: skipping decode and cell benchmarks\n");
+    }
+
+    // Blur plus noise: the symbol still decodes, but the scanner works for it
+    ImageDistorter *distorter = [[ImageDistorter alloc] init];
+    [distorter addDistortion:[DistortionParameters parametersWithType:DistortionTypeGaussianBlur intensity:0.4f strength:0.5f]];
+    DistortionParameters *noise = [DistortionParameters parametersWithType:DistortionTypeGaussianNoise intensity:0.2f strength:0.5f];
+    noise.seed = BenchmarkSeed;
+    [distorter addDistortion:noise];
+
+    BOOL cellDone = NO;
+    NSEnumerator *symbologies = [[encoder supportedSymbologies] objectEnumerator];
+    NSDictionary *symbology;
+    while ((symbology = [symbologies nextObject])) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        int symbologyID = [[symbology objectForKey:@"id"] intValue];
+        NSString *symbologySlug = slug([symbology objectForKey:@"name"]);
+        NSString *payload = [self payloadForSymbology:symbologyID];
+        if (!payload) {
+            fprintf(stderr, "%s encodes neither fixture payload: skipped\n", [symbologySlug UTF8String]);
+            [pool release];
+            continue;
+        }
+
+        NSString *name = [NSString stringWithFormat:@"encode/%@/%@", encoderSlug, symbologySlug];
+        if ([self wantsBenchmark:name]) {
+            EncodeCase c = {encoder, payload, symbologyID};
+            [self measure:name unit:@"ns/op" body:runEncode context:&c units:1.0 into:results];
+        }
+
+        if (decoderSlug) {
+            ImageBuffer clean = [encoder encodeBufferFromData:payload symbology:symbologyID options:nil];
+            ImageBuffer distorted = [distorter applyDistortionsToBuffer:clean];
+            ImageBuffer rasters[] = {clean, distorted};
+            NSString *kinds[] = {@"clean", @"distorted"};
+            int r;
+            for (r = 0; r < 2; r++) {
+                name = [NSString stringWithFormat:@"decode/%@/%@/%@", decoderSlug, symbologySlug, kinds[r]];
+                if (ImageBufferIsValid(rasters[r]) && [self wantsBenchmark:name]) {
+                    DecodeCase c = {decoder, rasters[r], payload};
+                    [self measure:name unit:@"ns/op" body:runDecode context:&c units:1.0 into:results];
+                }
+            }
+            ImageBufferFree(&distorted);
+            ImageBufferFree(&clean);
+
+            // Full cells for the first symbology only: the encode and decode
+            // benchmarks above already cover the others
+            if (!cellDone) {
+                cellDone = YES;
+                BarcodeTester *tester = [[BarcodeTester alloc] initWithEncoder:encoder decoder:decoder];
+                CellCase c = {tester, payload, symbologyID};
+                name = [NSString stringWithFormat:@"cell/%@/cached", symbologySlug];
+                if ([self wantsBenchmark:name]) {
+                    [self measure:name unit:@"ns/op" body:runCell context:&c units:1.0 into:results];
+                }
+                name = [NSString stringWithFormat:@"cell/%@/uncached", symbologySlug];
+                if ([self wantsBenchmark:name]) {
+                    tester.rasterCache = nil;
+                    [self measure:name unit:@"ns/op" body:runCell context:&c units:1.0 into:results];
+                }
+                [tester release];
+            }
+        }
+        [pool release];
+    }
+    [distorter release];
+}
+
+- (NSArray *)run {
+    NSMutableArray *results = [NSMutableArray array];
+
+    // Fixed-seed frame (xorshift32) with bar-like runs, so box and motion
+    // kernels see edges rather than pure noise
+    int pixels = BenchmarkImageWidth * BenchmarkImageHeight;
+    unsigned char *frame = (unsigned char *)malloc(pixels);
+    if (!frame) {
+        return results;
+    }
+    uint32_t state = BenchmarkSeed;
+    int i;
+    for (i = 0; i < pixels; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        int bar = ((i % BenchmarkImageWidth) / 7) & 1;
+        frame[i] = (unsigned char)((bar ? 200 : 40) + (int)(state & 31) - 16);
+    }
+
+    [self runConvolutionBenchmarks:frame into:results];
+    [self runGrayscaleBenchmarks:frame into:results];
+    [self runPyramidBenchmarks:frame into:results];
+    free(frame);
+    [self runBackendBenchmarksInto:results];
+    return results;
+}
+
+- (BOOL)writeResults:(NSArray *)results toFile:(NSString *)path error:(NSError **)error {
+    NSDictionary *document = [NSDictionary dictionaryWithObjectsAndKeys:
+        @"SmallBarcodeReader benchmark", @"format",
+        [NSNumber numberWithInt:1], @"version",
+        [self encoderName], @"encoder",
+        [self decoderName], @"decoder",
+        [NSNumber numberWithInt:ImageParallelMaximumThreads()], @"threads",
+        [NSNumber numberWithInteger:(NSInteger)ImageConvolutionSIMDSupported()], @"simd",
+        [NSNumber numberWithInt:options.repetitions], @"repetitions",
+        results, @"benchmarks",
+        nil];
+    NSData *data = [NSJSONSerialization dataWithJSONObject:document options:NSJSONWritingPrettyPrinted error:NULL];
+    if (!data) {
+        return failWithMessage(error, 1, @"Results cannot be written as JSON");
+    }
+    if (![data writeToFile:path atomically:YES]) {
+        return failWithMessage(error, 2, [NSString stringWithFormat:@"Cannot write %@", path]);
+    }
+    return YES;
+}
+
++ (NSArray *)resultsWithContentsOfFile:(NSString *)path error:(NSError **)error {
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (!data) {
+        failWithMessage(error, 3, [NSString stringWithFormat:@"Cannot read %@", path]);
+        return nil;
+    }
+    id document = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+    id results = [document isKindOfClass:[NSDictionary class]] ? [document objectForKey:@"benchmarks"] : nil;
+    if (![results isKindOfClass:[NSArray class]]) {
+        failWithMessage(error, 4, [NSString stringWithFormat:@"%@ is not a benchmark result file", path]);
+        return nil;
+    }
+    return results;
+}
+
++ (NSArray *)regressionsInResults:(NSArray *)results baseline:(NSArray *)baseline threshold:(double)threshold {
+    NSMutableDictionary *baselineMeans = [NSMutableDictionary dictionary];
+    NSEnumerator *entries = [baseline objectEnumerator];
+    NSDictionary *result;
+    while ((result = [entries nextObject])) {
+        NSString *name = [result objectForKey:BarcodeBenchmarkKeyName];
+        NSNumber *mean = [result objectForKey:BarcodeBenchmarkKeyMean];
+        if (name && mean) {
+            [baselineMeans setObject:mean forKey:name];
+        }
+    }
+
+    NSMutableArray *regressions = [NSMutableArray array];
+    entries = [results objectEnumerator];
+    while ((result = [entries nextObject])) {
+        NSString *name = [result objectForKey:BarcodeBenchmarkKeyName];
+        double reference = [[baselineMeans objectForKey:name] doubleValue];
+        if (!name || reference <= 0.0) {
+            continue;
+        }
+        double mean = [[result objectForKey:BarcodeBenchmarkKeyMean] doubleValue];
+        double fastEnd = mean - [[result objectForKey:BarcodeBenchmarkKeyConfidence] doubleValue];
+        if (fastEnd > reference * (1.0 + threshold)) {
+            [regressions addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                name, BarcodeBenchmarkKeyName,
+                [NSNumber numberWithDouble:reference], @"baseline",
+                [NSNumber numberWithDouble:mean], @"candidate",
+                [NSNumber numberWithDouble:mean / reference], @"ratio",
+                nil]];
+        }
+    }
+    return regressions;
+}
+
+@end
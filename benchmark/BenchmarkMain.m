@@ -0,0 +1,147 @@
+//
+//  BenchmarkMain.m
+//  SmallBarcodeReader
+//
+//  Entry point for the benchmark tool. Runs headless like BarcodeBatch.
+//
+//  Usage: BarcodeBenchmark [-r repetitions] [-w warm-up ms] [-s sample ms]
+//                          [-j threads] [-f filter] [-o results.json]
+//                          [-b baseline.json] [-t threshold] [-v]
+//  Exits 1 if a benchmark regressed against the baseline, 2 on a usage or
+//  file error.
+//
+
+#import <Foundation/Foundation.h>
+#import "BarcodeBenchmark.h"
+#import "BarcodeDecoder.h"
+#import "ImageParallel.h"
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "usage: %s [-r repetitions] [-w ms] [-s ms] [-j threads] [-f filter]\n", program);
+    fprintf(stderr, "       %*s [-o results.json] [-b baseline.json] [-t threshold] [-v]\n", (int)strlen(program), "");
+    fprintf(stderr, "  -r  timed samples per benchmark (default 10)\n");
+    fprintf(stderr, "  -w  warm-up before sampling, milliseconds (default 200)\n");
+    fprintf(stderr, "  -s  length of one sample, milliseconds (default 50)\n");
+    fprintf(stderr, "  -j  image threads (default 1, for repeatable figures; 0 for all)\n");
+    fprintf(stderr, "  -f  only run benchmarks whose name contains this, e.g. convolve/\n");
+    fprintf(stderr, "  -o  write results as JSON\n");
+    fprintf(stderr, "  -b  compare against results written earlier with -o\n");
+    fprintf(stderr, "  -t  slowdown that counts as a regression (default 0.10)\n");
+    fprintf(stderr, "  -v  report each benchmark on stderr as it finishes\n");
+}
+
+int main(int argc, char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BarcodeBenchmarkOptions options = BarcodeBenchmarkDefaultOptions();
+    NSString *filter = nil, *outputPath = nil, *baselinePath = nil;
+    double threshold = 0.10;
+    int threads = 1;
+    BOOL verbose = NO, usable = YES;
+
+    int option;
+    while (usable && (option = getopt(argc, argv, "r:w:s:j:f:o:b:t:v")) != -1) {
+        switch (option) {
+            case 'r':
+                usable = (options.repetitions = atoi(optarg)) >= 2;
+                break;
+            case 'w':
+                usable = (options.warmUpMilliseconds = atof(optarg)) >= 0.0;
+                break;
+            case 's':
+                usable = (options.sampleMilliseconds = atof(optarg)) > 0.0;
+                break;
+            case 'j':
+                usable = (threads = atoi(optarg)) >= 0;
+                break;
+            case 'f':
+                filter = [NSString stringWithUTF8String:optarg];
+                break;
+            case 'o':
+                outputPath = [NSString stringWithUTF8String:optarg];
+                break;
+            case 'b':
+                baselinePath = [NSString stringWithUTF8String:optarg];
+                break;
+            case 't':
+                usable = (threshold = atof(optarg)) >= 0.0;
+                break;
+            case 'v':
+                verbose = YES;
+                break;
+            default:
+                usable = NO;
+                break;
+        }
+    }
+    if (!usable || optind != argc) {
+        printUsage(argv[0]);
+        [pool release];
+        return 2;
+    }
+
+    // Read the baseline first so a bad path fails before a long run
+    NSError *error = nil;
+    NSArray *baseline = nil;
+    if (baselinePath) {
+        baseline = [BarcodeBenchmarkSuite resultsWithContentsOfFile:baselinePath error:&error];
+        if (!baseline) {
+            fprintf(stderr, "%s: %s\n", argv[0], [[error localizedDescription] UTF8String]);
+            [pool release];
+            return 2;
+        }
+    }
+
+    ImageParallelSetMaximumThreads(threads);
+    [BarcodeDecoder setDynamicFallbackEnabled:YES];
+    BarcodeBenchmarkSuite *suite = [[BarcodeBenchmarkSuite alloc] init];
+    suite.options = options;
+    suite.filter = filter;
+    suite.verbose = verbose;
+
+    printf("encoder %s, decoder %s, %d thread(s), %d samples of %.0f ms after %.0f ms warm-up\n",
+           [[suite encoderName] UTF8String], [[suite decoderName] UTF8String], ImageParallelMaximumThreads(),
+           options.repetitions, options.sampleMilliseconds, options.warmUpMilliseconds);
+    NSArray *results = [suite run];
+
+    printf("%-44s %12s %10s %-9s %14s\n", "benchmark", "mean", "ci95", "unit", "per second");
+    NSEnumerator *entries = [results objectEnumerator];
+    NSDictionary *result;
+    while ((result = [entries nextObject])) {
+        printf("%-44s %12.3f %10.3f %-9s %14.1f\n",
+               [[result objectForKey:BarcodeBenchmarkKeyName] UTF8String],
+               [[result objectForKey:BarcodeBenchmarkKeyMean] doubleValue],
+               [[result objectForKey:BarcodeBenchmarkKeyConfidence] doubleValue],
+               [[result objectForKey:BarcodeBenchmarkKeyUnit] UTF8String],
+               [[result objectForKey:BarcodeBenchmarkKeyThroughput] doubleValue]);
+    }
+
+    int status = 0;
+    if (outputPath && ![suite writeResults:results toFile:outputPath error:&error]) {
+        fprintf(stderr, "%s: %s\n", argv[0], [[error localizedDescription] UTF8String]);
+        status = 2;
+    }
+    if (baseline) {
+        NSArray *regressions = [BarcodeBenchmarkSuite regressionsInResults:results baseline:baseline threshold:threshold];
+        entries = [regressions objectEnumerator];
+        while ((result = [entries nextObject])) {
+            printf("REGRESSION %s: %.3f -> %.3f (%.0f%% slower)\n",
+                   [[result objectForKey:BarcodeBenchmarkKeyName] UTF8String],
+                   [[result objectForKey:@"baseline"] doubleValue],
+                   [[result objectForKey:@"candidate"] doubleValue],
+                   ([[result objectForKey:@"ratio"] doubleValue] - 1.0) * 100.0);
+        }
+        printf("%lu of %lu benchmarks regressed by more than %.0f%%\n",
+               (unsigned long)[regressions count], (unsigned long)[results count], threshold * 100.0);
+        if ([regressions count] > 0 && status == 0) {
+            status = 1;
+        }
+    }
+
+    [suite release];
+    [pool release];
+    return status;
+}
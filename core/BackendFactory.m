@@ -9,6 +9,7 @@
 #import "DynamicLibraryLoader.h"
 #import "BarcodeDecoderBackend.h"
 #import "BarcodeEncoderBackend.h"
+#import "BarcodeDecoderZBarDynamic.h"
 
 // Forward declarations for backend classes
 @class BarcodeDecoderZBar;
@@ -108,18 +109,13 @@
 }
 
 + (id<BarcodeDecoderBackend>)createZBarDecoderFromLibrary:(DynamicLibrary *)library {
-    // For now, we can't dynamically create a ZBar backend without the headers
-    // This would require a wrapper class that uses dlsym to call ZBar functions
-    // For Phase 2.2, we'll return nil and note that this requires a wrapper implementation
-    
-    // TODO: Create a dynamic ZBar wrapper that uses dlsym
-    // This is complex because we need to:
-    // 1. Define function pointer types for all ZBar functions we use
-    // 2. Resolve all symbols at runtime
-    // 3. Create a wrapper class that uses these function pointers
+    if (![self libraryContainsZBar:library]) {
+        return nil;
+    }
     
-    // For now, return nil - static linking still works
-    return nil;
+    // Calls ZBar through a function table resolved from this library, so no
+    // ZBar headers or link-time library are needed
+    return [[[BarcodeDecoderZBarDynamic alloc] initWithLibrary:library] autorelease];
 }
 
 + (id<BarcodeEncoderBackend>)createZIntEncoderFromLibrary:(DynamicLibrary *)library {
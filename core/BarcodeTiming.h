@@ -0,0 +1,26 @@
+//
+//  BarcodeTiming.h
+//  SmallBarcodeReader
+//
+//  Monotonic stage timing with a process-wide switch (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Turn stage timing on or off for the whole process (on by default). While
+/// off, the tester and decoder skip every clock read and report stages as
+/// not timed (-1), so a sweep pays one flag test per stage.
+/// @param enabled YES to time stages
+void BarcodeTimingSetEnabled(BOOL enabled);
+
+/// Whether stage timing is on
+/// @return YES if callers should read the clock
+BOOL BarcodeTimingIsEnabled(void);
+
+/// Monotonic clock, unaffected by wall-clock changes
+/// @return Milliseconds since an arbitrary fixed point
+double BarcodeTimingNow(void);
+
+NS_ASSUME_NONNULL_END
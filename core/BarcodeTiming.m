@@ -0,0 +1,26 @@
+//
+//  BarcodeTiming.m
+//  SmallBarcodeReader
+//
+//  Monotonic stage timing implementation
+//
+
+#import "BarcodeTiming.h"
+#import <time.h>
+
+// Set before runs start; workers only read it
+static BOOL timingEnabled = YES;
+
+void BarcodeTimingSetEnabled(BOOL enabled) {
+    timingEnabled = enabled;
+}
+
+BOOL BarcodeTimingIsEnabled(void) {
+    return timingEnabled;
+}
+
+double BarcodeTimingNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1.0e6;
+}
@@ -39,11 +39,33 @@ NS_ASSUME_NONNULL_BEGIN
 /// @return Error message string, or nil if no error
 + (NSString *)lastError;
 
-/// Find library in standard search paths
+/// Find library in standard search paths. Answers come from the probe index
+/// while none of the search directories has changed since the last probe.
+/// The library is not opened.
 /// @param libraryName Base name of library (e.g., "zbar", "zint")
 /// @return Full path to library if found, nil otherwise
 + (NSString *)findLibrary:(NSString *)libraryName;
 
+/// Find library in the given directories (searched in order), through the
+/// probe index. Each answer is saved with the modification times of the
+/// directories; it is reused while they and the directory list are unchanged,
+/// so a lookup costs one stat per directory instead of one per candidate name.
+/// @param libraryName Base name of library (e.g., "zbar", "zint")
+/// @param directories Directories to search
+/// @return Full path to library if found, nil otherwise
++ (NSString *)findLibrary:(NSString *)libraryName inDirectories:(NSArray *)directories;
+
+/// Location of the on-disk probe index (a property list in the user's caches
+/// directory). Deleting the file only forces the next lookups to probe again.
+/// @return Path of the index file
++ (NSString *)probeIndexPath;
+
+/// Keep the probe index somewhere else (tests point it at a temporary file so
+/// the user's cache is left alone). The in-memory index is dropped and
+/// reloaded from the new file on the next lookup.
+/// @param path Path of the index file, or nil for the default location
++ (void)setProbeIndexPath:(NSString *)path;
+
 /// Get standard library search paths
 /// @return Array of directory paths where libraries are typically found
 + (NSArray *)standardSearchPaths;
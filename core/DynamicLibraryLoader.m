@@ -6,9 +6,10 @@
 //
 
 #import "DynamicLibraryLoader.h"
-#import "../SmallStep/SmallStep/Core/SmallStep.h"
 #import <dlfcn.h>
 #import <string.h>
+#import <pthread.h>
+#import <sys/stat.h>
 
 #if TARGET_OS_MAC && !TARGET_OS_IPHONE
 #import <AppKit/AppKit.h>
@@ -16,6 +17,34 @@
 
 static NSString *_lastError = nil;
 
+// Probe index: library name -> {path, directories, mtimes}. Read from disk on
+// first use and written back whenever a probe refreshes an entry.
+static NSMutableDictionary *probeIndex = nil;
+static NSString *probeIndexOverridePath = nil; // Set by setProbeIndexPath:
+static pthread_mutex_t probeIndexMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Modification time of a directory in nanoseconds, or -1 if it does not exist
+static long long directoryModificationTime(NSString *directory) {
+    struct stat info;
+    if (directory.length == 0 || stat([directory fileSystemRepresentation], &info) != 0) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    return (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+    return (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+}
+
+static NSArray *directoryModificationTimes(NSArray *directories) {
+    NSMutableArray *times = [NSMutableArray arrayWithCapacity:directories.count];
+    NSUInteger i;
+    for (i = 0; i < directories.count; i++) {
+        [times addObject:[NSNumber numberWithLongLong:directoryModificationTime([directories objectAtIndex:i])]];
+    }
+    return times;
+}
+
 @implementation DynamicLibrary
 
 @synthesize path = _path;
@@ -89,6 +118,14 @@ static NSString *_lastError = nil;
 #else
     // Linux paths
     [paths addObject:@"/usr/lib"];
+#if defined(__x86_64__)
+    [paths addObject:@"/usr/lib/x86_64-linux-gnu"];
+#elif defined(__aarch64__)
+    [paths addObject:@"/usr/lib/aarch64-linux-gnu"];
+#elif defined(__i386__)
+    [paths addObject:@"/usr/lib/i386-linux-gnu"];
+#endif
+    [paths addObject:@"/usr/lib64"];
     [paths addObject:@"/usr/local/lib"];
     [paths addObject:@"/lib"];
     [paths addObject:@"/lib64"];
@@ -98,7 +135,12 @@ static NSString *_lastError = nil;
     NSString *ldLibraryPath = [[[NSProcessInfo processInfo] environment] objectForKey:@"LD_LIBRARY_PATH"];
     if (ldLibraryPath) {
         NSArray *ldPaths = [ldLibraryPath componentsSeparatedByString:@":"];
-        [paths addObjectsFromArray:ldPaths];
+        NSUInteger i;
+        for (i = 0; i < ldPaths.count; i++) {
+            if ([[ldPaths objectAtIndex:i] length] > 0) {
+                [paths addObject:[ldPaths objectAtIndex:i]];
+            }
+        }
     }
 #endif
     
@@ -106,13 +148,33 @@ static NSString *_lastError = nil;
 #endif
 }
 
-+ (NSString *)findLibrary:(NSString *)libraryName {
-    if (!libraryName || libraryName.length == 0) {
-        return nil;
++ (NSString *)probeIndexPath {
+    pthread_mutex_lock(&probeIndexMutex);
+    NSString *overridePath = [[probeIndexOverridePath retain] autorelease];
+    pthread_mutex_unlock(&probeIndexMutex);
+    if (overridePath) {
+        return overridePath;
     }
-    
+    NSArray *caches = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+    NSString *base = caches.count > 0 ? [caches objectAtIndex:0] : NSTemporaryDirectory();
+    return [[base stringByAppendingPathComponent:@"SmallBarcodeReader"]
+            stringByAppendingPathComponent:@"LibraryProbeIndex.plist"];
+}
+
++ (void)setProbeIndexPath:(NSString *)path {
+    NSString *copied = [path copy];
+    pthread_mutex_lock(&probeIndexMutex);
+    [probeIndexOverridePath release];
+    probeIndexOverridePath = copied;
+    // Entries loaded from the previous file do not belong to the new one
+    [probeIndex release];
+    probeIndex = nil;
+    pthread_mutex_unlock(&probeIndexMutex);
+}
+
+// Look for the library on disk, trying each candidate name in each directory
++ (NSString *)probeLibrary:(NSString *)libraryName inDirectories:(NSArray *)searchPaths {
     NSString *extension = [self libraryExtension];
-    NSArray *searchPaths = [self standardSearchPaths];
     
     // Try with "lib" prefix
     NSString *baseName = libraryName;
@@ -120,9 +182,13 @@ static NSString *_lastError = nil;
         baseName = [NSString stringWithFormat:@"lib%@", libraryName];
     }
     
-    // Try various naming patterns
+    // Try various naming patterns; runtime-only packages ship just the soname
+    // (libzbar.so.0), the unversioned name comes with the development files
     NSArray *namePatterns = [NSArray arrayWithObjects:
         [NSString stringWithFormat:@"%@%@", baseName, extension],
+        [NSString stringWithFormat:@"%@%@.0", baseName, extension],
+        [NSString stringWithFormat:@"%@%@.1", baseName, extension],
+        [NSString stringWithFormat:@"%@%@.2", baseName, extension],
         [NSString stringWithFormat:@"%@.0%@", baseName, extension],
         [NSString stringWithFormat:@"%@.1%@", baseName, extension],
         [NSString stringWithFormat:@"%@.2%@", baseName, extension],
@@ -142,6 +208,55 @@ static NSString *_lastError = nil;
     return nil;
 }
 
++ (NSString *)findLibrary:(NSString *)libraryName inDirectories:(NSArray *)directories {
+    if (!libraryName || libraryName.length == 0 || !directories) {
+        return nil;
+    }
+    
+    // Installing or removing a library changes its directory's mtime, so an
+    // entry recorded against the same times still holds
+    NSArray *mtimes = directoryModificationTimes(directories);
+    
+    pthread_mutex_lock(&probeIndexMutex);
+    if (!probeIndex) {
+        NSDictionary *saved = [NSDictionary dictionaryWithContentsOfFile:[self probeIndexPath]];
+        probeIndex = saved ? [saved mutableCopy] : [[NSMutableDictionary alloc] init];
+    }
+    NSDictionary *entry = [probeIndex objectForKey:libraryName];
+    if ([entry isKindOfClass:[NSDictionary class]] &&
+        [[entry objectForKey:@"directories"] isEqual:directories] &&
+        [[entry objectForKey:@"mtimes"] isEqual:mtimes]) {
+        NSString *path = [[[entry objectForKey:@"path"] retain] autorelease];
+        pthread_mutex_unlock(&probeIndexMutex);
+        return path.length > 0 ? path : nil;
+    }
+    pthread_mutex_unlock(&probeIndexMutex);
+    
+    NSString *found = [self probeLibrary:libraryName inDirectories:directories];
+    
+    entry = [NSDictionary dictionaryWithObjectsAndKeys:
+        found ? found : @"", @"path",
+        directories, @"directories",
+        mtimes, @"mtimes",
+        nil];
+    pthread_mutex_lock(&probeIndexMutex);
+    [probeIndex setObject:entry forKey:libraryName];
+    NSDictionary *snapshot = [[probeIndex copy] autorelease];
+    pthread_mutex_unlock(&probeIndexMutex);
+    
+    // The index is only a cache: failing to save it costs the next process a probe
+    NSString *indexPath = [self probeIndexPath];
+    [[NSFileManager defaultManager] createDirectoryAtPath:[indexPath stringByDeletingLastPathComponent]
+                              withIntermediateDirectories:YES attributes:nil error:NULL];
+    [snapshot writeToFile:indexPath atomically:YES];
+    
+    return found;
+}
+
++ (NSString *)findLibrary:(NSString *)libraryName {
+    return [self findLibrary:libraryName inDirectories:[self standardSearchPaths]];
+}
+
 + (DynamicLibrary *)loadLibraryAtPath:(NSString *)path error:(NSError **)error {
 #if TARGET_OS_IPHONE || TARGET_OS_WIN32
     // Dynamic library loading not supported on iOS/Windows
@@ -12,8 +12,12 @@
 #else
 #import <AppKit/AppKit.h>
 #endif
+#import "ImageBuffer.h"
+#import "ImagePixelFormat.h"
+#import "ImagePyramid.h"
 
 @protocol BarcodeDecoderBackend;
+struct BarcodeBackendSlot;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -34,13 +38,107 @@ NS_ASSUME_NONNULL_BEGIN
 
 @end
 
+/// Split of the most recent decode call (milliseconds; -1 if not timed)
+typedef struct {
+    double conversionMilliseconds; // Image or pixels to packed Y800, and any pyramid levels
+    double scanMilliseconds;       // Backend scans
+} BarcodeDecodeTiming;
+
+/// How a buffer is scanned
+typedef NS_ENUM(NSInteger, BarcodeDecodeStrategy) {
+    BarcodeDecodeStrategyFullResolution = 0, // One backend scan of the whole frame
+    BarcodeDecodeStrategyPyramid             // Coarse level first, then textured regions at full resolution
+};
+
+/// Counters of the pyramid strategy, summed over every pyramid decode of a
+/// decoder. Level 0 is full resolution; region and fallback scans count there.
+/// Times stay 0 while BarcodeTimingIsEnabled() is off.
+typedef struct {
+    unsigned long decodes;          // Frames decoded through a pyramid
+    unsigned long earlyExits;       // Stopped once expectedSymbolCount symbols were found
+    unsigned long fallbacks;        // Whole frame scanned at full resolution after all
+    unsigned long regionsScanned;   // Candidate regions scanned at full resolution
+    unsigned long levelHits[ImagePyramidMaximumLevels];   // Symbols first found on each level
+    double levelMilliseconds[ImagePyramidMaximumLevels];  // Backend scan time on each level
+    double buildMilliseconds;       // Downsampling and region search
+    unsigned long long framePixels;   // Pixels of the frames decoded
+    unsigned long long pixelsScanned; // Pixels handed to the backend, all levels
+} BarcodePyramidStatistics;
+
+/// Which registered backends scan a buffer
+typedef NS_ENUM(NSInteger, BarcodeDecodePolicy) {
+    BarcodeDecodePolicyPrimary = 0, // Only the primary backend (the default)
+    BarcodeDecodePolicyCascade,     // One at a time, cheapest expected cost first, until enough symbols are found
+    BarcodeDecodePolicyRace,        // All at once on their own threads; the first to find a symbol wins
+    BarcodeDecodePolicyConsensus    // All at once; keep the symbols enough backends agree on
+};
+
+/// Outcome counters of one backend, over the scans of a decoder
+typedef struct {
+    unsigned long scans;        // Finished scans
+    unsigned long successes;    // Scans that found at least one symbol
+    unsigned long wins;         // Scans whose symbols were returned (cascade, race) or agreed (consensus)
+    unsigned long abandoned;    // Race scans still running when another backend won
+    unsigned long timedScans;   // Finished scans made while stage timing was on
+    double totalMilliseconds;   // Wall time of the timed scans
+} BarcodeBackendStatistics;
+
 /// Generic barcode decoder supporting multiple backends
-@interface BarcodeDecoder : NSObject {
+/// Copies drive their own backend instances, so each thread can use its own
+/// copy without sharing backend state. Backends that adopt NSCopying are
+/// copied with their configuration; others are re-created with init.
+/// Under the Primary policy a shared decoder scans concurrently; the other
+/// policies run one scan at a time per backend.
+@interface BarcodeDecoder : NSObject <NSCopying> {
     id _backend; // id<BarcodeDecoderBackend>
     NSMutableArray *_dynamicBackends; // Array of dynamically loaded backends
+    NSArray *_enabledSymbologies; // nil = all
+    BarcodeDecodeTiming _lastTiming;
+    BarcodeDecodeStrategy _decodeStrategy;
+    NSInteger _expectedSymbolCount;
+    long _pyramidMinimumPixels;
+    BarcodePyramidStatistics _pyramidStatistics;
+    BarcodeDecodePolicy _decodePolicy;
+    NSInteger _consensusQuorum;
+    NSCondition *_backendCondition; // Guards the slots; broadcast when a backend goes idle
+    struct BarcodeBackendSlot *_backendSlots; // One per entry of -allBackends
+    NSUInteger _backendSlotCount;
 }
 
-/// Initialize with auto-detected backend
+/// How the registered backends share a scan (BarcodeDecodePolicyPrimary by
+/// default). Every policy records per-backend statistics; cascade orders
+/// backends by mean scan time divided by their (smoothed) success rate, so
+/// a backend that is slow but usually right can still go first. Race scans
+/// cannot interrupt a backend: the call returns on the first success and the
+/// losers finish in the background, their results discarded; a busy backend
+/// sits out later races until it is done. Copies keep the policy but start
+/// with fresh statistics.
+@property (assign, nonatomic) BarcodeDecodePolicy decodePolicy;
+
+/// Backends that must report the same data for a symbol to pass consensus
+/// (default 2; capped at the number of backends that took part)
+@property (assign, nonatomic) NSInteger consensusQuorum;
+
+/// How buffers are scanned (BarcodeDecodeStrategyFullResolution by default).
+/// With BarcodeDecodeStrategyPyramid, frames of at least pyramidMinimumPixels
+/// are first scanned at a reduced level of at most about 2 MP. If that finds
+/// fewer than expectedSymbolCount symbols, the regions of the half-size level
+/// with strong local contrast are scanned at full resolution, and the whole
+/// frame is scanned only when the regions cover most of it or nothing at
+/// all was found. Result points are in full-resolution coordinates.
+@property (assign, nonatomic) BarcodeDecodeStrategy decodeStrategy;
+
+/// Symbols a frame is expected to hold. The pyramid strategy stops once it
+/// has found this many (0, the default, scans every candidate region), and
+/// so does a cascade (which stops at the first symbol while this is 0).
+@property (assign, nonatomic) NSInteger expectedSymbolCount;
+
+/// Smallest frame the pyramid strategy reduces (default 4194304, i.e. 4 MP);
+/// smaller frames are scanned once at full resolution
+@property (assign, nonatomic) long pyramidMinimumPixels;
+
+/// Initialize with auto-detected backend. Without a linked backend, libzbar
+/// found at run time is used only if the dynamic fallback is enabled.
 - (instancetype)init;
 
 /// Initialize with specific backend
@@ -50,6 +148,16 @@ NS_ASSUME_NONNULL_BEGIN
 /// Get available backend names
 + (NSArray *)availableBackends;
 
+/// Let init and availableBackends fall back to libzbar found at run time
+/// (default NO). Searching for it reads and rewrites the library probe index
+/// in the user's cache, so applications opt in at startup; tests and
+/// embedders that pass their own backends never touch the index.
+/// @param enabled YES to search for libzbar when no backend is linked
++ (void)setDynamicFallbackEnabled:(BOOL)enabled;
+
+/// Whether init may fall back to libzbar found at run time
++ (BOOL)isDynamicFallbackEnabled;
+
 /// Get current backend name
 - (NSString *)backendName;
 
@@ -67,17 +175,70 @@ NS_ASSUME_NONNULL_BEGIN
 /// @return Array of BarcodeResult objects, or nil on error
 - (NSArray *)decodeBarcodesFromImage:(id)image originalInput:(NSString *)originalInput;
 
+/// Decode barcodes from a grayscale buffer without any image conversion
+/// @param buffer Grayscale (Y800) buffer; padded rows are packed before scanning
+/// @param originalInput Original input data (if this image was encoded, for matching)
+/// @return Array of BarcodeResult objects, or nil on error
+- (NSArray *)decodeBarcodesFromBuffer:(ImageBuffer)buffer originalInput:(NSString *)originalInput;
+
+/// Decode barcodes straight from caller-owned pixels (e.g. camera frames).
+/// Packed Gray8 frames are scanned in place; colour frames are converted to
+/// grayscale once. The pixels are never modified or retained.
+/// @param pixels Top-left pixel
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param stride Bytes between the starts of consecutive rows
+/// @param format Pixel layout
+/// @param originalInput Original input data (if this image was encoded, for matching)
+/// @return Array of BarcodeResult objects, or nil on error
+- (NSArray *)decodeBarcodesFromPixels:(const unsigned char *)pixels width:(int)width height:(int)height stride:(int)stride format:(ImagePixelFormat)format originalInput:(NSString *)originalInput;
+
 /// Decode barcodes from image data
 /// @param imageData The image data (JPEG, PNG, etc.)
 /// @return Array of BarcodeResult objects, or nil on error
 - (NSArray *)decodeBarcodesFromImageData:(NSData *)imageData;
 
+/// Restrict decoding to the symbologies the caller expects; backends that
+/// support it skip decoders that cannot match
+/// @param symbologies Array of NSNumber symbology IDs as listed by
+///        -[BarcodeEncoder supportedSymbologies], or nil to enable all
+- (void)setEnabledSymbologies:(NSArray *)symbologies;
+
+/// Symbologies passed to setEnabledSymbologies:, or nil if all are enabled
+- (NSArray *)enabledSymbologies;
+
+/// Timing of the most recent decode call on this decoder, split into image
+/// conversion and backend scan. Both are -1 while BarcodeTimingIsEnabled()
+/// is off or if the call failed before that step.
+- (BarcodeDecodeTiming)lastDecodeTiming;
+
+/// Pyramid strategy counters since this decoder was created or last reset
+- (BarcodePyramidStatistics)pyramidStatistics;
+
+/// Zero the pyramid strategy counters
+- (void)resetPyramidStatistics;
+
 /// Register a dynamically loaded backend
 - (void)registerDynamicBackend:(id<BarcodeDecoderBackend>)backend;
 
 /// Get all registered backends (static + dynamic)
 - (NSArray *)allBackends;
 
+/// Backends in the order a cascade would try them now
+- (NSArray *)backendsInDecodeOrder;
+
+/// Statistics of one backend
+/// @param backend An entry of -allBackends
+/// @return Counters (all zero for an unknown backend)
+- (BarcodeBackendStatistics)statisticsForBackend:(id)backend;
+
+/// Zero every backend's statistics, which also resets the cascade order
+- (void)resetBackendStatistics;
+
+/// Block until no backend is scanning, including race losers still running
+/// in the background; their scans are counted once this returns
+- (void)waitUntilBackendsIdle;
+
 @end
 
 NS_ASSUME_NONNULL_END
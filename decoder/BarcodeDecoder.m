@@ -7,6 +7,10 @@
 
 #import "BarcodeDecoder.h"
 #import "BarcodeDecoderBackend.h"
+#import "BarcodeDecoderZBarDynamic.h"
+#import "ImageScratch.h"
+#import "BarcodeTiming.h"
+#import <math.h>
 #import <string.h>
 
 #if TARGET_OS_IPHONE
@@ -30,6 +34,26 @@
 #define ZINT_BACKEND_AVAILABLE 0
 #endif
 
+// Set once at startup by applications that want libzbar found at run time
+static BOOL dynamicFallbackEnabled = NO;
+
+// Pyramid strategy tuning
+static const long BarcodePyramidCoarsePixels = 1L << 21;     // Coarsest level scanned first, about 2 MP
+static const float BarcodePyramidMinimumEnergy = 8.0f;      // Tile gradient worth a closer look
+static const int BarcodePyramidMinimumTiles = 2;            // Smaller groups are noise, not symbols
+static const double BarcodePyramidMaximumRegionShare = 0.5; // Regions covering more of the frame scan it whole
+static const double BarcodePyramidDuplicateDistance = 64.0; // Same symbol found twice, in full-resolution pixels
+enum { BarcodePyramidMaximumRegions = 64 };
+
+// Backends past this many are left out of cascades, races and consensus
+enum { BarcodeDecoderMaximumBackends = 16 };
+
+// Bookkeeping of one backend, indexed like -allBackends
+struct BarcodeBackendSlot {
+    BarcodeBackendStatistics statistics;
+    BOOL scanning; // A scan runs on it, possibly a race entry that already lost
+};
+
 @implementation BarcodeResult
 
 @synthesize data;
@@ -57,8 +81,148 @@
 
 @end
 
+// Bounding box of a result's points, or NO if it has none
+static BOOL resultBounds(BarcodeResult *result, NSRect *bounds) {
+    NSArray *points = result.points;
+    if ([points count] == 0) {
+        return NO;
+    }
+    double left = HUGE_VAL, top = HUGE_VAL, right = -HUGE_VAL, bottom = -HUGE_VAL;
+    NSInteger i;
+    for (i = 0; i < points.count; i++) {
+        NSPoint point = [[points objectAtIndex:i] rectValue].origin;
+        left = fmin(left, point.x);
+        top = fmin(top, point.y);
+        right = fmax(right, point.x);
+        bottom = fmax(bottom, point.y);
+    }
+    *bounds = NSMakeRect(left, top, right - left, bottom - top);
+    return YES;
+}
+
+// Move a result's points from a pyramid level or crop into frame coordinates
+static void mapResultPoints(BarcodeResult *result, int level, int originX, int originY) {
+    NSArray *points = result.points;
+    if ([points count] == 0) {
+        return;
+    }
+    // Level pixel centres land on the centre of the block they average
+    double scale = (double)(1 << level);
+    double offset = (scale - 1.0) / 2.0;
+    NSMutableArray *mapped = [NSMutableArray arrayWithCapacity:points.count];
+    NSInteger i;
+    for (i = 0; i < points.count; i++) {
+        NSRect rect = [[points objectAtIndex:i] rectValue];
+        rect.origin.x = rect.origin.x * scale + offset + originX;
+        rect.origin.y = rect.origin.y * scale + offset + originY;
+        rect.size.width *= scale;
+        rect.size.height *= scale;
+        [mapped addObject:[NSValue valueWithRect:rect]];
+    }
+    result.points = mapped;
+}
+
+// Whether a result repeats one already found: same symbology and data, and
+// (when both have points) centred within BarcodePyramidDuplicateDistance
+static BOOL isKnownResult(BarcodeResult *result, NSArray *found) {
+    NSRect bounds, knownBounds;
+    BOOL located = resultBounds(result, &bounds);
+    NSInteger i;
+    for (i = 0; i < found.count; i++) {
+        BarcodeResult *known = [found objectAtIndex:i];
+        if (![known.data isEqualToString:result.data] || ![known.type isEqualToString:result.type]) {
+            continue;
+        }
+        if (!located || !resultBounds(known, &knownBounds)) {
+            return YES;
+        }
+        double dx = NSMidX(bounds) - NSMidX(knownBounds);
+        double dy = NSMidY(bounds) - NSMidY(knownBounds);
+        if (sqrt(dx * dx + dy * dy) <= BarcodePyramidDuplicateDistance) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Whether a region is most likely the symbol of a result already found:
+// its centre lies within the result's points grown by the duplicate distance
+static BOOL isRegionResolved(ImageRegion region, NSArray *found) {
+    double centerX = region.x + region.width / 2.0;
+    double centerY = region.y + region.height / 2.0;
+    NSInteger i;
+    for (i = 0; i < found.count; i++) {
+        NSRect bounds;
+        if (!resultBounds([found objectAtIndex:i], &bounds)) {
+            continue;
+        }
+        bounds = NSInsetRect(bounds, -BarcodePyramidDuplicateDistance, -BarcodePyramidDuplicateDistance);
+        if (centerX >= NSMinX(bounds) && centerX <= NSMaxX(bounds) &&
+            centerY >= NSMinY(bounds) && centerY <= NSMaxY(bounds)) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Expected cost of one success: mean scan time over the smoothed success
+// rate. A backend never tried costs nothing, so it gets one early turn;
+// with timing off every scan costs the same and only the rate counts.
+static double expectedScanCost(BarcodeBackendStatistics statistics) {
+    if (statistics.scans == 0) {
+        return 0.0;
+    }
+    double mean = statistics.timedScans > 0 ? statistics.totalMilliseconds / (double)statistics.timedScans : 1.0;
+    double rate = ((double)statistics.successes + 1.0) / ((double)statistics.scans + 2.0);
+    return mean / rate;
+}
+
+/// One buffer scanned by several backends at once, each on its own thread.
+/// Backends cannot be interrupted, so a participant that loses keeps
+/// running; the race (and the decoder it reports to) stays alive until the
+/// last one finishes.
+@interface BarcodeBackendRace : NSObject {
+    BarcodeDecoder *decoder;      // Receives each participant's outcome
+    NSArray *backends;            // Participants
+    NSUInteger slots[BarcodeDecoderMaximumBackends];
+    unsigned char *data;
+    unsigned width;
+    unsigned height;
+    BOOL ownsData;                // Copied, so the caller may return before the losers finish
+    NSCondition *condition;       // Guards the fields below
+    NSMutableArray *results;      // Per participant; NSNull until it finishes, or if it failed
+    NSUInteger finished;
+    NSInteger winner;             // First participant to find a symbol, or -1
+    BOOL collected;               // The caller stopped waiting
+}
+
+/// @param copyData Copy the pixels so waitForFirstSuccess can return early
+- (instancetype)initWithDecoder:(BarcodeDecoder *)owner backends:(NSArray *)participants slots:(const NSUInteger *)participantSlots
+                           data:(unsigned char *)pixels width:(unsigned)pixelWidth height:(unsigned)pixelHeight copyData:(BOOL)copyData;
+
+/// Start every participant on a detached thread
+- (void)start;
+
+/// Wait for the first participant to find a symbol, or for all to finish
+/// @param winnerIndex Receives the winning participant, or -1
+/// @return The winner's results; without one, an empty array if any
+///         participant answered, else nil
+- (NSArray *)waitForFirstSuccess:(NSInteger *)winnerIndex;
+
+/// Wait for every participant
+/// @return Per-participant results (NSNull where a backend failed)
+- (NSArray *)waitForAll;
+
+@end
+
 @implementation BarcodeDecoder
 
+@synthesize decodeStrategy = _decodeStrategy;
+@synthesize expectedSymbolCount = _expectedSymbolCount;
+@synthesize pyramidMinimumPixels = _pyramidMinimumPixels;
+@synthesize decodePolicy = _decodePolicy;
+@synthesize consensusQuorum = _consensusQuorum;
+
 + (NSArray *)availableBackends {
     NSMutableArray *backends = [NSMutableArray array];
     
@@ -69,6 +233,13 @@
     }
 #endif
     
+    // Otherwise libzbar found at run time (not opened here), if enabled
+    if (dynamicFallbackEnabled &&
+        ![backends containsObject:[BarcodeDecoderZBarDynamic backendName]] &&
+        [BarcodeDecoderZBarDynamic isAvailable]) {
+        [backends addObject:[BarcodeDecoderZBarDynamic backendName]];
+    }
+    
     // Check ZInt (if compiled in)
 #if ZINT_BACKEND_AVAILABLE
     if ([BarcodeDecoderZInt isAvailable]) {
@@ -79,6 +250,14 @@
     return backends;
 }
 
++ (void)setDynamicFallbackEnabled:(BOOL)enabled {
+    dynamicFallbackEnabled = enabled;
+}
+
++ (BOOL)isDynamicFallbackEnabled {
+    return dynamicFallbackEnabled;
+}
+
 - (instancetype)init {
     // Auto-detect and use first available backend
     // If no backend is available, still initialize (backend will be nil)
@@ -99,6 +278,12 @@
     }
 #endif
     
+    // Without a linked backend, use libzbar through dlsym if the application
+    // opted in; the library is only opened by the first decode
+    if (!backend && dynamicFallbackEnabled && [BarcodeDecoderZBarDynamic isAvailable]) {
+        backend = [[BarcodeDecoderZBarDynamic alloc] init];
+    }
+    
     // Initialize even if no backend is available
     // The app will show a graceful error message when decoding is attempted
     return [self initWithBackend:backend];
@@ -109,6 +294,13 @@
     if (self) {
         _backend = [backend retain];
         _dynamicBackends = [[NSMutableArray alloc] init];
+        _lastTiming.conversionMilliseconds = -1.0;
+        _lastTiming.scanMilliseconds = -1.0;
+        _decodeStrategy = BarcodeDecodeStrategyFullResolution;
+        _pyramidMinimumPixels = 1L << 22;
+        _decodePolicy = BarcodeDecodePolicyPrimary;
+        _consensusQuorum = 2;
+        _backendCondition = [[NSCondition alloc] init];
     }
     return self;
 }
@@ -116,12 +308,18 @@
 - (void)dealloc {
     [_backend release];
     [_dynamicBackends release];
+    [_enabledSymbologies release];
+    [_backendCondition release];
+    free(_backendSlots);
     [super dealloc];
 }
 
 - (void)registerDynamicBackend:(id<BarcodeDecoderBackend>)backend {
     if (backend && ![_dynamicBackends containsObject:backend]) {
         [_dynamicBackends addObject:backend];
+        if (_enabledSymbologies && [backend respondsToSelector:@selector(setEnabledSymbologies:)]) {
+            [backend setEnabledSymbologies:_enabledSymbologies];
+        }
         
         // If no static backend is set, use the first dynamic one
         if (!_backend && _dynamicBackends.count > 0) {
@@ -137,11 +335,79 @@
         [all addObject:_backend];
     }
     
-    [all addObjectsFromArray:_dynamicBackends];
+    // The primary backend may itself be the first dynamic one
+    NSInteger i;
+    for (i = 0; i < _dynamicBackends.count; i++) {
+        id backend = [_dynamicBackends objectAtIndex:i];
+        if (backend != _backend) {
+            [all addObject:backend];
+        }
+    }
     
     return all;
 }
 
+- (void)setEnabledSymbologies:(NSArray *)symbologies {
+    if (symbologies == _enabledSymbologies ||
+        (symbologies && _enabledSymbologies && [symbologies isEqualToArray:_enabledSymbologies])) {
+        return;
+    }
+    
+    NSArray *copied = [symbologies copy];
+    [_enabledSymbologies release];
+    _enabledSymbologies = copied;
+    
+    NSArray *backends = [self allBackends];
+    NSInteger i;
+    for (i = 0; i < backends.count; i++) {
+        id backend = [backends objectAtIndex:i];
+        if ([backend respondsToSelector:@selector(setEnabledSymbologies:)]) {
+            [backend setEnabledSymbologies:_enabledSymbologies];
+        }
+    }
+}
+
+- (NSArray *)enabledSymbologies {
+    return _enabledSymbologies;
+}
+
+// New backend for a copy: backends keep per-instance state, so each copy
+// gets its own. One that adopts NSCopying copies its configuration along;
+// any other is a fresh instance of the same class.
+static id copyBackend(id backend) {
+    if ([backend conformsToProtocol:@protocol(NSCopying)]) {
+        return [backend copy];
+    }
+    return [[[backend class] alloc] init];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    id backend = _backend ? copyBackend(_backend) : nil;
+    BarcodeDecoder *copy = [[[self class] allocWithZone:zone] initWithBackend:backend];
+    [backend release];
+    
+    NSInteger i;
+    for (i = 0; i < _dynamicBackends.count; i++) {
+        id dynamicBackend = [_dynamicBackends objectAtIndex:i];
+        if (dynamicBackend == _backend) {
+            continue; // Already copied above
+        }
+        id freshBackend = copyBackend(dynamicBackend);
+        if (freshBackend) {
+            [copy registerDynamicBackend:freshBackend];
+            [freshBackend release];
+        }
+    }
+    
+    [copy setEnabledSymbologies:_enabledSymbologies];
+    copy.decodeStrategy = _decodeStrategy;
+    copy.expectedSymbolCount = _expectedSymbolCount;
+    copy.pyramidMinimumPixels = _pyramidMinimumPixels;
+    copy.decodePolicy = _decodePolicy;
+    copy.consensusQuorum = _consensusQuorum;
+    return copy;
+}
+
 - (NSString *)backendName {
     if (_backend && [_backend respondsToSelector:@selector(backendName)]) {
         return [_backend performSelector:@selector(backendName)];
@@ -153,6 +419,514 @@
     return (_backend != nil);
 }
 
+- (BarcodeDecodeTiming)lastDecodeTiming {
+    return _lastTiming;
+}
+
+// Start of a decode call: forget the previous split
+- (void)resetTiming {
+    _lastTiming.conversionMilliseconds = -1.0;
+    _lastTiming.scanMilliseconds = -1.0;
+}
+
+// A conversion done before handing a buffer on counts toward the call's
+// conversion time
+- (void)addConversionMilliseconds:(double)milliseconds {
+    if (_lastTiming.conversionMilliseconds < 0.0) {
+        _lastTiming.conversionMilliseconds = 0.0;
+    }
+    _lastTiming.conversionMilliseconds += milliseconds;
+}
+
+// Pyramid decodes scan several buffers per call
+- (void)addScanMilliseconds:(double)milliseconds {
+    if (_lastTiming.scanMilliseconds < 0.0) {
+        _lastTiming.scanMilliseconds = 0.0;
+    }
+    _lastTiming.scanMilliseconds += milliseconds;
+}
+
+- (BarcodePyramidStatistics)pyramidStatistics {
+    return _pyramidStatistics;
+}
+
+- (void)resetPyramidStatistics {
+    memset(&_pyramidStatistics, 0, sizeof(_pyramidStatistics));
+}
+
+// Grow the slot table to cover every registered backend. Call with
+// _backendCondition locked.
+- (void)ensureBackendSlots:(NSUInteger)count {
+    if (count <= _backendSlotCount) {
+        return;
+    }
+    struct BarcodeBackendSlot *slots = (struct BarcodeBackendSlot *)realloc(_backendSlots, count * sizeof(struct BarcodeBackendSlot));
+    if (!slots) {
+        return;
+    }
+    memset(slots + _backendSlotCount, 0, (count - _backendSlotCount) * sizeof(struct BarcodeBackendSlot));
+    _backendSlots = slots;
+    _backendSlotCount = count;
+}
+
+// Wait until no scan runs on a backend, then mark it busy
+- (void)claimBackendSlot:(NSUInteger)slot {
+    [_backendCondition lock];
+    [self ensureBackendSlots:slot + 1];
+    while (slot < _backendSlotCount && _backendSlots[slot].scanning) {
+        [_backendCondition wait];
+    }
+    if (slot < _backendSlotCount) {
+        _backendSlots[slot].scanning = YES;
+    }
+    [_backendCondition unlock];
+}
+
+// Mark a backend busy unless a scan already runs on it
+- (BOOL)tryClaimBackendSlot:(NSUInteger)slot {
+    BOOL claimed = NO;
+    [_backendCondition lock];
+    [self ensureBackendSlots:slot + 1];
+    if (slot < _backendSlotCount && !_backendSlots[slot].scanning) {
+        _backendSlots[slot].scanning = YES;
+        claimed = YES;
+    }
+    [_backendCondition unlock];
+    return claimed;
+}
+
+// Count a finished scan; milliseconds is negative when it was not timed.
+// Call with _backendCondition locked.
+- (void)countScanForBackendSlot:(NSUInteger)slot milliseconds:(double)milliseconds found:(BOOL)found abandoned:(BOOL)abandoned {
+    if (slot >= _backendSlotCount) {
+        return;
+    }
+    BarcodeBackendStatistics *statistics = &_backendSlots[slot].statistics;
+    statistics->scans++;
+    if (milliseconds >= 0.0) {
+        statistics->timedScans++;
+        statistics->totalMilliseconds += milliseconds;
+    }
+    if (found) {
+        statistics->successes++;
+    }
+    if (abandoned) {
+        statistics->abandoned++;
+    }
+}
+
+// Record a finished scan and mark the backend idle; race threads call this too
+- (void)finishBackendSlot:(NSUInteger)slot milliseconds:(double)milliseconds found:(BOOL)found abandoned:(BOOL)abandoned {
+    [_backendCondition lock];
+    [self countScanForBackendSlot:slot milliseconds:milliseconds found:found abandoned:abandoned];
+    if (slot < _backendSlotCount) {
+        _backendSlots[slot].scanning = NO;
+    }
+    [_backendCondition broadcast];
+    [_backendCondition unlock];
+}
+
+- (void)recordWinForBackendSlot:(NSUInteger)slot {
+    [_backendCondition lock];
+    if (slot < _backendSlotCount) {
+        _backendSlots[slot].statistics.wins++;
+    }
+    [_backendCondition unlock];
+}
+
+// Slots of the first count backends, cheapest expected cost first and in
+// registration order on ties
+- (NSUInteger)orderBackendSlots:(NSUInteger *)order count:(NSUInteger)count {
+    if (count > BarcodeDecoderMaximumBackends) {
+        count = BarcodeDecoderMaximumBackends;
+    }
+    double costs[BarcodeDecoderMaximumBackends];
+    NSUInteger i;
+    [_backendCondition lock];
+    [self ensureBackendSlots:count];
+    for (i = 0; i < count; i++) {
+        costs[i] = i < _backendSlotCount ? expectedScanCost(_backendSlots[i].statistics) : 0.0;
+    }
+    [_backendCondition unlock];
+    
+    for (i = 0; i < count; i++) {
+        NSUInteger j = i;
+        while (j > 0 && costs[order[j - 1]] > costs[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return count;
+}
+
+- (NSArray *)backendsInDecodeOrder {
+    NSArray *backends = [self allBackends];
+    NSUInteger order[BarcodeDecoderMaximumBackends];
+    NSUInteger count = [self orderBackendSlots:order count:backends.count];
+    NSMutableArray *ordered = [NSMutableArray arrayWithCapacity:backends.count];
+    NSUInteger i;
+    for (i = 0; i < count; i++) {
+        [ordered addObject:[backends objectAtIndex:order[i]]];
+    }
+    for (i = count; i < backends.count; i++) {
+        [ordered addObject:[backends objectAtIndex:i]];
+    }
+    return ordered;
+}
+
+- (BarcodeBackendStatistics)statisticsForBackend:(id)backend {
+    BarcodeBackendStatistics statistics;
+    memset(&statistics, 0, sizeof(statistics));
+    NSUInteger slot = [[self allBackends] indexOfObjectIdenticalTo:backend];
+    [_backendCondition lock];
+    if (slot != NSNotFound && slot < _backendSlotCount) {
+        statistics = _backendSlots[slot].statistics;
+    }
+    [_backendCondition unlock];
+    return statistics;
+}
+
+- (void)resetBackendStatistics {
+    [_backendCondition lock];
+    NSUInteger i;
+    for (i = 0; i < _backendSlotCount; i++) {
+        memset(&_backendSlots[i].statistics, 0, sizeof(BarcodeBackendStatistics));
+    }
+    [_backendCondition unlock];
+}
+
+- (void)waitUntilBackendsIdle {
+    [_backendCondition lock];
+    NSUInteger i = 0;
+    while (i < _backendSlotCount) {
+        if (_backendSlots[i].scanning) {
+            // finishBackendSlot: broadcasts; look at every slot again after
+            [_backendCondition wait];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    [_backendCondition unlock];
+}
+
+// Scan with a backend already claimed for the calling thread
+- (NSArray *)scanData:(unsigned char *)data width:(unsigned)width height:(unsigned)height
+          claimedSlot:(NSUInteger)slot backend:(id)backend {
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    NSArray *results = [backend decodeBarcodesFromData:data width:width height:height];
+    double milliseconds = timed ? BarcodeTimingNow() - started : -1.0;
+    [self finishBackendSlot:slot milliseconds:milliseconds found:results.count > 0 abandoned:NO];
+    return results;
+}
+
+// Scan with the primary backend without claiming it: backends take
+// concurrent scans, so a shared decoder is not serialized here
+- (NSArray *)scanPrimaryData:(unsigned char *)data width:(unsigned)width height:(unsigned)height {
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    NSArray *results = [_backend decodeBarcodesFromData:data width:width height:height];
+    double milliseconds = timed ? BarcodeTimingNow() - started : -1.0;
+    [_backendCondition lock];
+    [self ensureBackendSlots:1];
+    [self countScanForBackendSlot:0 milliseconds:milliseconds found:results.count > 0 abandoned:NO];
+    [_backendCondition unlock];
+    return results;
+}
+
+// Backends one at a time until enough symbols are known
+- (NSArray *)cascadeData:(unsigned char *)data width:(unsigned)width height:(unsigned)height backends:(NSArray *)backends {
+    NSUInteger order[BarcodeDecoderMaximumBackends];
+    NSUInteger count = [self orderBackendSlots:order count:backends.count];
+    NSUInteger wanted = _expectedSymbolCount > 0 ? (NSUInteger)_expectedSymbolCount : 1;
+    NSMutableArray *found = [NSMutableArray array];
+    BOOL answered = NO;
+    NSUInteger i;
+    for (i = 0; i < count && found.count < wanted; i++) {
+        id backend = [backends objectAtIndex:order[i]];
+        if (![backend respondsToSelector:@selector(decodeBarcodesFromData:width:height:)]) {
+            continue;
+        }
+        [self claimBackendSlot:order[i]];
+        NSArray *results = [self scanData:data width:width height:height claimedSlot:order[i] backend:backend];
+        if (!results) {
+            continue;
+        }
+        answered = YES;
+        NSUInteger before = found.count;
+        NSInteger r;
+        for (r = 0; r < results.count; r++) {
+            BarcodeResult *result = [results objectAtIndex:r];
+            if (!isKnownResult(result, found)) {
+                [found addObject:result];
+            }
+        }
+        if (found.count > before) {
+            [self recordWinForBackendSlot:order[i]];
+        }
+    }
+    return answered ? found : nil;
+}
+
+// Symbols that at least quorum participants report with the same data; the
+// copy kept is the one from the earliest participant in decode order
+- (NSArray *)agreedResults:(NSArray *)perParticipant slots:(const NSUInteger *)slots quorum:(NSUInteger)quorum {
+    NSUInteger count = perParticipant.count, p, q;
+    BOOL voted[BarcodeDecoderMaximumBackends];
+    memset(voted, 0, sizeof(voted));
+    NSMutableArray *agreed = [NSMutableArray array];
+    BOOL answered = NO;
+    
+    for (p = 0; p < count; p++) {
+        id results = [perParticipant objectAtIndex:p];
+        if (results == [NSNull null]) {
+            continue;
+        }
+        answered = YES;
+        NSInteger r;
+        for (r = 0; r < [results count]; r++) {
+            BarcodeResult *result = [results objectAtIndex:r];
+            NSInteger a;
+            BOOL known = NO;
+            for (a = 0; a < agreed.count && !known; a++) {
+                known = [[[agreed objectAtIndex:a] data] isEqualToString:result.data];
+            }
+            if (known) {
+                continue;
+            }
+            
+            BOOL supporters[BarcodeDecoderMaximumBackends];
+            memset(supporters, 0, sizeof(supporters));
+            NSUInteger votes = 0;
+            for (q = p; q < count; q++) {
+                id other = [perParticipant objectAtIndex:q];
+                if (other == [NSNull null]) {
+                    continue;
+                }
+                NSInteger o;
+                for (o = 0; o < [other count] && !supporters[q]; o++) {
+                    supporters[q] = [[[other objectAtIndex:o] data] isEqualToString:result.data];
+                }
+                votes += supporters[q] ? 1 : 0;
+            }
+            if (votes >= quorum) {
+                [agreed addObject:result];
+                for (q = p; q < count; q++) {
+                    voted[q] = voted[q] || supporters[q];
+                }
+            }
+        }
+    }
+    
+    for (p = 0; p < count; p++) {
+        if (voted[p]) {
+            [self recordWinForBackendSlot:slots[p]];
+        }
+    }
+    return answered ? agreed : nil;
+}
+
+// Backends at once: the first success (race) or the agreed symbols (consensus)
+- (NSArray *)raceData:(unsigned char *)data width:(unsigned)width height:(unsigned)height
+             backends:(NSArray *)backends consensus:(BOOL)consensus {
+    NSUInteger order[BarcodeDecoderMaximumBackends], slots[BarcodeDecoderMaximumBackends];
+    NSUInteger count = [self orderBackendSlots:order count:backends.count];
+    NSMutableArray *participants = [NSMutableArray arrayWithCapacity:count];
+    NSUInteger i;
+    for (i = 0; i < count; i++) {
+        id backend = [backends objectAtIndex:order[i]];
+        if (![backend respondsToSelector:@selector(decodeBarcodesFromData:width:height:)]) {
+            continue;
+        }
+        // A race skips backends still busy with an earlier race; consensus needs every vote
+        if (consensus) {
+            [self claimBackendSlot:order[i]];
+        } else if (![self tryClaimBackendSlot:order[i]]) {
+            continue;
+        }
+        slots[participants.count] = order[i];
+        [participants addObject:backend];
+    }
+    if (participants.count == 0) {
+        // Every backend is still finishing a lost race: wait for the cheapest
+        for (i = 0; i < count && participants.count == 0; i++) {
+            id backend = [backends objectAtIndex:order[i]];
+            if ([backend respondsToSelector:@selector(decodeBarcodesFromData:width:height:)]) {
+                [self claimBackendSlot:order[i]];
+                slots[0] = order[i];
+                [participants addObject:backend];
+            }
+        }
+        if (participants.count == 0) {
+            return nil;
+        }
+    }
+    
+    if (participants.count == 1) {
+        NSArray *results = [self scanData:data width:width height:height claimedSlot:slots[0] backend:[participants objectAtIndex:0]];
+        if (results.count > 0) {
+            [self recordWinForBackendSlot:slots[0]];
+        }
+        return results;
+    }
+    
+    BarcodeBackendRace *race = [[BarcodeBackendRace alloc] initWithDecoder:self backends:participants slots:slots
+                                                                      data:data width:width height:height copyData:!consensus];
+    [race start];
+    NSArray *results;
+    if (consensus) {
+        NSUInteger quorum = (NSUInteger)MAX(_consensusQuorum, (NSInteger)1);
+        results = [self agreedResults:[race waitForAll] slots:slots quorum:MIN(quorum, participants.count)];
+    } else {
+        NSInteger winner = -1;
+        results = [race waitForFirstSuccess:&winner];
+        if (winner >= 0) {
+            [self recordWinForBackendSlot:slots[winner]];
+        }
+    }
+    [race release];
+    return results;
+}
+
+// Scan packed Y800 with the backends the policy calls for
+- (NSArray *)scanData:(unsigned char *)data width:(unsigned)width height:(unsigned)height {
+    NSArray *backends = _decodePolicy == BarcodeDecodePolicyPrimary ? nil : [self allBackends];
+    if (backends.count < 2) {
+        return [self scanPrimaryData:data width:width height:height];
+    }
+    if (_decodePolicy == BarcodeDecodePolicyCascade) {
+        return [self cascadeData:data width:width height:height backends:backends];
+    }
+    return [self raceData:data width:width height:height backends:backends
+                consensus:_decodePolicy == BarcodeDecodePolicyConsensus];
+}
+
+// Backend scan of a buffer, added to the call's timing
+- (NSArray *)scanBuffer:(ImageBuffer)buffer {
+    // Backends take tightly packed Y800; only padded buffers need a copy.
+    // The backend does not free or modify the data (we pass NULL as cleanup function to ZBar)
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    ImageBuffer packed = buffer;
+    if (buffer.stride != buffer.width) {
+        packed = ImageBufferCopy(buffer);
+        if (!packed.data) {
+            return nil;
+        }
+    }
+    double packedAt = timed ? BarcodeTimingNow() : 0.0;
+    
+    NSArray *results = [self scanData:packed.data width:(unsigned)packed.width height:(unsigned)packed.height];
+    if (timed) {
+        [self addConversionMilliseconds:packedAt - started];
+        [self addScanMilliseconds:BarcodeTimingNow() - packedAt];
+    }
+    
+    if (packed.data != buffer.data) {
+        ImageBufferFree(&packed);
+    }
+    return results;
+}
+
+// Scan one pyramid level or full-resolution crop, keep the symbols not yet
+// found and count them against the level
+- (NSUInteger)scanBuffer:(ImageBuffer)buffer level:(int)level originX:(int)originX originY:(int)originY into:(NSMutableArray *)found {
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    NSArray *results = [self scanBuffer:buffer];
+    if (timed) {
+        _pyramidStatistics.levelMilliseconds[level] += BarcodeTimingNow() - started;
+    }
+    _pyramidStatistics.pixelsScanned += (unsigned long long)buffer.width * buffer.height;
+    
+    NSUInteger added = 0;
+    NSInteger i;
+    for (i = 0; i < results.count; i++) {
+        BarcodeResult *result = [results objectAtIndex:i];
+        mapResultPoints(result, level, originX, originY);
+        if (!isKnownResult(result, found)) {
+            [found addObject:result];
+            added++;
+        }
+    }
+    _pyramidStatistics.levelHits[level] += added;
+    return added;
+}
+
+// Coarse-to-fine decode: the coarsest level finds large symbols cheaply,
+// textured regions of the half-size level locate small ones for a
+// full-resolution look, and the whole frame is the last resort
+- (NSArray *)decodePyramidFromBuffer:(ImageBuffer)frame {
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    ImagePyramid pyramid = ImagePyramidCreate(frame, BarcodePyramidCoarsePixels);
+    if (pyramid.count < 2) {
+        ImagePyramidFree(&pyramid);
+        return [self scanBuffer:frame];
+    }
+    if (timed) {
+        double built = BarcodeTimingNow();
+        _pyramidStatistics.buildMilliseconds += built - started;
+        [self addConversionMilliseconds:built - started];
+    }
+    _pyramidStatistics.decodes++;
+    _pyramidStatistics.framePixels += (unsigned long long)frame.width * frame.height;
+    
+    NSMutableArray *found = [NSMutableArray array];
+    int coarsest = pyramid.count - 1;
+    [self scanBuffer:pyramid.levels[coarsest] level:coarsest originX:0 originY:0 into:found];
+    BOOL satisfied = _expectedSymbolCount > 0 && (NSInteger)found.count >= _expectedSymbolCount;
+    
+    if (!satisfied) {
+        // Regions are found on the half-size level and scanned at full resolution
+        started = timed ? BarcodeTimingNow() : 0.0;
+        ImageRegion regions[BarcodePyramidMaximumRegions];
+        int regionCount = ImageFindTexturedRegions(pyramid.levels[1], BarcodePyramidMinimumEnergy,
+                                                   BarcodePyramidMinimumTiles, regions, BarcodePyramidMaximumRegions);
+        long regionPixels = 0;
+        int i;
+        for (i = 0; i < regionCount; i++) {
+            ImageRegion region = regions[i];
+            regions[i].x = region.x * 2;
+            regions[i].y = region.y * 2;
+            regions[i].width = region.width * 2 < frame.width - regions[i].x ? region.width * 2 : frame.width - regions[i].x;
+            regions[i].height = region.height * 2 < frame.height - regions[i].y ? region.height * 2 : frame.height - regions[i].y;
+            regionPixels += (long)regions[i].width * regions[i].height;
+        }
+        if (timed) {
+            double searched = BarcodeTimingNow();
+            _pyramidStatistics.buildMilliseconds += searched - started;
+            [self addConversionMilliseconds:searched - started];
+        }
+        
+        BOOL wholeFrame = regionPixels > BarcodePyramidMaximumRegionShare * frame.width * frame.height;
+        for (i = 0; i < regionCount && !wholeFrame && !satisfied; i++) {
+            ImageRegion region = regions[i];
+            if (isRegionResolved(region, found)) {
+                continue;
+            }
+            ImageBuffer crop = ImageBufferWrap(frame.data + (size_t)region.y * frame.stride + region.x,
+                                               region.width, region.height, frame.stride);
+            [self scanBuffer:crop level:0 originX:region.x originY:region.y into:found];
+            _pyramidStatistics.regionsScanned++;
+            satisfied = _expectedSymbolCount > 0 && (NSInteger)found.count >= _expectedSymbolCount;
+        }
+        
+        if (!satisfied && (wholeFrame || found.count == 0)) {
+            [self scanBuffer:frame level:0 originX:0 originY:0 into:found];
+            _pyramidStatistics.fallbacks++;
+        }
+    }
+    if (satisfied) {
+        _pyramidStatistics.earlyExits++;
+    }
+    
+    ImagePyramidFree(&pyramid);
+    return found;
+}
+
 - (NSArray *)decodeBarcodesFromImage:(id)image {
     return [self decodeBarcodesFromImage:image originalInput:nil];
 }
@@ -184,139 +958,113 @@
     int height = (int)size.height;
     
     // Create bitmap context
+    [self resetTiming];
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
     CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-    unsigned char *rawData = (unsigned char *)malloc(width * height * 4);
+    unsigned char *rawData = (unsigned char *)ImageScratchAlloc((size_t)width * height * 4);
+    if (!rawData) {
+        return nil;
+    }
     CGContextRef context = CGBitmapContextCreate(rawData, width, height, 8, width * 4, colorSpace, kCGImageAlphaPremultipliedLast);
     CGColorSpaceRelease(colorSpace);
     
     // Draw image to context
     CGContextDrawImage(context, CGRectMake(0, 0, width, height), [uiImage CGImage]);
+    CGContextRelease(context);
+    double drawn = timed ? BarcodeTimingNow() : 0.0;
     
-    // Convert to grayscale
-    unsigned char *grayData = (unsigned char *)malloc(width * height);
-    int i;
-    for (i = 0; i < width * height; i++) {
-        unsigned char r = rawData[i * 4];
-        unsigned char g = rawData[i * 4 + 1];
-        unsigned char b = rawData[i * 4 + 2];
-        grayData[i] = (unsigned char)(0.299 * r + 0.587 * g + 0.114 * b);
+    NSArray *results = [self decodeBarcodesFromPixels:rawData width:width height:height stride:width * 4 format:ImagePixelFormatRGBA32 originalInput:originalInput];
+    if (timed) {
+        [self addConversionMilliseconds:drawn - started];
     }
+    ImageScratchFree(rawData);
+    return results;
+#else
+    // macOS/Linux/Windows: Convert NSImage to a grayscale buffer (ZBar needs Y800 format)
+    [self resetTiming];
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    ImageBuffer buffer = ImageBufferFromImage(image);
+    if (!ImageBufferIsValid(buffer)) {
+        return nil;
+    }
+    double converted = timed ? BarcodeTimingNow() : 0.0;
     
-    CGContextRelease(context);
-    free(rawData);
+    NSArray *results = [self decodeBarcodesFromBuffer:buffer originalInput:originalInput];
+    if (timed) {
+        [self addConversionMilliseconds:converted - started];
+    }
+    ImageBufferFree(&buffer);
+    return results;
+#endif
+}
+
+- (NSArray *)decodeBarcodesFromBuffer:(ImageBuffer)buffer originalInput:(NSString *)originalInput {
+    [self resetTiming];
     
-    // Use backend to decode
-    if (_backend && [_backend respondsToSelector:@selector(decodeBarcodesFromData:width:height:)]) {
-        NSArray *results = [_backend decodeBarcodesFromData:grayData width:(unsigned)width height:(unsigned)height];
-        
-        // Set original input for matching if provided
-        if (originalInput && results) {
-            NSInteger j;
-            for (j = 0; j < results.count; j++) {
-                BarcodeResult *result = [results objectAtIndex:j];
-                result.originalInput = originalInput;
-            }
-        }
-        
-        free(grayData);
-        return results;
+    // Check if backend is available
+    if (!_backend) {
+        return nil; // No backend available - caller should show error message
     }
     
-    free(grayData);
-    return nil;
-#else
-    // macOS/Linux/Windows: Convert NSImage to NSData (TIFF representation)
-    NSData *tiffData = [image TIFFRepresentation];
-    if (!tiffData) {
+    if (!ImageBufferIsValid(buffer)) {
         return nil;
     }
     
-    // Create bitmap image from TIFF data
-    NSBitmapImageRep *bitmapRep = [NSBitmapImageRep imageRepWithData:tiffData];
-    if (!bitmapRep) {
+    if (![_backend respondsToSelector:@selector(decodeBarcodesFromData:width:height:)]) {
         return nil;
     }
     
-    // Get raw pixel data
-    NSInteger width = [bitmapRep pixelsWide];
-    NSInteger height = [bitmapRep pixelsHigh];
-    NSInteger bitsPerPixel = [bitmapRep bitsPerPixel];
-    NSInteger bytesPerRow = [bitmapRep bytesPerRow];
-    
-    // Always convert to grayscale (ZBar needs Y800 format)
-    // Allocate our own buffer so we can safely pass it to ZBar
-    unsigned char *rawData = malloc(width * height);
-    if (!rawData) {
-        return nil;
+    NSArray *results;
+    if (_decodeStrategy == BarcodeDecodeStrategyPyramid &&
+        (long)buffer.width * buffer.height >= _pyramidMinimumPixels) {
+        results = [self decodePyramidFromBuffer:buffer];
+    } else {
+        results = [self scanBuffer:buffer];
     }
     
-    unsigned char *sourceData = (unsigned char *)[bitmapRep bitmapData];
-    BOOL needsConversion = YES;
-    
-    // Check if already grayscale
-    if (bitsPerPixel == 8 && [bitmapRep hasAlpha] == NO) {
-        // Copy grayscale data
-        NSInteger y;
-        for (y = 0; y < height; y++) {
-            memcpy(rawData + y * width, sourceData + y * bytesPerRow, width);
-        }
-        needsConversion = NO;
-    }
-    
-    if (needsConversion) {
-        // Convert to grayscale
-        NSInteger y, x;
-        for (y = 0; y < height; y++) {
-            for (x = 0; x < width; x++) {
-                NSInteger sourceIndex = y * bytesPerRow + x * (bitsPerPixel / 8);
-                NSInteger destIndex = y * width + x;
-                
-                if (bitsPerPixel == 32) {
-                    // RGBA - convert to grayscale
-                    unsigned char r = sourceData[sourceIndex];
-                    unsigned char g = sourceData[sourceIndex + 1];
-                    unsigned char b = sourceData[sourceIndex + 2];
-                    rawData[destIndex] = (unsigned char)(0.299 * r + 0.587 * g + 0.114 * b);
-                } else if (bitsPerPixel == 24) {
-                    // RGB - convert to grayscale
-                    unsigned char r = sourceData[sourceIndex];
-                    unsigned char g = sourceData[sourceIndex + 1];
-                    unsigned char b = sourceData[sourceIndex + 2];
-                    rawData[destIndex] = (unsigned char)(0.299 * r + 0.587 * g + 0.114 * b);
-                } else {
-                    rawData[destIndex] = sourceData[sourceIndex];
-                }
-            }
+    // Set original input for matching if provided
+    if (originalInput && results) {
+        NSInteger i;
+        for (i = 0; i < results.count; i++) {
+            BarcodeResult *result = [results objectAtIndex:i];
+            result.originalInput = originalInput;
         }
     }
     
-    // Use backend to decode (backend will handle memory management)
-    if (_backend && [_backend respondsToSelector:@selector(decodeBarcodesFromData:width:height:)]) {
-        NSArray *results = [_backend decodeBarcodesFromData:rawData width:(unsigned)width height:(unsigned)height];
-        
-        // Set original input for matching if provided
-        if (originalInput && results) {
-            NSInteger i;
-            for (i = 0; i < results.count; i++) {
-                BarcodeResult *result = [results objectAtIndex:i];
-                result.originalInput = originalInput;
-            }
-        }
-        
-        // Free the data after backend is done with it
-        // We allocated it, so we're responsible for freeing it
-        // The backend should NOT free it (we pass NULL as cleanup function to ZBar)
-        free(rawData);
-        return results;
+    return results;
+}
+
+- (NSArray *)decodeBarcodesFromPixels:(const unsigned char *)pixels width:(int)width height:(int)height stride:(int)stride format:(ImagePixelFormat)format originalInput:(NSString *)originalInput {
+    if (!_backend || !pixels) {
+        return nil;
     }
     
-    // No backend available - free the data we allocated
-    free(rawData);
-    return nil;
-#endif
+    // Grey frames need no conversion; the backend only reads the pixels
+    if (format == ImagePixelFormatGray8) {
+        ImageBuffer frame = ImageBufferWrap((unsigned char *)pixels, width, height, stride);
+        return [self decodeBarcodesFromBuffer:frame originalInput:originalInput];
+    }
+    
+    [self resetTiming];
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    ImageBuffer gray = ImageBufferFromPixels(pixels, width, height, stride, format);
+    if (!gray.data) {
+        return nil;
+    }
+    double converted = timed ? BarcodeTimingNow() : 0.0;
+    NSArray *results = [self decodeBarcodesFromBuffer:gray originalInput:originalInput];
+    if (timed) {
+        [self addConversionMilliseconds:converted - started];
+    }
+    ImageBufferFree(&gray);
+    return results;
 }
 
 - (NSArray *)decodeBarcodesFromImageData:(NSData *)imageData {
+    [self resetTiming];
     if (!imageData) {
         return nil;
     }
@@ -332,3 +1080,118 @@
 }
 
 @end
+
+@implementation BarcodeBackendRace
+
+- (instancetype)initWithDecoder:(BarcodeDecoder *)owner backends:(NSArray *)participants slots:(const NSUInteger *)participantSlots
+                           data:(unsigned char *)pixels width:(unsigned)pixelWidth height:(unsigned)pixelHeight copyData:(BOOL)copyData {
+    self = [super init];
+    if (self) {
+        decoder = [owner retain];
+        backends = [participants copy];
+        memcpy(slots, participantSlots, backends.count * sizeof(NSUInteger));
+        width = pixelWidth;
+        height = pixelHeight;
+        data = pixels;
+        if (copyData) {
+            // Without a copy the caller's pixels must outlive every
+            // participant, so the race then waits for all of them
+            unsigned char *copied = (unsigned char *)malloc((size_t)width * height);
+            if (copied) {
+                memcpy(copied, pixels, (size_t)width * height);
+                data = copied;
+                ownsData = YES;
+            }
+        }
+        condition = [[NSCondition alloc] init];
+        results = [[NSMutableArray alloc] initWithCapacity:backends.count];
+        NSUInteger i;
+        for (i = 0; i < backends.count; i++) {
+            [results addObject:[NSNull null]];
+        }
+        winner = -1;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (ownsData) {
+        free(data);
+    }
+    [results release];
+    [condition release];
+    [backends release];
+    [decoder release];
+    [super dealloc];
+}
+
+- (void)start {
+    NSUInteger i;
+    for (i = 0; i < backends.count; i++) {
+        [NSThread detachNewThreadSelector:@selector(runParticipant:)
+                                 toTarget:self
+                               withObject:[NSNumber numberWithUnsignedInteger:i]];
+    }
+}
+
+- (void)runParticipant:(NSNumber *)index {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger i = [index unsignedIntegerValue];
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    NSArray *found = [[backends objectAtIndex:i] decodeBarcodesFromData:data width:width height:height];
+    double milliseconds = timed ? BarcodeTimingNow() - started : -1.0;
+    
+    // Statistics first, so they are complete once the caller stops waiting
+    [condition lock];
+    BOOL abandoned = collected;
+    [condition unlock];
+    [decoder finishBackendSlot:slots[i] milliseconds:milliseconds found:found.count > 0 abandoned:abandoned];
+    
+    [condition lock];
+    if (found) {
+        [results replaceObjectAtIndex:i withObject:found];
+    }
+    if (found.count > 0 && winner < 0) {
+        winner = (NSInteger)i;
+    }
+    finished++;
+    [condition broadcast];
+    [condition unlock];
+    [pool release];
+}
+
+- (NSArray *)waitForFirstSuccess:(NSInteger *)winnerIndex {
+    [condition lock];
+    while (finished < backends.count && (winner < 0 || !ownsData)) {
+        [condition wait];
+    }
+    collected = YES;
+    NSArray *answer = nil;
+    if (winner >= 0) {
+        answer = [[[results objectAtIndex:(NSUInteger)winner] retain] autorelease];
+    } else {
+        NSUInteger i;
+        for (i = 0; i < results.count && !answer; i++) {
+            if ([results objectAtIndex:i] != [NSNull null]) {
+                answer = [NSArray array];
+            }
+        }
+    }
+    *winnerIndex = winner;
+    [condition unlock];
+    return answer;
+}
+
+- (NSArray *)waitForAll {
+    [condition lock];
+    while (finished < backends.count) {
+        [condition wait];
+    }
+    collected = YES;
+    NSArray *all = [[results copy] autorelease];
+    [condition unlock];
+    return all;
+}
+
+@end
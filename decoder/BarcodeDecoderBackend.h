@@ -26,4 +26,12 @@
 /// Name of the backend
 + (NSString *)backendName;
 
+@optional
+
+/// Restrict decoding to the given symbologies so the backend can skip
+/// decoders that cannot match
+/// @param symbologies Array of NSNumber symbology IDs (BarcodeEncoder IDs, i.e.
+///        ZInt BARCODE_* values), or nil to enable every symbology
+- (void)setEnabledSymbologies:(NSArray *)symbologies;
+
 @end
@@ -8,7 +8,19 @@
 #import <Foundation/Foundation.h>
 #import "BarcodeDecoderBackend.h"
 
+struct BarcodeZBarScannerPool;
+
 /// ZBar-based barcode decoder backend
-@interface BarcodeDecoderZBar : NSObject <BarcodeDecoderBackend>
+/// Image scanners are created once and kept in a pool: a decode borrows an idle
+/// scanner (creating one only when all are busy), so concurrent callers each
+/// end up with their own long-lived scanner. Safe to use from several threads.
+@interface BarcodeDecoderZBar : NSObject <BarcodeDecoderBackend, NSCopying> {
+    struct BarcodeZBarScannerPool *scannerPool; // Idle scanners and enabled symbologies
+}
+
+/// Restrict scanning to the given symbologies (ZInt BARCODE_* IDs). IDs ZBar
+/// cannot read are ignored; if none remain, every symbology stays enabled.
+/// @param symbologies Array of NSNumber symbology IDs, or nil for all
+- (void)setEnabledSymbologies:(NSArray *)symbologies;
 
 @end
@@ -6,8 +6,7 @@
 //
 
 #import "BarcodeDecoderZBar.h"
-#import "BarcodeDecoder.h"  // Contains BarcodeResult definition
-#import <string.h>
+#import "BarcodeDecoderZBarCommon.h"
 
 #if defined(HAVE_ZBAR) || __has_include(<zbar.h>)
 #import <zbar.h>
@@ -16,6 +15,34 @@
 #define ZBAR_AVAILABLE 0
 #endif
 
+#if ZBAR_AVAILABLE
+
+// libzbar's own entry points in the shared function table. The handle types
+// differ only in pointer type, so the casts keep the calling convention.
+static const BarcodeZBarFunctions zbarFunctions = {
+    (void *(*)(void))zbar_image_scanner_create,
+    (void (*)(void *))zbar_image_scanner_destroy,
+    (int (*)(void *, int, int, int))zbar_image_scanner_set_config,
+    (int (*)(void *, void *))zbar_scan_image,
+    (void *(*)(void))zbar_image_create,
+    (void (*)(void *))zbar_image_destroy,
+    (void (*)(void *, unsigned long))zbar_image_set_format,
+    (void (*)(void *, unsigned, unsigned))zbar_image_set_size,
+    (void (*)(void *, const void *, unsigned long, void (*)(void *)))zbar_image_set_data,
+    (const void *(*)(const void *))zbar_image_first_symbol,
+    (const void *(*)(const void *))zbar_symbol_next,
+    (int (*)(const void *))zbar_symbol_get_type,
+    (const char *(*)(const void *))zbar_symbol_get_data,
+    (unsigned (*)(const void *))zbar_symbol_get_data_length,
+    (int (*)(const void *))zbar_symbol_get_quality,
+    (unsigned (*)(const void *))zbar_symbol_get_loc_size,
+    (int (*)(const void *, unsigned))zbar_symbol_get_loc_x,
+    (int (*)(const void *, unsigned))zbar_symbol_get_loc_y,
+    (const char *(*)(int))zbar_get_symbol_name
+};
+
+#endif
+
 @implementation BarcodeDecoderZBar
 
 + (BOOL)isAvailable {
@@ -36,105 +63,42 @@
     return @"ZBar";
 }
 
-- (NSArray *)decodeBarcodesFromData:(unsigned char *)data width:(unsigned)width height:(unsigned)height {
-#if ZBAR_AVAILABLE
-    // Create ZBar image scanner
-    zbar_image_scanner_t *scanner = zbar_image_scanner_create();
-    if (!scanner) {
-        return nil;
-    }
-    
-    // Configure scanner to detect all symbologies
-    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_ENABLE, 1);
-    
-    // Create ZBar image
-    zbar_image_t *image = zbar_image_create();
-    if (!image) {
-        zbar_image_scanner_destroy(scanner);
-        return nil;
-    }
-    
-    zbar_image_set_format(image, zbar_fourcc('Y','8','0','0'));
-    zbar_image_set_size(image, width, height);
-    // Don't use zbar_image_free_data - we'll free the data ourselves after ZBar is done
-    // This prevents double-free errors since we allocated the data
-    zbar_image_set_data(image, data, width * height, NULL);
-    
-    // Scan the image
-    int n = zbar_scan_image(scanner, image);
-    
-    NSMutableArray *results = [NSMutableArray array];
-    
-    if (n > 0) {
-        // Get first symbol
-        const zbar_symbol_t *symbol = zbar_image_first_symbol(image);
-        
-        while (symbol) {
-            BarcodeResult *result = [[BarcodeResult alloc] init];
-            
-            // Get symbol data
-            zbar_symbol_type_t typ = zbar_symbol_get_type(symbol);
-            const char *symbolData = zbar_symbol_get_data(symbol);
-            
-            if (symbolData) {
-                result.data = [NSString stringWithUTF8String:symbolData];
-                if (!result.data) {
-                    // Fallback: create string from raw bytes
-                    unsigned int dataLength = zbar_symbol_get_data_length(symbol);
-                    result.data = [[NSString alloc] initWithBytes:symbolData length:dataLength encoding:NSUTF8StringEncoding];
-                    if (!result.data) {
-                        result.data = [[NSString alloc] initWithBytes:symbolData length:dataLength encoding:NSISOLatin1StringEncoding];
-                    }
-                }
-            } else {
-                result.data = @"";
-            }
-            
-            const char *typeName = zbar_get_symbol_name(typ);
-            result.type = typeName ? [NSString stringWithUTF8String:typeName] : @"Unknown";
-            
-            // Get quality score (ZBar quality is typically 0-100, but can vary)
-            // zbar_symbol_get_quality returns an integer quality metric
-            int zbarQuality = zbar_symbol_get_quality(symbol);
-            // ZBar quality can be negative or very high, normalize to 0-100 range
-            if (zbarQuality >= 0) {
-                // Clamp to 0-100 range (ZBar may return values outside this)
-                if (zbarQuality > 100) {
-                    result.quality = 100;
-                } else {
-                    result.quality = zbarQuality;
-                }
-            } else {
-                result.quality = -1; // Quality not available
-            }
-            
-            // Get symbol location points
-            NSMutableArray *points = [NSMutableArray array];
-            int pointCount = zbar_symbol_get_loc_size(symbol);
-            int i;
-            for (i = 0; i < pointCount; i++) {
-                int x = zbar_symbol_get_loc_x(symbol, i);
-                int y = zbar_symbol_get_loc_y(symbol, i);
-                NSRect rect = NSMakeRect(x, y, 0, 0);
-                [points addObject:[NSValue valueWithRect:rect]];
-            }
-            result.points = points;
-            
-            [results addObject:result];
-            [result release];
-            
-            // Get next symbol
-            symbol = zbar_symbol_next(symbol);
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        scannerPool = BarcodeZBarScannerPoolCreate();
+        if (!scannerPool) {
+            [self release];
+            return nil;
         }
     }
-    
-    // Cleanup
-    // Note: We don't free 'data' here because it's owned by the caller (BarcodeDecoder)
-    // The caller will free it after we return
-    zbar_image_destroy(image);
-    zbar_image_scanner_destroy(scanner);
-    
-    return results.count > 0 ? results : nil;
+    return self;
+}
+
+- (void)dealloc {
+#if ZBAR_AVAILABLE
+    BarcodeZBarScannerPoolDestroy(scannerPool, &zbarFunctions);
+#else
+    BarcodeZBarScannerPoolDestroy(scannerPool, NULL);
+#endif
+    [super dealloc];
+}
+
+- (void)setEnabledSymbologies:(NSArray *)symbologies {
+    BarcodeZBarScannerPoolSetSymbologies(scannerPool, symbologies);
+}
+
+// A copy gets its own scanner pool, set up for the same symbologies
+- (id)copyWithZone:(NSZone *)zone {
+    BarcodeDecoderZBar *copy = [[[self class] allocWithZone:zone] init];
+    [copy setEnabledSymbologies:BarcodeZBarScannerPoolSymbologies(scannerPool)];
+    return copy;
+}
+
+- (NSArray *)decodeBarcodesFromData:(unsigned char *)data width:(unsigned)width height:(unsigned)height {
+#if ZBAR_AVAILABLE
+    // Borrow a pooled scanner, already configured for the enabled symbologies
+    return BarcodeZBarScanGray(scannerPool, &zbarFunctions, data, width, height);
 #else
     return nil;
 #endif
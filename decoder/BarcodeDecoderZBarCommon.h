@@ -0,0 +1,92 @@
+//
+//  BarcodeDecoderZBarCommon.h
+//  SmallBarcodeReader
+//
+//  Scanner pool, symbology mapping and result building shared by the
+//  linked and the dlsym ZBar backends
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// ZBar entry points the backends call; handles are opaque. The linked
+/// backend fills this from libzbar's own symbols, the dynamic one via dlsym.
+typedef struct {
+    void *(*imageScannerCreate)(void);
+    void (*imageScannerDestroy)(void *scanner);
+    int (*imageScannerSetConfig)(void *scanner, int symbolType, int config, int value);
+    int (*scanImage)(void *scanner, void *image);
+    void *(*imageCreate)(void);
+    void (*imageDestroy)(void *image);
+    void (*imageSetFormat)(void *image, unsigned long format);
+    void (*imageSetSize)(void *image, unsigned width, unsigned height);
+    void (*imageSetData)(void *image, const void *data, unsigned long length, void (*cleanup)(void *image));
+    const void *(*imageFirstSymbol)(const void *image);
+    const void *(*symbolNext)(const void *symbol);
+    int (*symbolGetType)(const void *symbol);
+    const char *(*symbolGetData)(const void *symbol);
+    unsigned (*symbolGetDataLength)(const void *symbol);
+    int (*symbolGetQuality)(const void *symbol);
+    unsigned (*symbolGetLocSize)(const void *symbol);
+    int (*symbolGetLocX)(const void *symbol, unsigned index);
+    int (*symbolGetLocY)(const void *symbol, unsigned index);
+    const char *(*getSymbolName)(int symbolType);
+} BarcodeZBarFunctions;
+
+/// A scanner and the configuration generation it was last set up for
+typedef struct {
+    void *scanner; // zbar_image_scanner_t
+    unsigned long generation;
+} BarcodeZBarPooledScanner;
+
+/// Idle scanners of one backend plus the symbologies they should scan for.
+/// A decode borrows an idle scanner (creating one only when all are busy),
+/// so concurrent callers each end up with their own long-lived scanner.
+typedef struct BarcodeZBarScannerPool {
+    BarcodeZBarPooledScanner *idle;
+    NSUInteger count;
+    NSUInteger capacity;
+    NSArray *enabledSymbologies;    // nil = all
+    unsigned long configGeneration; // Bumped whenever enabledSymbologies changes
+    pthread_mutex_t lock;           // Guards every field above
+} BarcodeZBarScannerPool;
+
+/// ZBar types that read a ZInt symbology
+/// @param symbology ZInt BARCODE_* ID
+/// @param types Receives up to two zbar_symbol_type_t values
+/// @return Number of types written (0 if ZBar cannot read the symbology)
+int BarcodeZBarTypesForSymbology(int symbology, int *types);
+
+/// Create an empty pool
+/// @return Pool, or NULL if out of memory
+BarcodeZBarScannerPool *BarcodeZBarScannerPoolCreate(void);
+
+/// Destroy the idle scanners and free the pool
+/// @param pool Pool (NULL is ignored)
+/// @param zbar Functions the scanners were made with; may be NULL if none were
+void BarcodeZBarScannerPoolDestroy(BarcodeZBarScannerPool *pool, const BarcodeZBarFunctions *zbar);
+
+/// Restrict scanning to the given symbologies; idle scanners are
+/// reconfigured the next time they are borrowed
+/// @param pool Pool
+/// @param symbologies Array of NSNumber ZInt IDs, or nil for all
+void BarcodeZBarScannerPoolSetSymbologies(BarcodeZBarScannerPool *pool, NSArray *symbologies);
+
+/// Symbologies the pool's scanners are set up for
+/// @param pool Pool
+/// @return Array of NSNumber ZInt IDs, or nil for all
+NSArray *BarcodeZBarScannerPoolSymbologies(BarcodeZBarScannerPool *pool);
+
+/// Scan an 8-bit grayscale image with a borrowed scanner
+/// @param pool Pool to borrow from and return to
+/// @param zbar ZBar functions
+/// @param data width * height bytes; still owned by the caller afterwards
+/// @param width Image width
+/// @param height Image height
+/// @return Array of BarcodeResult, or nil if nothing was found
+NSArray *BarcodeZBarScanGray(BarcodeZBarScannerPool *pool, const BarcodeZBarFunctions *zbar,
+                             unsigned char *data, unsigned width, unsigned height);
+
+NS_ASSUME_NONNULL_END
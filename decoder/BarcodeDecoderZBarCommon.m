@@ -0,0 +1,274 @@
+//
+//  BarcodeDecoderZBarCommon.m
+//  SmallBarcodeReader
+//
+//  Scanner pool, symbology mapping and result building shared by the
+//  ZBar backends
+//
+
+#import "BarcodeDecoderZBarCommon.h"
+#import "BarcodeDecoder.h"  // Contains BarcodeResult definition
+#import <stdlib.h>
+#import <string.h>
+
+// zbar_symbol_type_t values (part of ZBar's ABI, unchanged since 0.10)
+enum {
+    ZBarTypeEAN8 = 8,
+    ZBarTypeUPCE = 9,
+    ZBarTypeUPCA = 12,
+    ZBarTypeEAN13 = 13,
+    ZBarTypeISBN13 = 14,
+    ZBarTypeI25 = 25,
+    ZBarTypeDataBar = 34,
+    ZBarTypeDataBarExpanded = 35,
+    ZBarTypeCodabar = 38,
+    ZBarTypeCode39 = 39,
+    ZBarTypePDF417 = 57,
+    ZBarTypeQRCode = 64,
+    ZBarTypeCode93 = 93,
+    ZBarTypeCode128 = 128
+};
+
+#define ZBarConfigEnable 0 // ZBAR_CFG_ENABLE
+#define ZBarFormatY800 ((unsigned long)'Y' | ((unsigned long)'8' << 8) | \
+                        ((unsigned long)'0' << 16) | ((unsigned long)'0' << 24))
+
+// ZInt symbology IDs (as used by BarcodeEncoder) to the ZBar types that read them
+int BarcodeZBarTypesForSymbology(int symbology, int *types) {
+    switch (symbology) {
+        case 20: // BARCODE_CODE128
+        case 16: // BARCODE_GS1_128
+            types[0] = ZBarTypeCode128;
+            return 1;
+        case 8:  // BARCODE_CODE39
+        case 9:  // BARCODE_EXCODE39
+            types[0] = ZBarTypeCode39;
+            return 1;
+        case 25: // BARCODE_CODE93
+            types[0] = ZBarTypeCode93;
+            return 1;
+        case 18: // BARCODE_CODABAR
+            types[0] = ZBarTypeCodabar;
+            return 1;
+        case 3:  // BARCODE_C25INTER
+            types[0] = ZBarTypeI25;
+            return 1;
+        case 13: // BARCODE_EANX
+        case 14: // BARCODE_EANX_CHK
+            types[0] = ZBarTypeEAN13;
+            types[1] = ZBarTypeEAN8;
+            return 2;
+        case 69: // BARCODE_ISBNX
+            types[0] = ZBarTypeISBN13;
+            types[1] = ZBarTypeEAN13;
+            return 2;
+        case 34: // BARCODE_UPCA
+        case 35: // BARCODE_UPCA_CHK
+            // ZBar's EAN decoder finds UPC-A; keep EAN-13 as its fallback report
+            types[0] = ZBarTypeUPCA;
+            types[1] = ZBarTypeEAN13;
+            return 2;
+        case 37: // BARCODE_UPCE
+        case 38: // BARCODE_UPCE_CHK
+            types[0] = ZBarTypeUPCE;
+            return 1;
+        case 29: // BARCODE_DBAR_OMN
+            types[0] = ZBarTypeDataBar;
+            return 1;
+        case 31: // BARCODE_DBAR_EXP
+            types[0] = ZBarTypeDataBarExpanded;
+            return 1;
+        case 55: // BARCODE_PDF417
+        case 56: // BARCODE_PDF417COMP
+            types[0] = ZBarTypePDF417;
+            return 1;
+        case 58: // BARCODE_QRCODE
+            types[0] = ZBarTypeQRCode;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void configureScanner(const BarcodeZBarFunctions *zbar, void *scanner, NSArray *symbologies) {
+    int types[64];
+    int typeCount = 0;
+    NSInteger i;
+    for (i = 0; i < symbologies.count && typeCount <= 62; i++) {
+        typeCount += BarcodeZBarTypesForSymbology([[symbologies objectAtIndex:i] intValue], types + typeCount);
+    }
+
+    if (typeCount == 0) {
+        // Nothing ZBar can target (or no restriction): scan for everything
+        zbar->imageScannerSetConfig(scanner, 0, ZBarConfigEnable, 1);
+        return;
+    }
+
+    zbar->imageScannerSetConfig(scanner, 0, ZBarConfigEnable, 0);
+    int t;
+    for (t = 0; t < typeCount; t++) {
+        zbar->imageScannerSetConfig(scanner, types[t], ZBarConfigEnable, 1);
+    }
+}
+
+BarcodeZBarScannerPool *BarcodeZBarScannerPoolCreate(void) {
+    BarcodeZBarScannerPool *pool = (BarcodeZBarScannerPool *)calloc(1, sizeof(BarcodeZBarScannerPool));
+    if (pool) {
+        pthread_mutex_init(&pool->lock, NULL);
+    }
+    return pool;
+}
+
+void BarcodeZBarScannerPoolDestroy(BarcodeZBarScannerPool *pool, const BarcodeZBarFunctions *zbar) {
+    if (!pool) {
+        return;
+    }
+    // Scanners only exist once a function table was available to make them
+    NSUInteger i;
+    for (i = 0; zbar && i < pool->count; i++) {
+        zbar->imageScannerDestroy(pool->idle[i].scanner);
+    }
+    free(pool->idle);
+    [pool->enabledSymbologies release];
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+void BarcodeZBarScannerPoolSetSymbologies(BarcodeZBarScannerPool *pool, NSArray *symbologies) {
+    NSArray *copied = [symbologies copy];
+    pthread_mutex_lock(&pool->lock);
+    [pool->enabledSymbologies release];
+    pool->enabledSymbologies = copied;
+    pool->configGeneration++;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+NSArray *BarcodeZBarScannerPoolSymbologies(BarcodeZBarScannerPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    NSArray *symbologies = [[pool->enabledSymbologies retain] autorelease];
+    pthread_mutex_unlock(&pool->lock);
+    return symbologies;
+}
+
+// Borrow an idle scanner (or create one) configured for the current symbologies
+static BarcodeZBarPooledScanner acquireScanner(BarcodeZBarScannerPool *pool, const BarcodeZBarFunctions *zbar) {
+    BarcodeZBarPooledScanner pooled = {NULL, 0};
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count > 0) {
+        pooled = pool->idle[--pool->count];
+    }
+    unsigned long generation = pool->configGeneration;
+    NSArray *symbologies = [pool->enabledSymbologies retain];
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!pooled.scanner) {
+        pooled.scanner = zbar->imageScannerCreate();
+        if (!pooled.scanner) {
+            [symbologies release];
+            return pooled;
+        }
+        configureScanner(zbar, pooled.scanner, symbologies);
+        pooled.generation = generation;
+    } else if (pooled.generation != generation) {
+        configureScanner(zbar, pooled.scanner, symbologies);
+        pooled.generation = generation;
+    }
+
+    [symbologies release];
+    return pooled;
+}
+
+// Return a scanner to the pool for the next decode
+static void releaseScanner(BarcodeZBarScannerPool *pool, const BarcodeZBarFunctions *zbar, BarcodeZBarPooledScanner pooled) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == pool->capacity) {
+        NSUInteger capacity = pool->capacity > 0 ? pool->capacity * 2 : 4;
+        BarcodeZBarPooledScanner *idle = (BarcodeZBarPooledScanner *)realloc(pool->idle, capacity * sizeof(BarcodeZBarPooledScanner));
+        if (!idle) {
+            pthread_mutex_unlock(&pool->lock);
+            zbar->imageScannerDestroy(pooled.scanner);
+            return;
+        }
+        pool->idle = idle;
+        pool->capacity = capacity;
+    }
+    pool->idle[pool->count++] = pooled;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// One decoded symbol as a BarcodeResult
+static BarcodeResult *resultForSymbol(const BarcodeZBarFunctions *zbar, const void *symbol) {
+    BarcodeResult *result = [[BarcodeResult alloc] init];
+
+    const char *symbolData = zbar->symbolGetData(symbol);
+    if (symbolData) {
+        result.data = [NSString stringWithUTF8String:symbolData];
+        if (!result.data) {
+            // Not UTF-8 (or embedded NULs): fall back to the raw bytes
+            unsigned dataLength = zbar->symbolGetDataLength(symbol);
+            result.data = [[[NSString alloc] initWithBytes:symbolData length:dataLength encoding:NSUTF8StringEncoding] autorelease];
+            if (!result.data) {
+                result.data = [[[NSString alloc] initWithBytes:symbolData length:dataLength encoding:NSISOLatin1StringEncoding] autorelease];
+            }
+        }
+    } else {
+        result.data = @"";
+    }
+
+    const char *typeName = zbar->getSymbolName(zbar->symbolGetType(symbol));
+    result.type = typeName ? [NSString stringWithUTF8String:typeName] : @"Unknown";
+
+    // ZBar quality is unbounded; clamp to 0-100, -1 when not reported
+    int zbarQuality = zbar->symbolGetQuality(symbol);
+    if (zbarQuality >= 0) {
+        result.quality = zbarQuality > 100 ? 100 : zbarQuality;
+    } else {
+        result.quality = -1;
+    }
+
+    NSMutableArray *points = [NSMutableArray array];
+    unsigned pointCount = zbar->symbolGetLocSize(symbol);
+    unsigned i;
+    for (i = 0; i < pointCount; i++) {
+        NSRect rect = NSMakeRect(zbar->symbolGetLocX(symbol, i), zbar->symbolGetLocY(symbol, i), 0, 0);
+        [points addObject:[NSValue valueWithRect:rect]];
+    }
+    result.points = points;
+
+    return [result autorelease];
+}
+
+NSArray *BarcodeZBarScanGray(BarcodeZBarScannerPool *pool, const BarcodeZBarFunctions *zbar,
+                             unsigned char *data, unsigned width, unsigned height) {
+    BarcodeZBarPooledScanner pooled = acquireScanner(pool, zbar);
+    if (!pooled.scanner) {
+        return nil;
+    }
+
+    void *image = zbar->imageCreate();
+    if (!image) {
+        releaseScanner(pool, zbar, pooled);
+        return nil;
+    }
+
+    zbar->imageSetFormat(image, ZBarFormatY800);
+    zbar->imageSetSize(image, width, height);
+    // No cleanup handler: the caller owns data and frees it after we return
+    zbar->imageSetData(image, data, (unsigned long)width * height, NULL);
+
+    int n = zbar->scanImage(pooled.scanner, image);
+
+    NSMutableArray *results = [NSMutableArray array];
+    if (n > 0) {
+        const void *symbol;
+        for (symbol = zbar->imageFirstSymbol(image); symbol; symbol = zbar->symbolNext(symbol)) {
+            [results addObject:resultForSymbol(zbar, symbol)];
+        }
+    }
+
+    zbar->imageDestroy(image);
+    releaseScanner(pool, zbar, pooled);
+
+    return results.count > 0 ? results : nil;
+}
@@ -0,0 +1,41 @@
+//
+//  BarcodeDecoderZBarDynamic.h
+//  SmallBarcodeReader
+//
+//  ZBar decoder that reaches libzbar through dlsym at run time
+//
+
+#import <Foundation/Foundation.h>
+#import "BarcodeDecoderBackend.h"
+
+@class DynamicLibrary;
+
+struct BarcodeZBarScannerPool;
+
+/// ZBar decoder backend that needs neither zbar.h nor -lzbar at build time.
+/// The ZBar entry points it calls are resolved once per process into a
+/// function table. A backend made with init only opens libzbar (found through
+/// DynamicLibraryLoader's probe index) on its first decode; one made with
+/// initWithLibrary: uses a library the caller already loaded. Scanners are
+/// pooled as in BarcodeDecoderZBar. Safe to use from several threads.
+@interface BarcodeDecoderZBarDynamic : NSObject <BarcodeDecoderBackend, NSCopying> {
+    struct BarcodeZBarScannerPool *scannerPool; // Idle scanners and enabled symbologies
+}
+
+/// Backend bound to a loaded library; its ZBar functions are resolved now.
+/// Once a library is bound, a later one is only checked for
+/// zbar_image_scanner_create and the first library's table is used.
+/// @param library Loaded dynamic library containing ZBar
+/// @return Backend, or nil if the library lacks a function the decoder calls
+- (instancetype)initWithLibrary:(DynamicLibrary *)library;
+
+/// Whether the ZBar function table has been resolved in this process
+/// @return YES once a library has been opened and bound
++ (BOOL)isLoaded;
+
+/// Restrict scanning to the given symbologies (ZInt BARCODE_* IDs). IDs ZBar
+/// cannot read are ignored; if none remain, every symbology stays enabled.
+/// @param symbologies Array of NSNumber symbology IDs, or nil for all
+- (void)setEnabledSymbologies:(NSArray *)symbologies;
+
+@end
@@ -0,0 +1,171 @@
+//
+//  BarcodeDecoderZBarDynamic.m
+//  SmallBarcodeReader
+//
+//  ZBar decoder that reaches libzbar through dlsym at run time
+//
+
+#import "BarcodeDecoderZBarDynamic.h"
+#import "BarcodeDecoderZBarCommon.h"
+#import "DynamicLibraryLoader.h"
+#import <pthread.h>
+#import <stddef.h>
+
+// The ZBar entry points the decoder calls, by symbol name
+static const struct {
+    const char *name;
+    size_t offset;
+} zbarSymbols[] = {
+    {"zbar_image_scanner_create", offsetof(BarcodeZBarFunctions, imageScannerCreate)},
+    {"zbar_image_scanner_destroy", offsetof(BarcodeZBarFunctions, imageScannerDestroy)},
+    {"zbar_image_scanner_set_config", offsetof(BarcodeZBarFunctions, imageScannerSetConfig)},
+    {"zbar_scan_image", offsetof(BarcodeZBarFunctions, scanImage)},
+    {"zbar_image_create", offsetof(BarcodeZBarFunctions, imageCreate)},
+    {"zbar_image_destroy", offsetof(BarcodeZBarFunctions, imageDestroy)},
+    {"zbar_image_set_format", offsetof(BarcodeZBarFunctions, imageSetFormat)},
+    {"zbar_image_set_size", offsetof(BarcodeZBarFunctions, imageSetSize)},
+    {"zbar_image_set_data", offsetof(BarcodeZBarFunctions, imageSetData)},
+    {"zbar_image_first_symbol", offsetof(BarcodeZBarFunctions, imageFirstSymbol)},
+    {"zbar_symbol_next", offsetof(BarcodeZBarFunctions, symbolNext)},
+    {"zbar_symbol_get_type", offsetof(BarcodeZBarFunctions, symbolGetType)},
+    {"zbar_symbol_get_data", offsetof(BarcodeZBarFunctions, symbolGetData)},
+    {"zbar_symbol_get_data_length", offsetof(BarcodeZBarFunctions, symbolGetDataLength)},
+    {"zbar_symbol_get_quality", offsetof(BarcodeZBarFunctions, symbolGetQuality)},
+    {"zbar_symbol_get_loc_size", offsetof(BarcodeZBarFunctions, symbolGetLocSize)},
+    {"zbar_symbol_get_loc_x", offsetof(BarcodeZBarFunctions, symbolGetLocX)},
+    {"zbar_symbol_get_loc_y", offsetof(BarcodeZBarFunctions, symbolGetLocY)},
+    {"zbar_get_symbol_name", offsetof(BarcodeZBarFunctions, getSymbolName)}
+};
+
+// Process-wide binding, made once; the bound library is never closed
+static BarcodeZBarFunctions zbarFunctions;
+static DynamicLibrary *zbarLibrary = nil;
+static int zbarState = 0; // 0 = not tried yet, 1 = bound, -1 = could not load
+static pthread_mutex_t zbarMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Resolve every entry point from library into the shared table (zbarMutex held)
+static BOOL bindZBarFunctions(DynamicLibrary *library) {
+    BarcodeZBarFunctions resolved;
+    size_t i;
+    for (i = 0; i < sizeof(zbarSymbols) / sizeof(zbarSymbols[0]); i++) {
+        void *symbol = [DynamicLibraryLoader getSymbol:[NSString stringWithUTF8String:zbarSymbols[i].name]
+                                           fromLibrary:library];
+        if (!symbol) {
+            NSLog(@"ZBar: %@ lacks %s", library.path, zbarSymbols[i].name);
+            return NO;
+        }
+        *(void **)((char *)&resolved + zbarSymbols[i].offset) = symbol;
+    }
+    zbarFunctions = resolved;
+    zbarLibrary = [library retain];
+    zbarState = 1;
+    return YES;
+}
+
+// The shared table, opening libzbar on the first call; NULL if it cannot be loaded
+static const BarcodeZBarFunctions *loadZBarFunctions(void) {
+    pthread_mutex_lock(&zbarMutex);
+    if (zbarState == 0) {
+        zbarState = -1;
+        NSString *path = [DynamicLibraryLoader findLibrary:@"zbar"];
+        NSError *error = nil;
+        DynamicLibrary *library = path ? [DynamicLibraryLoader loadLibraryAtPath:path error:&error] : nil;
+        if (!library) {
+            NSLog(@"ZBar: could not load libzbar%@%@", error ? @": " : @"", error ? [error localizedDescription] : @"");
+        } else {
+            bindZBarFunctions(library);
+        }
+    }
+    const BarcodeZBarFunctions *functions = zbarState == 1 ? &zbarFunctions : NULL;
+    pthread_mutex_unlock(&zbarMutex);
+    return functions;
+}
+
+@implementation BarcodeDecoderZBarDynamic
+
++ (BOOL)isAvailable {
+    pthread_mutex_lock(&zbarMutex);
+    int state = zbarState;
+    pthread_mutex_unlock(&zbarMutex);
+    if (state != 0) {
+        return state == 1;
+    }
+    // Not opened yet: a library on the search path is enough
+    return [DynamicLibraryLoader findLibrary:@"zbar"] != nil;
+}
+
++ (BOOL)isLoaded {
+    pthread_mutex_lock(&zbarMutex);
+    BOOL loaded = zbarState == 1;
+    pthread_mutex_unlock(&zbarMutex);
+    return loaded;
+}
+
++ (NSString *)backendName {
+    return @"ZBar";
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        scannerPool = BarcodeZBarScannerPoolCreate();
+        if (!scannerPool) {
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (instancetype)initWithLibrary:(DynamicLibrary *)library {
+    self = [self init];
+    if (self) {
+        // The first library bound serves every instance; a later one must
+        // still be ZBar, so it has to export the scanner constructor
+        pthread_mutex_lock(&zbarMutex);
+        BOOL bound;
+        if (zbarState == 1) {
+            bound = library == zbarLibrary ||
+                [DynamicLibraryLoader getSymbol:@"zbar_image_scanner_create" fromLibrary:library] != NULL;
+            if (!bound) {
+                NSLog(@"ZBar: %@ lacks zbar_image_scanner_create", library.path);
+            }
+        } else {
+            bound = bindZBarFunctions(library);
+        }
+        pthread_mutex_unlock(&zbarMutex);
+        if (!bound) {
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    // Scanners only exist once the table is bound
+    BarcodeZBarScannerPoolDestroy(scannerPool, &zbarFunctions);
+    [super dealloc];
+}
+
+- (void)setEnabledSymbologies:(NSArray *)symbologies {
+    BarcodeZBarScannerPoolSetSymbologies(scannerPool, symbologies);
+}
+
+// A copy gets its own scanner pool, set up for the same symbologies
+- (id)copyWithZone:(NSZone *)zone {
+    BarcodeDecoderZBarDynamic *copy = [[[self class] allocWithZone:zone] init];
+    [copy setEnabledSymbologies:BarcodeZBarScannerPoolSymbologies(scannerPool)];
+    return copy;
+}
+
+- (NSArray *)decodeBarcodesFromData:(unsigned char *)data width:(unsigned)width height:(unsigned)height {
+    // The first decode in the process opens libzbar
+    const BarcodeZBarFunctions *zbar = loadZBarFunctions();
+    if (!zbar) {
+        return nil;
+    }
+    return BarcodeZBarScanGray(scannerPool, zbar, data, width, height);
+}
+
+@end
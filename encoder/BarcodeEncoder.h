@@ -7,6 +7,7 @@
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
+#import "ImageBuffer.h"
 
 @protocol BarcodeEncoderBackend;
 
@@ -22,7 +23,10 @@ extern NSString * const BarcodeEncoderOptionForegroundColor;
 extern NSString * const BarcodeEncoderOptionBackgroundColor;
 
 /// Generic barcode encoder supporting multiple backends
-@interface BarcodeEncoder : NSObject {
+/// Copies drive their own backend instances, so each thread can use its own
+/// copy without sharing backend state. Backends that adopt NSCopying are
+/// copied with their configuration; others are re-created with init.
+@interface BarcodeEncoder : NSObject <NSCopying> {
     id _backend; // id<BarcodeEncoderBackend>
     NSMutableArray *_dynamicBackends; // Array of dynamically loaded backends
 }
@@ -56,6 +60,14 @@ extern NSString * const BarcodeEncoderOptionBackgroundColor;
 /// @return NSImage containing the encoded barcode, or nil on error
 - (NSImage *)encodeBarcodeFromData:(NSString *)data symbology:(int)symbology;
 
+/// Encode barcode into a grayscale buffer
+/// Uses the backend's in-memory renderer when it has one, otherwise converts its image.
+/// @param data The text data to encode
+/// @param symbology Barcode symbology/type identifier
+/// @param options Dictionary of encoding options (size, error correction, etc.)
+/// @return Grayscale buffer (must be freed with ImageBufferFree), or invalid buffer on error
+- (ImageBuffer)encodeBufferFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options;
+
 /// Get list of supported symbologies from current backend
 /// @return Array of dictionaries with keys: "id" (int), "name" (NSString), "description" (NSString)
 - (NSArray *)supportedSymbologies;
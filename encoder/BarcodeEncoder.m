@@ -97,6 +97,37 @@ NSString * const BarcodeEncoderOptionBackgroundColor = @"backgroundColor";
     return all;
 }
 
+// New backend for a copy: backends keep per-instance state, so each copy
+// gets its own. One that adopts NSCopying copies its configuration along;
+// any other is a fresh instance of the same class.
+static id copyBackend(id backend) {
+    if ([backend conformsToProtocol:@protocol(NSCopying)]) {
+        return [backend copy];
+    }
+    return [[[backend class] alloc] init];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    id backend = _backend ? copyBackend(_backend) : nil;
+    BarcodeEncoder *copy = [[[self class] allocWithZone:zone] initWithBackend:backend];
+    [backend release];
+    
+    NSInteger i;
+    for (i = 0; i < _dynamicBackends.count; i++) {
+        id dynamicBackend = [_dynamicBackends objectAtIndex:i];
+        if (dynamicBackend == _backend) {
+            continue; // Already copied above
+        }
+        id freshBackend = copyBackend(dynamicBackend);
+        if (freshBackend) {
+            [copy registerDynamicBackend:freshBackend];
+            [freshBackend release];
+        }
+    }
+    
+    return copy;
+}
+
 - (NSString *)backendName {
     if (_backend && [_backend respondsToSelector:@selector(backendName)]) {
         return [_backend performSelector:@selector(backendName)];
@@ -130,6 +161,27 @@ NSString * const BarcodeEncoderOptionBackgroundColor = @"backgroundColor";
     return [self encodeBarcodeFromData:data symbology:symbology options:nil];
 }
 
+- (ImageBuffer)encodeBufferFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+    ImageBuffer buffer = {NULL, 0, 0, 0, 0};
+    
+    // Check if backend is available
+    if (!_backend || !data || data.length == 0) {
+        return buffer;
+    }
+    
+    // Prefer the backend's in-memory renderer
+    if ([_backend respondsToSelector:@selector(encodeBufferFromData:symbology:options:)]) {
+        return [_backend encodeBufferFromData:data symbology:symbology options:options];
+    }
+    
+    // Fall back to converting the backend's image
+    NSImage *image = [self encodeBarcodeFromData:data symbology:symbology options:options];
+    if (image) {
+        buffer = ImageBufferFromImage(image);
+    }
+    return buffer;
+}
+
 - (NSArray *)supportedSymbologies {
     if (_backend) {
         // Try instance method first
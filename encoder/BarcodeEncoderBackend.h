@@ -7,6 +7,7 @@
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
+#import "ImageBuffer.h"
 
 /// Protocol that barcode encoder backends must implement
 @protocol BarcodeEncoderBackend <NSObject>
@@ -28,4 +29,13 @@
 /// Name of the backend
 + (NSString *)backendName;
 
+@optional
+
+/// Encode barcode straight into memory, without files or image codecs
+/// @param data The text data to encode
+/// @param symbology Barcode symbology/type identifier (backend-specific)
+/// @param options Dictionary of encoding options (size, error correction, etc.)
+/// @return Grayscale buffer (must be freed with ImageBufferFree), or invalid buffer on error
+- (ImageBuffer)encodeBufferFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options;
+
 @end
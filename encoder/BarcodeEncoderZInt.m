@@ -6,7 +6,7 @@
 //
 
 #import "BarcodeEncoderZInt.h"
-#import "../SmallStep/SmallStep/Core/SmallStep.h"
+#import "ImagePixelFormat.h"
 #import <string.h>
 
 #if defined(HAVE_ZINT) || __has_include(<zint.h>)
@@ -111,16 +111,18 @@
     return symbologies;
 }
 
-- (NSImage *)encodeBarcodeFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
 #if ZINT_AVAILABLE
+// Encode and rasterize a symbol in memory (ZBarcode_Buffer fills symbol->bitmap
+// with RGB triplets). Returns NULL on error; caller deletes the symbol.
+static struct zint_symbol *renderSymbol(NSString *data, int symbology, NSDictionary *options) {
     if (!data || data.length == 0) {
-        return nil;
+        return NULL;
     }
     
     // Create ZInt symbol
     struct zint_symbol *symbol = ZBarcode_Create();
     if (!symbol) {
-        return nil;
+        return NULL;
     }
     
     // Set symbology
@@ -182,42 +184,75 @@
     // Encode the barcode
     const char *dataUTF8 = [data UTF8String];
     int error = ZBarcode_Encode(symbol, (const unsigned char *)dataUTF8, 0);
-    
     if (error != 0) {
         // Encoding failed
         ZBarcode_Delete(symbol);
-        return nil;
+        return NULL;
     }
     
-    // Get temporary directory using SmallStep
-    SSFileSystem *fileSystem = [SSFileSystem sharedFileSystem];
-    NSString *tempDir = [fileSystem temporaryDirectory];
-    if (!tempDir) {
+    // Rasterize into symbol->bitmap (no rotation)
+    error = ZBarcode_Buffer(symbol, 0);
+    if (error != 0 || !symbol->bitmap || symbol->bitmap_width <= 0 || symbol->bitmap_height <= 0) {
         ZBarcode_Delete(symbol);
-        return nil;
+        return NULL;
     }
     
-    // Create temporary file path
-    NSString *tempFileName = [NSString stringWithFormat:@"barcode_%ld.png", (long)[[NSDate date] timeIntervalSince1970]];
-    NSString *tempFilePath = [tempDir stringByAppendingPathComponent:tempFileName];
+    return symbol;
+}
+#endif
+
+- (ImageBuffer)encodeBufferFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+    ImageBuffer buffer = {NULL, 0, 0, 0, 0};
+#if ZINT_AVAILABLE
+    struct zint_symbol *symbol = renderSymbol(data, symbology, options);
+    if (!symbol) {
+        return buffer;
+    }
     
-    // Set output file in symbol
-    strncpy(symbol->outfile, [tempFilePath UTF8String], 256);
+    int width = symbol->bitmap_width;
+    int height = symbol->bitmap_height;
+    // RGB triplets to grayscale
+    buffer = ImageBufferFromPixels((const unsigned char *)symbol->bitmap, width, height, width * 3, ImagePixelFormatRGB24);
     
-    // Print to file (PNG format)
-    error = ZBarcode_Print(symbol, 0);
+    ZBarcode_Delete(symbol);
+#endif
+    return buffer;
+}
+
+- (NSImage *)encodeBarcodeFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+#if ZINT_AVAILABLE
+    struct zint_symbol *symbol = renderSymbol(data, symbology, options);
+    if (!symbol) {
+        return nil;
+    }
     
-    NSImage *resultImage = nil;
+    // Copy the RGB raster into a bitmap rep (keeps foreground/background colours)
+    int width = symbol->bitmap_width;
+    int height = symbol->bitmap_height;
+    NSBitmapImageRep *bitmapRep = [[NSBitmapImageRep alloc]
+        initWithBitmapDataPlanes:NULL
+        pixelsWide:width
+        pixelsHigh:height
+        bitsPerSample:8
+        samplesPerPixel:3
+        hasAlpha:NO
+        isPlanar:NO
+        colorSpaceName:NSCalibratedRGBColorSpace
+        bytesPerRow:width * 3
+        bitsPerPixel:24];
     
-    if (error == 0) {
-        // Load the image from file
-        NSData *imageData = [NSData dataWithContentsOfFile:tempFilePath];
-        if (imageData) {
-            resultImage = [[NSImage alloc] initWithData:imageData];
+    NSImage *resultImage = nil;
+    if (bitmapRep) {
+        unsigned char *bitmapData = [bitmapRep bitmapData];
+        NSInteger bytesPerRow = [bitmapRep bytesPerRow];
+        int y;
+        for (y = 0; y < height; y++) {
+            memcpy(bitmapData + y * bytesPerRow, symbol->bitmap + (size_t)y * width * 3, (size_t)width * 3);
         }
         
-        // Clean up temporary file
-        [fileSystem deleteFileAtPath:tempFilePath error:NULL];
+        resultImage = [[NSImage alloc] initWithSize:NSMakeSize(width, height)];
+        [resultImage addRepresentation:bitmapRep];
+        [bitmapRep release];
     }
     
     // Clean up symbol
@@ -0,0 +1,62 @@
+//
+//  ImageBuffer.h
+//  SmallBarcodeReader
+//
+//  8-bit grayscale pixel buffer (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// 8-bit grayscale (Y800) image buffer
+typedef struct {
+    unsigned char *data; // Top-left pixel
+    int width;           // Width in pixels
+    int height;          // Height in pixels
+    int stride;          // Bytes between the starts of consecutive rows (>= width)
+    int owned;           // Non-zero if ImageBufferFree must release data
+} ImageBuffer;
+
+/// Create a new buffer (stride == width, contents uninitialized). Pixels
+/// come from the calling thread's ImageScratch pool, so the data must only
+/// ever be released through ImageBufferFree, never free().
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @return New buffer (must be freed with ImageBufferFree), or invalid buffer on error
+ImageBuffer ImageBufferCreate(int width, int height);
+
+/// Wrap caller-owned pixels without copying
+/// @param data Pixel data (must outlive the buffer)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param stride Bytes per row
+/// @return Borrowed buffer (ImageBufferFree does not release the pixels)
+ImageBuffer ImageBufferWrap(unsigned char *data, int width, int height, int stride);
+
+/// Free buffer memory if owned (back to the ImageScratch pool), and reset the buffer
+/// @param buffer Buffer to free
+void ImageBufferFree(ImageBuffer *buffer);
+
+/// Check if a buffer holds pixels
+/// @param buffer Buffer
+/// @return Non-zero if valid
+int ImageBufferIsValid(ImageBuffer buffer);
+
+/// Copy a buffer into new tightly packed memory
+/// @param buffer Source buffer
+/// @return New owned buffer (must be freed), or invalid buffer on error
+ImageBuffer ImageBufferCopy(ImageBuffer buffer);
+
+/// Convert an NSImage to a grayscale buffer (UI boundary only)
+/// @param image Source image
+/// @return New owned buffer (must be freed), or invalid buffer on error
+ImageBuffer ImageBufferFromImage(NSImage *image);
+
+/// Create an NSImage from a buffer (UI boundary only)
+/// @param buffer Source buffer
+/// @return Grayscale image, or nil on error
+NSImage *ImageBufferToImage(ImageBuffer buffer);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,173 @@
+//
+//  ImageBuffer.m
+//  SmallBarcodeReader
+//
+//  8-bit grayscale pixel buffer implementation
+//
+
+#import "ImageBuffer.h"
+#import "ImagePixelFormat.h"
+#import "ImageScratch.h"
+#import <stdlib.h>
+#import <string.h>
+
+ImageBuffer ImageBufferCreate(int width, int height) {
+    ImageBuffer buffer = {NULL, 0, 0, 0, 0};
+    if (width <= 0 || height <= 0) {
+        return buffer;
+    }
+
+    buffer.data = (unsigned char *)ImageScratchAlloc((size_t)width * height);
+    if (!buffer.data) {
+        return buffer;
+    }
+    buffer.width = width;
+    buffer.height = height;
+    buffer.stride = width;
+    buffer.owned = 1;
+    return buffer;
+}
+
+ImageBuffer ImageBufferWrap(unsigned char *data, int width, int height, int stride) {
+    ImageBuffer buffer = {NULL, 0, 0, 0, 0};
+    if (!data || width <= 0 || height <= 0 || stride < width) {
+        return buffer;
+    }
+    buffer.data = data;
+    buffer.width = width;
+    buffer.height = height;
+    buffer.stride = stride;
+    buffer.owned = 0;
+    return buffer;
+}
+
+void ImageBufferFree(ImageBuffer *buffer) {
+    if (buffer) {
+        if (buffer->owned && buffer->data) {
+            ImageScratchFree(buffer->data);
+        }
+        buffer->data = NULL;
+        buffer->width = 0;
+        buffer->height = 0;
+        buffer->stride = 0;
+        buffer->owned = 0;
+    }
+}
+
+int ImageBufferIsValid(ImageBuffer buffer) {
+    return buffer.data != NULL && buffer.width > 0 && buffer.height > 0;
+}
+
+ImageBuffer ImageBufferCopy(ImageBuffer source) {
+    if (!ImageBufferIsValid(source)) {
+        ImageBuffer invalid = {NULL, 0, 0, 0, 0};
+        return invalid;
+    }
+
+    ImageBuffer copy = ImageBufferCreate(source.width, source.height);
+    if (!copy.data) {
+        return copy;
+    }
+
+    if (source.stride == source.width) {
+        memcpy(copy.data, source.data, (size_t)source.width * source.height);
+    } else {
+        int y;
+        for (y = 0; y < source.height; y++) {
+            memcpy(copy.data + (size_t)y * copy.stride, source.data + (size_t)y * source.stride, source.width);
+        }
+    }
+    return copy;
+}
+
+static ImageBuffer bufferFromBitmap(NSBitmapImageRep *bitmapRep) {
+    int width = (int)[bitmapRep pixelsWide];
+    int height = (int)[bitmapRep pixelsHigh];
+    int bitsPerPixel = (int)[bitmapRep bitsPerPixel];
+    int bytesPerRow = (int)[bitmapRep bytesPerRow];
+    const unsigned char *sourceData = (const unsigned char *)[bitmapRep bitmapData];
+
+    if (bitsPerPixel == 8 || bitsPerPixel == 24 || bitsPerPixel == 32) {
+        ImagePixelFormat format = ImagePixelFormatGray8;
+        if (bitsPerPixel == 24) {
+            format = ImagePixelFormatRGB24;
+        } else if (bitsPerPixel == 32) {
+            format = ([bitmapRep bitmapFormat] & NSAlphaFirstBitmapFormat) ? ImagePixelFormatARGB32 : ImagePixelFormatRGBA32;
+        }
+        return ImageBufferFromPixels(sourceData, width, height, bytesPerRow, format);
+    }
+
+    ImageBuffer buffer = ImageBufferCreate(width, height);
+    if (!buffer.data) {
+        return buffer;
+    }
+
+    int y, x;
+    for (y = 0; y < height; y++) {
+        const unsigned char *sourceRow = sourceData + (size_t)y * bytesPerRow;
+        unsigned char *destRow = buffer.data + (size_t)y * buffer.stride;
+        if (bitsPerPixel == 16) {
+            // Grayscale + alpha
+            for (x = 0; x < width; x++) {
+                destRow[x] = sourceRow[x * 2];
+            }
+        } else {
+            memset(destRow, 128, width); // Default gray
+        }
+    }
+
+    return buffer;
+}
+
+ImageBuffer ImageBufferFromImage(NSImage *image) {
+    ImageBuffer buffer = {NULL, 0, 0, 0, 0};
+    if (!image) {
+        return buffer;
+    }
+
+    // The TIFF data and bitmap are autoreleased; drain them here instead of
+    // letting them pile up in a caller's long-lived pool
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSData *tiffData = [image TIFFRepresentation];
+    NSBitmapImageRep *bitmapRep = tiffData ? [NSBitmapImageRep imageRepWithData:tiffData] : nil;
+    if (bitmapRep) {
+        buffer = bufferFromBitmap(bitmapRep);
+    }
+    [pool release];
+    return buffer;
+}
+
+NSImage *ImageBufferToImage(ImageBuffer buffer) {
+    if (!ImageBufferIsValid(buffer)) {
+        return nil;
+    }
+
+    NSBitmapImageRep *bitmapRep = [[NSBitmapImageRep alloc]
+        initWithBitmapDataPlanes:NULL
+        pixelsWide:buffer.width
+        pixelsHigh:buffer.height
+        bitsPerSample:8
+        samplesPerPixel:1
+        hasAlpha:NO
+        isPlanar:NO
+        colorSpaceName:NSCalibratedWhiteColorSpace
+        bytesPerRow:buffer.width
+        bitsPerPixel:8];
+
+    if (!bitmapRep) {
+        return nil;
+    }
+
+    unsigned char *bitmapData = [bitmapRep bitmapData];
+    NSInteger bytesPerRow = [bitmapRep bytesPerRow];
+    int y;
+    for (y = 0; y < buffer.height; y++) {
+        memcpy(bitmapData + y * bytesPerRow, buffer.data + (size_t)y * buffer.stride, buffer.width);
+    }
+
+    NSImage *image = [[NSImage alloc] initWithSize:NSMakeSize(buffer.width, buffer.height)];
+    [image addRepresentation:bitmapRep];
+    [bitmapRep release];
+
+    return [image autorelease];
+}
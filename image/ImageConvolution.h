@@ -0,0 +1,159 @@
+//
+//  ImageConvolution.h
+//  SmallBarcodeReader
+//
+//  Convolution of grayscale buffers with square kernels (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+#import "ImageMatrix.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Vector instruction sets for the fixed-point convolution path
+typedef NS_ENUM(NSInteger, ImageConvolutionSIMD) {
+    ImageConvolutionSIMDNone = 0, // Portable scalar code
+    ImageConvolutionSIMDSSE2,     // 8 pixels per step
+    ImageConvolutionSIMDAVX2      // 16 pixels per step
+};
+
+/// Ways ImageConvolve can run a kernel
+typedef NS_ENUM(NSInteger, ImageConvolutionStrategy) {
+    ImageConvolutionStrategyBox = 0,    // Running sums (uniform kernels)
+    ImageConvolutionStrategySeparable,  // Two 1D float passes (rank-1 kernels)
+    ImageConvolutionStrategyFixedPoint, // Non-zero taps in 16-bit fixed point, vectorized
+    ImageConvolutionStrategyFFT,        // Product of spectra (any square kernel)
+    ImageConvolutionStrategyDirect      // Float reference
+};
+
+/// Convolve a packed grayscale image, picking the cheapest path for the
+/// kernel and image size (see ImageConvolutionChooseStrategy): uniform
+/// kernels use a running sum, rank-1 kernels two 1D passes, sparse or small
+/// kernels ImageConvolveFixedPoint with the best supported instruction set,
+/// and large dense kernels ImageConvolveFFT. Edges are clamped; results are
+/// rounded and clamped to 0-255 and stay within 1 grey level of the direct
+/// path (kernels with integer weights, such as sharpen and Laplacian, match
+/// it exactly on the fixed-point path).
+/// Large images are processed in row bands on the ImageParallel thread pool.
+/// Every path takes its temporaries from the calling thread's ImageScratch
+/// pool. Only the returned buffer comes from malloc, because the caller owns
+/// it; per-cell code convolves into pooled planes with ImageConvolveInto.
+/// @param data Source pixels (stride == width)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param kernel Square kernel with odd size
+/// @return New buffer (must be freed with free()), or NULL on error
+unsigned char *ImageConvolve(const unsigned char *data, int width, int height, ImageMatrix kernel);
+
+/// ImageConvolve into a caller-provided buffer, with no allocation outside
+/// the scratch pool
+/// @param data Source pixels (stride == width)
+/// @param dest Destination pixels (stride == width; may not alias data)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param kernel Square kernel with odd size
+/// @return Non-zero on success
+int ImageConvolveInto(const unsigned char *data, unsigned char *dest, int width, int height, ImageMatrix kernel);
+
+/// Estimated single-threaded running time of one path, from per-tap and
+/// per-butterfly costs measured by tools/convolution_benchmark
+/// @param kernel Kernel
+/// @param strategy Path
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @return Estimate in nanoseconds, or a negative value if the path cannot
+///         run this kernel (e.g. Box for a non-uniform kernel)
+double ImageConvolutionEstimateCost(ImageMatrix kernel, ImageConvolutionStrategy strategy, int width, int height);
+
+/// Path with the lowest ImageConvolutionEstimateCost; non-square or
+/// even-sized kernels always run direct
+/// @param kernel Kernel
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @return Strategy ImageConvolve uses
+ImageConvolutionStrategy ImageConvolutionChooseStrategy(ImageMatrix kernel, int width, int height);
+
+/// ImageConvolveInto forced down one path (for benchmarks and tests)
+/// @param data Source pixels (stride == width)
+/// @param dest Destination pixels (stride == width; may not alias data)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param kernel Kernel
+/// @param strategy Path to run
+/// @return Non-zero on success; zero if the path cannot run this kernel or
+///         is out of memory
+int ImageConvolveWithStrategyInto(const unsigned char *data, unsigned char *dest, int width, int height,
+                                  ImageMatrix kernel, ImageConvolutionStrategy strategy);
+
+/// Convolve through the frequency domain: edge-padded real row FFTs, column
+/// FFTs multiplied by the kernel spectrum, and the inverse. Cost grows with
+/// the image size times log, not with the kernel size, so it wins for large
+/// dense kernels (long motion blurs, wide Gaussians). Within 1 grey level of
+/// the direct path.
+/// @param data Source pixels (stride == width)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param kernel Square kernel with odd size
+/// @return New buffer (must be freed with free()), or NULL on error
+unsigned char *ImageConvolveFFT(const unsigned char *data, int width, int height, ImageMatrix kernel);
+
+/// Reference full 2D convolution (K*K multiply-adds per pixel, single-threaded)
+/// @param data Source pixels (stride == width)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param kernel Square kernel with odd size
+/// @return New buffer (must be freed with free()), or NULL on error
+unsigned char *ImageConvolveDirect(const unsigned char *data, int width, int height, ImageMatrix kernel);
+
+/// Convolve with integer (fixed-point) weights. Interior pixels run
+/// branch-free, vectorized when simd allows; only the left and right border
+/// strips clamp coordinates. Weights are scaled by the largest power of two
+/// that keeps them in 16 bits, so integer-valued kernels are exact.
+/// @param data Source pixels (stride == width)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param kernel Square kernel with odd size
+/// @param simd Instruction set to use (lowered to the best one supported)
+/// @return New buffer (must be freed with free()), or NULL on error or if the
+///         weights cannot be represented in 16 bits
+unsigned char *ImageConvolveFixedPoint(const unsigned char *data, int width, int height,
+                                       ImageMatrix kernel, ImageConvolutionSIMD simd);
+
+/// Best instruction set supported by this CPU (detected once)
+ImageConvolutionSIMD ImageConvolutionSIMDSupported(void);
+
+/// Convolve with an outer-product kernel: column[ky] * row[kx]
+/// @param data Source pixels (stride == width)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param column Vertical taps (size entries)
+/// @param row Horizontal taps (size entries)
+/// @param size Number of taps in each direction (odd)
+/// @return New buffer (must be freed with free()), or NULL on error
+unsigned char *ImageConvolveSeparable(const unsigned char *data, int width, int height,
+                                      const float *column, const float *row, int size);
+
+/// Convolve with a uniform size x size kernel whose every element is value,
+/// using running sums (cost independent of size)
+/// @param data Source pixels (stride == width)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param size Kernel size (odd)
+/// @param value Kernel element (1 / (size * size) for a normalized box blur)
+/// @return New buffer (must be freed with free()), or NULL on error
+unsigned char *ImageConvolveBox(const unsigned char *data, int width, int height, int size, float value);
+
+/// Split a square kernel into column and row vectors if it is rank 1
+/// @param kernel Square kernel
+/// @param column Receives kernel.rows vertical taps
+/// @param row Receives kernel.cols horizontal taps
+/// @return Non-zero if kernel == column * row (within float tolerance)
+int ImageMatrixSeparate(ImageMatrix kernel, float *column, float *row);
+
+/// Check whether all kernel elements are equal
+/// @param kernel Kernel
+/// @param value Receives the common element value
+/// @return Non-zero if the kernel is uniform
+int ImageMatrixIsUniform(ImageMatrix kernel, float *value);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,992 @@
+//
+//  ImageConvolution.m
+//  SmallBarcodeReader
+//
+//  Convolution of grayscale buffers with square kernels
+//
+
+#import "ImageConvolution.h"
+#import "ImageFFT.h"
+#import "ImageParallel.h"
+#import "ImageScratch.h"
+#import <math.h>
+#import <pthread.h>
+#import <stdlib.h>
+#import <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define IMAGE_CONVOLUTION_X86 1
+#import <immintrin.h>
+#endif
+
+// Relative tolerance when matching kernel elements (kernels are built in float)
+static const float ImageConvolutionTolerance = 1e-5f;
+
+static inline int clampIndex(int i, int limit) {
+    if (i < 0) return 0;
+    if (i >= limit) return limit - 1;
+    return i;
+}
+
+static inline unsigned char roundToPixel(float sum) {
+    // Same rounding as the direct path
+    int value = (int)(sum + 0.5f);
+    if (value < 0) value = 0;
+    if (value > 255) value = 255;
+    return (unsigned char)value;
+}
+
+static void convolveDirectInto(const unsigned char *data, unsigned char *result, int width, int height,
+                               ImageMatrix kernel) {
+    int kernelSize = kernel.rows;
+    int halfKernel = kernelSize / 2;
+    
+    int y, x;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            float sum = 0.0f;
+            int ky, kx;
+            for (ky = 0; ky < kernelSize; ky++) {
+                for (kx = 0; kx < kernelSize; kx++) {
+                    int px = x + kx - halfKernel;
+                    int py = y + ky - halfKernel;
+                    
+                    // Handle boundaries (clamp to edge)
+                    if (px < 0) px = 0;
+                    if (px >= width) px = width - 1;
+                    if (py < 0) py = 0;
+                    if (py >= height) py = height - 1;
+                    
+                    float kernelValue = ImageMatrixGet(kernel, ky, kx);
+                    sum += data[py * width + px] * kernelValue;
+                }
+            }
+            
+            result[y * width + x] = roundToPixel(sum);
+        }
+    }
+}
+
+unsigned char *ImageConvolveDirect(const unsigned char *data, int width, int height, ImageMatrix kernel) {
+    if (!data || width <= 0 || height <= 0 || !kernel.data) {
+        return NULL;
+    }
+    
+    unsigned char *result = (unsigned char *)malloc((size_t)width * height);
+    if (!result) {
+        return NULL;
+    }
+    
+    convolveDirectInto(data, result, width, height, kernel);
+    return result;
+}
+
+// Shared by the row bands of one separable convolution
+typedef struct {
+    const unsigned char *data;
+    unsigned char *result;
+    int width;
+    int height;
+    const float *column;
+    const float *row;
+    int size;
+    int failed; // Set by a band that could not allocate its scratch rows
+} SeparableJob;
+
+static void convolveSeparableRows(void *context, int rowStart, int rowEnd) {
+    SeparableJob *job = (SeparableJob *)context;
+    int width = job->width;
+    int size = job->size;
+    int half = size / 2;
+    
+    // The vertical pass reads half rows of halo above and below the band
+    int haloStart = rowStart - half;
+    int haloRows = rowEnd - rowStart + 2 * half;
+    float *horizontal = (float *)ImageScratchAlloc((size_t)width * haloRows * sizeof(float));
+    unsigned char *padded = (unsigned char *)ImageScratchAlloc((size_t)width + 2 * half);
+    float *accumulator = (float *)ImageScratchAlloc((size_t)width * sizeof(float));
+    if (!horizontal || !padded || !accumulator) {
+        ImageScratchFree(horizontal);
+        ImageScratchFree(padded);
+        ImageScratchFree(accumulator);
+        job->failed = 1;
+        return;
+    }
+    
+    // Horizontal pass into float, via an edge-replicated copy of each row so
+    // the tap loop has no boundary checks
+    int i, y, x, k;
+    for (i = 0; i < haloRows; i++) {
+        const unsigned char *sourceRow = job->data + (size_t)clampIndex(haloStart + i, job->height) * width;
+        memset(padded, sourceRow[0], half);
+        memcpy(padded + half, sourceRow, width);
+        memset(padded + half + width, sourceRow[width - 1], half);
+        
+        float *destRow = horizontal + (size_t)i * width;
+        for (x = 0; x < width; x++) {
+            const unsigned char *window = padded + x;
+            float sum = 0.0f;
+            for (k = 0; k < size; k++) {
+                sum += window[k] * job->row[k];
+            }
+            destRow[x] = sum;
+        }
+    }
+    
+    // Vertical pass, row at a time; halo rows are already edge-clamped
+    for (y = rowStart; y < rowEnd; y++) {
+        memset(accumulator, 0, (size_t)width * sizeof(float));
+        for (k = 0; k < size; k++) {
+            const float *sourceRow = horizontal + (size_t)(y - rowStart + k) * width;
+            float tap = job->column[k];
+            for (x = 0; x < width; x++) {
+                accumulator[x] += sourceRow[x] * tap;
+            }
+        }
+        
+        unsigned char *destRow = job->result + (size_t)y * width;
+        for (x = 0; x < width; x++) {
+            destRow[x] = roundToPixel(accumulator[x]);
+        }
+    }
+    
+    ImageScratchFree(horizontal);
+    ImageScratchFree(padded);
+    ImageScratchFree(accumulator);
+}
+
+static int convolveSeparableInto(const unsigned char *data, unsigned char *result, int width, int height,
+                                 const float *column, const float *row, int size) {
+    SeparableJob job = {data, result, width, height, column, row, size, 0};
+    ImageParallelForRows(height, width, convolveSeparableRows, &job);
+    return !job.failed;
+}
+
+unsigned char *ImageConvolveSeparable(const unsigned char *data, int width, int height,
+                                      const float *column, const float *row, int size) {
+    if (!data || width <= 0 || height <= 0 || !column || !row || size <= 0) {
+        return NULL;
+    }
+    
+    unsigned char *result = (unsigned char *)malloc((size_t)width * height);
+    if (result && !convolveSeparableInto(data, result, width, height, column, row, size)) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+// Shared by the row bands of one box convolution
+typedef struct {
+    const unsigned char *data;
+    unsigned char *result;
+    int width;
+    int height;
+    int size;
+    float value;
+    int failed;
+} BoxJob;
+
+static void convolveBoxRows(void *context, int rowStart, int rowEnd) {
+    BoxJob *job = (BoxJob *)context;
+    int width = job->width;
+    int half = job->size / 2;
+    
+    // Row sums for the band plus half rows of halo above and below
+    int haloStart = rowStart - half;
+    int haloRows = rowEnd - rowStart + 2 * half;
+    int *rowSums = (int *)ImageScratchAlloc((size_t)width * haloRows * sizeof(int));
+    int *columnSums = (int *)ImageScratchAlloc((size_t)width * sizeof(int));
+    if (!rowSums || !columnSums) {
+        ImageScratchFree(rowSums);
+        ImageScratchFree(columnSums);
+        job->failed = 1;
+        return;
+    }
+    
+    // Horizontal running sums: add the pixel entering the window, drop the one leaving
+    int i, y, x, k;
+    for (i = 0; i < haloRows; i++) {
+        const unsigned char *sourceRow = job->data + (size_t)clampIndex(haloStart + i, job->height) * width;
+        int *sumRow = rowSums + (size_t)i * width;
+        
+        int sum = 0;
+        for (k = -half; k <= half; k++) {
+            sum += sourceRow[clampIndex(k, width)];
+        }
+        for (x = 0; x < width; x++) {
+            sumRow[x] = sum;
+            sum += sourceRow[clampIndex(x + half + 1, width)] - sourceRow[clampIndex(x - half, width)];
+        }
+    }
+    
+    // Vertical running sums over the row sums, one accumulator per column
+    memset(columnSums, 0, (size_t)width * sizeof(int));
+    for (k = 0; k <= 2 * half; k++) {
+        const int *sumRow = rowSums + (size_t)k * width;
+        for (x = 0; x < width; x++) {
+            columnSums[x] += sumRow[x];
+        }
+    }
+    for (y = rowStart; y < rowEnd; y++) {
+        unsigned char *destRow = job->result + (size_t)y * width;
+        for (x = 0; x < width; x++) {
+            destRow[x] = roundToPixel(columnSums[x] * job->value);
+        }
+        if (y + 1 == rowEnd) {
+            break;
+        }
+        
+        const int *entering = rowSums + (size_t)(y - haloStart + half + 1) * width;
+        const int *leaving = rowSums + (size_t)(y - haloStart - half) * width;
+        for (x = 0; x < width; x++) {
+            columnSums[x] += entering[x] - leaving[x];
+        }
+    }
+    
+    ImageScratchFree(rowSums);
+    ImageScratchFree(columnSums);
+}
+
+static int convolveBoxInto(const unsigned char *data, unsigned char *result, int width, int height,
+                           int size, float value) {
+    BoxJob job = {data, result, width, height, size, value, 0};
+    ImageParallelForRows(height, width, convolveBoxRows, &job);
+    return !job.failed;
+}
+
+unsigned char *ImageConvolveBox(const unsigned char *data, int width, int height, int size, float value) {
+    if (!data || width <= 0 || height <= 0 || size <= 0) {
+        return NULL;
+    }
+    
+    unsigned char *result = (unsigned char *)malloc((size_t)width * height);
+    if (result && !convolveBoxInto(data, result, width, height, size, value)) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+// Fixed-point form of a kernel: its non-zero taps, padded to an even count
+// so the vector code can multiply-add them in pairs
+typedef struct {
+    int count;
+    int shift;        // Fractional bits of each weight
+    int *rowOffset;   // ky - rows / 2
+    int *colOffset;   // kx - cols / 2
+    short *weight;    // Round(value * 2^shift)
+    int *pair;        // weight[2i] in the low half, weight[2i + 1] in the high half
+} FixedPointKernel;
+
+static void fixedPointKernelFree(FixedPointKernel *kernel) {
+    ImageScratchFree(kernel->rowOffset);
+    ImageScratchFree(kernel->colOffset);
+    ImageScratchFree(kernel->weight);
+    ImageScratchFree(kernel->pair);
+}
+
+static int fixedPointKernelInit(FixedPointKernel *fixed, ImageMatrix kernel) {
+    memset(fixed, 0, sizeof(FixedPointKernel));
+    int elements = kernel.rows * kernel.cols;
+    
+    float largest = 0.0f, total = 0.0f;
+    int i;
+    for (i = 0; i < elements; i++) {
+        float magnitude = fabsf(kernel.data[i]);
+        if (magnitude > largest) largest = magnitude;
+        total += magnitude;
+    }
+    
+    // Largest scale that keeps every weight in int16 and the 32-bit
+    // accumulator (255 * sum of weights, plus rounding) clear of overflow
+    int shift = 14;
+    while (shift >= 0 && (largest * (float)(1 << shift) > 32767.0f ||
+                          total * (float)(1 << shift) * 255.0f > 1073741824.0f)) {
+        shift--;
+    }
+    if (shift < 0) {
+        return 0;
+    }
+    
+    int capacity = elements + 2;
+    fixed->rowOffset = (int *)ImageScratchAlloc(capacity * sizeof(int));
+    fixed->colOffset = (int *)ImageScratchAlloc(capacity * sizeof(int));
+    fixed->weight = (short *)ImageScratchAlloc(capacity * sizeof(short));
+    fixed->pair = (int *)ImageScratchAlloc((capacity / 2 + 1) * sizeof(int));
+    if (!fixed->rowOffset || !fixed->colOffset || !fixed->weight || !fixed->pair) {
+        fixedPointKernelFree(fixed);
+        return 0;
+    }
+    
+    fixed->shift = shift;
+    int ky, kx;
+    for (ky = 0; ky < kernel.rows; ky++) {
+        for (kx = 0; kx < kernel.cols; kx++) {
+            long value = lrintf(kernel.data[ky * kernel.cols + kx] * (float)(1 << shift));
+            if (value == 0) {
+                continue; // Sparse kernels (motion blur) skip their zeros
+            }
+            fixed->rowOffset[fixed->count] = ky - kernel.rows / 2;
+            fixed->colOffset[fixed->count] = kx - kernel.cols / 2;
+            fixed->weight[fixed->count] = (short)value;
+            fixed->count++;
+        }
+    }
+    while (fixed->count == 0 || fixed->count % 2 != 0) {
+        fixed->rowOffset[fixed->count] = 0;
+        fixed->colOffset[fixed->count] = 0;
+        fixed->weight[fixed->count] = 0;
+        fixed->count++;
+    }
+    
+    for (i = 0; i < fixed->count; i += 2) {
+        fixed->pair[i / 2] = (int)((unsigned int)(unsigned short)fixed->weight[i] |
+                                   ((unsigned int)(unsigned short)fixed->weight[i + 1] << 16));
+    }
+    return 1;
+}
+
+static inline unsigned char fixedPointToPixel(int sum, int shift) {
+    int value = sum >> shift;
+    if (value < 0) value = 0;
+    if (value > 255) value = 255;
+    return (unsigned char)value;
+}
+
+// Interior row kernels: taps[t][x] is the source pixel of tap t for output x.
+// Each computes dest[x] for from <= x < to.
+typedef void (*ConvolveRowFunction)(const FixedPointKernel *kernel, const unsigned char **taps,
+                                    unsigned char *dest, int from, int to);
+
+static void convolveRowScalar(const FixedPointKernel *kernel, const unsigned char **taps,
+                              unsigned char *dest, int from, int to) {
+    int bias = kernel->shift > 0 ? 1 << (kernel->shift - 1) : 0;
+    int x, t;
+    for (x = from; x < to; x++) {
+        int sum = bias;
+        for (t = 0; t < kernel->count; t++) {
+            sum += kernel->weight[t] * taps[t][x];
+        }
+        dest[x] = fixedPointToPixel(sum, kernel->shift);
+    }
+}
+
+// Border pixels: rows[t] is the (already clamped) source row of tap t
+static void convolveBorder(const FixedPointKernel *kernel, const unsigned char **rows,
+                           unsigned char *dest, int from, int to, int width) {
+    int bias = kernel->shift > 0 ? 1 << (kernel->shift - 1) : 0;
+    int x, t;
+    for (x = from; x < to; x++) {
+        int sum = bias;
+        for (t = 0; t < kernel->count; t++) {
+            sum += kernel->weight[t] * rows[t][clampIndex(x + kernel->colOffset[t], width)];
+        }
+        dest[x] = fixedPointToPixel(sum, kernel->shift);
+    }
+}
+
+#ifdef IMAGE_CONVOLUTION_X86
+
+// 8 pixels per step: widen to 16 bits, interleave two taps and let
+// madd_epi16 do both multiply-adds into 32-bit sums
+__attribute__((target("sse2")))
+static void convolveRowSSE2(const FixedPointKernel *kernel, const unsigned char **taps,
+                            unsigned char *dest, int from, int to) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32(kernel->shift > 0 ? 1 << (kernel->shift - 1) : 0);
+    const __m128i shiftCount = _mm_cvtsi32_si128(kernel->shift);
+    
+    int x = from, t;
+    for (; x + 8 <= to; x += 8) {
+        __m128i low = bias;
+        __m128i high = bias;
+        for (t = 0; t < kernel->count; t += 2) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(taps[t] + x)), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(taps[t + 1] + x)), zero);
+            __m128i weights = _mm_set1_epi32(kernel->pair[t / 2]);
+            low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+            high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+        }
+        low = _mm_sra_epi32(low, shiftCount);
+        high = _mm_sra_epi32(high, shiftCount);
+        
+        // Saturating packs clamp to 0-255
+        __m128i words = _mm_packs_epi32(low, high);
+        _mm_storel_epi64((__m128i *)(dest + x), _mm_packus_epi16(words, words));
+    }
+    
+    convolveRowScalar(kernel, taps, dest, x, to);
+}
+
+// 16 pixels per step; same scheme as SSE2 with 256-bit registers
+__attribute__((target("avx2")))
+static void convolveRowAVX2(const FixedPointKernel *kernel, const unsigned char **taps,
+                            unsigned char *dest, int from, int to) {
+    const __m256i bias = _mm256_set1_epi32(kernel->shift > 0 ? 1 << (kernel->shift - 1) : 0);
+    const __m128i shiftCount = _mm_cvtsi32_si128(kernel->shift);
+    
+    int x = from, t;
+    for (; x + 16 <= to; x += 16) {
+        __m256i low = bias;
+        __m256i high = bias;
+        for (t = 0; t < kernel->count; t += 2) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(taps[t] + x)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(taps[t + 1] + x)));
+            __m256i weights = _mm256_set1_epi32(kernel->pair[t / 2]);
+            low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights));
+            high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights));
+        }
+        low = _mm256_sra_epi32(low, shiftCount);
+        high = _mm256_sra_epi32(high, shiftCount);
+        
+        // Packs work per 128-bit lane: pixels 0-7 end up in quadword 0 and
+        // 8-15 in quadword 2
+        __m256i words = _mm256_packs_epi32(low, high);
+        __m256i bytes = _mm256_packus_epi16(words, words);
+        bytes = _mm256_permute4x64_epi64(bytes, 0x08);
+        _mm_storeu_si128((__m128i *)(dest + x), _mm256_castsi256_si128(bytes));
+    }
+    
+    convolveRowSSE2(kernel, taps, dest, x, to);
+}
+
+#endif
+
+static pthread_once_t simdOnce = PTHREAD_ONCE_INIT;
+static ImageConvolutionSIMD simdSupported = ImageConvolutionSIMDNone;
+
+static void detectSIMD(void) {
+#ifdef IMAGE_CONVOLUTION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        simdSupported = ImageConvolutionSIMDAVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        simdSupported = ImageConvolutionSIMDSSE2;
+    }
+#endif
+}
+
+ImageConvolutionSIMD ImageConvolutionSIMDSupported(void) {
+    pthread_once(&simdOnce, detectSIMD);
+    return simdSupported;
+}
+
+// Shared by the row bands of one fixed-point convolution
+typedef struct {
+    const unsigned char *data;
+    unsigned char *result;
+    int width;
+    int height;
+    const FixedPointKernel *fixed;
+    ConvolveRowFunction convolveRow;
+    int interiorStart;
+    int interiorEnd;
+    int failed;
+} FixedPointJob;
+
+static void convolveFixedPointRows(void *context, int rowStart, int rowEnd) {
+    FixedPointJob *job = (FixedPointJob *)context;
+    const FixedPointKernel *fixed = job->fixed;
+    const unsigned char **rows = (const unsigned char **)ImageScratchAlloc(fixed->count * sizeof(unsigned char *));
+    const unsigned char **taps = (const unsigned char **)ImageScratchAlloc(fixed->count * sizeof(unsigned char *));
+    if (!rows || !taps) {
+        ImageScratchFree((void *)rows);
+        ImageScratchFree((void *)taps);
+        job->failed = 1;
+        return;
+    }
+    
+    int y, t;
+    for (y = rowStart; y < rowEnd; y++) {
+        unsigned char *destRow = job->result + (size_t)y * job->width;
+        for (t = 0; t < fixed->count; t++) {
+            rows[t] = job->data + (size_t)clampIndex(y + fixed->rowOffset[t], job->height) * job->width;
+            // Based at the first interior pixel so the pointer stays in the row
+            taps[t] = rows[t] + job->interiorStart + fixed->colOffset[t];
+        }
+        
+        job->convolveRow(fixed, taps, destRow + job->interiorStart, 0, job->interiorEnd - job->interiorStart);
+        
+        // Border strips clamp columns too
+        convolveBorder(fixed, rows, destRow, 0, job->interiorStart, job->width);
+        convolveBorder(fixed, rows, destRow, job->interiorEnd, job->width, job->width);
+    }
+    
+    ImageScratchFree((void *)rows);
+    ImageScratchFree((void *)taps);
+}
+
+static int convolveFixedPointInto(const unsigned char *data, unsigned char *result, int width, int height,
+                                  ImageMatrix kernel, ImageConvolutionSIMD simd) {
+    FixedPointKernel fixed;
+    if (!fixedPointKernelInit(&fixed, kernel)) {
+        return 0;
+    }
+    
+    if (simd > ImageConvolutionSIMDSupported()) {
+        simd = ImageConvolutionSIMDSupported();
+    }
+    ConvolveRowFunction convolveRow = convolveRowScalar;
+#ifdef IMAGE_CONVOLUTION_X86
+    if (simd == ImageConvolutionSIMDAVX2) {
+        convolveRow = convolveRowAVX2;
+    } else if (simd == ImageConvolutionSIMDSSE2) {
+        convolveRow = convolveRowSSE2;
+    }
+#endif
+
+    // Columns [interiorStart, interiorEnd) never reach past the left or right
+    // edge; top and bottom edges are handled by clamping the source rows
+    int halfCols = kernel.cols / 2;
+    int interiorStart = halfCols < width ? halfCols : width;
+    int interiorEnd = width - halfCols > interiorStart ? width - halfCols : interiorStart;
+    
+    FixedPointJob job = {data, result, width, height, &fixed, convolveRow, interiorStart, interiorEnd, 0};
+    ImageParallelForRows(height, width, convolveFixedPointRows, &job);
+    
+    fixedPointKernelFree(&fixed);
+    return !job.failed;
+}
+
+unsigned char *ImageConvolveFixedPoint(const unsigned char *data, int width, int height,
+                                       ImageMatrix kernel, ImageConvolutionSIMD simd) {
+    if (!data || width <= 0 || height <= 0 || !kernel.data || kernel.rows <= 0 || kernel.cols <= 0) {
+        return NULL;
+    }
+    
+    unsigned char *result = (unsigned char *)malloc((size_t)width * height);
+    if (result && !convolveFixedPointInto(data, result, width, height, kernel, simd)) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+// Shared by the phases of one FFT convolution. The image is edge-padded by
+// half a kernel on every side, zero-padded to rowLength x columnLength, and
+// correlated with the kernel as a product of spectra; the padding is large
+// enough that the circular result never wraps into the rows kept.
+typedef struct {
+    const unsigned char *data;
+    unsigned char *result;
+    int width;
+    int height;
+    int half;                       // kernel.rows / 2
+    int paddedWidth;                // width + kernel.cols - 1
+    int kernelRows;
+    const ImageFFTPlan *rowPlan;    // rowLength / 2 points (real transforms)
+    const ImageFFTPlan *columnPlan; // columnLength points
+    int rowLength;
+    int columnLength;
+    int bins;                       // rowLength / 2 + 1 complex bins per row
+    float *spectrum;                // columnLength rows of bins
+    const float *kernelSpectrum;    // kernelRows rows of bins
+    float scale;
+    int failed;
+} FFTJob;
+
+// Forward real transform of each padded source row
+static void convolveFFTForwardRows(void *context, int rowStart, int rowEnd) {
+    FFTJob *job = (FFTJob *)context;
+    float *line = (float *)ImageScratchAlloc((size_t)job->rowLength * sizeof(float));
+    float *scratch = (float *)ImageScratchAlloc((size_t)job->rowLength * 2 * sizeof(float));
+    if (!line || !scratch) {
+        ImageScratchFree(line);
+        ImageScratchFree(scratch);
+        job->failed = 1;
+        return;
+    }
+    
+    int i, x;
+    for (x = job->paddedWidth; x < job->rowLength; x++) {
+        line[x] = 0.0f;
+    }
+    for (i = rowStart; i < rowEnd; i++) {
+        const unsigned char *sourceRow = job->data + (size_t)clampIndex(i - job->half, job->height) * job->width;
+        for (x = 0; x < job->paddedWidth; x++) {
+            line[x] = sourceRow[clampIndex(x - job->half, job->width)];
+        }
+        ImageFFTRealForward(job->rowPlan, line, job->spectrum + (size_t)i * job->bins * 2, scratch);
+    }
+    
+    ImageScratchFree(line);
+    ImageScratchFree(scratch);
+}
+
+// Column transforms: each column of bins is multiplied by the conjugate
+// kernel spectrum (correlation, as the direct path computes) and brought back
+static void convolveFFTColumns(void *context, int columnStart, int columnEnd) {
+    FFTJob *job = (FFTJob *)context;
+    int length = job->columnLength;
+    float *column = (float *)ImageScratchAlloc((size_t)length * 2 * sizeof(float));
+    float *kernelColumn = (float *)ImageScratchAlloc((size_t)length * 2 * sizeof(float));
+    float *scratch = (float *)ImageScratchAlloc((size_t)length * 2 * sizeof(float));
+    if (!column || !kernelColumn || !scratch) {
+        ImageScratchFree(column);
+        ImageScratchFree(kernelColumn);
+        ImageScratchFree(scratch);
+        job->failed = 1;
+        return;
+    }
+    
+    size_t rowFloats = (size_t)job->bins * 2;
+    int c, i;
+    for (c = columnStart; c < columnEnd; c++) {
+        for (i = 0; i < length; i++) {
+            const float *bin = job->spectrum + i * rowFloats + 2 * c;
+            column[2 * i] = bin[0];
+            column[2 * i + 1] = bin[1];
+        }
+        memset(kernelColumn, 0, (size_t)length * 2 * sizeof(float));
+        for (i = 0; i < job->kernelRows; i++) {
+            const float *bin = job->kernelSpectrum + i * rowFloats + 2 * c;
+            kernelColumn[2 * i] = bin[0];
+            kernelColumn[2 * i + 1] = bin[1];
+        }
+        ImageFFTTransform(job->columnPlan, column, scratch, 0);
+        ImageFFTTransform(job->columnPlan, kernelColumn, scratch, 0);
+        
+        for (i = 0; i < length; i++) {
+            float re = column[2 * i], im = column[2 * i + 1];
+            float kre = kernelColumn[2 * i], kim = kernelColumn[2 * i + 1];
+            column[2 * i] = re * kre + im * kim;
+            column[2 * i + 1] = im * kre - re * kim;
+        }
+        ImageFFTTransform(job->columnPlan, column, scratch, 1);
+        
+        // Only the first height rows are output rows
+        for (i = 0; i < job->height; i++) {
+            float *bin = job->spectrum + i * rowFloats + 2 * c;
+            bin[0] = column[2 * i];
+            bin[1] = column[2 * i + 1];
+        }
+    }
+    
+    ImageScratchFree(column);
+    ImageScratchFree(kernelColumn);
+    ImageScratchFree(scratch);
+}
+
+// Inverse real transform of each output row, scaled, rounded and clamped
+static void convolveFFTInverseRows(void *context, int rowStart, int rowEnd) {
+    FFTJob *job = (FFTJob *)context;
+    float *line = (float *)ImageScratchAlloc((size_t)job->rowLength * sizeof(float));
+    float *scratch = (float *)ImageScratchAlloc((size_t)job->rowLength * 2 * sizeof(float));
+    if (!line || !scratch) {
+        ImageScratchFree(line);
+        ImageScratchFree(scratch);
+        job->failed = 1;
+        return;
+    }
+    
+    int y, x;
+    for (y = rowStart; y < rowEnd; y++) {
+        ImageFFTRealInverse(job->rowPlan, job->spectrum + (size_t)y * job->bins * 2, line, scratch);
+        unsigned char *destRow = job->result + (size_t)y * job->width;
+        for (x = 0; x < job->width; x++) {
+            destRow[x] = roundToPixel(line[x] * job->scale);
+        }
+    }
+    
+    ImageScratchFree(line);
+    ImageScratchFree(scratch);
+}
+
+// Transform sizes for an FFT convolution: real row length and column length
+static void fftConvolutionSizes(int width, int height, int kernelSize, int *rowLength, int *columnLength) {
+    *rowLength = ImageFFTGoodSize(width + kernelSize - 1);
+    *columnLength = ImageFFTGoodSize(height + kernelSize - 1);
+}
+
+static int convolveFFTInto(const unsigned char *data, unsigned char *result, int width, int height,
+                           ImageMatrix kernel) {
+    int size = kernel.rows;
+    int rowLength, columnLength;
+    fftConvolutionSizes(width, height, size, &rowLength, &columnLength);
+    int bins = rowLength / 2 + 1;
+    
+    ImageFFTPlan *rowPlan = ImageFFTPlanCreate(rowLength / 2);
+    ImageFFTPlan *columnPlan = ImageFFTPlanCreate(columnLength);
+    float *spectrum = (float *)ImageScratchAlloc((size_t)columnLength * bins * 2 * sizeof(float));
+    float *kernelSpectrum = (float *)ImageScratchAlloc((size_t)size * bins * 2 * sizeof(float));
+    float *line = (float *)ImageScratchAlloc((size_t)rowLength * sizeof(float));
+    float *scratch = (float *)ImageScratchAlloc((size_t)rowLength * 2 * sizeof(float));
+    int done = 0;
+    if (rowPlan && columnPlan && spectrum && kernelSpectrum && line && scratch) {
+        memset(line, 0, (size_t)rowLength * sizeof(float));
+        // Kernel rows at the origin; the columns are finished per column
+        int ky, kx;
+        for (ky = 0; ky < size; ky++) {
+            for (kx = 0; kx < size; kx++) {
+                line[kx] = kernel.data[ky * size + kx];
+            }
+            ImageFFTRealForward(rowPlan, line, kernelSpectrum + (size_t)ky * bins * 2, scratch);
+        }
+        
+        int paddedHeight = height + size - 1;
+        memset(spectrum + (size_t)paddedHeight * bins * 2, 0,
+               (size_t)(columnLength - paddedHeight) * bins * 2 * sizeof(float));
+        
+        // Both passes are unnormalized: the round trip scales by
+        // columnLength * rowLength / 2
+        FFTJob job = {data, result, width, height, size / 2, width + size - 1, size, rowPlan, columnPlan,
+                      rowLength, columnLength, bins, spectrum, kernelSpectrum,
+                      1.0f / ((float)columnLength * (float)(rowLength / 2)), 0};
+        ImageParallelForRows(paddedHeight, rowLength, convolveFFTForwardRows, &job);
+        if (!job.failed) {
+            ImageParallelForRows(bins, columnLength, convolveFFTColumns, &job);
+        }
+        if (!job.failed) {
+            ImageParallelForRows(height, rowLength, convolveFFTInverseRows, &job);
+        }
+        done = !job.failed;
+    }
+    
+    ImageFFTPlanFree(rowPlan);
+    ImageFFTPlanFree(columnPlan);
+    ImageScratchFree(spectrum);
+    ImageScratchFree(kernelSpectrum);
+    ImageScratchFree(line);
+    ImageScratchFree(scratch);
+    return done;
+}
+
+unsigned char *ImageConvolveFFT(const unsigned char *data, int width, int height, ImageMatrix kernel) {
+    if (!data || width <= 0 || height <= 0 || !kernel.data || kernel.rows <= 0 ||
+        kernel.cols != kernel.rows || kernel.rows % 2 == 0) {
+        return NULL;
+    }
+    
+    unsigned char *result = (unsigned char *)malloc((size_t)width * height);
+    if (result && !convolveFFTInto(data, result, width, height, kernel)) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+int ImageMatrixIsUniform(ImageMatrix kernel, float *value) {
+    if (!kernel.data || kernel.rows <= 0 || kernel.cols <= 0) {
+        return 0;
+    }
+    
+    float first = kernel.data[0];
+    float tolerance = fabsf(first) * ImageConvolutionTolerance;
+    int i;
+    for (i = 1; i < kernel.rows * kernel.cols; i++) {
+        if (fabsf(kernel.data[i] - first) > tolerance) {
+            return 0;
+        }
+    }
+    
+    if (value) {
+        *value = first;
+    }
+    return 1;
+}
+
+int ImageMatrixSeparate(ImageMatrix kernel, float *column, float *row) {
+    if (!kernel.data || kernel.rows <= 0 || kernel.cols <= 0 || !column || !row) {
+        return 0;
+    }
+    
+    // Pivot on the largest element for a stable split
+    int pivotRow = 0, pivotCol = 0;
+    float largest = 0.0f;
+    int i, j;
+    for (i = 0; i < kernel.rows; i++) {
+        for (j = 0; j < kernel.cols; j++) {
+            float magnitude = fabsf(kernel.data[i * kernel.cols + j]);
+            if (magnitude > largest) {
+                largest = magnitude;
+                pivotRow = i;
+                pivotCol = j;
+            }
+        }
+    }
+    if (largest == 0.0f) {
+        return 0;
+    }
+    
+    float pivot = kernel.data[pivotRow * kernel.cols + pivotCol];
+    for (i = 0; i < kernel.rows; i++) {
+        column[i] = kernel.data[i * kernel.cols + pivotCol];
+    }
+    for (j = 0; j < kernel.cols; j++) {
+        row[j] = kernel.data[pivotRow * kernel.cols + j] / pivot;
+    }
+    
+    // Rank 1 only if every element is reproduced by the outer product
+    float tolerance = largest * ImageConvolutionTolerance;
+    for (i = 0; i < kernel.rows; i++) {
+        for (j = 0; j < kernel.cols; j++) {
+            if (fabsf(kernel.data[i * kernel.cols + j] - column[i] * row[j]) > tolerance) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Single-threaded cost of each path in nanoseconds, measured with
+// tools/convolution_benchmark on an x86-64 desktop. Only the ratios matter:
+// they place the crossovers, and every path splits into row bands alike.
+static const double CostBoxPerPixel = 1.6;
+static const double CostSeparablePerTap = 0.7;        // Per pixel, per tap of each 1D pass
+static const double CostFixedPointPerTap[] = {0.9, 0.12, 0.07}; // Per pixel, per tap; by ImageConvolutionSIMD
+static const double CostFixedPointBorderPerTap = 1.2; // Clamped scalar strips at the left and right
+static const double CostDirectPerTap = 1.0;
+static const double CostFFTPerButterfly = 1.8;        // Per complex point, per log2 of the length
+static const double CostFFTPerPoint = 2.0;            // Padding, gathers and rounding
+
+double ImageConvolutionEstimateCost(ImageMatrix kernel, ImageConvolutionStrategy strategy, int width, int height) {
+    if (!kernel.data || kernel.rows <= 0 || kernel.cols <= 0 || width <= 0 || height <= 0) {
+        return -1.0;
+    }
+    int size = kernel.rows;
+    int square = kernel.cols == size && size % 2 == 1;
+    double pixels = (double)width * height;
+    
+    switch (strategy) {
+        case ImageConvolutionStrategyBox:
+            return square && ImageMatrixIsUniform(kernel, NULL) ? pixels * CostBoxPerPixel : -1.0;
+        
+        case ImageConvolutionStrategySeparable: {
+            float *column = (float *)ImageScratchAlloc((size_t)size * sizeof(float));
+            float *row = (float *)ImageScratchAlloc((size_t)kernel.cols * sizeof(float));
+            int separable = square && column && row && ImageMatrixSeparate(kernel, column, row);
+            ImageScratchFree(column);
+            ImageScratchFree(row);
+            return separable ? pixels * 2 * size * CostSeparablePerTap : -1.0;
+        }
+        
+        case ImageConvolutionStrategyFixedPoint: {
+            // Only the non-zero taps are visited
+            FixedPointKernel fixed;
+            if (!fixedPointKernelInit(&fixed, kernel)) {
+                return -1.0;
+            }
+            int taps = fixed.count;
+            fixedPointKernelFree(&fixed);
+            int borderColumns = kernel.cols - 1 < width ? kernel.cols - 1 : width;
+            double border = (double)borderColumns * height;
+            return taps * ((pixels - border) * CostFixedPointPerTap[ImageConvolutionSIMDSupported()] +
+                           border * CostFixedPointBorderPerTap);
+        }
+        
+        case ImageConvolutionStrategyFFT: {
+            if (!square) {
+                return -1.0;
+            }
+            int rowLength, columnLength;
+            fftConvolutionSizes(width, height, size, &rowLength, &columnLength);
+            double half = rowLength / 2;
+            double bins = half + 1;
+            double paddedHeight = height + size - 1;
+            // Real row transforms in and out, three column transforms per bin
+            // (image, kernel, inverse), kernel row transforms
+            double rowWork = (paddedHeight + height + size) * half * log2(half > 1 ? half : 2);
+            double columnWork = 3.0 * bins * columnLength * log2(columnLength);
+            return (rowWork + columnWork) * CostFFTPerButterfly +
+                   ((double)rowLength * paddedHeight + 2.0 * bins * columnLength) * CostFFTPerPoint;
+        }
+        
+        case ImageConvolutionStrategyDirect:
+            return pixels * kernel.rows * kernel.cols * CostDirectPerTap;
+    }
+    return -1.0;
+}
+
+ImageConvolutionStrategy ImageConvolutionChooseStrategy(ImageMatrix kernel, int width, int height) {
+    // Fast paths assume the square, odd-sized kernels the distorter builds
+    if (!kernel.data || kernel.cols != kernel.rows || kernel.rows % 2 == 0) {
+        return ImageConvolutionStrategyDirect;
+    }
+    
+    ImageConvolutionStrategy best = ImageConvolutionStrategyDirect;
+    double bestCost = ImageConvolutionEstimateCost(kernel, best, width, height);
+    ImageConvolutionStrategy candidates[] = {
+        ImageConvolutionStrategyBox, ImageConvolutionStrategySeparable,
+        ImageConvolutionStrategyFixedPoint, ImageConvolutionStrategyFFT
+    };
+    int i;
+    for (i = 0; i < 4; i++) {
+        double cost = ImageConvolutionEstimateCost(kernel, candidates[i], width, height);
+        if (cost >= 0.0 && cost < bestCost) {
+            best = candidates[i];
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+int ImageConvolveWithStrategyInto(const unsigned char *data, unsigned char *dest, int width, int height,
+                                  ImageMatrix kernel, ImageConvolutionStrategy strategy) {
+    if (!data || !dest || width <= 0 || height <= 0 || !kernel.data) {
+        return 0;
+    }
+    
+    int size = kernel.rows;
+    int square = kernel.cols == size && size % 2 == 1;
+    float value;
+    switch (strategy) {
+        case ImageConvolutionStrategyBox:
+            if (!square || !ImageMatrixIsUniform(kernel, &value)) {
+                return 0;
+            }
+            return convolveBoxInto(data, dest, width, height, size, value);
+        
+        case ImageConvolutionStrategySeparable: {
+            if (!square) {
+                return 0;
+            }
+            float *column = (float *)ImageScratchAlloc((size_t)size * sizeof(float));
+            float *row = (float *)ImageScratchAlloc((size_t)size * sizeof(float));
+            int done = column && row && ImageMatrixSeparate(kernel, column, row) &&
+                       convolveSeparableInto(data, dest, width, height, column, row, size);
+            ImageScratchFree(column);
+            ImageScratchFree(row);
+            return done;
+        }
+        
+        case ImageConvolutionStrategyFixedPoint:
+            return convolveFixedPointInto(data, dest, width, height, kernel, ImageConvolutionSIMDSupported());
+        
+        case ImageConvolutionStrategyFFT:
+            return square && convolveFFTInto(data, dest, width, height, kernel);
+        
+        case ImageConvolutionStrategyDirect:
+            convolveDirectInto(data, dest, width, height, kernel);
+            return 1;
+    }
+    return 0;
+}
+
+int ImageConvolveInto(const unsigned char *data, unsigned char *dest, int width, int height, ImageMatrix kernel) {
+    if (!data || !dest || width <= 0 || height <= 0 || !kernel.data) {
+        return 0;
+    }
+    
+    ImageConvolutionStrategy strategy = ImageConvolutionChooseStrategy(kernel, width, height);
+    if (ImageConvolveWithStrategyInto(data, dest, width, height, kernel, strategy)) {
+        return 1;
+    }
+    
+    // Out of memory on the way; the direct path needs none
+    convolveDirectInto(data, dest, width, height, kernel);
+    return 1;
+}
+
+unsigned char *ImageConvolve(const unsigned char *data, int width, int height, ImageMatrix kernel) {
+    if (!data || width <= 0 || height <= 0 || !kernel.data) {
+        return NULL;
+    }
+    
+    unsigned char *result = (unsigned char *)malloc((size_t)width * height);
+    if (result && !ImageConvolveInto(data, result, width, height, kernel)) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
@@ -7,6 +7,8 @@
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
+#import "ImageBuffer.h"
+#import "ImageWarp.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -19,10 +21,13 @@ typedef NS_ENUM(NSInteger, DistortionType) {
     DistortionTypeEdgeDetection,
     DistortionTypeMotionBlur,
     DistortionTypeLaplacian,
-    DistortionTypeRotate,
+    DistortionTypeRotate,             // Any angle; canvas grows to fit
     DistortionTypeScale,
-    DistortionTypeSkew,
-    DistortionTypeNoise
+    DistortionTypeSkew,               // Horizontal and vertical shear
+    DistortionTypeNoise,              // Uniform additive noise
+    DistortionTypeGaussianNoise,
+    DistortionTypeSaltAndPepperNoise,
+    DistortionTypeContrast            // Levels pulled toward mid gray
 };
 
 /// Distortion parameters
@@ -31,12 +36,16 @@ typedef NS_ENUM(NSInteger, DistortionType) {
     float intensity;      // 0.0 to 1.0
     float strength;       // Additional parameter (kernel size, angle, etc.)
     float strength2;     // Second parameter if needed
+    uint32_t seed;       // Random stream for noise distortions
 }
 
 @property (assign, nonatomic) DistortionType type;
 @property (assign, nonatomic) float intensity;
 @property (assign, nonatomic) float strength;
 @property (assign, nonatomic) float strength2;
+/// Seed for noise distortions (default 0): equal parameters and seed give
+/// bit-identical output on any thread
+@property (assign, nonatomic) uint32_t seed;
 
 + (instancetype)parametersWithType:(DistortionType)type intensity:(float)intensity strength:(float)strength;
 + (instancetype)parametersWithType:(DistortionType)type intensity:(float)intensity strength:(float)strength strength2:(float)strength2;
@@ -46,8 +55,12 @@ typedef NS_ENUM(NSInteger, DistortionType) {
 /// Image distortion pipeline
 @interface ImageDistorter : NSObject {
     NSMutableArray *distortions; // Array of DistortionParameters
+    ImageInterpolation interpolation;
 }
 
+/// Filter for rotate, scale and skew stages (default bilinear)
+@property (assign, nonatomic) ImageInterpolation interpolation;
+
 /// Initialize empty distorter
 - (instancetype)init;
 
@@ -66,12 +79,29 @@ typedef NS_ENUM(NSInteger, DistortionType) {
 /// @return Distorted image (new instance)
 - (NSImage *)applyDistortionsToImage:(NSImage *)image;
 
+/// Apply all distortions to a grayscale buffer. The distortions are compiled
+/// into an ImagePipeline first: adjacent blurs merge into one kernel,
+/// consecutive rotate, scale and skew stages resample once, and per-pixel
+/// stages (noise, contrast, the sharpen blend) share one pass.
+/// @param buffer Source buffer (not modified)
+/// @return Distorted buffer (must be freed with ImageBufferFree; may borrow the
+///         source pixels if every stage is a no-op), or invalid buffer on error
+- (ImageBuffer)applyDistortionsToBuffer:(ImageBuffer)buffer;
+
 /// Apply a single distortion to an image
 /// @param image Source image
 /// @param parameters Distortion parameters
 /// @return Distorted image (new instance)
 + (NSImage *)applyDistortion:(DistortionParameters *)parameters toImage:(NSImage *)image;
 
+/// Apply a single distortion to a grayscale buffer (geometric stages use
+/// bilinear interpolation)
+/// @param parameters Distortion parameters
+/// @param buffer Source buffer (not modified)
+/// @return Distorted buffer (must be freed with ImageBufferFree; borrows the
+///         source pixels if the distortion is a no-op), or invalid buffer on error
++ (ImageBuffer)applyDistortion:(DistortionParameters *)parameters toBuffer:(ImageBuffer)buffer;
+
 /// Get distortion type name
 /// @param type Distortion type
 /// @return Human-readable name
@@ -7,8 +7,7 @@
 
 #import "ImageDistorter.h"
 #import "ImageMatrix.h"
-#import <math.h>
-#import <stdlib.h>
+#import "ImagePipeline.h"
 
 @implementation DistortionParameters
 
@@ -16,6 +15,7 @@
 @synthesize intensity;
 @synthesize strength;
 @synthesize strength2;
+@synthesize seed;
 
 + (instancetype)parametersWithType:(DistortionType)type intensity:(float)intensity strength:(float)strength {
     DistortionParameters *params = [[DistortionParameters alloc] init];
@@ -37,12 +37,135 @@
 
 @end
 
+// Append one distortion to a pipeline; types with nothing to do add no stage
+static BOOL addDistortionStage(ImagePipeline *pipeline, DistortionParameters *parameters,
+                               ImageInterpolation interpolation) {
+    ImageMatrix matrix = {NULL, 0, 0};
+    int added = 1;
+    int kernelSize;
+    
+    switch (parameters.type) {
+        case DistortionTypeGaussianBlur: {
+            kernelSize = 3 + (int)(parameters.strength * 8); // 3 to 11
+            if (kernelSize % 2 == 0) kernelSize++;
+            float sigma = 1.0f + parameters.intensity * 3.0f;
+            matrix = ImageMatrixGaussianBlur(kernelSize, sigma);
+            added = ImagePipelineAddConvolution(pipeline, matrix);
+            break;
+        }
+        
+        case DistortionTypeBoxBlur:
+            kernelSize = 3 + (int)(parameters.strength * 8); // 3 to 11
+            if (kernelSize % 2 == 0) kernelSize++;
+            matrix = ImageMatrixBoxBlur(kernelSize);
+            added = ImagePipelineAddConvolution(pipeline, matrix);
+            break;
+        
+        case DistortionTypeSharpen:
+            // Blend with original based on intensity
+            matrix = ImageMatrixSharpen();
+            added = ImagePipelineAddBlendedConvolution(pipeline, matrix, parameters.intensity);
+            break;
+        
+        case DistortionTypeEdgeDetection:
+            matrix = ImageMatrixEdgeDetection((int)parameters.strength); // 0 or 1
+            added = ImagePipelineAddConvolution(pipeline, matrix);
+            break;
+        
+        case DistortionTypeMotionBlur: {
+            int length = 3 + (int)(parameters.strength * 10); // 3 to 13
+            if (length % 2 == 0) length++;
+            float angle = parameters.strength2 * 360.0f; // 0 to 360 degrees
+            matrix = ImageMatrixMotionBlur(length, angle);
+            added = ImagePipelineAddConvolution(pipeline, matrix);
+            break;
+        }
+        
+        case DistortionTypeLaplacian:
+            matrix = ImageMatrixLaplacian();
+            added = ImagePipelineAddConvolution(pipeline, matrix);
+            break;
+        
+        case DistortionTypeRotate:
+            matrix = ImageMatrixRotation(parameters.strength * 360.0f); // 0 to 360 degrees
+            added = ImagePipelineAddTransform(pipeline, matrix, interpolation);
+            break;
+        
+        case DistortionTypeScale:
+            matrix = ImageMatrixScaling(0.5f + parameters.strength * 1.5f,   // 0.5 to 2.0
+                                        0.5f + parameters.strength2 * 1.5f);
+            added = ImagePipelineAddTransform(pipeline, matrix, interpolation);
+            break;
+        
+        case DistortionTypeSkew:
+            matrix = ImageMatrixShear(parameters.strength, parameters.strength2); // Up to 45 degrees
+            added = ImagePipelineAddTransform(pipeline, matrix, interpolation);
+            break;
+        
+        case DistortionTypeNoise:
+            added = ImagePipelineAddNoise(pipeline, ImageNoiseTypeUniform, parameters.intensity, parameters.seed);
+            break;
+        
+        case DistortionTypeGaussianNoise:
+            added = ImagePipelineAddNoise(pipeline, ImageNoiseTypeGaussian, parameters.intensity, parameters.seed);
+            break;
+        
+        case DistortionTypeSaltAndPepperNoise:
+            added = ImagePipelineAddNoise(pipeline, ImageNoiseTypeSaltAndPepper, parameters.intensity, parameters.seed);
+            break;
+        
+        case DistortionTypeContrast: {
+            // Pull levels toward mid gray: intensity 1 leaves a flat image
+            unsigned char table[256];
+            float contrast = 1.0f - parameters.intensity;
+            int i;
+            for (i = 0; i < 256; i++) {
+                // Intensities outside 0..1 push levels past the byte range
+                float level = 128.0f + (i - 128) * contrast + 0.5f;
+                table[i] = (unsigned char)(level < 0.0f ? 0.0f : (level > 255.0f ? 255.0f : level));
+            }
+            added = ImagePipelineAddLookup(pipeline, table);
+            break;
+        }
+        
+        default:
+            break;
+    }
+    
+    ImageMatrixFree(&matrix);
+    return added != 0;
+}
+
+// Compile distortions into one pipeline and run it
+static ImageBuffer applyDistortionList(NSArray *list, ImageBuffer buffer, ImageInterpolation interpolation) {
+    ImageBuffer invalid = {NULL, 0, 0, 0, 0};
+    ImagePipeline *pipeline = ImagePipelineCreate();
+    if (!pipeline) {
+        return invalid;
+    }
+    
+    NSUInteger i;
+    for (i = 0; i < list.count; i++) {
+        if (!addDistortionStage(pipeline, [list objectAtIndex:i], interpolation)) {
+            ImagePipelineFree(pipeline);
+            return invalid;
+        }
+    }
+    
+    ImageBuffer result = ImagePipelineRun(pipeline, buffer);
+    ImagePipelineFree(pipeline);
+    return result;
+}
+
 @implementation ImageDistorter
 
+@synthesize interpolation;
+
 - (instancetype)init {
     self = [super init];
     if (self) {
         distortions = [[NSMutableArray alloc] init];
+        interpolation = ImageInterpolationBilinear;
     }
     return self;
 }
@@ -70,20 +193,31 @@
     if (!image) {
         return nil;
     }
+    if (distortions.count == 0) {
+        return image;
+    }
     
-    NSImage *result = image;
-    NSInteger i;
-    for (i = 0; i < distortions.count; i++) {
-        DistortionParameters *params = [distortions objectAtIndex:i];
-        result = [[self class] applyDistortion:params toImage:result];
-        if (!result) {
-            return nil; // Distortion failed
-        }
+    ImageBuffer source = ImageBufferFromImage(image);
+    if (!ImageBufferIsValid(source)) {
+        return nil;
     }
     
+    ImageBuffer distorted = [self applyDistortionsToBuffer:source];
+    NSImage *result = ImageBufferIsValid(distorted) ? ImageBufferToImage(distorted) : nil;
+    ImageBufferFree(&distorted);
+    ImageBufferFree(&source);
+    
     return result;
 }
 
+- (ImageBuffer)applyDistortionsToBuffer:(ImageBuffer)buffer {
+    if (!ImageBufferIsValid(buffer)) {
+        ImageBuffer invalid = {NULL, 0, 0, 0, 0};
+        return invalid;
+    }
+    return applyDistortionList(distortions, buffer, interpolation);
+}
+
 + (NSString *)nameForDistortionType:(DistortionType)type {
     switch (type) {
         case DistortionTypeNone:
@@ -108,6 +242,12 @@
             return @"Skew";
         case DistortionTypeNoise:
             return @"Noise";
+        case DistortionTypeGaussianNoise:
+            return @"Gaussian Noise";
+        case DistortionTypeSaltAndPepperNoise:
+            return @"Salt and Pepper Noise";
+        case DistortionTypeContrast:
+            return @"Contrast";
         default:
             return @"Unknown";
     }
@@ -125,323 +265,41 @@
         [NSNumber numberWithInt:DistortionTypeScale],
         [NSNumber numberWithInt:DistortionTypeSkew],
         [NSNumber numberWithInt:DistortionTypeNoise],
+        [NSNumber numberWithInt:DistortionTypeGaussianNoise],
+        [NSNumber numberWithInt:DistortionTypeSaltAndPepperNoise],
+        [NSNumber numberWithInt:DistortionTypeContrast],
         nil];
 }
 
-// Helper function to apply convolution kernel to grayscale image
-static unsigned char *applyConvolution(unsigned char *data, int width, int height, ImageMatrix kernel) {
-    if (!data || width <= 0 || height <= 0) {
-        return NULL;
-    }
-    
-    unsigned char *result = (unsigned char *)malloc(width * height);
-    if (!result) {
-        return NULL;
-    }
-    
-    int kernelSize = kernel.rows;
-    int halfKernel = kernelSize / 2;
-    
-    int y, x;
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            float sum = 0.0f;
-            int ky, kx;
-            for (ky = 0; ky < kernelSize; ky++) {
-                for (kx = 0; kx < kernelSize; kx++) {
-                    int px = x + kx - halfKernel;
-                    int py = y + ky - halfKernel;
-                    
-                    // Handle boundaries (clamp to edge)
-                    if (px < 0) px = 0;
-                    if (px >= width) px = width - 1;
-                    if (py < 0) py = 0;
-                    if (py >= height) py = height - 1;
-                    
-                    float kernelValue = ImageMatrixGet(kernel, ky, kx);
-                    sum += data[py * width + px] * kernelValue;
-                }
-            }
-            
-            // Clamp to 0-255
-            int value = (int)(sum + 0.5f);
-            if (value < 0) value = 0;
-            if (value > 255) value = 255;
-            result[y * width + x] = (unsigned char)value;
-        }
-    }
-    
-    return result;
-}
-
-// Helper function to convert NSImage to grayscale buffer
-static unsigned char *imageToGrayscale(NSImage *image, int *width, int *height) {
-    if (!image) {
-        return NULL;
-    }
-    
-    NSData *tiffData = [image TIFFRepresentation];
-    if (!tiffData) {
-        return NULL;
-    }
-    
-    NSBitmapImageRep *bitmapRep = [NSBitmapImageRep imageRepWithData:tiffData];
-    if (!bitmapRep) {
-        return NULL;
-    }
-    
-    *width = (int)[bitmapRep pixelsWide];
-    *height = (int)[bitmapRep pixelsHigh];
-    int bitsPerPixel = (int)[bitmapRep bitsPerPixel];
-    int bytesPerRow = (int)[bitmapRep bytesPerRow];
-    
-    unsigned char *grayData = (unsigned char *)malloc(*width * *height);
-    if (!grayData) {
-        return NULL;
-    }
-    
-    unsigned char *sourceData = (unsigned char *)[bitmapRep bitmapData];
-    
-    int y, x;
-    for (y = 0; y < *height; y++) {
-        for (x = 0; x < *width; x++) {
-            int sourceIndex = y * bytesPerRow + x * (bitsPerPixel / 8);
-            int destIndex = y * *width + x;
-            
-            if (bitsPerPixel == 32) {
-                // RGBA
-                unsigned char r = sourceData[sourceIndex];
-                unsigned char g = sourceData[sourceIndex + 1];
-                unsigned char b = sourceData[sourceIndex + 2];
-                grayData[destIndex] = (unsigned char)(0.299 * r + 0.587 * g + 0.114 * b);
-            } else if (bitsPerPixel == 24) {
-                // RGB
-                unsigned char r = sourceData[sourceIndex];
-                unsigned char g = sourceData[sourceIndex + 1];
-                unsigned char b = sourceData[sourceIndex + 2];
-                grayData[destIndex] = (unsigned char)(0.299 * r + 0.587 * g + 0.114 * b);
-            } else if (bitsPerPixel == 8) {
-                grayData[destIndex] = sourceData[sourceIndex];
-            } else {
-                grayData[destIndex] = 128; // Default gray
-            }
-        }
-    }
-    
-    return grayData;
-}
-
-// Helper function to convert grayscale buffer to NSImage
-static NSImage *grayscaleToImage(unsigned char *data, int width, int height) {
-    if (!data || width <= 0 || height <= 0) {
-        return nil;
-    }
-    
-    NSBitmapImageRep *bitmapRep = [[NSBitmapImageRep alloc] 
-        initWithBitmapDataPlanes:NULL
-        pixelsWide:width
-        pixelsHigh:height
-        bitsPerSample:8
-        samplesPerPixel:1
-        hasAlpha:NO
-        isPlanar:NO
-        colorSpaceName:NSCalibratedWhiteColorSpace
-        bytesPerRow:width
-        bitsPerPixel:8];
-    
-    if (!bitmapRep) {
-        return nil;
-    }
-    
-    unsigned char *bitmapData = [bitmapRep bitmapData];
-    memcpy(bitmapData, data, width * height);
-    
-    NSImage *image = [[NSImage alloc] init];
-    [image addRepresentation:bitmapRep];
-    [bitmapRep release];
-    
-    return [image autorelease];
-}
-
 + (NSImage *)applyDistortion:(DistortionParameters *)parameters toImage:(NSImage *)image {
     if (!parameters || !image || parameters.type == DistortionTypeNone) {
         return image;
     }
     
-    int width, height;
-    unsigned char *grayData = imageToGrayscale(image, &width, &height);
-    if (!grayData) {
+    ImageBuffer source = ImageBufferFromImage(image);
+    if (!ImageBufferIsValid(source)) {
         return nil;
     }
     
-    unsigned char *resultData = NULL;
-    ImageMatrix kernel;
-    int kernelSize;
-    
-    switch (parameters.type) {
-        case DistortionTypeGaussianBlur: {
-            kernelSize = 3 + (int)(parameters.strength * 8); // 3 to 11
-            if (kernelSize % 2 == 0) kernelSize++;
-            float sigma = 1.0f + parameters.intensity * 3.0f;
-            kernel = ImageMatrixGaussianBlur(kernelSize, sigma);
-            resultData = applyConvolution(grayData, width, height, kernel);
-            ImageMatrixFree(&kernel);
-            break;
-        }
-        
-        case DistortionTypeBoxBlur: {
-            kernelSize = 3 + (int)(parameters.strength * 8); // 3 to 11
-            if (kernelSize % 2 == 0) kernelSize++;
-            kernel = ImageMatrixBoxBlur(kernelSize);
-            resultData = applyConvolution(grayData, width, height, kernel);
-            ImageMatrixFree(&kernel);
-            break;
-        }
-        
-        case DistortionTypeSharpen: {
-            kernel = ImageMatrixSharpen();
-            // Blend with original based on intensity
-            unsigned char *sharpData = applyConvolution(grayData, width, height, kernel);
-            if (sharpData) {
-                resultData = (unsigned char *)malloc(width * height);
-                int i;
-                for (i = 0; i < width * height; i++) {
-                    float blended = grayData[i] * (1.0f - parameters.intensity) + 
-                                   sharpData[i] * parameters.intensity;
-                    resultData[i] = (unsigned char)(blended + 0.5f);
-                }
-                free(sharpData);
-            }
-            ImageMatrixFree(&kernel);
-            break;
-        }
-        
-        case DistortionTypeEdgeDetection: {
-            kernel = ImageMatrixEdgeDetection((int)parameters.strength); // 0 or 1
-            resultData = applyConvolution(grayData, width, height, kernel);
-            ImageMatrixFree(&kernel);
-            break;
-        }
-        
-        case DistortionTypeMotionBlur: {
-            int length = 3 + (int)(parameters.strength * 10); // 3 to 13
-            if (length % 2 == 0) length++;
-            float angle = parameters.strength2 * 360.0f; // 0 to 360 degrees
-            kernel = ImageMatrixMotionBlur(length, angle);
-            resultData = applyConvolution(grayData, width, height, kernel);
-            ImageMatrixFree(&kernel);
-            break;
-        }
-        
-        case DistortionTypeLaplacian: {
-            kernel = ImageMatrixLaplacian();
-            resultData = applyConvolution(grayData, width, height, kernel);
-            ImageMatrixFree(&kernel);
-            break;
-        }
-        
-        case DistortionTypeRotate: {
-            // Simple rotation (90, 180, 270 degrees)
-            float angle = parameters.strength * 360.0f;
-            int angleInt = ((int)(angle / 90.0f + 0.5f)) % 4;
-            
-            resultData = (unsigned char *)malloc(width * height);
-            int y, x;
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++) {
-                    int srcX, srcY;
-                    switch (angleInt) {
-                        case 1: // 90 degrees
-                            srcX = height - 1 - y;
-                            srcY = x;
-                            break;
-                        case 2: // 180 degrees
-                            srcX = width - 1 - x;
-                            srcY = height - 1 - y;
-                            break;
-                        case 3: // 270 degrees
-                            srcX = y;
-                            srcY = width - 1 - x;
-                            break;
-                        default: // 0 degrees
-                            srcX = x;
-                            srcY = y;
-                            break;
-                    }
-                    if (srcX >= 0 && srcX < width && srcY >= 0 && srcY < height) {
-                        resultData[y * width + x] = grayData[srcY * width + srcX];
-                    } else {
-                        resultData[y * width + x] = 255; // White background
-                    }
-                }
-            }
-            break;
-        }
-        
-        case DistortionTypeScale: {
-            float scaleX = 0.5f + parameters.strength * 1.5f; // 0.5 to 2.0
-            float scaleY = 0.5f + parameters.strength2 * 1.5f;
-            if (scaleY <= 0) scaleY = scaleX; // Use scaleX if scaleY not set
-            
-            int newWidth = (int)(width * scaleX + 0.5f);
-            int newHeight = (int)(height * scaleY + 0.5f);
-            if (newWidth < 1) newWidth = 1;
-            if (newHeight < 1) newHeight = 1;
-            
-            unsigned char *scaledData = (unsigned char *)malloc(newWidth * newHeight);
-            if (scaledData) {
-                int y, x;
-                for (y = 0; y < newHeight; y++) {
-                    for (x = 0; x < newWidth; x++) {
-                        int srcX = (int)(x / scaleX + 0.5f);
-                        int srcY = (int)(y / scaleY + 0.5f);
-                        if (srcX >= 0 && srcX < width && srcY >= 0 && srcY < height) {
-                            scaledData[y * newWidth + x] = grayData[srcY * width + srcX];
-                        } else {
-                            scaledData[y * newWidth + x] = 255;
-                        }
-                    }
-                }
-                free(grayData);
-                grayData = scaledData;
-                width = newWidth;
-                height = newHeight;
-                resultData = grayData;
-                grayData = NULL; // Don't free it, resultData points to it
-            }
-            break;
-        }
-        
-        case DistortionTypeNoise: {
-            resultData = (unsigned char *)malloc(width * height);
-            if (resultData) {
-                int i;
-                for (i = 0; i < width * height; i++) {
-                    float noise = (float)(rand() % 256 - 128) * parameters.intensity;
-                    float value = grayData[i] + noise;
-                    if (value < 0) value = 0;
-                    if (value > 255) value = 255;
-                    resultData[i] = (unsigned char)(value + 0.5f);
-                }
-            }
-            break;
-        }
-        
-        default:
-            free(grayData);
-            return image;
-    }
-    
-    free(grayData);
-    
-    if (!resultData) {
-        return nil;
+    ImageBuffer distorted = [self applyDistortion:parameters toBuffer:source];
+    if (distorted.data == source.data) {
+        // Unsupported distortion: leave the image untouched
+        ImageBufferFree(&source);
+        return image;
     }
-    
-    NSImage *result = grayscaleToImage(resultData, width, height);
-    free(resultData);
+    NSImage *result = ImageBufferIsValid(distorted) ? ImageBufferToImage(distorted) : nil;
+    ImageBufferFree(&distorted);
+    ImageBufferFree(&source);
     
     return result;
 }
 
++ (ImageBuffer)applyDistortion:(DistortionParameters *)parameters toBuffer:(ImageBuffer)buffer {
+    if (!parameters || !ImageBufferIsValid(buffer) || parameters.type == DistortionTypeNone) {
+        // Nothing to do: hand back a borrowed view of the source
+        return ImageBufferWrap(buffer.data, buffer.width, buffer.height, buffer.stride);
+    }
+    return applyDistortionList([NSArray arrayWithObject:parameters], buffer, ImageInterpolationBilinear);
+}
+
 @end
@@ -0,0 +1,58 @@
+//
+//  ImageFFT.h
+//  SmallBarcodeReader
+//
+//  Self-contained mixed-radix FFT (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Precomputed twiddles and factorization for one transform size
+typedef struct ImageFFTPlan ImageFFTPlan;
+
+/// Smallest even size >= n whose only prime factors are 2, 3 and 5
+/// @param n Minimum size
+/// @return Transform size that runs on the fast radix-2, 3, 4 and 5 stages
+int ImageFFTGoodSize(int n);
+
+/// Plan complex transforms of one size (any size; sizes from
+/// ImageFFTGoodSize avoid the slow generic radix)
+/// @param size Number of complex points
+/// @return New plan (free with ImageFFTPlanFree), or NULL on error
+ImageFFTPlan *ImageFFTPlanCreate(int size);
+
+/// Free a plan
+/// @param plan Plan (may be NULL)
+void ImageFFTPlanFree(ImageFFTPlan *plan);
+
+/// Number of complex points a plan transforms
+/// @param plan Plan
+/// @return Size
+int ImageFFTPlanSize(const ImageFFTPlan *plan);
+
+/// Unnormalized complex DFT in place. Plans are read-only, so threads may
+/// share one as long as each has its own scratch.
+/// @param plan Plan
+/// @param data size interleaved (real, imaginary) pairs
+/// @param scratch 2 * size floats
+/// @param inverse Non-zero for the inverse transform (positive exponent)
+void ImageFFTTransform(const ImageFFTPlan *plan, float *data, float *scratch, int inverse);
+
+/// Unnormalized DFT of 2 * size real samples through a complex plan of
+/// size points
+/// @param plan Plan for half the real length
+/// @param input 2 * size real samples
+/// @param output size + 1 interleaved complex bins (the non-negative frequencies)
+/// @param scratch 4 * size floats
+void ImageFFTRealForward(const ImageFFTPlan *plan, const float *input, float *output, float *scratch);
+
+/// Inverse of ImageFFTRealForward, scaled by size (half the real length)
+/// @param plan Plan for half the real length
+/// @param input size + 1 interleaved complex bins
+/// @param output 2 * size real samples
+/// @param scratch 4 * size floats
+void ImageFFTRealInverse(const ImageFFTPlan *plan, const float *input, float *output, float *scratch);
+
+NS_ASSUME_NONNULL_END
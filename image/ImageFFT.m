@@ -0,0 +1,287 @@
+//
+//  ImageFFT.m
+//  SmallBarcodeReader
+//
+//  Self-contained mixed-radix FFT implementation
+//
+
+#import "ImageFFT.h"
+#import <math.h>
+#import <stdlib.h>
+#import <string.h>
+
+// More factors than any int size can have
+#define ImageFFTMaximumFactors 32
+
+struct ImageFFTPlan {
+    int size;
+    int factorCount;
+    int factors[ImageFFTMaximumFactors];
+    float *twiddles;      // e^(-2 pi i t / size) for t in [0, size)
+    float *realTwiddles;  // e^(-2 pi i k / (2 size)) for k in [0, size]
+};
+
+typedef struct {
+    float re;
+    float im;
+} FFTComplex;
+
+static inline FFTComplex complexAdd(FFTComplex a, FFTComplex b) {
+    FFTComplex c = {a.re + b.re, a.im + b.im};
+    return c;
+}
+
+static inline FFTComplex complexSub(FFTComplex a, FFTComplex b) {
+    FFTComplex c = {a.re - b.re, a.im - b.im};
+    return c;
+}
+
+static inline FFTComplex complexMul(FFTComplex a, FFTComplex b) {
+    FFTComplex c = {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+    return c;
+}
+
+static inline FFTComplex complexScale(FFTComplex a, float s) {
+    FFTComplex c = {a.re * s, a.im * s};
+    return c;
+}
+
+// -i * a
+static inline FFTComplex complexMulNegI(FFTComplex a) {
+    FFTComplex c = {a.im, -a.re};
+    return c;
+}
+
+int ImageFFTGoodSize(int n) {
+    if (n < 2) {
+        return 2;
+    }
+    int size = n + (n & 1);
+    for (;; size += 2) {
+        int rest = size;
+        while (rest % 2 == 0) rest /= 2;
+        while (rest % 3 == 0) rest /= 3;
+        while (rest % 5 == 0) rest /= 5;
+        if (rest == 1) {
+            return size;
+        }
+    }
+}
+
+ImageFFTPlan *ImageFFTPlanCreate(int size) {
+    if (size < 1) {
+        return NULL;
+    }
+    ImageFFTPlan *plan = (ImageFFTPlan *)calloc(1, sizeof(ImageFFTPlan));
+    if (!plan) {
+        return NULL;
+    }
+    plan->size = size;
+    plan->twiddles = (float *)malloc((size_t)size * 2 * sizeof(float));
+    plan->realTwiddles = (float *)malloc(((size_t)size + 1) * 2 * sizeof(float));
+    if (!plan->twiddles || !plan->realTwiddles) {
+        ImageFFTPlanFree(plan);
+        return NULL;
+    }
+
+    // Radix 4 first (fewest operations per point), then the small primes,
+    // then whatever is left
+    int rest = size;
+    int radices[] = {4, 2, 3, 5};
+    int r;
+    for (r = 0; r < 4; r++) {
+        while (rest % radices[r] == 0) {
+            plan->factors[plan->factorCount++] = radices[r];
+            rest /= radices[r];
+        }
+    }
+    int divisor;
+    for (divisor = 7; rest > 1; divisor += 2) {
+        while (rest % divisor == 0) {
+            plan->factors[plan->factorCount++] = divisor;
+            rest /= divisor;
+        }
+    }
+
+    int t;
+    for (t = 0; t < size; t++) {
+        double angle = -2.0 * M_PI * t / size;
+        plan->twiddles[2 * t] = (float)cos(angle);
+        plan->twiddles[2 * t + 1] = (float)sin(angle);
+    }
+    for (t = 0; t <= size; t++) {
+        double angle = -M_PI * t / size;
+        plan->realTwiddles[2 * t] = (float)cos(angle);
+        plan->realTwiddles[2 * t + 1] = (float)sin(angle);
+    }
+    return plan;
+}
+
+void ImageFFTPlanFree(ImageFFTPlan *plan) {
+    if (!plan) {
+        return;
+    }
+    free(plan->twiddles);
+    free(plan->realTwiddles);
+    free(plan);
+}
+
+int ImageFFTPlanSize(const ImageFFTPlan *plan) {
+    return plan->size;
+}
+
+// One Stockham stage (decimation in frequency, self-sorting): transforms of
+// the current length split into radix-point butterflies; stride counts the
+// interleaved transforms left by earlier stages
+static void fftStage(const ImageFFTPlan *plan, const FFTComplex *x, FFTComplex *y,
+                     int length, int stride, int radix) {
+    const FFTComplex *twiddles = (const FFTComplex *)plan->twiddles;
+    int m = length / radix;
+    int step = plan->size / length;  // Twiddle index of e^(-2 pi i / length)
+    int rootStep = plan->size / radix;
+    int j, q, r, k;
+
+    for (j = 0; j < m; j++) {
+        FFTComplex w1 = twiddles[(size_t)j * step % plan->size];
+        FFTComplex w2 = twiddles[(size_t)2 * j * step % plan->size];
+        FFTComplex w3 = twiddles[(size_t)3 * j * step % plan->size];
+        FFTComplex w4 = twiddles[(size_t)4 * j * step % plan->size];
+        for (q = 0; q < stride; q++) {
+            const FFTComplex *in = x + q + (size_t)stride * j;
+            FFTComplex *out = y + q + (size_t)stride * radix * j;
+            size_t spread = (size_t)stride * m;
+
+            switch (radix) {
+                case 2: {
+                    FFTComplex a0 = in[0], a1 = in[spread];
+                    out[0] = complexAdd(a0, a1);
+                    out[stride] = complexMul(complexSub(a0, a1), w1);
+                    break;
+                }
+                case 3: {
+                    const float c = -0.5f, s = 0.86602540378443865f;
+                    FFTComplex a0 = in[0], a1 = in[spread], a2 = in[2 * spread];
+                    FFTComplex t1 = complexAdd(a1, a2);
+                    FFTComplex mid = complexAdd(a0, complexScale(t1, c));
+                    FFTComplex n = complexScale(complexMulNegI(complexSub(a1, a2)), s);
+                    out[0] = complexAdd(a0, t1);
+                    out[stride] = complexMul(complexAdd(mid, n), w1);
+                    out[2 * stride] = complexMul(complexSub(mid, n), w2);
+                    break;
+                }
+                case 4: {
+                    FFTComplex a0 = in[0], a1 = in[spread], a2 = in[2 * spread], a3 = in[3 * spread];
+                    FFTComplex t0 = complexAdd(a0, a2), t1 = complexSub(a0, a2);
+                    FFTComplex t2 = complexAdd(a1, a3), t3 = complexMulNegI(complexSub(a1, a3));
+                    out[0] = complexAdd(t0, t2);
+                    out[stride] = complexMul(complexAdd(t1, t3), w1);
+                    out[2 * stride] = complexMul(complexSub(t0, t2), w2);
+                    out[3 * stride] = complexMul(complexSub(t1, t3), w3);
+                    break;
+                }
+                case 5: {
+                    const float c1 = 0.30901699437494742f, c2 = -0.80901699437494742f;
+                    const float s1 = 0.95105651629515357f, s2 = 0.58778525229247313f;
+                    FFTComplex a0 = in[0], a1 = in[spread], a2 = in[2 * spread];
+                    FFTComplex a3 = in[3 * spread], a4 = in[4 * spread];
+                    FFTComplex t1 = complexAdd(a1, a4), t2 = complexAdd(a2, a3);
+                    FFTComplex t3 = complexSub(a1, a4), t4 = complexSub(a2, a3);
+                    FFTComplex m1 = complexAdd(a0, complexAdd(complexScale(t1, c1), complexScale(t2, c2)));
+                    FFTComplex m2 = complexAdd(a0, complexAdd(complexScale(t1, c2), complexScale(t2, c1)));
+                    FFTComplex n1 = complexMulNegI(complexAdd(complexScale(t3, s1), complexScale(t4, s2)));
+                    FFTComplex n2 = complexMulNegI(complexSub(complexScale(t3, s2), complexScale(t4, s1)));
+                    out[0] = complexAdd(a0, complexAdd(t1, t2));
+                    out[stride] = complexMul(complexAdd(m1, n1), w1);
+                    out[2 * stride] = complexMul(complexAdd(m2, n2), w2);
+                    out[3 * stride] = complexMul(complexSub(m2, n2), w3);
+                    out[4 * stride] = complexMul(complexSub(m1, n1), w4);
+                    break;
+                }
+                default:
+                    // Direct DFT over the radix points
+                    for (k = 0; k < radix; k++) {
+                        FFTComplex sum = {0.0f, 0.0f};
+                        for (r = 0; r < radix; r++) {
+                            FFTComplex root = twiddles[(size_t)((r * k) % radix) * rootStep];
+                            sum = complexAdd(sum, complexMul(in[r * spread], root));
+                        }
+                        out[k * stride] = complexMul(sum, twiddles[(size_t)j * k * step % plan->size]);
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+void ImageFFTTransform(const ImageFFTPlan *plan, float *data, float *scratch, int inverse) {
+    int size = plan->size;
+    int i;
+    if (inverse) {
+        // Conjugate in and out: the inverse is the forward transform mirrored
+        for (i = 0; i < size; i++) data[2 * i + 1] = -data[2 * i + 1];
+    }
+
+    FFTComplex *x = (FFTComplex *)data;
+    FFTComplex *y = (FFTComplex *)scratch;
+    int length = size, stride = 1, f;
+    for (f = 0; f < plan->factorCount; f++) {
+        fftStage(plan, x, y, length, stride, plan->factors[f]);
+        length /= plan->factors[f];
+        stride *= plan->factors[f];
+        FFTComplex *swap = x;
+        x = y;
+        y = swap;
+    }
+    if ((float *)x != data) {
+        memcpy(data, x, (size_t)size * sizeof(FFTComplex));
+    }
+
+    if (inverse) {
+        for (i = 0; i < size; i++) data[2 * i + 1] = -data[2 * i + 1];
+    }
+}
+
+void ImageFFTRealForward(const ImageFFTPlan *plan, const float *input, float *output, float *scratch) {
+    int size = plan->size;
+    const FFTComplex *roots = (const FFTComplex *)plan->realTwiddles;
+
+    // Even samples as the real part, odd as the imaginary part: one
+    // half-length complex transform carries both
+    FFTComplex *z = (FFTComplex *)scratch;
+    memcpy(z, input, (size_t)size * sizeof(FFTComplex));
+    ImageFFTTransform(plan, (float *)z, scratch + 2 * size, 0);
+
+    FFTComplex *bins = (FFTComplex *)output;
+    int k;
+    for (k = 0; k <= size; k++) {
+        FFTComplex zk = z[k % size];
+        FFTComplex zm = z[(size - k) % size];
+        zm.im = -zm.im;
+        FFTComplex even = complexScale(complexAdd(zk, zm), 0.5f);
+        FFTComplex odd = complexScale(complexMulNegI(complexSub(zk, zm)), 0.5f);
+        bins[k] = complexAdd(even, complexMul(roots[k], odd));
+    }
+}
+
+void ImageFFTRealInverse(const ImageFFTPlan *plan, const float *input, float *output, float *scratch) {
+    int size = plan->size;
+    const FFTComplex *roots = (const FFTComplex *)plan->realTwiddles;
+    const FFTComplex *bins = (const FFTComplex *)input;
+
+    // Undo the split: rebuild the half-length spectrum of the even/odd pairs
+    FFTComplex *z = (FFTComplex *)scratch;
+    int k;
+    for (k = 0; k < size; k++) {
+        FFTComplex xk = bins[k];
+        FFTComplex xm = bins[size - k];
+        xm.im = -xm.im;
+        FFTComplex root = roots[k];
+        root.im = -root.im;
+        FFTComplex even = complexScale(complexAdd(xk, xm), 0.5f);
+        FFTComplex odd = complexScale(complexMul(complexSub(xk, xm), root), 0.5f);
+        FFTComplex iOdd = {-odd.im, odd.re};
+        z[k] = complexAdd(even, iOdd);
+    }
+    ImageFFTTransform(plan, (float *)z, scratch + 2 * size, 1);
+    memcpy(output, z, (size_t)size * sizeof(FFTComplex));
+}
@@ -92,4 +92,43 @@ ImageMatrix ImageMatrixMotionBlur(int length, float angle);
 /// @return Laplacian kernel (3x3)
 ImageMatrix ImageMatrixLaplacian(void);
 
+/// Single kernel equivalent to filtering with first and then second
+/// (away from clamped edges, and before rounding)
+/// @param first Kernel applied first
+/// @param second Kernel applied second
+/// @return (first.rows + second.rows - 1) x (first.cols + second.cols - 1)
+///         kernel (must be freed), or invalid matrix if either is invalid
+ImageMatrix ImageMatrixCombineKernels(ImageMatrix first, ImageMatrix second);
+
+/// Homogeneous 2D transforms (3x3, acting on column vectors (x, y, 1))
+/// @name Geometric Transforms
+
+/// Rotation about the origin; multiples of 90 degrees are exact
+/// @param degrees Angle in degrees (clockwise in image coordinates, y down)
+/// @return 3x3 transform
+ImageMatrix ImageMatrixRotation(float degrees);
+
+/// Scaling about the origin
+/// @param scaleX Horizontal factor
+/// @param scaleY Vertical factor
+/// @return 3x3 transform
+ImageMatrix ImageMatrixScaling(float scaleX, float scaleY);
+
+/// Shear: x' = x + shearX * y, y' = y + shearY * x
+/// @param shearX Horizontal shear factor
+/// @param shearY Vertical shear factor
+/// @return 3x3 transform
+ImageMatrix ImageMatrixShear(float shearX, float shearY);
+
+/// Translation
+/// @param dx Horizontal offset
+/// @param dy Vertical offset
+/// @return 3x3 transform
+ImageMatrix ImageMatrixTranslation(float dx, float dy);
+
+/// Inverse of a 3x3 matrix
+/// @param matrix Matrix to invert
+/// @return Inverse (must be freed), or invalid matrix if singular or not 3x3
+ImageMatrix ImageMatrixInvert3x3(ImageMatrix matrix);
+
 NS_ASSUME_NONNULL_END
@@ -213,3 +213,109 @@ ImageMatrix ImageMatrixLaplacian(void) {
     };
     return ImageMatrixFromArray(data, 3, 3);
 }
+
+ImageMatrix ImageMatrixCombineKernels(ImageMatrix first, ImageMatrix second) {
+    if (!first.data || !second.data) {
+        ImageMatrix result = {NULL, 0, 0};
+        return result;
+    }
+    
+    // Tap offsets add, so every pair of taps lands on the sum of its offsets
+    ImageMatrix result = ImageMatrixCreate(first.rows + second.rows - 1, first.cols + second.cols - 1);
+    if (!result.data) {
+        return result;
+    }
+    int i, j, k, l;
+    for (i = 0; i < first.rows; i++) {
+        for (j = 0; j < first.cols; j++) {
+            float weight = ImageMatrixGet(first, i, j);
+            if (weight == 0.0f) {
+                continue;
+            }
+            for (k = 0; k < second.rows; k++) {
+                for (l = 0; l < second.cols; l++) {
+                    result.data[(i + k) * result.cols + j + l] += weight * ImageMatrixGet(second, k, l);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+ImageMatrix ImageMatrixRotation(float degrees) {
+    float turns = degrees / 90.0f;
+    float cosine, sine;
+    if (turns == floorf(turns)) {
+        // Exact quarter turns keep rotated rasters pixel-aligned
+        static const float cosines[4] = {1, 0, -1, 0};
+        int quarter = ((int)turns % 4 + 4) % 4;
+        cosine = cosines[quarter];
+        sine = cosines[(quarter + 3) % 4];
+    } else {
+        double radians = degrees * M_PI / 180.0;
+        cosine = (float)cos(radians);
+        sine = (float)sin(radians);
+    }
+    float data[] = {
+        cosine, -sine, 0,
+        sine,  cosine, 0,
+        0,     0,      1
+    };
+    return ImageMatrixFromArray(data, 3, 3);
+}
+
+ImageMatrix ImageMatrixScaling(float scaleX, float scaleY) {
+    float data[] = {
+        scaleX, 0,      0,
+        0,      scaleY, 0,
+        0,      0,      1
+    };
+    return ImageMatrixFromArray(data, 3, 3);
+}
+
+ImageMatrix ImageMatrixShear(float shearX, float shearY) {
+    float data[] = {
+        1,      shearX, 0,
+        shearY, 1,      0,
+        0,      0,      1
+    };
+    return ImageMatrixFromArray(data, 3, 3);
+}
+
+ImageMatrix ImageMatrixTranslation(float dx, float dy) {
+    float data[] = {
+        1, 0, dx,
+        0, 1, dy,
+        0, 0, 1
+    };
+    return ImageMatrixFromArray(data, 3, 3);
+}
+
+ImageMatrix ImageMatrixInvert3x3(ImageMatrix matrix) {
+    ImageMatrix invalid = {NULL, 0, 0};
+    if (!matrix.data || matrix.rows != 3 || matrix.cols != 3) {
+        return invalid;
+    }
+    
+    // Adjugate over determinant, in double to keep composed transforms exact
+    const float *m = matrix.data;
+    double c00 = (double)m[4] * m[8] - (double)m[5] * m[7];
+    double c01 = (double)m[5] * m[6] - (double)m[3] * m[8];
+    double c02 = (double)m[3] * m[7] - (double)m[4] * m[6];
+    double determinant = m[0] * c00 + m[1] * c01 + m[2] * c02;
+    if (fabs(determinant) < 1e-12) {
+        return invalid;
+    }
+    
+    double inverse[9] = {
+        c00, (double)m[2] * m[7] - (double)m[1] * m[8], (double)m[1] * m[5] - (double)m[2] * m[4],
+        c01, (double)m[0] * m[8] - (double)m[2] * m[6], (double)m[2] * m[3] - (double)m[0] * m[5],
+        c02, (double)m[1] * m[6] - (double)m[0] * m[7], (double)m[0] * m[4] - (double)m[1] * m[3]
+    };
+    ImageMatrix result = ImageMatrixCreate(3, 3);
+    int i;
+    for (i = 0; i < 9; i++) {
+        result.data[i] = (float)(inverse[i] / determinant);
+    }
+    return result;
+}
@@ -0,0 +1,68 @@
+//
+//  ImageNoise.h
+//  SmallBarcodeReader
+//
+//  Seeded, counter-based noise for grayscale images (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+#import <stdint.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Noise models
+typedef NS_ENUM(NSInteger, ImageNoiseType) {
+    ImageNoiseTypeUniform = 0,    // Offsets uniform in [-128, 127] * amount
+    ImageNoiseTypeGaussian,       // Near-Gaussian offsets with the uniform model's spread
+    ImageNoiseTypeSaltAndPepper   // A fraction amount of pixels set to black or white
+};
+
+/// Noise prepared for applying to ranges of rows
+typedef struct {
+    ImageNoiseType type;
+    int amount;          // Uniform and Gaussian: amount in 1/256 units (0 to 256)
+    uint32_t threshold;  // Salt and pepper: amount in 1/65536 units (0 to 65536)
+    uint64_t seed;       // Stream seed spread over 64 bits
+} ImageNoiseOperation;
+
+/// Random 64-bit word number counter of a stream: the SplitMix64 output
+/// function applied to seed and counter. Words are independent of each
+/// other, so any range can be generated in any order or on any thread.
+/// @param seed Stream seed
+/// @param counter Word index
+/// @return Random word
+uint64_t ImageNoiseWord(uint64_t seed, uint64_t counter);
+
+/// Add noise to an image. Pixel (x, y) depends only on seed, y, x and its
+/// source value, so output is bit-identical for any band split, thread count
+/// or CPU. Arithmetic is 8-bit fixed point; rows run on the shared thread pool.
+/// @param source Source pixels (packed rows)
+/// @param dest Destination (packed rows; may not alias source)
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param type Noise model
+/// @param amount Strength, 0.0 to 1.0
+/// @param seed Stream seed
+void ImageAddNoise(const unsigned char *source, unsigned char *dest, int width, int height,
+                   ImageNoiseType type, float amount, uint32_t seed);
+
+/// Prepare a noise operation for ImageNoiseApplyRows
+/// @param type Noise model
+/// @param amount Strength, 0.0 to 1.0
+/// @param seed Stream seed
+/// @return Operation equivalent to ImageAddNoise with the same arguments
+ImageNoiseOperation ImageNoiseOperationMake(ImageNoiseType type, float amount, uint32_t seed);
+
+/// Add noise to rows [rowStart, rowEnd) of an image, on the calling thread.
+/// Rows get the same noise they get from ImageAddNoise, so callers can fuse
+/// noise with other per-pixel work in their own row bands.
+/// @param operation Prepared operation
+/// @param source Source pixels (packed rows, starting at row 0)
+/// @param dest Destination (packed rows; may be source for in-place noise)
+/// @param width Width in pixels
+/// @param rowStart First row
+/// @param rowEnd Row after the last
+void ImageNoiseApplyRows(const ImageNoiseOperation *operation, const unsigned char *source, unsigned char *dest,
+                         int width, int rowStart, int rowEnd);
+
+NS_ASSUME_NONNULL_END
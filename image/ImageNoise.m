@@ -0,0 +1,122 @@
+//
+//  ImageNoise.m
+//  SmallBarcodeReader
+//
+//  Seeded, counter-based noise implementation
+//
+
+#import "ImageNoise.h"
+#import "ImageParallel.h"
+
+// Pixels generated per block; words for a block are produced first in a
+// branch-free loop the compiler can vectorize, then consumed per pixel
+#define ImageNoiseBlockPixels 64
+
+// Shared by the row bands of one noise operation
+typedef struct {
+    const unsigned char *source;
+    unsigned char *dest;
+    int width;
+    ImageNoiseOperation operation;
+} NoiseJob;
+
+uint64_t ImageNoiseWord(uint64_t seed, uint64_t counter) {
+    uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline unsigned char clampFixed(int value) {
+    // value is a pixel in 8.8 fixed point, already offset for rounding
+    if (value < 0) return 0;
+    if (value > 0xFFFF) return 255;
+    return (unsigned char)(value >> 8);
+}
+
+void ImageNoiseApplyRows(const ImageNoiseOperation *operation, const unsigned char *sourcePixels, unsigned char *destPixels,
+                         int width, int rowStart, int rowEnd) {
+    uint64_t words[ImageNoiseBlockPixels / 2];
+    int y;
+    for (y = rowStart; y < rowEnd; y++) {
+        // Each pixel is read before it is written, so source may be dest
+        const unsigned char *source = sourcePixels + (size_t)y * width;
+        unsigned char *dest = destPixels + (size_t)y * width;
+        // Each row owns counters [y << 32, (y + 1) << 32)
+        uint64_t rowCounter = (uint64_t)y << 32;
+        int blockStart;
+        for (blockStart = 0; blockStart < width; blockStart += ImageNoiseBlockPixels) {
+            int count = width - blockStart;
+            if (count > ImageNoiseBlockPixels) count = ImageNoiseBlockPixels;
+            int i;
+
+            if (operation->type == ImageNoiseTypeUniform) {
+                // One byte per pixel: eight pixels per word
+                uint64_t first = rowCounter + (uint64_t)(blockStart >> 3);
+                for (i = 0; i < ImageNoiseBlockPixels / 8; i++) {
+                    words[i] = ImageNoiseWord(operation->seed, first + i);
+                }
+                for (i = 0; i < count; i++) {
+                    int noise = (int)((words[i >> 3] >> ((i & 7) * 8)) & 0xFF) - 128;
+                    dest[blockStart + i] = clampFixed(source[blockStart + i] * 256 + noise * operation->amount + 128);
+                }
+                continue;
+            }
+
+            // Four bytes per pixel: two pixels per word
+            uint64_t first = rowCounter + (uint64_t)(blockStart >> 1);
+            for (i = 0; i < ImageNoiseBlockPixels / 2; i++) {
+                words[i] = ImageNoiseWord(operation->seed, first + i);
+            }
+            for (i = 0; i < count; i++) {
+                uint32_t bits = (uint32_t)(words[i >> 1] >> ((i & 1) * 32));
+                if (operation->type == ImageNoiseTypeGaussian) {
+                    // Sum of four uniform bytes (Irwin-Hall): standard deviation
+                    // 147.8, halved to match the uniform model
+                    int sum = (int)(bits & 0xFF) + (int)((bits >> 8) & 0xFF) +
+                              (int)((bits >> 16) & 0xFF) + (int)(bits >> 24) - 510;
+                    dest[blockStart + i] = clampFixed(source[blockStart + i] * 256 + (sum * operation->amount) / 2 + 128);
+                } else {
+                    unsigned char value = source[blockStart + i];
+                    if ((bits & 0xFFFF) < operation->threshold) {
+                        value = (bits & 0x10000) ? 255 : 0;
+                    }
+                    dest[blockStart + i] = value;
+                }
+            }
+        }
+    }
+}
+
+static void noiseRows(void *context, int rowStart, int rowEnd) {
+    NoiseJob *job = (NoiseJob *)context;
+    ImageNoiseApplyRows(&job->operation, job->source, job->dest, job->width, rowStart, rowEnd);
+}
+
+ImageNoiseOperation ImageNoiseOperationMake(ImageNoiseType type, float amount, uint32_t seed) {
+    if (amount < 0.0f) amount = 0.0f;
+    if (amount > 1.0f) amount = 1.0f;
+
+    ImageNoiseOperation operation;
+    operation.type = type;
+    operation.amount = (int)(amount * 256.0f + 0.5f);
+    operation.threshold = (uint32_t)(amount * 65536.0f + 0.5f);
+    // Spread the 32-bit seed over the whole word so nearby seeds give
+    // unrelated streams
+    operation.seed = ImageNoiseWord(0, seed);
+    return operation;
+}
+
+void ImageAddNoise(const unsigned char *source, unsigned char *dest, int width, int height,
+                   ImageNoiseType type, float amount, uint32_t seed) {
+    if (!source || !dest || width <= 0 || height <= 0) {
+        return;
+    }
+
+    NoiseJob job;
+    job.source = source;
+    job.dest = dest;
+    job.width = width;
+    job.operation = ImageNoiseOperationMake(type, amount, seed);
+    ImageParallelForRows(height, width, noiseRows, &job);
+}
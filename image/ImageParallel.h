@@ -0,0 +1,41 @@
+//
+//  ImageParallel.h
+//  SmallBarcodeReader
+//
+//  Row-band parallelism for image operations (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Work on output rows [rowStart, rowEnd); bands never overlap, so a body may
+/// write its own rows freely and read any row of a shared, read-only source
+typedef void (*ImageRowBandFunction)(void *context, int rowStart, int rowEnd);
+
+/// Run body over rows [0, height) split into bands on a shared thread pool.
+/// Images smaller than two minimum tiles, calls made while the pool is busy
+/// (e.g. from test executor workers) and single-core machines run inline on
+/// the calling thread. Returns when every band has finished.
+/// @param height Number of rows
+/// @param width Pixels per row (used with height to size bands)
+/// @param body Band function
+/// @param context Passed to body
+void ImageParallelForRows(int height, int width, ImageRowBandFunction body, void *context);
+
+/// Set the minimum number of pixels per band (default 262144, i.e. 512x512).
+/// Typical barcode rasters stay below it and are processed on one thread.
+/// @param pixels Minimum band size in pixels (values < 1 are treated as 1)
+void ImageParallelSetMinimumTilePixels(int pixels);
+
+/// Minimum number of pixels per band
+int ImageParallelMinimumTilePixels(void);
+
+/// Limit the number of threads (including the caller) used for one image
+/// @param count Maximum threads (0 uses every processor)
+void ImageParallelSetMaximumThreads(int count);
+
+/// Maximum threads used for one image
+int ImageParallelMaximumThreads(void);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,143 @@
+//
+//  ImageParallel.m
+//  SmallBarcodeReader
+//
+//  Row-band parallelism implementation
+//
+
+#import "ImageParallel.h"
+#import <pthread.h>
+#import <unistd.h>
+
+static int minimumTilePixels = 512 * 512;
+static int maximumThreads = 0;
+
+// One job at a time; workers sleep on workReady between jobs
+typedef struct {
+    pthread_mutex_t submitLock; // Held by the thread that owns the current job
+    pthread_mutex_t lock;       // Guards everything below
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    int workerCount;            // Pool threads, not counting the caller
+    unsigned long generation;   // Bumped for every job
+    ImageRowBandFunction body;
+    void *context;
+    int height;
+    int bandCount;
+    int nextBand;
+    int pendingBands;
+} RowBandPool;
+
+static RowBandPool pool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    0, 0, NULL, NULL, 0, 0, 0, 0
+};
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+
+// Run bands of the current job until none are left; called with pool.lock held
+static void runBands(void) {
+    while (pool.nextBand < pool.bandCount) {
+        int band = pool.nextBand++;
+        ImageRowBandFunction body = pool.body;
+        void *context = pool.context;
+        int rowStart = (int)((long)pool.height * band / pool.bandCount);
+        int rowEnd = (int)((long)pool.height * (band + 1) / pool.bandCount);
+        
+        pthread_mutex_unlock(&pool.lock);
+        body(context, rowStart, rowEnd);
+        pthread_mutex_lock(&pool.lock);
+        
+        if (--pool.pendingBands == 0) {
+            pthread_cond_signal(&pool.workDone);
+        }
+    }
+}
+
+static void *workerMain(void *argument) {
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.generation == seen) {
+            pthread_cond_wait(&pool.workReady, &pool.lock);
+        }
+        seen = pool.generation;
+        runBands();
+    }
+    return NULL;
+}
+
+static void startPool(void) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    int wanted = processors > 1 ? (int)processors - 1 : 0;
+    
+    int i;
+    for (i = 0; i < wanted; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerMain, NULL) != 0) {
+            break;
+        }
+        pthread_detach(thread);
+        pool.workerCount++;
+    }
+}
+
+void ImageParallelForRows(int height, int width, ImageRowBandFunction body, void *context) {
+    if (height <= 0 || !body) {
+        return;
+    }
+    
+    long pixels = (long)height * (width > 0 ? width : 1);
+    long bands = pixels / ImageParallelMinimumTilePixels();
+    if (bands > height) bands = height;
+    if (bands >= 2) {
+        pthread_once(&poolOnce, startPool);
+        if (bands > pool.workerCount + 1) bands = pool.workerCount + 1;
+        int limit = ImageParallelMaximumThreads();
+        if (limit > 0 && bands > limit) bands = limit;
+    }
+    
+    // Small image, single core, or another image already owns the pool
+    if (bands < 2 || pthread_mutex_trylock(&pool.submitLock) != 0) {
+        body(context, 0, height);
+        return;
+    }
+    
+    pthread_mutex_lock(&pool.lock);
+    pool.body = body;
+    pool.context = context;
+    pool.height = height;
+    pool.bandCount = (int)bands;
+    pool.nextBand = 0;
+    pool.pendingBands = (int)bands;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.workReady);
+    
+    runBands();
+    while (pool.pendingBands > 0) {
+        pthread_cond_wait(&pool.workDone, &pool.lock);
+    }
+    pool.body = NULL;
+    pool.context = NULL;
+    pthread_mutex_unlock(&pool.lock);
+    
+    pthread_mutex_unlock(&pool.submitLock);
+}
+
+void ImageParallelSetMinimumTilePixels(int pixels) {
+    minimumTilePixels = pixels > 0 ? pixels : 1;
+}
+
+int ImageParallelMinimumTilePixels(void) {
+    return minimumTilePixels;
+}
+
+void ImageParallelSetMaximumThreads(int count) {
+    maximumThreads = count > 0 ? count : 0;
+}
+
+int ImageParallelMaximumThreads(void) {
+    return maximumThreads;
+}
@@ -0,0 +1,83 @@
+//
+//  ImagePipeline.h
+//  SmallBarcodeReader
+//
+//  Compiled chains of grayscale filters (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+#import "ImageBuffer.h"
+#import "ImageMatrix.h"
+#import "ImageNoise.h"
+#import "ImageWarp.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// A chain of filters compiled into as few passes over the image as possible.
+/// Stages are fused as they are added:
+/// - a convolution after a range-preserving one (non-negative weights summing
+///   to at most 1, so nothing is clamped in between) merges into a single
+///   kernel when that is cheaper than two passes
+/// - consecutive transforms compose into one resampling
+/// - per-pixel stages (lookup tables, noise, the blend of a blended
+///   convolution) run together in one pass, row by row, in place
+/// Running the pipeline keeps intermediates in two ping-pong buffers.
+typedef struct ImagePipeline ImagePipeline;
+
+/// Create an empty pipeline
+/// @return New pipeline (free with ImagePipelineFree), or NULL if out of memory
+ImagePipeline *ImagePipelineCreate(void);
+
+/// Free a pipeline
+/// @param pipeline Pipeline (may be NULL)
+void ImagePipelineFree(ImagePipeline *pipeline);
+
+/// Append a convolution (as ImageConvolve)
+/// @param pipeline Pipeline
+/// @param kernel Square kernel with odd size (copied)
+/// @return Non-zero on success
+int ImagePipelineAddConvolution(ImagePipeline *pipeline, ImageMatrix kernel);
+
+/// Append a convolution whose result is blended with its input:
+/// input * (1 - amount) + convolved * amount
+/// @param pipeline Pipeline
+/// @param kernel Square kernel with odd size (copied)
+/// @param amount Weight of the convolved image, 0.0 to 1.0
+/// @return Non-zero on success
+int ImagePipelineAddBlendedConvolution(ImagePipeline *pipeline, ImageMatrix kernel, float amount);
+
+/// Append a geometric transform; the canvas is fitted to the result (as
+/// ImageWarpFitTransform)
+/// @param pipeline Pipeline
+/// @param transform Forward 3x3 transform (copied)
+/// @param interpolation Resampling filter
+/// @return Non-zero on success
+int ImagePipelineAddTransform(ImagePipeline *pipeline, ImageMatrix transform, ImageInterpolation interpolation);
+
+/// Append noise (as ImageAddNoise)
+/// @param pipeline Pipeline
+/// @param type Noise model
+/// @param amount Strength, 0.0 to 1.0
+/// @param seed Stream seed
+/// @return Non-zero on success
+int ImagePipelineAddNoise(ImagePipeline *pipeline, ImageNoiseType type, float amount, uint32_t seed);
+
+/// Append a per-pixel lookup table
+/// @param pipeline Pipeline
+/// @param table 256 output values indexed by input value (copied)
+/// @return Non-zero on success
+int ImagePipelineAddLookup(ImagePipeline *pipeline, const unsigned char *table);
+
+/// Number of passes over the image the pipeline compiled to
+/// @param pipeline Pipeline
+/// @return Pass count
+int ImagePipelinePassCount(const ImagePipeline *pipeline);
+
+/// Run the pipeline
+/// @param pipeline Pipeline
+/// @param source Source buffer (any stride; not modified)
+/// @return New owned buffer (must be freed with ImageBufferFree), a borrowed
+///         view of source if the pipeline is empty, or invalid buffer on error
+ImageBuffer ImagePipelineRun(const ImagePipeline *pipeline, ImageBuffer source);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,457 @@
+//
+//  ImagePipeline.m
+//  SmallBarcodeReader
+//
+//  Compiled chains of grayscale filters implementation
+//
+
+#import "ImagePipeline.h"
+#import "ImageConvolution.h"
+#import "ImageParallel.h"
+#import "ImageScratch.h"
+#import <stdlib.h>
+#import <string.h>
+
+// Cost of one extra pass over the image (read, write and a cold cache), in
+// nanoseconds per pixel as ImageConvolutionEstimateCost counts them, about
+// a box blur; merging two kernels must cost less than this more
+#define PipelinePassCost 2.0
+
+// Image side the merge decision is costed at (stages are added before the
+// image size is known; the crossovers move little with it)
+#define PipelineNominalSize 512
+
+// Kernel weights summing to at most this keep results within 0-255
+#define PipelineRangeTolerance 1e-4f
+
+typedef enum {
+    PipelineStepConvolve = 0,
+    PipelineStepWarp,
+    PipelineStepPointwise
+} PipelineStepKind;
+
+typedef enum {
+    PointwiseLookup = 0,
+    PointwiseNoise,
+    PointwiseBlend      // With the input of the preceding convolution
+} PointwiseKind;
+
+typedef struct {
+    PointwiseKind kind;
+    unsigned char table[256];
+    ImageNoiseOperation noise;
+    float amount;
+} PointwiseOperation;
+
+typedef struct {
+    PipelineStepKind kind;
+    int mergeable;                   // Convolve: later kernels may merge into this one
+    ImageMatrix kernel;              // Convolve
+    ImageMatrix *transforms;         // Warp: one per stage, fitted when run
+    int transformCount;
+    ImageInterpolation interpolation;
+    PointwiseOperation *operations;  // Pointwise, in order
+    int operationCount;
+} PipelineStep;
+
+struct ImagePipeline {
+    PipelineStep *steps;
+    int count;
+    int capacity;
+};
+
+// Shared by the row bands of one pointwise pass
+typedef struct {
+    const PipelineStep *step;
+    const unsigned char *source;
+    const unsigned char *original;   // Input of the preceding convolution
+    unsigned char *dest;             // May be source
+    int width;
+} PointwiseJob;
+
+ImagePipeline *ImagePipelineCreate(void) {
+    return (ImagePipeline *)calloc(1, sizeof(ImagePipeline));
+}
+
+void ImagePipelineFree(ImagePipeline *pipeline) {
+    if (!pipeline) {
+        return;
+    }
+    int i, t;
+    for (i = 0; i < pipeline->count; i++) {
+        PipelineStep *step = &pipeline->steps[i];
+        ImageMatrixFree(&step->kernel);
+        for (t = 0; t < step->transformCount; t++) {
+            ImageMatrixFree(&step->transforms[t]);
+        }
+        free(step->transforms);
+        free(step->operations);
+    }
+    free(pipeline->steps);
+    free(pipeline);
+}
+
+static ImageMatrix copyMatrix(ImageMatrix matrix) {
+    if (!matrix.data) {
+        return matrix;
+    }
+    return ImageMatrixFromArray(matrix.data, matrix.rows, matrix.cols);
+}
+
+static PipelineStep *appendStep(ImagePipeline *pipeline, PipelineStepKind kind) {
+    if (pipeline->count == pipeline->capacity) {
+        int capacity = pipeline->capacity ? pipeline->capacity * 2 : 8;
+        PipelineStep *steps = (PipelineStep *)realloc(pipeline->steps, capacity * sizeof(PipelineStep));
+        if (!steps) {
+            return NULL;
+        }
+        pipeline->steps = steps;
+        pipeline->capacity = capacity;
+    }
+    PipelineStep *step = &pipeline->steps[pipeline->count++];
+    memset(step, 0, sizeof(PipelineStep));
+    step->kind = kind;
+    return step;
+}
+
+static PipelineStep *lastStep(ImagePipeline *pipeline, PipelineStepKind kind) {
+    if (pipeline->count == 0 || pipeline->steps[pipeline->count - 1].kind != kind) {
+        return NULL;
+    }
+    return &pipeline->steps[pipeline->count - 1];
+}
+
+// Cost per pixel of the strategy ImageConvolve picks, in nanoseconds
+static double kernelCost(ImageMatrix kernel) {
+    ImageConvolutionStrategy strategy = ImageConvolutionChooseStrategy(kernel, PipelineNominalSize, PipelineNominalSize);
+    return ImageConvolutionEstimateCost(kernel, strategy, PipelineNominalSize, PipelineNominalSize) /
+           ((double)PipelineNominalSize * PipelineNominalSize);
+}
+
+// Whether every output of the kernel is already a valid pixel, so it needs
+// no clamping before the next filter
+static int kernelPreservesRange(ImageMatrix kernel) {
+    float sum = 0.0f;
+    int i;
+    for (i = 0; i < kernel.rows * kernel.cols; i++) {
+        if (kernel.data[i] < 0.0f) {
+            return 0;
+        }
+        sum += kernel.data[i];
+    }
+    return sum <= 1.0f + PipelineRangeTolerance;
+}
+
+int ImagePipelineAddConvolution(ImagePipeline *pipeline, ImageMatrix kernel) {
+    if (!pipeline || !kernel.data) {
+        return 0;
+    }
+
+    PipelineStep *previous = lastStep(pipeline, PipelineStepConvolve);
+    if (previous && previous->mergeable && kernelPreservesRange(previous->kernel)) {
+        ImageMatrix combined = ImageMatrixCombineKernels(previous->kernel, kernel);
+        if (!combined.data) {
+            return 0;
+        }
+        if (kernelCost(combined) <= kernelCost(previous->kernel) + kernelCost(kernel) + PipelinePassCost) {
+            ImageMatrixFree(&previous->kernel);
+            previous->kernel = combined;
+            return 1;
+        }
+        ImageMatrixFree(&combined);
+    }
+
+    PipelineStep *step = appendStep(pipeline, PipelineStepConvolve);
+    if (!step) {
+        return 0;
+    }
+    step->mergeable = 1;
+    step->kernel = copyMatrix(kernel);
+    if (!step->kernel.data) {
+        pipeline->count--;
+        return 0;
+    }
+    return 1;
+}
+
+static PointwiseOperation *appendOperation(ImagePipeline *pipeline) {
+    PipelineStep *step = lastStep(pipeline, PipelineStepPointwise);
+    if (!step) {
+        step = appendStep(pipeline, PipelineStepPointwise);
+        if (!step) {
+            return NULL;
+        }
+    }
+    PointwiseOperation *operations = (PointwiseOperation *)realloc(step->operations,
+                                                                  (step->operationCount + 1) * sizeof(PointwiseOperation));
+    if (!operations) {
+        if (step->operationCount == 0) {
+            pipeline->count--;
+        }
+        return NULL;
+    }
+    step->operations = operations;
+    PointwiseOperation *operation = &operations[step->operationCount++];
+    memset(operation, 0, sizeof(PointwiseOperation));
+    return operation;
+}
+
+int ImagePipelineAddBlendedConvolution(ImagePipeline *pipeline, ImageMatrix kernel, float amount) {
+    if (!pipeline || !kernel.data) {
+        return 0;
+    }
+
+    // The blend needs this convolution's input, so it never merges
+    PipelineStep *step = appendStep(pipeline, PipelineStepConvolve);
+    if (!step) {
+        return 0;
+    }
+    step->kernel = copyMatrix(kernel);
+    if (!step->kernel.data) {
+        pipeline->count--;
+        return 0;
+    }
+
+    PointwiseOperation *operation = appendOperation(pipeline);
+    if (!operation) {
+        // Drop the convolution too; appendOperation may have moved the steps
+        ImageMatrixFree(&pipeline->steps[pipeline->count - 1].kernel);
+        pipeline->count--;
+        return 0;
+    }
+    operation->kind = PointwiseBlend;
+    operation->amount = amount;
+    return 1;
+}
+
+int ImagePipelineAddTransform(ImagePipeline *pipeline, ImageMatrix transform, ImageInterpolation interpolation) {
+    if (!pipeline || !transform.data || transform.rows != 3 || transform.cols != 3) {
+        return 0;
+    }
+
+    PipelineStep *step = lastStep(pipeline, PipelineStepWarp);
+    if (!step || step->interpolation != interpolation) {
+        step = appendStep(pipeline, PipelineStepWarp);
+        if (!step) {
+            return 0;
+        }
+        step->interpolation = interpolation;
+    }
+    ImageMatrix *transforms = (ImageMatrix *)realloc(step->transforms, (step->transformCount + 1) * sizeof(ImageMatrix));
+    if (!transforms) {
+        if (step->transformCount == 0) {
+            pipeline->count--;
+        }
+        return 0;
+    }
+    step->transforms = transforms;
+    transforms[step->transformCount] = copyMatrix(transform);
+    if (!transforms[step->transformCount].data) {
+        if (step->transformCount == 0) {
+            pipeline->count--;
+        }
+        return 0;
+    }
+    step->transformCount++;
+    return 1;
+}
+
+int ImagePipelineAddNoise(ImagePipeline *pipeline, ImageNoiseType type, float amount, uint32_t seed) {
+    if (!pipeline) {
+        return 0;
+    }
+    PointwiseOperation *operation = appendOperation(pipeline);
+    if (!operation) {
+        return 0;
+    }
+    operation->kind = PointwiseNoise;
+    operation->noise = ImageNoiseOperationMake(type, amount, seed);
+    return 1;
+}
+
+int ImagePipelineAddLookup(ImagePipeline *pipeline, const unsigned char *table) {
+    if (!pipeline || !table) {
+        return 0;
+    }
+
+    // Consecutive tables compose into one
+    PipelineStep *step = lastStep(pipeline, PipelineStepPointwise);
+    if (step && step->operations[step->operationCount - 1].kind == PointwiseLookup) {
+        unsigned char *composed = step->operations[step->operationCount - 1].table;
+        int i;
+        for (i = 0; i < 256; i++) {
+            composed[i] = table[composed[i]];
+        }
+        return 1;
+    }
+
+    PointwiseOperation *operation = appendOperation(pipeline);
+    if (!operation) {
+        return 0;
+    }
+    operation->kind = PointwiseLookup;
+    memcpy(operation->table, table, 256);
+    return 1;
+}
+
+int ImagePipelinePassCount(const ImagePipeline *pipeline) {
+    return pipeline ? pipeline->count : 0;
+}
+
+static void pointwiseRows(void *context, int rowStart, int rowEnd) {
+    PointwiseJob *job = (PointwiseJob *)context;
+    const PipelineStep *step = job->step;
+    int width = job->width;
+    int y, o, x;
+    // Every operation on a row before the next row, while it is in cache
+    for (y = rowStart; y < rowEnd; y++) {
+        size_t offset = (size_t)y * width;
+        const unsigned char *input = job->source;
+        unsigned char *dest = job->dest + offset;
+        for (o = 0; o < step->operationCount; o++) {
+            const PointwiseOperation *operation = &step->operations[o];
+            const unsigned char *source = input + offset;
+            switch (operation->kind) {
+                case PointwiseLookup:
+                    for (x = 0; x < width; x++) {
+                        dest[x] = operation->table[source[x]];
+                    }
+                    break;
+                case PointwiseNoise:
+                    ImageNoiseApplyRows(&operation->noise, input, job->dest, width, y, y + 1);
+                    break;
+                case PointwiseBlend: {
+                    const unsigned char *original = job->original + offset;
+                    for (x = 0; x < width; x++) {
+                        float blended = original[x] * (1.0f - operation->amount) + source[x] * operation->amount;
+                        dest[x] = (unsigned char)(blended + 0.5f);
+                    }
+                    break;
+                }
+            }
+            input = job->dest;
+        }
+    }
+}
+
+// Compose the stage transforms of a warp step, each fitted to the canvas the
+// previous stage produced
+static ImageMatrix fitWarp(const PipelineStep *step, int *width, int *height) {
+    ImageMatrix composed = ImageMatrixIdentity(3);
+    int t;
+    for (t = 0; t < step->transformCount && composed.data; t++) {
+        ImageMatrix fitted = ImageWarpFitTransform(step->transforms[t], *width, *height, width, height);
+        ImageMatrix product = {NULL, 0, 0};
+        if (fitted.data) {
+            product = ImageMatrixMultiply(fitted, composed);
+            ImageMatrixFree(&fitted);
+        }
+        ImageMatrixFree(&composed);
+        composed = product;
+    }
+    return composed;
+}
+
+ImageBuffer ImagePipelineRun(const ImagePipeline *pipeline, ImageBuffer source) {
+    ImageBuffer invalid = {NULL, 0, 0, 0, 0};
+    if (!pipeline || !ImageBufferIsValid(source)) {
+        return invalid;
+    }
+    if (pipeline->count == 0) {
+        return ImageBufferWrap(source.data, source.width, source.height, source.stride);
+    }
+
+    // Plan: canvas sizes after each warp decide the ping-pong buffer size
+    ImageMatrix *fitted = (ImageMatrix *)calloc(pipeline->count, sizeof(ImageMatrix));
+    int *sizes = (int *)malloc(pipeline->count * 2 * sizeof(int));
+    if (!fitted || !sizes) {
+        free(fitted);
+        free(sizes);
+        return invalid;
+    }
+    int width = source.width, height = source.height;
+    size_t largest = (size_t)width * height;
+    int i, ok = 1;
+    for (i = 0; i < pipeline->count && ok; i++) {
+        if (pipeline->steps[i].kind == PipelineStepWarp) {
+            fitted[i] = fitWarp(&pipeline->steps[i], &width, &height);
+            ok = fitted[i].data != NULL;
+            if ((size_t)width * height > largest) {
+                largest = (size_t)width * height;
+            }
+        }
+        sizes[2 * i] = width;
+        sizes[2 * i + 1] = height;
+    }
+
+    unsigned char *buffers[2] = {NULL, NULL};
+    if (ok) {
+        // From the scratch pool: the result is released with ImageBufferFree
+        buffers[0] = (unsigned char *)ImageScratchAlloc(largest);
+        buffers[1] = (unsigned char *)ImageScratchAlloc(largest);
+        ok = buffers[0] && buffers[1];
+    }
+
+    // Filters other than warps read packed rows
+    ImageBuffer current = source;
+    ImageBuffer original = source;
+    int target = 0;
+    if (ok && source.stride != source.width && pipeline->steps[0].kind != PipelineStepWarp) {
+        int y;
+        for (y = 0; y < source.height; y++) {
+            memcpy(buffers[0] + (size_t)y * source.width, source.data + (size_t)y * source.stride, source.width);
+        }
+        current = ImageBufferWrap(buffers[0], source.width, source.height, source.width);
+        target = 1;
+    }
+
+    for (i = 0; i < pipeline->count && ok; i++) {
+        const PipelineStep *step = &pipeline->steps[i];
+        switch (step->kind) {
+            case PipelineStepConvolve: {
+                ImageBuffer next = ImageBufferWrap(buffers[target], current.width, current.height, current.width);
+                ok = ImageConvolveInto(current.data, next.data, current.width, current.height, step->kernel);
+                original = current;
+                current = next;
+                target ^= 1;
+                break;
+            }
+            case PipelineStepWarp: {
+                ImageBuffer next = ImageBufferWrap(buffers[target], sizes[2 * i], sizes[2 * i + 1], sizes[2 * i]);
+                ok = ImageWarpInto(current, fitted[i], next, step->interpolation);
+                current = next;
+                target ^= 1;
+                break;
+            }
+            case PipelineStepPointwise: {
+                // In place, unless the source is still the caller's
+                unsigned char *dest = current.data;
+                if (dest != buffers[0] && dest != buffers[1]) {
+                    dest = buffers[target];
+                    target ^= 1;
+                }
+                PointwiseJob job = {step, current.data, original.data, dest, current.width};
+                ImageParallelForRows(current.height, current.width, pointwiseRows, &job);
+                current = ImageBufferWrap(dest, current.width, current.height, current.width);
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < pipeline->count; i++) {
+        ImageMatrixFree(&fitted[i]);
+    }
+    free(fitted);
+    free(sizes);
+
+    if (!ok) {
+        ImageScratchFree(buffers[0]);
+        ImageScratchFree(buffers[1]);
+        return invalid;
+    }
+
+    // The last pass wrote into one buffer; the other goes
+    ImageScratchFree(current.data == buffers[0] ? buffers[1] : buffers[0]);
+    current.owned = 1;
+    return current;
+}
@@ -0,0 +1,51 @@
+//
+//  ImagePixelFormat.h
+//  SmallBarcodeReader
+//
+//  Conversion of packed colour pixels to 8-bit grayscale (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+#import "ImageBuffer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Layouts of caller-supplied pixel buffers (8 bits per channel, interleaved)
+typedef NS_ENUM(NSInteger, ImagePixelFormat) {
+    ImagePixelFormatGray8 = 0, // Y800, 1 byte per pixel
+    ImagePixelFormatRGB24,     // R, G, B
+    ImagePixelFormatRGBA32,    // R, G, B, A (alpha ignored)
+    ImagePixelFormatBGRA32,    // B, G, R, A (alpha ignored)
+    ImagePixelFormatARGB32     // A, R, G, B (alpha ignored)
+};
+
+/// Bytes per pixel of a format
+/// @param format Pixel format
+/// @return 1, 3 or 4, or 0 for an unknown format
+int ImagePixelFormatBytesPerPixel(ImagePixelFormat format);
+
+/// Convert pixels to grayscale into an existing buffer. Colour formats use
+/// BT.601 luma in 14-bit fixed point, (4899*R + 9617*G + 1868*B + 8192) >> 14,
+/// vectorized with SSE2/SSSE3 where the CPU supports it; every path produces
+/// identical output. Gray8 rows are copied.
+/// @param pixels Top-left source pixel
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param stride Bytes between the starts of consecutive source rows
+/// @param format Source pixel format
+/// @param dest Destination buffer (at least width x height; any stride)
+/// @return Non-zero on success
+int ImageConvertToGray(const unsigned char *pixels, int width, int height, int stride,
+                       ImagePixelFormat format, ImageBuffer dest);
+
+/// Convert pixels to a new grayscale buffer
+/// @param pixels Top-left source pixel
+/// @param width Width in pixels
+/// @param height Height in pixels
+/// @param stride Bytes between the starts of consecutive source rows
+/// @param format Source pixel format
+/// @return New owned buffer (must be freed), or invalid buffer on error
+ImageBuffer ImageBufferFromPixels(const unsigned char *pixels, int width, int height, int stride,
+                                  ImagePixelFormat format);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,222 @@
+//
+//  ImagePixelFormat.m
+//  SmallBarcodeReader
+//
+//  Conversion of packed colour pixels to 8-bit grayscale
+//
+
+#import "ImagePixelFormat.h"
+#import "ImageParallel.h"
+#import <pthread.h>
+#import <stdlib.h>
+#import <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define IMAGE_PIXEL_FORMAT_X86 1
+#import <immintrin.h>
+#endif
+
+// BT.601 luma weights scaled by 2^14; they sum to exactly 16384 so white stays 255
+enum {
+    LumaShift = 14,
+    LumaRed = 4899,
+    LumaGreen = 9617,
+    LumaBlue = 1868,
+    LumaBias = 1 << (LumaShift - 1)
+};
+
+// Converts one row; weights[c] multiplies byte c of each pixel
+typedef void (*GrayRowFunction)(const unsigned char *source, unsigned char *dest, int width, const short *weights);
+
+static void grayRowScalar4(const unsigned char *source, unsigned char *dest, int width, const short *weights) {
+    int x;
+    for (x = 0; x < width; x++) {
+        const unsigned char *pixel = source + x * 4;
+        int sum = weights[0] * pixel[0] + weights[1] * pixel[1] + weights[2] * pixel[2] + weights[3] * pixel[3];
+        dest[x] = (unsigned char)((sum + LumaBias) >> LumaShift);
+    }
+}
+
+static void grayRowScalar3(const unsigned char *source, unsigned char *dest, int width, const short *weights) {
+    int x;
+    for (x = 0; x < width; x++) {
+        const unsigned char *pixel = source + x * 3;
+        int sum = weights[0] * pixel[0] + weights[1] * pixel[1] + weights[2] * pixel[2];
+        dest[x] = (unsigned char)((sum + LumaBias) >> LumaShift);
+    }
+}
+
+#ifdef IMAGE_PIXEL_FORMAT_X86
+
+// Luma of 4 four-byte pixels as 32-bit lanes: madd_epi16 sums channel pairs,
+// then the even and odd pair sums of each pixel are added
+__attribute__((target("sse2")))
+static inline __m128i lumaSSE2(__m128i quad, __m128i weights) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128 low = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(quad, zero), weights));
+    __m128 high = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(quad, zero), weights));
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+    __m128i sum = _mm_add_epi32(_mm_add_epi32(even, odd), _mm_set1_epi32(LumaBias));
+    return _mm_srai_epi32(sum, LumaShift);
+}
+
+// Pack 16 luma values (four vectors of 32-bit lanes) into bytes
+__attribute__((target("sse2")))
+static inline void storeLumaSSE2(unsigned char *dest, __m128i l0, __m128i l1, __m128i l2, __m128i l3) {
+    __m128i low = _mm_packs_epi32(l0, l1);
+    __m128i high = _mm_packs_epi32(l2, l3);
+    _mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(low, high));
+}
+
+// 16 four-byte pixels per step
+__attribute__((target("sse2")))
+static void grayRowSSE2(const unsigned char *source, unsigned char *dest, int width, const short *weights) {
+    const __m128i w = _mm_setr_epi16(weights[0], weights[1], weights[2], weights[3],
+                                     weights[0], weights[1], weights[2], weights[3]);
+    
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const unsigned char *p = source + x * 4;
+        storeLumaSSE2(dest + x,
+                      lumaSSE2(_mm_loadu_si128((const __m128i *)p), w),
+                      lumaSSE2(_mm_loadu_si128((const __m128i *)(p + 16)), w),
+                      lumaSSE2(_mm_loadu_si128((const __m128i *)(p + 32)), w),
+                      lumaSSE2(_mm_loadu_si128((const __m128i *)(p + 48)), w));
+    }
+    
+    grayRowScalar4(source + x * 4, dest + x, width - x, weights);
+}
+
+// 16 three-byte pixels per step: pshufb spreads each group of 4 pixels
+// (12 bytes) into four-byte lanes with a zero fourth channel
+__attribute__((target("ssse3")))
+static void grayRowSSSE3(const unsigned char *source, unsigned char *dest, int width, const short *weights) {
+    const __m128i w = _mm_setr_epi16(weights[0], weights[1], weights[2], 0,
+                                     weights[0], weights[1], weights[2], 0);
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    
+    // The last 16-byte load of a step starts at byte 36 and reads 4 bytes
+    // past the 48 it uses, so stop while that stays inside the row
+    int rowBytes = width * 3;
+    int x = 0;
+    for (; x * 3 + 52 <= rowBytes; x += 16) {
+        const unsigned char *p = source + x * 3;
+        storeLumaSSE2(dest + x,
+                      lumaSSE2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), spread), w),
+                      lumaSSE2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 12)), spread), w),
+                      lumaSSE2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 24)), spread), w),
+                      lumaSSE2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 36)), spread), w));
+    }
+    
+    grayRowScalar3(source + x * 3, dest + x, width - x, weights);
+}
+
+#endif
+
+static pthread_once_t rowFunctionsOnce = PTHREAD_ONCE_INIT;
+static GrayRowFunction grayRow3 = grayRowScalar3;
+static GrayRowFunction grayRow4 = grayRowScalar4;
+
+static void selectRowFunctions(void) {
+#ifdef IMAGE_PIXEL_FORMAT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        grayRow4 = grayRowSSE2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        grayRow3 = grayRowSSSE3;
+    }
+#endif
+}
+
+int ImagePixelFormatBytesPerPixel(ImagePixelFormat format) {
+    switch (format) {
+        case ImagePixelFormatGray8:
+            return 1;
+        case ImagePixelFormatRGB24:
+            return 3;
+        case ImagePixelFormatRGBA32:
+        case ImagePixelFormatBGRA32:
+        case ImagePixelFormatARGB32:
+            return 4;
+    }
+    return 0;
+}
+
+// Shared by the row bands of one conversion
+typedef struct {
+    const unsigned char *pixels;
+    int stride;
+    int width;
+    int bytesPerPixel;
+    short weights[4];
+    GrayRowFunction convertRow;
+    ImageBuffer dest;
+} GrayJob;
+
+static void convertGrayRows(void *context, int rowStart, int rowEnd) {
+    GrayJob *job = (GrayJob *)context;
+    int y;
+    for (y = rowStart; y < rowEnd; y++) {
+        const unsigned char *sourceRow = job->pixels + (size_t)y * job->stride;
+        unsigned char *destRow = job->dest.data + (size_t)y * job->dest.stride;
+        if (job->bytesPerPixel == 1) {
+            memcpy(destRow, sourceRow, job->width);
+        } else {
+            job->convertRow(sourceRow, destRow, job->width, job->weights);
+        }
+    }
+}
+
+int ImageConvertToGray(const unsigned char *pixels, int width, int height, int stride,
+                       ImagePixelFormat format, ImageBuffer dest) {
+    int bytesPerPixel = ImagePixelFormatBytesPerPixel(format);
+    if (!pixels || width <= 0 || height <= 0 || bytesPerPixel == 0 || stride < width * bytesPerPixel) {
+        return 0;
+    }
+    if (!ImageBufferIsValid(dest) || dest.width < width || dest.height < height) {
+        return 0;
+    }
+    
+    pthread_once(&rowFunctionsOnce, selectRowFunctions);
+    
+    GrayJob job = {pixels, stride, width, bytesPerPixel, {0, 0, 0, 0}, NULL, dest};
+    switch (format) {
+        case ImagePixelFormatRGB24:
+        case ImagePixelFormatRGBA32:
+            job.weights[0] = LumaRed;
+            job.weights[1] = LumaGreen;
+            job.weights[2] = LumaBlue;
+            break;
+        case ImagePixelFormatBGRA32:
+            job.weights[0] = LumaBlue;
+            job.weights[1] = LumaGreen;
+            job.weights[2] = LumaRed;
+            break;
+        case ImagePixelFormatARGB32:
+            job.weights[1] = LumaRed;
+            job.weights[2] = LumaGreen;
+            job.weights[3] = LumaBlue;
+            break;
+        case ImagePixelFormatGray8:
+            break;
+    }
+    job.convertRow = bytesPerPixel == 3 ? grayRow3 : grayRow4;
+    
+    ImageParallelForRows(height, width, convertGrayRows, &job);
+    return 1;
+}
+
+ImageBuffer ImageBufferFromPixels(const unsigned char *pixels, int width, int height, int stride,
+                                  ImagePixelFormat format) {
+    ImageBuffer buffer = ImageBufferCreate(width, height);
+    if (!buffer.data) {
+        return buffer;
+    }
+    
+    if (!ImageConvertToGray(pixels, width, height, stride, format, buffer)) {
+        ImageBufferFree(&buffer);
+    }
+    return buffer;
+}
@@ -0,0 +1,71 @@
+//
+//  ImagePyramid.h
+//  SmallBarcodeReader
+//
+//  Box-filtered resolution pyramid and textured-region search for coarse-to-fine
+//  decoding (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+#import "ImageBuffer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Most levels a pyramid holds (level 0 included)
+#define ImagePyramidMaximumLevels 8
+
+/// Side of the square tiles ImageFindTexturedRegions measures, in pixels
+#define ImageRegionTileSize 16
+
+/// Successive 2x reductions of one image
+typedef struct {
+    ImageBuffer levels[ImagePyramidMaximumLevels]; // levels[0] borrows the source
+    int count;                                     // Levels in use (at least 1 if built)
+} ImagePyramid;
+
+/// Rectangle of an image with strong local contrast
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+    float energy; // Sum of its tile scores
+} ImageRegion;
+
+/// Halve an image with a 2x2 box filter: each destination pixel is the
+/// rounded mean of four source pixels. An odd last row or column is dropped.
+/// SSE2 when available; rows run on the shared thread pool.
+/// @param source Source buffer (any stride, at least 2x2)
+/// @param dest Destination of source.width / 2 by source.height / 2 pixels
+///        (any stride; may not alias source)
+/// @return Non-zero on success, zero if the sizes do not match
+int ImageDownsampleInto(ImageBuffer source, ImageBuffer dest);
+
+/// Build a pyramid by halving until a level has at most coarsePixels pixels,
+/// a side would drop below 2 pixels, or ImagePyramidMaximumLevels is reached
+/// @param source Level 0 (borrowed; must outlive the pyramid)
+/// @param coarsePixels Largest acceptable coarsest level, in pixels
+/// @return Pyramid (free with ImagePyramidFree); count is 0 if source is
+///         invalid and stops early if memory runs out
+ImagePyramid ImagePyramidCreate(ImageBuffer source, long coarsePixels);
+
+/// Free the levels a pyramid owns and reset it
+/// @param pyramid Pyramid to free
+void ImagePyramidFree(ImagePyramid *pyramid);
+
+/// Find regions likely to hold a symbol. The image is cut into
+/// ImageRegionTileSize tiles scored by mean absolute gradient; tiles scoring
+/// at least minimumEnergy and a quarter of the best tile are grouped by
+/// 8-connectivity, groups of fewer than minimumTiles are dropped, and each
+/// group's bounding box is grown by one tile for the quiet zone. Overlapping
+/// boxes are merged. Regions come back most textured (highest energy) first.
+/// @param buffer Image to search (any stride)
+/// @param minimumEnergy Smallest tile score worth keeping (0-510)
+/// @param minimumTiles Smallest group worth keeping
+/// @param regions Receives up to maximumRegions regions, in buffer pixels
+/// @param maximumRegions Capacity of regions
+/// @return Number of regions written
+int ImageFindTexturedRegions(ImageBuffer buffer, float minimumEnergy, int minimumTiles,
+                             ImageRegion *regions, int maximumRegions);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,361 @@
+//
+//  ImagePyramid.m
+//  SmallBarcodeReader
+//
+//  Box-filtered resolution pyramid and textured-region search
+//
+
+#import "ImagePyramid.h"
+#import "ImageParallel.h"
+#import <pthread.h>
+#import <stdlib.h>
+#import <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define IMAGE_PYRAMID_X86 1
+#import <immintrin.h>
+#endif
+
+// Halves one row pair into a destination row of width pixels
+typedef void (*DownsampleRowFunction)(const unsigned char *top, const unsigned char *bottom, unsigned char *dest, int width);
+
+// Adds the gradient of one row to the running sum of each tile it crosses;
+// next is the row below (the row itself for the last row)
+typedef void (*EnergyRowFunction)(const unsigned char *row, const unsigned char *next, int width, unsigned int *tileSums);
+
+static void downsampleRowScalar(const unsigned char *top, const unsigned char *bottom, unsigned char *dest, int width) {
+    int x;
+    for (x = 0; x < width; x++) {
+        dest[x] = (unsigned char)((top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2);
+    }
+}
+
+static void energyRowScalar(const unsigned char *row, const unsigned char *next, int width, unsigned int *tileSums) {
+    int x;
+    for (x = 0; x < width; x++) {
+        int horizontal = x + 1 < width ? abs(row[x + 1] - row[x]) : 0;
+        tileSums[x / ImageRegionTileSize] += (unsigned int)(horizontal + abs(next[x] - row[x]));
+    }
+}
+
+#ifdef IMAGE_PYRAMID_X86
+
+// 32 source pixels per step: the even byte of each 16-bit lane is masked
+// off and the odd one shifted down, so pair sums stay in 16 bits
+__attribute__((target("sse2")))
+static inline __m128i pairSumsSSE2(__m128i pixels) {
+    const __m128i even = _mm_set1_epi16(0x00FF);
+    return _mm_add_epi16(_mm_and_si128(pixels, even), _mm_srli_epi16(pixels, 8));
+}
+
+__attribute__((target("sse2")))
+static void downsampleRowSSE2(const unsigned char *top, const unsigned char *bottom, unsigned char *dest, int width) {
+    const __m128i rounding = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const unsigned char *t = top + 2 * x;
+        const unsigned char *b = bottom + 2 * x;
+        __m128i low = _mm_add_epi16(pairSumsSSE2(_mm_loadu_si128((const __m128i *)t)),
+                                    pairSumsSSE2(_mm_loadu_si128((const __m128i *)b)));
+        __m128i high = _mm_add_epi16(pairSumsSSE2(_mm_loadu_si128((const __m128i *)(t + 16))),
+                                     pairSumsSSE2(_mm_loadu_si128((const __m128i *)(b + 16))));
+        low = _mm_srli_epi16(_mm_add_epi16(low, rounding), 2);
+        high = _mm_srli_epi16(_mm_add_epi16(high, rounding), 2);
+        _mm_storeu_si128((__m128i *)(dest + x), _mm_packus_epi16(low, high));
+    }
+
+    downsampleRowScalar(top + 2 * x, bottom + 2 * x, dest + x, width - x);
+}
+
+// One tile-aligned run of 16 pixels per step: psadbw sums the absolute
+// differences against the pixel to the right and the pixel below. The load
+// one to the right needs a 17th pixel, so the last run goes to the scalar path.
+__attribute__((target("sse2")))
+static void energyRowSSE2(const unsigned char *row, const unsigned char *next, int width, unsigned int *tileSums) {
+    int x = 0;
+    for (; x + ImageRegionTileSize < width; x += ImageRegionTileSize) {
+        __m128i here = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i right = _mm_loadu_si128((const __m128i *)(row + x + 1));
+        __m128i below = _mm_loadu_si128((const __m128i *)(next + x));
+        __m128i sums = _mm_add_epi64(_mm_sad_epu8(here, right), _mm_sad_epu8(here, below));
+        sums = _mm_add_epi64(sums, _mm_unpackhi_epi64(sums, sums));
+        tileSums[x / ImageRegionTileSize] += (unsigned int)_mm_cvtsi128_si32(sums);
+    }
+
+    energyRowScalar(row + x, next + x, width - x, tileSums + x / ImageRegionTileSize);
+}
+
+#endif
+
+static pthread_once_t rowFunctionsOnce = PTHREAD_ONCE_INIT;
+static DownsampleRowFunction downsampleRow = downsampleRowScalar;
+static EnergyRowFunction energyRow = energyRowScalar;
+
+static void selectRowFunctions(void) {
+#ifdef IMAGE_PYRAMID_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        downsampleRow = downsampleRowSSE2;
+        energyRow = energyRowSSE2;
+    }
+#endif
+}
+
+// Shared by the row bands of one reduction
+typedef struct {
+    ImageBuffer source;
+    ImageBuffer dest;
+} DownsampleJob;
+
+static void downsampleRows(void *context, int rowStart, int rowEnd) {
+    DownsampleJob *job = (DownsampleJob *)context;
+    int y;
+    for (y = rowStart; y < rowEnd; y++) {
+        const unsigned char *top = job->source.data + (size_t)(2 * y) * job->source.stride;
+        downsampleRow(top, top + job->source.stride, job->dest.data + (size_t)y * job->dest.stride, job->dest.width);
+    }
+}
+
+int ImageDownsampleInto(ImageBuffer source, ImageBuffer dest) {
+    if (!ImageBufferIsValid(source) || !ImageBufferIsValid(dest)) {
+        return 0;
+    }
+    if (dest.width != source.width / 2 || dest.height != source.height / 2 || dest.width == 0 || dest.height == 0) {
+        return 0;
+    }
+
+    pthread_once(&rowFunctionsOnce, selectRowFunctions);
+
+    DownsampleJob job = {source, dest};
+    ImageParallelForRows(dest.height, dest.width, downsampleRows, &job);
+    return 1;
+}
+
+ImagePyramid ImagePyramidCreate(ImageBuffer source, long coarsePixels) {
+    ImagePyramid pyramid;
+    memset(&pyramid, 0, sizeof(pyramid));
+    if (!ImageBufferIsValid(source)) {
+        return pyramid;
+    }
+
+    pyramid.levels[0] = ImageBufferWrap(source.data, source.width, source.height, source.stride);
+    pyramid.count = 1;
+    while (pyramid.count < ImagePyramidMaximumLevels) {
+        ImageBuffer last = pyramid.levels[pyramid.count - 1];
+        if ((long)last.width * last.height <= coarsePixels || last.width < 4 || last.height < 4) {
+            break;
+        }
+        ImageBuffer level = ImageBufferCreate(last.width / 2, last.height / 2);
+        if (!ImageBufferIsValid(level)) {
+            break;
+        }
+        ImageDownsampleInto(last, level);
+        pyramid.levels[pyramid.count++] = level;
+    }
+    return pyramid;
+}
+
+void ImagePyramidFree(ImagePyramid *pyramid) {
+    if (!pyramid) {
+        return;
+    }
+    int i;
+    for (i = 1; i < pyramid->count; i++) {
+        ImageBufferFree(&pyramid->levels[i]);
+    }
+    memset(pyramid, 0, sizeof(*pyramid));
+}
+
+// Shared by the tile-row bands of one energy map
+typedef struct {
+    ImageBuffer buffer;
+    int tilesAcross;
+    unsigned int *tileSums;
+} EnergyJob;
+
+static void measureTileRows(void *context, int tileRowStart, int tileRowEnd) {
+    EnergyJob *job = (EnergyJob *)context;
+    int y = tileRowStart * ImageRegionTileSize;
+    int yEnd = tileRowEnd * ImageRegionTileSize;
+    if (yEnd > job->buffer.height) {
+        yEnd = job->buffer.height;
+    }
+    for (; y < yEnd; y++) {
+        const unsigned char *row = job->buffer.data + (size_t)y * job->buffer.stride;
+        const unsigned char *next = y + 1 < job->buffer.height ? row + job->buffer.stride : row;
+        energyRow(row, next, job->buffer.width, job->tileSums + (size_t)(y / ImageRegionTileSize) * job->tilesAcross);
+    }
+}
+
+// One group of connected tiles, in tile coordinates
+typedef struct {
+    int left, top, right, bottom; // Inclusive
+    int tiles;
+    float energy; // Sum of tile scores
+} TileGroup;
+
+static int compareRegionsByEnergy(const void *a, const void *b) {
+    float ea = ((const ImageRegion *)a)->energy;
+    float eb = ((const ImageRegion *)b)->energy;
+    return ea < eb ? 1 : (ea > eb ? -1 : 0);
+}
+
+static int regionsOverlap(ImageRegion a, ImageRegion b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+// Merge overlapping regions in place until none overlap
+static int mergeOverlappingRegions(ImageRegion *regions, int count) {
+    int merged = 1;
+    while (merged) {
+        merged = 0;
+        int i, j;
+        for (i = 0; i < count && !merged; i++) {
+            for (j = i + 1; j < count; j++) {
+                if (!regionsOverlap(regions[i], regions[j])) {
+                    continue;
+                }
+                ImageRegion a = regions[i], b = regions[j];
+                int right = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+                int bottom = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+                regions[i].x = a.x < b.x ? a.x : b.x;
+                regions[i].y = a.y < b.y ? a.y : b.y;
+                regions[i].width = right - regions[i].x;
+                regions[i].height = bottom - regions[i].y;
+                regions[i].energy = a.energy + b.energy;
+                regions[j] = regions[--count];
+                merged = 1;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+int ImageFindTexturedRegions(ImageBuffer buffer, float minimumEnergy, int minimumTiles,
+                             ImageRegion *regions, int maximumRegions) {
+    if (!ImageBufferIsValid(buffer) || !regions || maximumRegions <= 0) {
+        return 0;
+    }
+
+    pthread_once(&rowFunctionsOnce, selectRowFunctions);
+
+    int tilesAcross = (buffer.width + ImageRegionTileSize - 1) / ImageRegionTileSize;
+    int tilesDown = (buffer.height + ImageRegionTileSize - 1) / ImageRegionTileSize;
+    int tileCount = tilesAcross * tilesDown;
+    unsigned int *tileSums = (unsigned int *)calloc((size_t)tileCount, sizeof(unsigned int));
+    float *energy = (float *)malloc((size_t)tileCount * sizeof(float));
+    int *labels = (int *)malloc((size_t)tileCount * sizeof(int));
+    int *stack = (int *)malloc((size_t)tileCount * sizeof(int));
+    TileGroup *groups = (TileGroup *)malloc((size_t)tileCount * sizeof(TileGroup));
+    ImageRegion *found = (ImageRegion *)malloc((size_t)tileCount * sizeof(ImageRegion));
+    if (!tileSums || !energy || !labels || !stack || !groups || !found) {
+        free(tileSums);
+        free(energy);
+        free(labels);
+        free(stack);
+        free(groups);
+        free(found);
+        return 0;
+    }
+
+    EnergyJob job = {buffer, tilesAcross, tileSums};
+    ImageParallelForRows(tilesDown, buffer.width * ImageRegionTileSize, measureTileRows, &job);
+
+    // Mean gradient per tile; edge tiles are divided by their own area
+    float strongest = 0.0f;
+    int tx, ty, i;
+    for (ty = 0; ty < tilesDown; ty++) {
+        int tileHeight = buffer.height - ty * ImageRegionTileSize;
+        if (tileHeight > ImageRegionTileSize) {
+            tileHeight = ImageRegionTileSize;
+        }
+        for (tx = 0; tx < tilesAcross; tx++) {
+            int tileWidth = buffer.width - tx * ImageRegionTileSize;
+            if (tileWidth > ImageRegionTileSize) {
+                tileWidth = ImageRegionTileSize;
+            }
+            i = ty * tilesAcross + tx;
+            energy[i] = (float)tileSums[i] / (float)(tileWidth * tileHeight);
+            if (energy[i] > strongest) {
+                strongest = energy[i];
+            }
+        }
+    }
+    float threshold = strongest * 0.25f > minimumEnergy ? strongest * 0.25f : minimumEnergy;
+
+    // Label 8-connected groups of textured tiles (-1 = flat, 0 = unvisited)
+    for (i = 0; i < tileCount; i++) {
+        labels[i] = energy[i] >= threshold ? 0 : -1;
+    }
+    int groupCount = 0;
+    for (i = 0; i < tileCount; i++) {
+        if (labels[i] != 0) {
+            continue;
+        }
+        TileGroup *group = &groups[groupCount++];
+        group->left = group->right = i % tilesAcross;
+        group->top = group->bottom = i / tilesAcross;
+        group->tiles = 0;
+        group->energy = 0.0f;
+
+        int depth = 0;
+        stack[depth++] = i;
+        labels[i] = groupCount;
+        while (depth > 0) {
+            int tile = stack[--depth];
+            int x = tile % tilesAcross, y = tile / tilesAcross, dx, dy;
+            group->tiles++;
+            group->energy += energy[tile];
+            if (x < group->left) group->left = x;
+            if (x > group->right) group->right = x;
+            if (y < group->top) group->top = y;
+            if (y > group->bottom) group->bottom = y;
+            for (dy = -1; dy <= 1; dy++) {
+                for (dx = -1; dx <= 1; dx++) {
+                    int nx = x + dx, ny = y + dy;
+                    if (nx < 0 || ny < 0 || nx >= tilesAcross || ny >= tilesDown) {
+                        continue;
+                    }
+                    int neighbour = ny * tilesAcross + nx;
+                    if (labels[neighbour] == 0) {
+                        labels[neighbour] = groupCount;
+                        stack[depth++] = neighbour;
+                    }
+                }
+            }
+        }
+    }
+
+    // Boxes grown by one tile for the quiet zone, clipped to the image
+    int foundCount = 0;
+    for (i = 0; i < groupCount; i++) {
+        TileGroup group = groups[i];
+        if (group.tiles < minimumTiles) {
+            continue;
+        }
+        int left = (group.left - 1) * ImageRegionTileSize;
+        int top = (group.top - 1) * ImageRegionTileSize;
+        int right = (group.right + 2) * ImageRegionTileSize;
+        int bottom = (group.bottom + 2) * ImageRegionTileSize;
+        if (left < 0) left = 0;
+        if (top < 0) top = 0;
+        if (right > buffer.width) right = buffer.width;
+        if (bottom > buffer.height) bottom = buffer.height;
+        ImageRegion region = {left, top, right - left, bottom - top, group.energy};
+        found[foundCount++] = region;
+    }
+    foundCount = mergeOverlappingRegions(found, foundCount);
+    qsort(found, (size_t)foundCount, sizeof(ImageRegion), compareRegionsByEnergy);
+
+    int count = foundCount < maximumRegions ? foundCount : maximumRegions;
+    memcpy(regions, found, (size_t)count * sizeof(ImageRegion));
+
+    free(tileSums);
+    free(energy);
+    free(labels);
+    free(stack);
+    free(groups);
+    free(found);
+    return count;
+}
@@ -0,0 +1,50 @@
+//
+//  ImageScratch.h
+//  SmallBarcodeReader
+//
+//  Per-thread pool of reusable scratch blocks (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Most bytes one thread keeps cached; blocks that would not fit go
+/// straight back to the system
+#define ImageScratchMaximumCachedBytes ((size_t)64 << 20)
+
+/// Most blocks one thread keeps cached
+#define ImageScratchMaximumCachedBlocks 16
+
+/// Pool counters of the calling thread
+typedef struct {
+    uint64_t hits;       // Allocations served from the pool
+    uint64_t misses;     // Allocations that went to malloc
+    int cachedBlocks;    // Blocks waiting for reuse
+    size_t cachedBytes;  // Their total capacity
+} ImageScratchStatistics;
+
+/// Allocate a block from the calling thread's pool, falling back to malloc.
+/// Test cells allocate the same few plane sizes over and over (rasters,
+/// grayscale copies, ping-pong buffers, convolution scratch), so after the
+/// first cell they are served without touching the allocator.
+/// @param size Bytes needed
+/// @return Block of at least size bytes (free with ImageScratchFree, never
+///         free()), or NULL if out of memory
+void *ImageScratchAlloc(size_t size);
+
+/// Return a block to the calling thread's pool. Any thread may return any
+/// block; it joins that thread's pool.
+/// @param block Block from ImageScratchAlloc (may be NULL)
+void ImageScratchFree(void *block);
+
+/// Mark the end of a unit of work (a test cell) on the calling thread:
+/// cached blocks not returned since the previous call are released, so a
+/// sweep that moves on to other raster sizes keeps a flat footprint
+void ImageScratchTrim(void);
+
+/// Counters of the calling thread's pool
+/// @return Statistics
+ImageScratchStatistics ImageScratchGetStatistics(void);
+
+NS_ASSUME_NONNULL_END
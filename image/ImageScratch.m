@@ -0,0 +1,155 @@
+//
+//  ImageScratch.m
+//  SmallBarcodeReader
+//
+//  Per-thread pool of reusable scratch blocks implementation
+//
+
+#import "ImageScratch.h"
+#import <pthread.h>
+#import <stdlib.h>
+#import <string.h>
+
+// Capacities are rounded up to this so near-equal sizes (a raster a few rows
+// taller after a rotation) reuse one block
+#define ImageScratchGranularity 4096
+
+// Header in front of every block; 32 bytes keeps the data 16-byte aligned
+// wherever malloc is
+typedef union {
+    struct {
+        size_t capacity;  // Usable bytes after the header
+        unsigned epoch;   // Trim epoch of the pool it was last returned to
+    } info;
+    unsigned char padding[32];
+} ScratchHeader;
+
+typedef struct {
+    ScratchHeader *blocks[ImageScratchMaximumCachedBlocks];
+    int count;
+    size_t bytes;
+    unsigned epoch;
+    uint64_t hits;
+    uint64_t misses;
+} ScratchPool;
+
+static pthread_once_t poolKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t poolKey;
+
+// Thread exit: cached blocks go back to the system with the pool
+static void destroyPool(void *context) {
+    ScratchPool *pool = (ScratchPool *)context;
+    int i;
+    for (i = 0; i < pool->count; i++) {
+        free(pool->blocks[i]);
+    }
+    free(pool);
+}
+
+static void createPoolKey(void) {
+    pthread_key_create(&poolKey, destroyPool);
+}
+
+static ScratchPool *currentPool(void) {
+    pthread_once(&poolKeyOnce, createPoolKey);
+    ScratchPool *pool = (ScratchPool *)pthread_getspecific(poolKey);
+    if (!pool) {
+        pool = (ScratchPool *)calloc(1, sizeof(ScratchPool));
+        if (pool && pthread_setspecific(poolKey, pool) != 0) {
+            free(pool);
+            pool = NULL;
+        }
+    }
+    return pool;
+}
+
+static void removeBlock(ScratchPool *pool, int index) {
+    pool->bytes -= pool->blocks[index]->info.capacity;
+    pool->blocks[index] = pool->blocks[--pool->count];
+}
+
+void *ImageScratchAlloc(size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    ScratchPool *pool = currentPool();
+
+    // Best fit, but never more than twice the request: a huge plane is not
+    // tied up by a small row buffer
+    if (pool) {
+        int best = -1, i;
+        for (i = 0; i < pool->count; i++) {
+            size_t capacity = pool->blocks[i]->info.capacity;
+            if (capacity >= size && capacity <= 2 * size + ImageScratchGranularity &&
+                (best < 0 || capacity < pool->blocks[best]->info.capacity)) {
+                best = i;
+            }
+        }
+        if (best >= 0) {
+            ScratchHeader *header = pool->blocks[best];
+            removeBlock(pool, best);
+            pool->hits++;
+            return header + 1;
+        }
+        pool->misses++;
+    }
+
+    size_t capacity = (size + ImageScratchGranularity - 1) / ImageScratchGranularity * ImageScratchGranularity;
+    if (capacity < size) {
+        return NULL; // Overflow
+    }
+    ScratchHeader *header = (ScratchHeader *)malloc(sizeof(ScratchHeader) + capacity);
+    if (!header) {
+        return NULL;
+    }
+    header->info.capacity = capacity;
+    header->info.epoch = 0;
+    return header + 1;
+}
+
+void ImageScratchFree(void *block) {
+    if (!block) {
+        return;
+    }
+    ScratchHeader *header = (ScratchHeader *)block - 1;
+    ScratchPool *pool = currentPool();
+    if (!pool || pool->count == ImageScratchMaximumCachedBlocks ||
+        pool->bytes + header->info.capacity > ImageScratchMaximumCachedBytes) {
+        free(header);
+        return;
+    }
+    header->info.epoch = pool->epoch;
+    pool->blocks[pool->count++] = header;
+    pool->bytes += header->info.capacity;
+}
+
+void ImageScratchTrim(void) {
+    ScratchPool *pool = currentPool();
+    if (!pool) {
+        return;
+    }
+    int i = 0;
+    while (i < pool->count) {
+        if (pool->blocks[i]->info.epoch != pool->epoch) {
+            ScratchHeader *stale = pool->blocks[i];
+            removeBlock(pool, i);
+            free(stale);
+        } else {
+            i++;
+        }
+    }
+    pool->epoch++;
+}
+
+ImageScratchStatistics ImageScratchGetStatistics(void) {
+    ImageScratchStatistics statistics;
+    memset(&statistics, 0, sizeof(statistics));
+    ScratchPool *pool = currentPool();
+    if (pool) {
+        statistics.hits = pool->hits;
+        statistics.misses = pool->misses;
+        statistics.cachedBlocks = pool->count;
+        statistics.cachedBytes = pool->bytes;
+    }
+    return statistics;
+}
@@ -0,0 +1,54 @@
+//
+//  ImageWarp.h
+//  SmallBarcodeReader
+//
+//  Single-pass affine/perspective resampling (platform-independent)
+//
+
+#import <Foundation/Foundation.h>
+#import "ImageBuffer.h"
+#import "ImageMatrix.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Resampling filters
+typedef NS_ENUM(NSInteger, ImageInterpolation) {
+    ImageInterpolationNearest = 0,
+    ImageInterpolationBilinear,   // 8-bit fixed-point weights; SSE2 on affine row spans
+    ImageInterpolationBicubic     // Catmull-Rom
+};
+
+/// Translate a transform so the image it produces starts at (0, 0), and
+/// size an output that holds all of it
+/// @param transform Forward 3x3 transform (source to destination coordinates,
+///        pixel edges at integers)
+/// @param width Source width
+/// @param height Source height
+/// @param outWidth Receives the output width (at least 1)
+/// @param outHeight Receives the output height (at least 1)
+/// @return Translated transform (must be freed), or invalid matrix if the
+///         transform sends a corner to infinity
+ImageMatrix ImageWarpFitTransform(ImageMatrix transform, int width, int height, int *outWidth, int *outHeight);
+
+/// Resample an image through a transform in one pass. Destination pixels
+/// whose source position falls outside the image are white. Affine
+/// transforms step source coordinates in 16.16 fixed point along each row;
+/// perspective transforms divide per pixel. Rows run on the shared thread pool.
+/// @param source Source buffer (any stride)
+/// @param transform Forward 3x3 transform (source to destination coordinates)
+/// @param width Output width
+/// @param height Output height
+/// @param interpolation Resampling filter
+/// @return New owned buffer (must be freed), or invalid buffer if the
+///         transform is singular or memory runs out
+ImageBuffer ImageWarp(ImageBuffer source, ImageMatrix transform, int width, int height, ImageInterpolation interpolation);
+
+/// ImageWarp into a caller-provided buffer
+/// @param source Source buffer (any stride)
+/// @param transform Forward 3x3 transform (source to destination coordinates)
+/// @param dest Destination (packed rows of its width; may not alias source)
+/// @param interpolation Resampling filter
+/// @return Non-zero on success, zero if the transform is singular
+int ImageWarpInto(ImageBuffer source, ImageMatrix transform, ImageBuffer dest, ImageInterpolation interpolation);
+
+NS_ASSUME_NONNULL_END
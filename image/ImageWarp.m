@@ -0,0 +1,345 @@
+//
+//  ImageWarp.m
+//  SmallBarcodeReader
+//
+//  Single-pass affine/perspective resampling implementation
+//
+
+#import "ImageWarp.h"
+#import "ImageParallel.h"
+#import <math.h>
+#import <pthread.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define IMAGE_WARP_X86 1
+#import <immintrin.h>
+#endif
+
+// Destination pixels that map outside the source
+#define WarpBackground 255
+
+// Largest source side the 16.16 fixed-point row stepping can address
+#define WarpFixedPointLimit 32767
+
+// Shared by the row bands of one warp
+typedef struct {
+    const unsigned char *source;
+    int sourceWidth;
+    int sourceHeight;
+    int sourceStride;
+    unsigned char *dest;
+    int width;
+    double inverse[9];     // Destination to source coordinates
+    int affine;            // Bottom row of inverse is (0, 0, 1)
+    ImageInterpolation interpolation;
+} WarpJob;
+
+// Bilinear over an interior span (every tap inside the source): dest[i] for
+// source positions (u + i * du, v + i * dv), 16.16 fixed point
+typedef void (*WarpSpanFunction)(const WarpJob *job, unsigned char *dest, int count,
+                                 int32_t u, int32_t v, int32_t du, int32_t dv);
+
+static inline int sourceTap(const WarpJob *job, int64_t x, int64_t y) {
+    if (x < 0 || y < 0 || x >= job->sourceWidth || y >= job->sourceHeight) {
+        return WarpBackground;
+    }
+    return job->source[(size_t)y * job->sourceStride + (size_t)x];
+}
+
+// Bilinear blend of a 2x2 neighbourhood with 8-bit weights; every path
+// (scalar, interior, SSE2) uses exactly this arithmetic
+static inline unsigned char blendBilinear(int p00, int p01, int p10, int p11, int fx, int fy) {
+    int top = (p00 * (256 - fx) + p01 * fx + 128) >> 8;
+    int bottom = (p10 * (256 - fx) + p11 * fx + 128) >> 8;
+    return (unsigned char)((top * (256 - fy) + bottom * fy + 128) >> 8);
+}
+
+static unsigned char sampleBilinear(const WarpJob *job, int64_t u, int64_t v) {
+    int64_t ix = u >> 16;
+    int64_t iy = v >> 16;
+    if (ix < -1 || iy < -1 || ix >= job->sourceWidth || iy >= job->sourceHeight) {
+        return WarpBackground;
+    }
+    int fx = (int)((u >> 8) & 0xFF);
+    int fy = (int)((v >> 8) & 0xFF);
+    return blendBilinear(sourceTap(job, ix, iy), sourceTap(job, ix + 1, iy),
+                         sourceTap(job, ix, iy + 1), sourceTap(job, ix + 1, iy + 1), fx, fy);
+}
+
+static unsigned char sampleNearest(const WarpJob *job, int64_t u, int64_t v) {
+    return (unsigned char)sourceTap(job, (u + 32768) >> 16, (v + 32768) >> 16);
+}
+
+// Catmull-Rom weights for taps -1, 0, 1, 2 at fraction t
+static inline void cubicWeights(double t, double *weights) {
+    weights[0] = ((-0.5 * t + 1.0) * t - 0.5) * t;
+    weights[1] = (1.5 * t - 2.5) * t * t + 1.0;
+    weights[2] = ((-1.5 * t + 2.0) * t + 0.5) * t;
+    weights[3] = (0.5 * t - 0.5) * t * t;
+}
+
+static unsigned char sampleBicubic(const WarpJob *job, double u, double v) {
+    double fu = floor(u);
+    double fv = floor(v);
+    if (fu < -3.0 || fv < -3.0 || fu > job->sourceWidth + 1.0 || fv > job->sourceHeight + 1.0) {
+        return WarpBackground;
+    }
+    int64_t ix = (int64_t)fu;
+    int64_t iy = (int64_t)fv;
+    double wx[4], wy[4];
+    cubicWeights(u - fu, wx);
+    cubicWeights(v - fv, wy);
+
+    double sum = 0.0;
+    int row, col;
+    for (row = 0; row < 4; row++) {
+        double line = 0.0;
+        for (col = 0; col < 4; col++) {
+            line += wx[col] * sourceTap(job, ix + col - 1, iy + row - 1);
+        }
+        sum += wy[row] * line;
+    }
+    if (sum < 0.0) return 0;
+    if (sum > 255.0) return 255;
+    return (unsigned char)(sum + 0.5);
+}
+
+static void bilinearSpanScalar(const WarpJob *job, unsigned char *dest, int count,
+                               int32_t u, int32_t v, int32_t du, int32_t dv) {
+    int stride = job->sourceStride;
+    int i;
+    for (i = 0; i < count; i++, u += du, v += dv) {
+        const unsigned char *p = job->source + (size_t)(v >> 16) * stride + (u >> 16);
+        dest[i] = blendBilinear(p[0], p[1], p[stride], p[stride + 1], (u >> 8) & 0xFF, (v >> 8) & 0xFF);
+    }
+}
+
+#ifdef IMAGE_WARP_X86
+
+// Four pixels per step: coordinates and weights in 32-bit lanes, taps
+// gathered as 16-bit pairs so madd_epi16 forms both products of a lerp
+__attribute__((target("sse2")))
+static void bilinearSpanSSE2(const WarpJob *job, unsigned char *dest, int count,
+                             int32_t u, int32_t v, int32_t du, int32_t dv) {
+    const int stride = job->sourceStride;
+    const __m128i lowByte = _mm_set1_epi32(0xFF);
+    const __m128i full = _mm_set1_epi32(256);
+    const __m128i half = _mm_set1_epi32(128);
+    __m128i us = _mm_setr_epi32(u, u + du, u + 2 * du, u + 3 * du);
+    __m128i vs = _mm_setr_epi32(v, v + dv, v + 2 * dv, v + 3 * dv);
+    const __m128i stepU = _mm_set1_epi32(4 * du);
+    const __m128i stepV = _mm_set1_epi32(4 * dv);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32_t xs[4], ys[4];
+        _mm_storeu_si128((__m128i *)xs, _mm_srai_epi32(us, 16));
+        _mm_storeu_si128((__m128i *)ys, _mm_srai_epi32(vs, 16));
+        int32_t topPairs[4], bottomPairs[4];
+        int lane;
+        for (lane = 0; lane < 4; lane++) {
+            const unsigned char *p = job->source + (size_t)ys[lane] * stride + xs[lane];
+            topPairs[lane] = p[0] | (p[1] << 16);
+            bottomPairs[lane] = p[stride] | (p[stride + 1] << 16);
+        }
+
+        __m128i fx = _mm_and_si128(_mm_srli_epi32(us, 8), lowByte);
+        __m128i fy = _mm_and_si128(_mm_srli_epi32(vs, 8), lowByte);
+        __m128i wx = _mm_or_si128(_mm_sub_epi32(full, fx), _mm_slli_epi32(fx, 16));
+        __m128i wy = _mm_or_si128(_mm_sub_epi32(full, fy), _mm_slli_epi32(fy, 16));
+
+        __m128i top = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)topPairs), wx), half), 8);
+        __m128i bottom = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)bottomPairs), wx), half), 8);
+        __m128i vertical = _mm_or_si128(top, _mm_slli_epi32(bottom, 16));
+        __m128i value = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(vertical, wy), half), 8);
+
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(value, value), value);
+        int32_t bytes = _mm_cvtsi128_si32(packed);
+        memcpy(dest + i, &bytes, 4);
+
+        us = _mm_add_epi32(us, stepU);
+        vs = _mm_add_epi32(vs, stepV);
+    }
+
+    bilinearSpanScalar(job, dest + i, count - i, u + i * du, v + i * dv, du, dv);
+}
+
+#endif
+
+static pthread_once_t spanFunctionOnce = PTHREAD_ONCE_INIT;
+static WarpSpanFunction bilinearSpan = bilinearSpanScalar;
+
+static void selectSpanFunction(void) {
+#ifdef IMAGE_WARP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        bilinearSpan = bilinearSpanSSE2;
+    }
+#endif
+}
+
+// Grow or shrink [*low, *high) to the x whose fixed-point coordinate
+// start + x * step has 0 <= (coordinate >> 16) <= limit - 2 (both taps inside)
+static void interiorRange(int64_t start, int64_t step, int limit, int *low, int *high) {
+    int64_t top = (int64_t)(limit - 1) << 16; // Exclusive
+#define INSIDE(x) ((start + (int64_t)(x) * step) >= 0 && (start + (int64_t)(x) * step) < top)
+    if (step == 0) {
+        if (!INSIDE(0)) *high = *low;
+        return;
+    }
+    // Estimate the crossing points, then correct by stepping
+    double first = step > 0 ? -(double)start / step : ((double)top - 1 - start) / step;
+    double last = step > 0 ? ((double)top - 1 - start) / step : -(double)start / step;
+    if (first > *low) *low = first > *high ? *high : (int)ceil(first);
+    if (last + 1 < *high) *high = last + 1 < *low ? *low : (int)floor(last) + 1;
+    while (*low < *high && !INSIDE(*low)) (*low)++;
+    while (*high > *low && !INSIDE(*high - 1)) (*high)--;
+#undef INSIDE
+}
+
+static void warpRows(void *context, int rowStart, int rowEnd) {
+    const WarpJob *job = (const WarpJob *)context;
+    const double *m = job->inverse;
+    int y, x;
+    for (y = rowStart; y < rowEnd; y++) {
+        unsigned char *dest = job->dest + (size_t)y * job->width;
+        double cy = y + 0.5;
+
+        if (!job->affine || job->interpolation == ImageInterpolationBicubic) {
+            // Per-pixel source position (sample coordinates: centres at integers)
+            for (x = 0; x < job->width; x++) {
+                double cx = x + 0.5;
+                double w = m[6] * cx + m[7] * cy + m[8];
+                if (w <= 1e-9) {
+                    dest[x] = WarpBackground;
+                    continue;
+                }
+                double u = (m[0] * cx + m[1] * cy + m[2]) / w - 0.5;
+                double v = (m[3] * cx + m[4] * cy + m[5]) / w - 0.5;
+                if (fabs(u) > 1e7 || fabs(v) > 1e7) {
+                    dest[x] = WarpBackground;
+                } else if (job->interpolation == ImageInterpolationBicubic) {
+                    dest[x] = sampleBicubic(job, u, v);
+                } else if (job->interpolation == ImageInterpolationNearest) {
+                    dest[x] = sampleNearest(job, llround(u * 65536.0), llround(v * 65536.0));
+                } else {
+                    dest[x] = sampleBilinear(job, llround(u * 65536.0), llround(v * 65536.0));
+                }
+            }
+            continue;
+        }
+
+        // Affine: the source position moves by a constant step along the row
+        int64_t u0 = llround((m[0] * 0.5 + m[1] * cy + m[2] - 0.5) * 65536.0);
+        int64_t v0 = llround((m[3] * 0.5 + m[4] * cy + m[5] - 0.5) * 65536.0);
+        int64_t du = llround(m[0] * 65536.0);
+        int64_t dv = llround(m[3] * 65536.0);
+
+        if (job->interpolation == ImageInterpolationNearest) {
+            for (x = 0; x < job->width; x++) {
+                dest[x] = sampleNearest(job, u0 + x * du, v0 + x * dv);
+            }
+            continue;
+        }
+
+        int low = 0, high = job->width;
+        interiorRange(u0, du, job->sourceWidth, &low, &high);
+        interiorRange(v0, dv, job->sourceHeight, &low, &high);
+        for (x = 0; x < low; x++) {
+            dest[x] = sampleBilinear(job, u0 + x * du, v0 + x * dv);
+        }
+        if (high > low) {
+            bilinearSpan(job, dest + low, high - low, (int32_t)(u0 + low * du), (int32_t)(v0 + low * dv),
+                         (int32_t)du, (int32_t)dv);
+        }
+        for (x = high > low ? high : low; x < job->width; x++) {
+            dest[x] = sampleBilinear(job, u0 + x * du, v0 + x * dv);
+        }
+    }
+}
+
+ImageMatrix ImageWarpFitTransform(ImageMatrix transform, int width, int height, int *outWidth, int *outHeight) {
+    ImageMatrix invalid = {NULL, 0, 0};
+    if (!transform.data || transform.rows != 3 || transform.cols != 3) {
+        return invalid;
+    }
+
+    const float *m = transform.data;
+    double corners[4][2] = {{0, 0}, {width, 0}, {0, height}, {width, height}};
+    double minX = HUGE_VAL, minY = HUGE_VAL, maxX = -HUGE_VAL, maxY = -HUGE_VAL;
+    int i;
+    for (i = 0; i < 4; i++) {
+        double x = corners[i][0], y = corners[i][1];
+        double w = m[6] * x + m[7] * y + m[8];
+        if (w <= 1e-9) {
+            return invalid;
+        }
+        double tx = (m[0] * x + m[1] * y + m[2]) / w;
+        double ty = (m[3] * x + m[4] * y + m[5]) / w;
+        if (tx < minX) minX = tx;
+        if (tx > maxX) maxX = tx;
+        if (ty < minY) minY = ty;
+        if (ty > maxY) maxY = ty;
+    }
+
+    // Tolerate float error so exact sizes do not gain a column
+    double fittedWidth = ceil(maxX - minX - 1e-3);
+    double fittedHeight = ceil(maxY - minY - 1e-3);
+    if (fittedWidth > 1e6 || fittedHeight > 1e6) {
+        return invalid;
+    }
+    *outWidth = fittedWidth < 1 ? 1 : (int)fittedWidth;
+    *outHeight = fittedHeight < 1 ? 1 : (int)fittedHeight;
+
+    ImageMatrix shift = ImageMatrixTranslation((float)-minX, (float)-minY);
+    ImageMatrix fitted = ImageMatrixMultiply(shift, transform);
+    ImageMatrixFree(&shift);
+    return fitted;
+}
+
+int ImageWarpInto(ImageBuffer source, ImageMatrix transform, ImageBuffer dest, ImageInterpolation interpolation) {
+    if (!ImageBufferIsValid(source) || !ImageBufferIsValid(dest)) {
+        return 0;
+    }
+
+    ImageMatrix inverse = ImageMatrixInvert3x3(transform);
+    if (!inverse.data) {
+        return 0;
+    }
+
+    WarpJob job;
+    job.source = source.data;
+    job.sourceWidth = source.width;
+    job.sourceHeight = source.height;
+    job.sourceStride = source.stride;
+    job.dest = dest.data;
+    job.width = dest.width;
+    job.interpolation = interpolation;
+    int i;
+    for (i = 0; i < 9; i++) {
+        job.inverse[i] = inverse.data[i] / inverse.data[8];
+    }
+    ImageMatrixFree(&inverse);
+    job.affine = job.inverse[6] == 0.0 && job.inverse[7] == 0.0 &&
+                 source.width <= WarpFixedPointLimit && source.height <= WarpFixedPointLimit;
+
+    pthread_once(&spanFunctionOnce, selectSpanFunction);
+    ImageParallelForRows(dest.height, dest.width, warpRows, &job);
+    return 1;
+}
+
+ImageBuffer ImageWarp(ImageBuffer source, ImageMatrix transform, int width, int height, ImageInterpolation interpolation) {
+    ImageBuffer result = {NULL, 0, 0, 0, 0};
+    if (!ImageBufferIsValid(source) || width <= 0 || height <= 0) {
+        return result;
+    }
+
+    result = ImageBufferCreate(width, height);
+    if (result.data && !ImageWarpInto(source, transform, result, interpolation)) {
+        ImageBufferFree(&result);
+    }
+    return result;
+}
@@ -0,0 +1,95 @@
+//
+//  BarcodeRasterCache.h
+//  SmallBarcodeReader
+//
+//  Bounded LRU cache of encoded barcode rasters for test sweeps
+//
+
+#import <Foundation/Foundation.h>
+#import "ImageBuffer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Bounded least-recently-used cache of encoded grayscale rasters, keyed by
+/// (payload, symbology, encoder options). Safe to share between threads:
+/// rasters are copied in and out, so eviction never frees pixels in use.
+/// A lookup can claim a missing key; other threads asking for that key then
+/// wait for the claimant's raster instead of encoding the symbol again.
+@interface BarcodeRasterCache : NSObject {
+    NSMutableDictionary *entries; // Key -> entry
+    NSMutableSet *pending;        // Keys claimed by an encode in progress
+    id mostRecent;                // Head of the recency list
+    id leastRecent;               // Tail of the recency list
+    NSUInteger capacity;
+    NSUInteger hits;
+    NSUInteger misses;
+    NSUInteger evictions;
+    NSCondition *lock;            // Signalled when a claimed key is settled
+}
+
+/// Initialize with default capacity (64 rasters)
+- (instancetype)init;
+
+/// Initialize with a maximum number of rasters
+/// @param capacity Maximum number of cached rasters (at least 1)
+- (instancetype)initWithCapacity:(NSUInteger)capacity;
+
+/// Look up an encoded raster; counts a hit or a miss
+/// @param data Encoded payload
+/// @param symbology Barcode symbology ID
+/// @param options Encoder options used (may be nil)
+/// @return Copy of the cached raster (must be freed with ImageBufferFree),
+///         or invalid buffer on a miss
+- (ImageBuffer)rasterForData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options;
+
+/// Look up an encoded raster, claiming the key on a miss. While another
+/// thread holds the claim, waits for it to store the raster (a hit) or
+/// abandon the key. A caller that gets a claim must settle it with
+/// setRaster:... or abandonRasterForData:....
+/// @param data Encoded payload
+/// @param symbology Barcode symbology ID
+/// @param options Encoder options used (may be nil)
+/// @param claimed Receives YES if the caller now has to encode the raster
+/// @return Copy of the cached raster (must be freed with ImageBufferFree),
+///         or invalid buffer on a miss
+- (ImageBuffer)rasterForData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options claimed:(BOOL *)claimed;
+
+/// Give up a claimed key without a raster (the encode failed); a waiting
+/// thread takes over the claim
+/// @param data Encoded payload
+/// @param symbology Barcode symbology ID
+/// @param options Encoder options used (may be nil)
+- (void)abandonRasterForData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options;
+
+/// Store a copy of an encoded raster, evicting the least recently used one
+/// when full, and settle any claim on its key
+/// @param raster Encoded raster (not retained; the cache keeps its own copy)
+/// @param data Encoded payload
+/// @param symbology Barcode symbology ID
+/// @param options Encoder options used (may be nil)
+- (void)setRaster:(ImageBuffer)raster forData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options;
+
+/// Remove all rasters (counters are kept)
+- (void)removeAllRasters;
+
+/// Reset hit/miss/eviction counters
+- (void)resetStatistics;
+
+/// Maximum number of rasters
+- (NSUInteger)capacity;
+
+/// Number of cached rasters
+- (NSUInteger)count;
+
+/// Lookups answered from the cache
+- (NSUInteger)hits;
+
+/// Lookups that required an encode
+- (NSUInteger)misses;
+
+/// Rasters dropped to stay within capacity
+- (NSUInteger)evictions;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,309 @@
+//
+//  BarcodeRasterCache.m
+//  SmallBarcodeReader
+//
+//  Bounded LRU raster cache implementation
+//
+
+#import "BarcodeRasterCache.h"
+
+static const NSUInteger BarcodeRasterCacheDefaultCapacity = 64;
+
+/// Cache key: payload, symbology and encoder options
+@interface BarcodeRasterCacheKey : NSObject <NSCopying> {
+    NSString *data;
+    int symbology;
+    NSDictionary *options;
+    NSUInteger hashValue;
+}
+
+- (instancetype)initWithData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options;
+
+@end
+
+@implementation BarcodeRasterCacheKey
+
+- (instancetype)initWithData:(NSString *)aData symbology:(int)aSymbology options:(NSDictionary *)someOptions {
+    self = [super init];
+    if (self) {
+        data = [aData copy];
+        symbology = aSymbology;
+        options = [someOptions copy];
+        hashValue = [data hash] * 31u + (NSUInteger)symbology;
+        if (options) {
+            // Sum the pairs so the hash does not depend on enumeration order
+            NSUInteger optionsHash = 0;
+            NSEnumerator *keys = [options keyEnumerator];
+            id optionKey;
+            while ((optionKey = [keys nextObject])) {
+                optionsHash += [optionKey hash] * 31u + [[options objectForKey:optionKey] hash];
+            }
+            hashValue = hashValue * 31u + optionsHash;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [data release];
+    [options release];
+    [super dealloc];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    // Immutable
+    return [self retain];
+}
+
+- (NSUInteger)hash {
+    return hashValue;
+}
+
+- (BOOL)isEqual:(id)object {
+    if (object == self) {
+        return YES;
+    }
+    if (![object isKindOfClass:[BarcodeRasterCacheKey class]]) {
+        return NO;
+    }
+    BarcodeRasterCacheKey *other = (BarcodeRasterCacheKey *)object;
+    if (other->symbology != symbology || ![other->data isEqualToString:data]) {
+        return NO;
+    }
+    if (options == other->options) {
+        return YES;
+    }
+    return options && other->options && [options isEqualToDictionary:other->options];
+}
+
+@end
+
+/// Cache entry, linked into the recency list
+@interface BarcodeRasterCacheEntry : NSObject {
+@public
+    BarcodeRasterCacheKey *key;
+    ImageBuffer raster; // Owned, packed
+    BarcodeRasterCacheEntry *newer; // Not retained
+    BarcodeRasterCacheEntry *older; // Not retained
+}
+@end
+
+@implementation BarcodeRasterCacheEntry
+
+- (void)dealloc {
+    [key release];
+    ImageBufferFree(&raster);
+    [super dealloc];
+}
+
+@end
+
+@implementation BarcodeRasterCache
+
+- (instancetype)init {
+    return [self initWithCapacity:BarcodeRasterCacheDefaultCapacity];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)maxCount {
+    self = [super init];
+    if (self) {
+        capacity = maxCount > 0 ? maxCount : 1;
+        entries = [[NSMutableDictionary alloc] initWithCapacity:capacity];
+        pending = [[NSMutableSet alloc] init];
+        lock = [[NSCondition alloc] init];
+        mostRecent = nil;
+        leastRecent = nil;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [entries release];
+    [pending release];
+    [lock release];
+    [super dealloc];
+}
+
+// Recency list helpers; callers hold the lock
+
+- (void)unlinkEntry:(BarcodeRasterCacheEntry *)entry {
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        mostRecent = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        leastRecent = entry->newer;
+    }
+    entry->newer = nil;
+    entry->older = nil;
+}
+
+- (void)linkEntryAsMostRecent:(BarcodeRasterCacheEntry *)entry {
+    BarcodeRasterCacheEntry *head = mostRecent;
+    entry->newer = nil;
+    entry->older = head;
+    if (head) {
+        head->newer = entry;
+    }
+    mostRecent = entry;
+    if (!leastRecent) {
+        leastRecent = entry;
+    }
+}
+
+- (ImageBuffer)rasterForData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+    return [self rasterForData:data symbology:symbology options:options claimed:NULL];
+}
+
+- (ImageBuffer)rasterForData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options claimed:(BOOL *)claimed {
+    ImageBuffer raster = {NULL, 0, 0, 0, 0};
+    if (claimed) {
+        *claimed = NO;
+    }
+    if (!data) {
+        return raster;
+    }
+
+    BarcodeRasterCacheKey *key = [[BarcodeRasterCacheKey alloc] initWithData:data symbology:symbology options:options];
+
+    [lock lock];
+    // Without a claim of its own the caller still encodes, so only claiming
+    // callers wait for one in progress
+    while (claimed && [pending containsObject:key]) {
+        [lock wait];
+    }
+    BarcodeRasterCacheEntry *entry = [entries objectForKey:key];
+    if (entry) {
+        hits++;
+        [self unlinkEntry:entry];
+        [self linkEntryAsMostRecent:entry];
+        raster = ImageBufferCopy(entry->raster);
+    } else {
+        misses++;
+        if (claimed) {
+            [pending addObject:key];
+            *claimed = YES;
+        }
+    }
+    [lock unlock];
+
+    [key release];
+    return raster;
+}
+
+- (void)abandonRasterForData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+    if (!data) {
+        return;
+    }
+    BarcodeRasterCacheKey *key = [[BarcodeRasterCacheKey alloc] initWithData:data symbology:symbology options:options];
+    [lock lock];
+    if ([pending containsObject:key]) {
+        [pending removeObject:key];
+        [lock broadcast];
+    }
+    [lock unlock];
+    [key release];
+}
+
+- (void)setRaster:(ImageBuffer)raster forData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+    if (!data) {
+        return;
+    }
+
+    // Copy outside the lock; with nothing to store, waiters encode themselves
+    ImageBuffer copy = {NULL, 0, 0, 0, 0};
+    if (ImageBufferIsValid(raster)) {
+        copy = ImageBufferCopy(raster);
+    }
+    if (!copy.data) {
+        [self abandonRasterForData:data symbology:symbology options:options];
+        return;
+    }
+
+    BarcodeRasterCacheKey *key = [[BarcodeRasterCacheKey alloc] initWithData:data symbology:symbology options:options];
+
+    [lock lock];
+    BarcodeRasterCacheEntry *entry = [entries objectForKey:key];
+    if (entry) {
+        // Another thread encoded the same symbol; keep one copy
+        ImageBufferFree(&entry->raster);
+        entry->raster = copy;
+        [self unlinkEntry:entry];
+        [self linkEntryAsMostRecent:entry];
+    } else {
+        while (entries.count >= capacity && leastRecent) {
+            BarcodeRasterCacheEntry *victim = [leastRecent retain];
+            [self unlinkEntry:victim];
+            [entries removeObjectForKey:victim->key];
+            [victim release];
+            evictions++;
+        }
+
+        entry = [[BarcodeRasterCacheEntry alloc] init];
+        entry->key = [key retain];
+        entry->raster = copy;
+        [entries setObject:entry forKey:key];
+        [self linkEntryAsMostRecent:entry];
+        [entry release];
+    }
+    if ([pending containsObject:key]) {
+        [pending removeObject:key];
+        [lock broadcast];
+    }
+    [lock unlock];
+
+    [key release];
+}
+
+- (void)removeAllRasters {
+    [lock lock];
+    [entries removeAllObjects];
+    mostRecent = nil;
+    leastRecent = nil;
+    [lock unlock];
+}
+
+- (void)resetStatistics {
+    [lock lock];
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+    [lock unlock];
+}
+
+- (NSUInteger)capacity {
+    return capacity;
+}
+
+- (NSUInteger)count {
+    [lock lock];
+    NSUInteger count = entries.count;
+    [lock unlock];
+    return count;
+}
+
+- (NSUInteger)hits {
+    [lock lock];
+    NSUInteger value = hits;
+    [lock unlock];
+    return value;
+}
+
+- (NSUInteger)misses {
+    [lock lock];
+    NSUInteger value = misses;
+    [lock unlock];
+    return value;
+}
+
+- (NSUInteger)evictions {
+    [lock lock];
+    NSUInteger value = evictions;
+    [lock unlock];
+    return value;
+}
+
+@end
@@ -0,0 +1,76 @@
+//
+//  BarcodeResultSink.h
+//  SmallBarcodeReader
+//
+//  Incremental writers for test results
+//
+
+#import <Foundation/Foundation.h>
+
+@class BarcodeTestResult;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Text formats understood by BarcodeStreamResultSink
+typedef NS_ENUM(NSInteger, BarcodeResultFormat) {
+    BarcodeResultFormatCSV = 0,   // Header line, then one quoted (RFC 4180) row per result
+    BarcodeResultFormatJSONLines  // One JSON object per line
+};
+
+/// Receives each result as a session records it. Calls are serialized by the
+/// session's caller, so sinks need no locking of their own.
+@protocol BarcodeResultSink <NSObject>
+
+/// Write one result
+/// @param result Result just added to the session
+- (void)writeResult:(BarcodeTestResult *)result;
+
+/// Push buffered output to its destination (called by -[BarcodeTestSession endSession])
+/// @return NO if any write has failed
+- (BOOL)flush;
+
+@end
+
+/// Formats results as CSV or JSON Lines into a fixed-size buffer and writes
+/// it out whenever it fills, so memory use does not grow with the run.
+@interface BarcodeStreamResultSink : NSObject <BarcodeResultSink> {
+    BarcodeResultFormat format;
+    int fileDescriptor;         // -1 when writing to data
+    BOOL closesFileDescriptor;
+    NSMutableData *data;        // In-memory destination (retained), or nil
+    char *buffer;
+    size_t used;
+    size_t capacity;
+    NSUInteger resultCount;
+    BOOL failed;
+}
+
+/// Initialize with an open file descriptor
+/// @param fd Destination (pipe, socket or file opened for writing)
+/// @param format Output format
+/// @param closeWhenDone Close fd in -close / dealloc
+- (instancetype)initWithFileDescriptor:(int)fd format:(BarcodeResultFormat)format closeWhenDone:(BOOL)closeWhenDone;
+
+/// Create (or truncate) a file and write to it
+/// @param path File path
+/// @param format Output format
+/// @return Sink, or nil if the file cannot be opened
+- (instancetype)initWithPath:(NSString *)path format:(BarcodeResultFormat)format;
+
+/// Append output to an in-memory buffer instead of a file descriptor
+/// @param data Destination (retained)
+/// @param format Output format
+- (instancetype)initWithMutableData:(NSMutableData *)data format:(BarcodeResultFormat)format;
+
+/// Flush and, if owned, close the file descriptor; later writes are ignored
+- (void)close;
+
+/// Results written so far
+- (NSUInteger)resultCount;
+
+/// YES once a write to the destination has failed (output is then incomplete)
+- (BOOL)hasFailed;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,251 @@
+//
+//  BarcodeResultSink.m
+//  SmallBarcodeReader
+//
+//  Incremental result writer implementation
+//
+
+#import "BarcodeResultSink.h"
+#import "BarcodeTestResult.h"
+#import <errno.h>
+#import <fcntl.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+
+static const size_t BarcodeResultSinkBufferSize = 64 * 1024;
+
+static const char *BarcodeResultCSVHeader =
+    "Barcode Type,Test Data,Distortion Type,Intensity,Strength,Decode Success,Quality Score,Data Matches,Decoded Data,Seed,"
+    "Encode ms,Distort ms,Decode ms,Total ms\n";
+
+@interface BarcodeStreamResultSink (Private)
+- (void)appendBytes:(const char *)bytes length:(size_t)length;
+- (void)appendCSVField:(NSString *)string;
+- (void)appendJSONString:(NSString *)string;
+- (void)appendStageTimings:(BarcodeTestResult *)result;
+@end
+
+@implementation BarcodeStreamResultSink
+
+- (instancetype)initWithFileDescriptor:(int)fd format:(BarcodeResultFormat)aFormat closeWhenDone:(BOOL)closeWhenDone {
+    self = [super init];
+    if (self) {
+        format = aFormat;
+        fileDescriptor = fd;
+        closesFileDescriptor = closeWhenDone;
+        capacity = BarcodeResultSinkBufferSize;
+        buffer = (char *)malloc(capacity);
+        if (!buffer || fd < 0) {
+            failed = YES;
+        } else if (format == BarcodeResultFormatCSV) {
+            [self appendBytes:BarcodeResultCSVHeader length:strlen(BarcodeResultCSVHeader)];
+        }
+    }
+    return self;
+}
+
+- (instancetype)initWithPath:(NSString *)path format:(BarcodeResultFormat)aFormat {
+    int fd = path ? open([path fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (fd < 0) {
+        [self release];
+        return nil;
+    }
+    return [self initWithFileDescriptor:fd format:aFormat closeWhenDone:YES];
+}
+
+- (instancetype)initWithMutableData:(NSMutableData *)someData format:(BarcodeResultFormat)aFormat {
+    self = [self initWithFileDescriptor:-1 format:aFormat closeWhenDone:NO];
+    if (self) {
+        data = [someData retain];
+        failed = (buffer == NULL || data == nil);
+        if (!failed && format == BarcodeResultFormatCSV) {
+            [self appendBytes:BarcodeResultCSVHeader length:strlen(BarcodeResultCSVHeader)];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self close];
+    free(buffer);
+    [super dealloc];
+}
+
+- (BOOL)flush {
+    if (used == 0) {
+        return !failed;
+    }
+    
+    if (data) {
+        [data appendBytes:buffer length:used];
+    } else if (fileDescriptor >= 0 && !failed) {
+        // write() may take only part of the buffer (pipes, sockets, signals)
+        size_t written = 0;
+        while (written < used) {
+            ssize_t count = write(fileDescriptor, buffer + written, used - written);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                failed = YES;
+                break;
+            }
+            written += (size_t)count;
+        }
+    }
+    used = 0;
+    return !failed;
+}
+
+- (void)close {
+    [self flush];
+    if (closesFileDescriptor && fileDescriptor >= 0) {
+        close(fileDescriptor);
+    }
+    fileDescriptor = -1;
+    [data release];
+    data = nil;
+}
+
+- (NSUInteger)resultCount {
+    return resultCount;
+}
+
+- (BOOL)hasFailed {
+    return failed;
+}
+
+- (void)appendBytes:(const char *)bytes length:(size_t)length {
+    if (used + length > capacity) {
+        [self flush];
+    }
+    if (length > capacity) {
+        // Longer than the whole buffer: hand it straight to the destination
+        char *saved = buffer;
+        buffer = (char *)bytes;
+        used = length;
+        [self flush];
+        buffer = saved;
+        return;
+    }
+    memcpy(buffer + used, bytes, length);
+    used += length;
+}
+
+- (void)appendCSVField:(NSString *)string {
+    const char *text = string ? [string UTF8String] : "";
+    if (!text) text = "";
+    
+    // Quote only fields that need it, doubling embedded quotes
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        [self appendBytes:text length:strlen(text)];
+        return;
+    }
+    [self appendBytes:"\"" length:1];
+    const char *start = text;
+    const char *quote;
+    while ((quote = strchr(start, '"')) != NULL) {
+        [self appendBytes:start length:(size_t)(quote - start + 1)];
+        [self appendBytes:"\"" length:1];
+        start = quote + 1;
+    }
+    [self appendBytes:start length:strlen(start)];
+    [self appendBytes:"\"" length:1];
+}
+
+- (void)appendJSONString:(NSString *)string {
+    const unsigned char *text = (const unsigned char *)(string ? [string UTF8String] : "");
+    if (!text) text = (const unsigned char *)"";
+    
+    [self appendBytes:"\"" length:1];
+    const unsigned char *start = text;
+    const unsigned char *p;
+    for (p = text; *p; p++) {
+        if (*p >= 0x20 && *p != '"' && *p != '\\') {
+            continue;
+        }
+        [self appendBytes:(const char *)start length:(size_t)(p - start)];
+        char escape[8];
+        switch (*p) {
+            case '"': strcpy(escape, "\\\""); break;
+            case '\\': strcpy(escape, "\\\\"); break;
+            case '\n': strcpy(escape, "\\n"); break;
+            case '\r': strcpy(escape, "\\r"); break;
+            case '\t': strcpy(escape, "\\t"); break;
+            default: snprintf(escape, sizeof(escape), "\\u%04x", *p); break;
+        }
+        [self appendBytes:escape length:strlen(escape)];
+        start = p + 1;
+    }
+    [self appendBytes:(const char *)start length:(size_t)(p - start)];
+    [self appendBytes:"\"" length:1];
+}
+
+// Stage times in milliseconds: empty CSV fields or JSON nulls when untimed
+- (void)appendStageTimings:(BarcodeTestResult *)result {
+    char field[48];
+    int length;
+    NSInteger stage;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        double milliseconds = [result millisecondsForStage:(BarcodeTestStage)stage];
+        if (format == BarcodeResultFormatJSONLines) {
+            length = milliseconds >= 0.0
+                ? snprintf(field, sizeof(field), ",\"%s\":%.3f", BarcodeTestStageJSONKeys[stage], milliseconds)
+                : snprintf(field, sizeof(field), ",\"%s\":null", BarcodeTestStageJSONKeys[stage]);
+        } else {
+            length = milliseconds >= 0.0 ? snprintf(field, sizeof(field), ",%.3f", milliseconds)
+                                         : snprintf(field, sizeof(field), ",");
+        }
+        [self appendBytes:field length:(size_t)length];
+    }
+}
+
+- (void)writeResult:(BarcodeTestResult *)result {
+    if (!result || (fileDescriptor < 0 && !data)) {
+        return;
+    }
+    
+    char numbers[160];
+    int length;
+    if (format == BarcodeResultFormatJSONLines) {
+        [self appendBytes:"{\"barcodeType\":" length:15];
+        [self appendJSONString:result.barcodeType];
+        [self appendBytes:",\"testData\":" length:12];
+        [self appendJSONString:result.testData];
+        length = snprintf(numbers, sizeof(numbers),
+                          ",\"distortionType\":%ld,\"intensity\":%.2f,\"strength\":%.2f,"
+                          "\"decodeSuccess\":%s,\"qualityScore\":%ld,\"dataMatches\":%s,\"decodedData\":",
+                          (long)result.distortionType,
+                          result.distortionIntensity,
+                          result.distortionStrength,
+                          result.decodeSuccess ? "true" : "false",
+                          (long)result.qualityScore,
+                          result.dataMatches ? "true" : "false");
+        [self appendBytes:numbers length:(size_t)length];
+        [self appendJSONString:result.decodedData];
+        length = snprintf(numbers, sizeof(numbers), ",\"seed\":%u", result.distortionSeed);
+        [self appendBytes:numbers length:(size_t)length];
+        [self appendStageTimings:result];
+        [self appendBytes:"}\n" length:2];
+    } else {
+        [self appendCSVField:result.barcodeType];
+        [self appendBytes:"," length:1];
+        [self appendCSVField:result.testData];
+        length = snprintf(numbers, sizeof(numbers), ",%ld,%.2f,%.2f,%d,%ld,%d,",
+                          (long)result.distortionType,
+                          result.distortionIntensity,
+                          result.distortionStrength,
+                          result.decodeSuccess ? 1 : 0,
+                          (long)result.qualityScore,
+                          result.dataMatches ? 1 : 0);
+        [self appendBytes:numbers length:(size_t)length];
+        [self appendCSVField:result.decodedData];
+        length = snprintf(numbers, sizeof(numbers), ",%u", result.distortionSeed);
+        [self appendBytes:numbers length:(size_t)length];
+        [self appendStageTimings:result];
+        [self appendBytes:"\n" length:1];
+    }
+    resultCount++;
+}
+
+@end
@@ -0,0 +1,130 @@
+//
+//  BarcodeResultStore.h
+//  SmallBarcodeReader
+//
+//  Columnar storage for test results
+//
+
+#import <Foundation/Foundation.h>
+#import "BarcodeTestStatistics.h"
+
+@class BarcodeTestResult;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// String index meaning "decoded data equals the test data"
+#define BarcodeResultStoreSameAsInput 0xFFFFFFFFu
+
+/// String index meaning "no decoded data" (nil, as opposed to an empty string)
+#define BarcodeResultStoreNoString 0xFFFFFFFEu
+
+/// Row predicate for filtered iteration; fields left at the values set by
+/// BarcodeResultFilterAny match every row
+typedef struct {
+    int symbology;            // Symbology ID, or -1 for any
+    NSInteger distortionType; // DistortionType, or -1 for any
+    float minIntensity;       // Rows with intensity > minIntensity
+    float maxIntensity;       // ... and intensity <= maxIntensity
+    float minStrength;        // Rows with strength > minStrength
+    float maxStrength;        // ... and strength <= maxStrength
+    int success;              // 1 successes only, 0 failures only, -1 either
+    int matches;              // 1 matching decodes only, 0 the rest, -1 either
+} BarcodeResultFilter;
+
+/// Filter that accepts every row
+BarcodeResultFilter BarcodeResultFilterAny(void);
+
+/// One stored row, without materializing any objects
+typedef struct {
+    int symbology;
+    NSInteger distortionType;
+    float intensity;
+    float strength;
+    uint32_t seed;         // Distortion seed
+    NSInteger qualityScore;
+    BOOL decodeSuccess;
+    BOOL dataMatches;
+    uint32_t barcodeType;  // String table index
+    uint32_t testData;     // String table index
+    uint32_t decodedData;  // String table index, BarcodeResultStoreSameAsInput or BarcodeResultStoreNoString
+    float stageMilliseconds[BarcodeTestStageCount]; // -1 if not timed
+} BarcodeResultRow;
+
+/// Struct-of-arrays result table. Numeric fields live in packed C columns;
+/// barcode type names, payloads and decoded data are interned once in a
+/// string table, and decoded data equal to the payload is not stored at all.
+/// Distortion types and quality scores outside the int32_t range are stored
+/// as -1.
+/// Rows are appended by one thread at a time and should be read once the run
+/// has finished (or from the appending thread).
+@interface BarcodeResultStore : NSObject {
+    NSUInteger count;
+    NSUInteger capacity;
+    // Columns
+    int32_t *symbologies;
+    int32_t *distortionTypes;
+    float *intensities;
+    float *strengths;
+    uint32_t *seeds;
+    int32_t *qualityScores;
+    uint8_t *flags;           // Bit 0: decode success, bit 1: data matches
+    uint32_t *barcodeTypes;
+    uint32_t *testData;
+    uint32_t *decodedData;
+    float *stageMilliseconds; // BarcodeTestStageCount per row
+    // String table
+    NSMutableArray *strings;
+    NSMutableDictionary *stringIndexes; // String -> NSNumber index
+}
+
+/// Append a result (copied into the columns; the object is not retained)
+/// @param result Result to store
+- (void)appendResult:(BarcodeTestResult *)result;
+
+/// Remove all rows and strings
+- (void)removeAllResults;
+
+/// Number of rows
+- (NSUInteger)count;
+
+/// Number of distinct strings
+- (NSUInteger)stringCount;
+
+/// Interned string
+/// @param index String table index
+/// @return String, or nil if out of range (including BarcodeResultStoreNoString)
+- (NSString *)stringAtIndex:(uint32_t)index;
+
+/// Read a row as plain values
+/// @param row Row index (< count)
+- (BarcodeResultRow)rowAtIndex:(NSUInteger)row;
+
+/// First row at or after start that passes the filter. Iterate with
+/// for (row = [store nextRowMatchingFilter:&f fromRow:0]; row != NSNotFound;
+///      row = [store nextRowMatchingFilter:&f fromRow:row + 1])
+/// @param filter Row predicate
+/// @param start First row to examine
+/// @return Row index, or NSNotFound
+- (NSUInteger)nextRowMatchingFilter:(const BarcodeResultFilter *)filter fromRow:(NSUInteger)start;
+
+/// Number of rows passing a filter (a single pass over the numeric columns)
+/// @param filter Row predicate
+- (NSUInteger)countOfRowsMatchingFilter:(const BarcodeResultFilter *)filter;
+
+/// Materialize one row as a result object
+/// @param row Row index (< count)
+/// @return New autoreleased result
+- (BarcodeTestResult *)resultAtIndex:(NSUInteger)row;
+
+/// Read-only array view that materializes result objects only when asked
+/// for them. Every access builds a new autoreleased object; the view keeps
+/// none, so reading a row twice gives two equal objects.
+/// @return Array view backed by this store
+- (NSArray *)results;
+
+/// Approximate heap bytes used by columns and string table
+- (NSUInteger)memoryUsage;
+
+@end
+
+NS_ASSUME_NONNULL_END
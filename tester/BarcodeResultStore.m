@@ -0,0 +1,310 @@
+//
+//  BarcodeResultStore.m
+//  SmallBarcodeReader
+//
+//  Columnar result storage implementation
+//
+
+#import "BarcodeResultStore.h"
+#import "BarcodeTestResult.h"
+#import <math.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <string.h>
+
+static const NSUInteger BarcodeResultStoreInitialCapacity = 256;
+
+enum {
+    RowFlagSuccess = 1 << 0,
+    RowFlagMatches = 1 << 1
+};
+
+BarcodeResultFilter BarcodeResultFilterAny(void) {
+    BarcodeResultFilter filter = {-1, -1, -HUGE_VALF, HUGE_VALF, -HUGE_VALF, HUGE_VALF, -1, -1};
+    return filter;
+}
+
+/// Array view over a store; rows become objects only when accessed
+@interface BarcodeResultStoreArray : NSArray {
+    BarcodeResultStore *store;
+}
+- (instancetype)initWithStore:(BarcodeResultStore *)store;
+@end
+
+@implementation BarcodeResultStoreArray
+
+- (instancetype)initWithStore:(BarcodeResultStore *)aStore {
+    self = [super init];
+    if (self) {
+        store = [aStore retain];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [store release];
+    [super dealloc];
+}
+
+- (NSUInteger)count {
+    return [store count];
+}
+
+// Built afresh on every access and autoreleased, so walking a large session
+// holds no more than the caller's pool does
+- (id)objectAtIndex:(NSUInteger)index {
+    NSUInteger total = [store count];
+    if (index >= total) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond result count %lu",
+            (unsigned long)index, (unsigned long)total];
+    }
+    return [store resultAtIndex:index];
+}
+
+@end
+
+@implementation BarcodeResultStore
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        strings = [[NSMutableArray alloc] init];
+        stringIndexes = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (void)freeColumns {
+    free(symbologies);
+    free(distortionTypes);
+    free(intensities);
+    free(strengths);
+    free(seeds);
+    free(qualityScores);
+    free(flags);
+    free(barcodeTypes);
+    free(testData);
+    free(decodedData);
+    free(stageMilliseconds);
+    symbologies = NULL;
+    distortionTypes = NULL;
+    intensities = NULL;
+    strengths = NULL;
+    seeds = NULL;
+    qualityScores = NULL;
+    flags = NULL;
+    barcodeTypes = NULL;
+    testData = NULL;
+    decodedData = NULL;
+    stageMilliseconds = NULL;
+    count = 0;
+    capacity = 0;
+}
+
+- (void)dealloc {
+    [self freeColumns];
+    [strings release];
+    [stringIndexes release];
+    [super dealloc];
+}
+
+// Grow every column to hold at least one more row
+- (BOOL)reserveRow {
+    if (count < capacity) {
+        return YES;
+    }
+    NSUInteger newCapacity = capacity > 0 ? capacity * 2 : BarcodeResultStoreInitialCapacity;
+
+#define GROW_COLUMN(column, type, width) do { \
+        type *grown = (type *)realloc(column, newCapacity * (width) * sizeof(type)); \
+        if (!grown) return NO; \
+        column = grown; \
+    } while (0)
+    
+    GROW_COLUMN(symbologies, int32_t, 1);
+    GROW_COLUMN(distortionTypes, int32_t, 1);
+    GROW_COLUMN(intensities, float, 1);
+    GROW_COLUMN(strengths, float, 1);
+    GROW_COLUMN(seeds, uint32_t, 1);
+    GROW_COLUMN(qualityScores, int32_t, 1);
+    GROW_COLUMN(flags, uint8_t, 1);
+    GROW_COLUMN(barcodeTypes, uint32_t, 1);
+    GROW_COLUMN(testData, uint32_t, 1);
+    GROW_COLUMN(decodedData, uint32_t, 1);
+    GROW_COLUMN(stageMilliseconds, float, BarcodeTestStageCount);
+#undef GROW_COLUMN
+
+    capacity = newCapacity;
+    return YES;
+}
+
+- (uint32_t)internString:(NSString *)string {
+    if (!string) {
+        return BarcodeResultStoreNoString;
+    }
+    NSNumber *index = [stringIndexes objectForKey:string];
+    if (index) {
+        return (uint32_t)[index unsignedIntValue];
+    }
+    
+    uint32_t newIndex = (uint32_t)strings.count;
+    NSString *copy = [string copy];
+    [strings addObject:copy];
+    [stringIndexes setObject:[NSNumber numberWithUnsignedInt:newIndex] forKey:copy];
+    [copy release];
+    return newIndex;
+}
+
+// NSInteger fields kept in int32_t columns; out-of-range values become -1
+static inline int32_t storedInteger(NSInteger value) {
+    return (value >= INT32_MIN && value <= INT32_MAX) ? (int32_t)value : -1;
+}
+
+- (void)appendResult:(BarcodeTestResult *)result {
+    if (!result || ![self reserveRow]) {
+        return;
+    }
+    
+    NSUInteger row = count;
+    symbologies[row] = result.symbology;
+    distortionTypes[row] = storedInteger(result.distortionType);
+    intensities[row] = result.distortionIntensity;
+    strengths[row] = result.distortionStrength;
+    seeds[row] = result.distortionSeed;
+    qualityScores[row] = storedInteger(result.qualityScore);
+    flags[row] = (result.decodeSuccess ? RowFlagSuccess : 0) | (result.dataMatches ? RowFlagMatches : 0);
+    barcodeTypes[row] = [self internString:result.barcodeType];
+    testData[row] = [self internString:result.testData];
+    
+    NSString *decoded = result.decodedData;
+    if (decoded && result.testData && [decoded isEqualToString:result.testData]) {
+        decodedData[row] = BarcodeResultStoreSameAsInput;
+    } else {
+        decodedData[row] = [self internString:decoded];
+    }
+    
+    NSInteger stage;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        stageMilliseconds[row * BarcodeTestStageCount + stage] = (float)[result millisecondsForStage:(BarcodeTestStage)stage];
+    }
+    count++;
+}
+
+- (void)removeAllResults {
+    [self freeColumns];
+    [strings removeAllObjects];
+    [stringIndexes removeAllObjects];
+}
+
+- (NSUInteger)count {
+    return count;
+}
+
+- (NSUInteger)stringCount {
+    return strings.count;
+}
+
+- (NSString *)stringAtIndex:(uint32_t)index {
+    if (index >= strings.count) {
+        return nil;
+    }
+    return [strings objectAtIndex:index];
+}
+
+- (BarcodeResultRow)rowAtIndex:(NSUInteger)row {
+    BarcodeResultRow value;
+    memset(&value, 0, sizeof(value));
+    if (row >= count) {
+        return value;
+    }
+    
+    value.symbology = symbologies[row];
+    value.distortionType = distortionTypes[row];
+    value.intensity = intensities[row];
+    value.strength = strengths[row];
+    value.seed = seeds[row];
+    value.qualityScore = qualityScores[row];
+    value.decodeSuccess = (flags[row] & RowFlagSuccess) ? YES : NO;
+    value.dataMatches = (flags[row] & RowFlagMatches) ? YES : NO;
+    value.barcodeType = barcodeTypes[row];
+    value.testData = testData[row];
+    value.decodedData = decodedData[row];
+    memcpy(value.stageMilliseconds, stageMilliseconds + row * BarcodeTestStageCount, sizeof(value.stageMilliseconds));
+    return value;
+}
+
+static inline BOOL rowMatchesFilter(const BarcodeResultFilter *filter, NSUInteger row,
+                                    const int32_t *symbologies, const int32_t *distortionTypes,
+                                    const float *intensities, const float *strengths, const uint8_t *flags) {
+    if (filter->symbology >= 0 && symbologies[row] != filter->symbology) return NO;
+    if (filter->distortionType >= 0 && distortionTypes[row] != filter->distortionType) return NO;
+    if (!(intensities[row] > filter->minIntensity && intensities[row] <= filter->maxIntensity)) return NO;
+    if (!(strengths[row] > filter->minStrength && strengths[row] <= filter->maxStrength)) return NO;
+    if (filter->success >= 0 && ((flags[row] & RowFlagSuccess) != 0) != (filter->success != 0)) return NO;
+    if (filter->matches >= 0 && ((flags[row] & RowFlagMatches) != 0) != (filter->matches != 0)) return NO;
+    return YES;
+}
+
+- (NSUInteger)nextRowMatchingFilter:(const BarcodeResultFilter *)filter fromRow:(NSUInteger)start {
+    NSUInteger row;
+    for (row = start; row < count; row++) {
+        if (rowMatchesFilter(filter, row, symbologies, distortionTypes, intensities, strengths, flags)) {
+            return row;
+        }
+    }
+    return NSNotFound;
+}
+
+- (NSUInteger)countOfRowsMatchingFilter:(const BarcodeResultFilter *)filter {
+    NSUInteger matching = 0;
+    NSUInteger row;
+    for (row = 0; row < count; row++) {
+        if (rowMatchesFilter(filter, row, symbologies, distortionTypes, intensities, strengths, flags)) {
+            matching++;
+        }
+    }
+    return matching;
+}
+
+- (BarcodeTestResult *)resultAtIndex:(NSUInteger)row {
+    if (row >= count) {
+        return nil;
+    }
+    
+    NSString *payload = [self stringAtIndex:testData[row]];
+    NSString *decoded = decodedData[row] == BarcodeResultStoreSameAsInput ? payload : [self stringAtIndex:decodedData[row]];
+    BarcodeTestResult *result = [BarcodeTestResult resultWithBarcodeType:[self stringAtIndex:barcodeTypes[row]]
+                                                                testData:payload
+                                                           distortionType:distortionTypes[row]
+                                                                intensity:intensities[row]
+                                                                 strength:strengths[row]
+                                                                  success:(flags[row] & RowFlagSuccess) ? YES : NO
+                                                                  quality:qualityScores[row]
+                                                                  matches:(flags[row] & RowFlagMatches) ? YES : NO
+                                                                  decoded:decoded];
+    result.symbology = symbologies[row];
+    result.distortionSeed = seeds[row];
+    NSInteger stage;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        [result setMilliseconds:stageMilliseconds[row * BarcodeTestStageCount + stage] forStage:(BarcodeTestStage)stage];
+    }
+    return result;
+}
+
+- (NSArray *)results {
+    return [[[BarcodeResultStoreArray alloc] initWithStore:self] autorelease];
+}
+
+- (NSUInteger)memoryUsage {
+    // Per row: 4 + 4 + 4 + 4 + 4 + 4 + 1 + 3 * 4 bytes plus the stage times
+    size_t rowBytes = 37 + BarcodeTestStageCount * sizeof(float);
+    NSUInteger bytes = capacity * rowBytes;
+    NSUInteger i;
+    for (i = 0; i < strings.count; i++) {
+        // String bytes plus dictionary and array entries
+        bytes += [[strings objectAtIndex:i] length] * sizeof(unichar) + 64;
+    }
+    return bytes;
+}
+
+@end
@@ -0,0 +1,155 @@
+//
+//  BarcodeSessionFile.h
+//  SmallBarcodeReader
+//
+//  Versioned binary session files: written incrementally, read with mmap
+//
+
+#import <Foundation/Foundation.h>
+#import "BarcodeResultSink.h"
+#import "BarcodeTestStatistics.h"
+#import <stdint.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// File layout (host byte order, checked through byteOrder):
+//   header | records[recordCount] | string offsets[stringCount + 1] + UTF-8 bytes
+//   | groups[groupCount] | row ids[recordCount]
+// Records are appended while the run goes; everything after them is written
+// by -close, which finally sets complete in the header.
+
+#define BarcodeSessionFileMagic "SBRSESS"
+#define BarcodeSessionFileVersion 1
+#define BarcodeSessionFileByteOrder 0x01020304u
+
+/// Decoded data string index meaning "same as the test data"
+#define BarcodeSessionSameAsInput 0xFFFFFFFFu
+
+/// String index meaning "no string" (nil, as opposed to an empty string)
+#define BarcodeSessionNoString 0xFFFFFFFEu
+
+/// Record flag bits
+#define BarcodeSessionRecordSuccess 0x1u
+#define BarcodeSessionRecordMatches 0x2u
+
+typedef struct {
+    char magic[8];            // BarcodeSessionFileMagic, NUL padded
+    uint32_t version;         // BarcodeSessionFileVersion
+    uint32_t byteOrder;       // BarcodeSessionFileByteOrder as written
+    uint32_t headerSize;      // sizeof(BarcodeSessionFileHeader)
+    uint32_t recordSize;      // sizeof(BarcodeSessionRecord)
+    uint32_t complete;        // Non-zero once every table has been written
+    uint32_t reserved;
+    uint64_t recordCount;
+    uint64_t recordsOffset;
+    uint64_t stringCount;
+    uint64_t stringsOffset;   // stringCount + 1 uint64 offsets, then the bytes
+    uint64_t groupCount;
+    uint64_t groupsOffset;
+    uint64_t rowsOffset;      // uint32 row ids, grouped like the group table
+    double startTime;         // Seconds since 1970
+    double endTime;
+} BarcodeSessionFileHeader;
+
+/// One test result (fixed width)
+typedef struct {
+    int32_t symbology;
+    int32_t distortionType;
+    float intensity;
+    float strength;
+    int32_t qualityScore;
+    uint32_t flags;           // BarcodeSessionRecord... bits
+    uint32_t barcodeType;     // String index
+    uint32_t testData;        // String index
+    uint32_t decodedData;     // String index, BarcodeSessionSameAsInput or BarcodeSessionNoString
+    uint32_t seed;            // Distortion seed
+    float stageMilliseconds[BarcodeTestStageCount]; // -1 if not timed
+} BarcodeSessionRecord;
+
+/// Index entry: all rows of one (symbology, distortion type) pair. Groups are
+/// sorted by symbology, then distortion type; their rows by intensity.
+typedef struct {
+    int32_t symbology;
+    int32_t distortionType;
+    uint64_t firstRow;        // Into the row id table
+    uint64_t rowCount;
+    uint64_t successes;
+    uint64_t matches;
+} BarcodeSessionGroup;
+
+/// A session file mapped into memory
+typedef struct {
+    void *mapping;
+    size_t length;
+    const BarcodeSessionFileHeader *header;
+    const BarcodeSessionRecord *records;
+    const BarcodeSessionGroup *groups;
+    const uint32_t *rows;
+    const uint64_t *stringOffsets;
+    const char *stringBytes;
+} BarcodeSessionFile;
+
+/// Map a complete session file and validate its tables
+/// @param path File path
+/// @param file Receives the mapping
+/// @return Non-zero on success
+int BarcodeSessionFileOpen(const char *path, BarcodeSessionFile *file);
+
+/// Unmap a file opened with BarcodeSessionFileOpen
+/// @param file File to close
+void BarcodeSessionFileClose(BarcodeSessionFile *file);
+
+/// String table entry (not NUL terminated)
+/// @param file Open file
+/// @param index String index
+/// @param length Receives the byte length
+/// @return UTF-8 bytes, or NULL if index is out of range (including
+///         BarcodeSessionNoString, which stands for nil)
+const char *BarcodeSessionFileString(const BarcodeSessionFile *file, uint32_t index, size_t *length);
+
+/// Look up a group by binary search
+/// @param file Open file
+/// @param symbology Symbology ID
+/// @param distortionType Distortion type
+/// @return Group, or NULL if the file has no rows for the pair
+const BarcodeSessionGroup *BarcodeSessionFileFindGroup(const BarcodeSessionFile *file, int32_t symbology, int32_t distortionType);
+
+/// Failure threshold of a group: the lowest intensity at which fewer than
+/// half of the group's rows decode
+/// @param file Open file
+/// @param group Group from the file
+/// @return Threshold intensity, or -1 if every intensity mostly decodes
+float BarcodeSessionFileGroupThreshold(const BarcodeSessionFile *file, const BarcodeSessionGroup *group);
+
+/// Result sink that writes a session file. Records go to disk as results
+/// arrive (through a 64 KiB buffer); -close appends the string table and the
+/// (symbology, distortion) index and completes the header.
+@interface BarcodeSessionFileWriter : NSObject <BarcodeResultSink> {
+    int fileDescriptor;
+    char *buffer;
+    size_t used;
+    uint64_t recordCount;
+    NSMutableArray *strings;
+    NSMutableDictionary *stringIndexes; // String -> NSNumber index
+    double startTime;
+    BOOL failed;
+}
+
+/// Create (or truncate) a session file
+/// @param path File path
+/// @return Writer, or nil if the file cannot be created
+- (instancetype)initWithPath:(NSString *)path;
+
+/// Write the tables and header and close the file; later results are ignored
+/// @return NO if any write failed
+- (BOOL)close;
+
+/// Records written so far
+- (uint64_t)recordCount;
+
+/// YES once a write has failed
+- (BOOL)hasFailed;
+
+@end
+
+NS_ASSUME_NONNULL_END
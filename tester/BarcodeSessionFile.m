@@ -0,0 +1,426 @@
+//
+//  BarcodeSessionFile.m
+//  SmallBarcodeReader
+//
+//  Binary session file writer and reader
+//
+
+#import "BarcodeSessionFile.h"
+#import "BarcodeTestResult.h"
+#import <errno.h>
+#import <fcntl.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+static const size_t BarcodeSessionFileBufferSize = 64 * 1024;
+
+// Write everything, retrying short writes; returns non-zero on success
+static int writeFully(int fd, const void *bytes, size_t length) {
+    const char *cursor = (const char *)bytes;
+    while (length > 0) {
+        ssize_t count = write(fd, cursor, length);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        cursor += count;
+        length -= (size_t)count;
+    }
+    return 1;
+}
+
+// Sort key for building the (symbology, distortion) index
+typedef struct {
+    int32_t symbology;
+    int32_t distortionType;
+    float intensity;
+    uint32_t row;
+} IndexKey;
+
+static int compareIndexKeys(const void *a, const void *b) {
+    const IndexKey *left = (const IndexKey *)a;
+    const IndexKey *right = (const IndexKey *)b;
+    if (left->symbology != right->symbology) return left->symbology < right->symbology ? -1 : 1;
+    if (left->distortionType != right->distortionType) return left->distortionType < right->distortionType ? -1 : 1;
+    if (left->intensity != right->intensity) return left->intensity < right->intensity ? -1 : 1;
+    if (left->row != right->row) return left->row < right->row ? -1 : 1;
+    return 0;
+}
+
+// Append the group table and row ids for records already on disk at
+// recordsOffset. The records are read back through a temporary mapping, so
+// only the sort keys are held in memory.
+static int writeIndex(int fd, uint64_t recordsOffset, uint64_t recordCount,
+                      uint64_t groupsOffset, uint64_t *groupCount, uint64_t *rowsOffset) {
+    *groupCount = 0;
+    *rowsOffset = groupsOffset;
+    if (recordCount == 0) {
+        return 1;
+    }
+
+    size_t mappedLength = (size_t)(recordsOffset + recordCount * sizeof(BarcodeSessionRecord));
+    void *mapping = mmap(NULL, mappedLength, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+    const BarcodeSessionRecord *records = (const BarcodeSessionRecord *)((const char *)mapping + recordsOffset);
+
+    IndexKey *keys = (IndexKey *)malloc((size_t)recordCount * sizeof(IndexKey));
+    uint32_t *rows = (uint32_t *)malloc((size_t)recordCount * sizeof(uint32_t));
+    BarcodeSessionGroup *groups = (BarcodeSessionGroup *)malloc((size_t)recordCount * sizeof(BarcodeSessionGroup));
+    int success = keys && rows && groups;
+
+    if (success) {
+        uint64_t i;
+        for (i = 0; i < recordCount; i++) {
+            keys[i].symbology = records[i].symbology;
+            keys[i].distortionType = records[i].distortionType;
+            keys[i].intensity = records[i].intensity;
+            keys[i].row = (uint32_t)i;
+        }
+        qsort(keys, (size_t)recordCount, sizeof(IndexKey), compareIndexKeys);
+
+        uint64_t count = 0;
+        for (i = 0; i < recordCount; i++) {
+            if (count == 0 || keys[i].symbology != groups[count - 1].symbology ||
+                keys[i].distortionType != groups[count - 1].distortionType) {
+                BarcodeSessionGroup group = {keys[i].symbology, keys[i].distortionType, i, 0, 0, 0};
+                groups[count++] = group;
+            }
+            BarcodeSessionGroup *group = &groups[count - 1];
+            const BarcodeSessionRecord *record = &records[keys[i].row];
+            group->rowCount++;
+            if (record->flags & BarcodeSessionRecordSuccess) group->successes++;
+            if (record->flags & BarcodeSessionRecordMatches) group->matches++;
+            rows[i] = keys[i].row;
+        }
+
+        *groupCount = count;
+        *rowsOffset = groupsOffset + count * sizeof(BarcodeSessionGroup);
+        success = writeFully(fd, groups, (size_t)count * sizeof(BarcodeSessionGroup)) &&
+                  writeFully(fd, rows, (size_t)recordCount * sizeof(uint32_t));
+    }
+
+    free(keys);
+    free(rows);
+    free(groups);
+    munmap(mapping, mappedLength);
+    return success;
+}
+
+// Check that [offset, offset + size) lies inside a file of the given length
+static int rangeFits(uint64_t offset, uint64_t size, size_t length) {
+    return offset <= length && size <= length - offset;
+}
+
+int BarcodeSessionFileOpen(const char *path, BarcodeSessionFile *file) {
+    if (!path || !file) {
+        return 0;
+    }
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(BarcodeSessionFileHeader)) {
+        close(fd);
+        return 0;
+    }
+    size_t length = (size_t)info.st_size;
+    void *mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+
+    const char *base = (const char *)mapping;
+    const BarcodeSessionFileHeader *header = (const BarcodeSessionFileHeader *)base;
+    int valid = memcmp(header->magic, BarcodeSessionFileMagic, sizeof(BarcodeSessionFileMagic)) == 0 &&
+        header->version == BarcodeSessionFileVersion &&
+        header->byteOrder == BarcodeSessionFileByteOrder &&
+        header->headerSize == sizeof(BarcodeSessionFileHeader) &&
+        header->recordSize == sizeof(BarcodeSessionRecord) &&
+        header->complete != 0 &&
+        header->recordCount <= UINT32_MAX &&
+        rangeFits(header->recordsOffset, header->recordCount * sizeof(BarcodeSessionRecord), length) &&
+        header->stringCount < BarcodeSessionNoString &&
+        rangeFits(header->stringsOffset, (header->stringCount + 1) * sizeof(uint64_t), length) &&
+        header->groupCount <= header->recordCount &&
+        rangeFits(header->groupsOffset, header->groupCount * sizeof(BarcodeSessionGroup), length) &&
+        rangeFits(header->rowsOffset, header->recordCount * sizeof(uint32_t), length) &&
+        header->recordsOffset % 8 == 0 && header->stringsOffset % 8 == 0 && header->groupsOffset % 8 == 0;
+
+    if (valid) {
+        file->mapping = mapping;
+        file->length = length;
+        file->header = header;
+        file->records = (const BarcodeSessionRecord *)(base + header->recordsOffset);
+        file->stringOffsets = (const uint64_t *)(base + header->stringsOffset);
+        file->stringBytes = base + header->stringsOffset + (header->stringCount + 1) * sizeof(uint64_t);
+        file->groups = (const BarcodeSessionGroup *)(base + header->groupsOffset);
+        file->rows = (const uint32_t *)(base + header->rowsOffset);
+
+        // The string bytes must end before the group table, and the offsets
+        // may never decrease, so every string lies inside the final one
+        uint64_t stringBytesOffset = (uint64_t)(file->stringBytes - base);
+        valid = header->groupsOffset >= stringBytesOffset &&
+                file->stringOffsets[header->stringCount] <= header->groupsOffset - stringBytesOffset;
+        uint64_t i;
+        for (i = 0; valid && i < header->stringCount; i++) {
+            valid = file->stringOffsets[i] <= file->stringOffsets[i + 1];
+        }
+
+        // Groups must tile the row table, and rows must name real records
+        uint64_t nextRow = 0;
+        for (i = 0; valid && i < header->groupCount; i++) {
+            valid = file->groups[i].firstRow == nextRow && file->groups[i].rowCount <= header->recordCount - nextRow;
+            nextRow += file->groups[i].rowCount;
+        }
+        valid = valid && nextRow == header->recordCount;
+        for (i = 0; valid && i < header->recordCount; i++) {
+            valid = file->rows[i] < header->recordCount;
+        }
+    }
+
+    if (!valid) {
+        munmap(mapping, length);
+        memset(file, 0, sizeof(*file));
+        return 0;
+    }
+    return 1;
+}
+
+void BarcodeSessionFileClose(BarcodeSessionFile *file) {
+    if (file && file->mapping) {
+        munmap(file->mapping, file->length);
+    }
+    if (file) {
+        memset(file, 0, sizeof(*file));
+    }
+}
+
+const char *BarcodeSessionFileString(const BarcodeSessionFile *file, uint32_t index, size_t *length) {
+    if (!file->header || index >= file->header->stringCount) {
+        if (length) *length = 0;
+        return NULL;
+    }
+    // BarcodeSessionFileOpen checked that the offsets never decrease
+    uint64_t start = file->stringOffsets[index];
+    uint64_t end = file->stringOffsets[index + 1];
+    if (length) *length = (size_t)(end - start);
+    return file->stringBytes + start;
+}
+
+const BarcodeSessionGroup *BarcodeSessionFileFindGroup(const BarcodeSessionFile *file, int32_t symbology, int32_t distortionType) {
+    if (!file->header) {
+        return NULL;
+    }
+    uint64_t low = 0;
+    uint64_t high = file->header->groupCount;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        const BarcodeSessionGroup *group = &file->groups[middle];
+        if (group->symbology < symbology ||
+            (group->symbology == symbology && group->distortionType < distortionType)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < file->header->groupCount &&
+        file->groups[low].symbology == symbology && file->groups[low].distortionType == distortionType) {
+        return &file->groups[low];
+    }
+    return NULL;
+}
+
+float BarcodeSessionFileGroupThreshold(const BarcodeSessionFile *file, const BarcodeSessionGroup *group) {
+    // Rows are sorted by intensity: walk runs of equal intensity
+    uint64_t row = group->firstRow;
+    uint64_t end = group->firstRow + group->rowCount;
+    while (row < end) {
+        float intensity = file->records[file->rows[row]].intensity;
+        uint64_t total = 0, successes = 0;
+        while (row < end && file->records[file->rows[row]].intensity == intensity) {
+            if (file->records[file->rows[row]].flags & BarcodeSessionRecordSuccess) {
+                successes++;
+            }
+            total++;
+            row++;
+        }
+        if (successes * 2 < total) {
+            return intensity;
+        }
+    }
+    return -1.0f;
+}
+
+@implementation BarcodeSessionFileWriter
+
+- (instancetype)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        fileDescriptor = path ? open([path fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0644) : -1;
+        buffer = (char *)malloc(BarcodeSessionFileBufferSize);
+        strings = [[NSMutableArray alloc] init];
+        stringIndexes = [[NSMutableDictionary alloc] init];
+        startTime = [[NSDate date] timeIntervalSince1970];
+
+        // Placeholder header; -close rewrites it with the table offsets
+        BarcodeSessionFileHeader header;
+        memset(&header, 0, sizeof(header));
+        if (fileDescriptor < 0 || !buffer || !writeFully(fileDescriptor, &header, sizeof(header))) {
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self close];
+    free(buffer);
+    [strings release];
+    [stringIndexes release];
+    [super dealloc];
+}
+
+- (uint64_t)recordCount {
+    return recordCount;
+}
+
+- (BOOL)hasFailed {
+    return failed;
+}
+
+- (BOOL)flush {
+    if (used > 0 && fileDescriptor >= 0 && !failed) {
+        if (!writeFully(fileDescriptor, buffer, used)) {
+            failed = YES;
+        }
+    }
+    used = 0;
+    return !failed;
+}
+
+- (void)appendBytes:(const void *)bytes length:(size_t)length {
+    if (used + length > BarcodeSessionFileBufferSize) {
+        [self flush];
+    }
+    if (length > BarcodeSessionFileBufferSize) {
+        if (!failed && !writeFully(fileDescriptor, bytes, length)) {
+            failed = YES;
+        }
+        return;
+    }
+    memcpy(buffer + used, bytes, length);
+    used += length;
+}
+
+- (uint32_t)internString:(NSString *)string {
+    if (!string) {
+        return BarcodeSessionNoString;
+    }
+    NSNumber *index = [stringIndexes objectForKey:string];
+    if (index) {
+        return (uint32_t)[index unsignedIntValue];
+    }
+
+    uint32_t newIndex = (uint32_t)strings.count;
+    NSString *copy = [string copy];
+    [strings addObject:copy];
+    [stringIndexes setObject:[NSNumber numberWithUnsignedInt:newIndex] forKey:copy];
+    [copy release];
+    return newIndex;
+}
+
+- (void)writeResult:(BarcodeTestResult *)result {
+    if (!result || fileDescriptor < 0 || recordCount >= UINT32_MAX) {
+        return;
+    }
+
+    BarcodeSessionRecord record;
+    memset(&record, 0, sizeof(record));
+    record.symbology = result.symbology;
+    record.distortionType = (int32_t)result.distortionType;
+    record.intensity = result.distortionIntensity;
+    record.strength = result.distortionStrength;
+    record.seed = result.distortionSeed;
+    record.qualityScore = (int32_t)result.qualityScore;
+    record.flags = (result.decodeSuccess ? BarcodeSessionRecordSuccess : 0) |
+                   (result.dataMatches ? BarcodeSessionRecordMatches : 0);
+    record.barcodeType = [self internString:result.barcodeType];
+    record.testData = [self internString:result.testData];
+    if (result.decodedData && result.testData && [result.decodedData isEqualToString:result.testData]) {
+        record.decodedData = BarcodeSessionSameAsInput;
+    } else {
+        record.decodedData = [self internString:result.decodedData];
+    }
+    NSInteger stage;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        record.stageMilliseconds[stage] = (float)[result millisecondsForStage:(BarcodeTestStage)stage];
+    }
+
+    [self appendBytes:&record length:sizeof(record)];
+    recordCount++;
+}
+
+- (BOOL)close {
+    if (fileDescriptor < 0) {
+        return !failed;
+    }
+
+    BarcodeSessionFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BarcodeSessionFileMagic, sizeof(BarcodeSessionFileMagic));
+    header.version = BarcodeSessionFileVersion;
+    header.byteOrder = BarcodeSessionFileByteOrder;
+    header.headerSize = sizeof(BarcodeSessionFileHeader);
+    header.recordSize = sizeof(BarcodeSessionRecord);
+    header.recordCount = recordCount;
+    header.recordsOffset = sizeof(BarcodeSessionFileHeader);
+    header.stringCount = strings.count;
+    header.stringsOffset = header.recordsOffset + recordCount * sizeof(BarcodeSessionRecord);
+    header.startTime = startTime;
+    header.endTime = [[NSDate date] timeIntervalSince1970];
+
+    // String table: offsets (relative to the first byte), then UTF-8 bytes
+    uint64_t offset = 0;
+    NSUInteger i;
+    [self appendBytes:&offset length:sizeof(offset)];
+    for (i = 0; i < strings.count; i++) {
+        offset += strlen([[strings objectAtIndex:i] UTF8String]);
+        [self appendBytes:&offset length:sizeof(offset)];
+    }
+    for (i = 0; i < strings.count; i++) {
+        const char *text = [[strings objectAtIndex:i] UTF8String];
+        [self appendBytes:text length:strlen(text)];
+    }
+    uint64_t stringsEnd = header.stringsOffset + (strings.count + 1) * sizeof(uint64_t) + offset;
+    uint64_t padding = (8 - stringsEnd % 8) % 8;
+    static const char zeros[8] = {0};
+    [self appendBytes:zeros length:(size_t)padding];
+    header.groupsOffset = stringsEnd + padding;
+    [self flush];
+
+    if (!failed && !writeIndex(fileDescriptor, header.recordsOffset, recordCount,
+                               header.groupsOffset, &header.groupCount, &header.rowsOffset)) {
+        failed = YES;
+    }
+
+    // Only a fully written file is marked complete
+    header.complete = failed ? 0 : 1;
+    if (pwrite(fileDescriptor, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        failed = YES;
+    }
+    close(fileDescriptor);
+    fileDescriptor = -1;
+    return !failed;
+}
+
+@end
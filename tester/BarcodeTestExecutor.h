@@ -0,0 +1,78 @@
+//
+//  BarcodeTestExecutor.h
+//  SmallBarcodeReader
+//
+//  Parallel execution engine for comprehensive test suites
+//
+
+#import <Foundation/Foundation.h>
+
+@class BarcodeEncoder;
+@class BarcodeDecoder;
+@class BarcodeTestSession;
+@class BarcodeRasterCache;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Runs the cells of a comprehensive test matrix on a pool of worker threads.
+/// Each worker drives its own copies of the encoder, decoder and backends. Cells are
+/// handed out from per-worker ranges; an idle worker steals the upper half of the
+/// busiest worker's remaining range. Results reach the session in the same order
+/// the serial nested loops would produce them, as soon as every earlier cell has
+/// finished; addResult: is then called from worker threads, one call at a time.
+@interface BarcodeTestExecutor : NSObject {
+    BarcodeEncoder *encoder;
+    BarcodeDecoder *decoder;
+    NSUInteger workerCount;
+    BarcodeRasterCache *rasterCache;
+}
+
+/// Raster cache shared by all workers (nil gives each worker a private cache)
+@property (retain, nonatomic) BarcodeRasterCache *rasterCache;
+
+/// Worker count used when none is given (number of active processors)
++ (NSUInteger)defaultWorkerCount;
+
+/// Initialize with prototype encoder/decoder
+/// @param encoder Encoder each worker copies (backends are copied when they adopt NSCopying)
+/// @param decoder Decoder each worker copies (backends are copied when they adopt NSCopying)
+/// @param workerCount Number of worker threads (0 uses defaultWorkerCount)
+- (instancetype)initWithEncoder:(BarcodeEncoder *)encoder
+                        decoder:(BarcodeDecoder *)decoder
+                    workerCount:(NSUInteger)workerCount;
+
+/// Number of worker threads
+- (NSUInteger)workerCount;
+
+/// Run the full data x symbology x distortion x intensity x strength matrix
+/// @param testDataArray Array of test data strings
+/// @param symbologyArray Array of symbology IDs
+/// @param distortionTypes Array of distortion type IDs
+/// @param intensityLevels Array of intensity values
+/// @param strengthLevels Array of strength values
+/// @param sessionName Name for the test session
+/// @return Test session with all results in deterministic (serial loop) order
+- (BarcodeTestSession *)runComprehensiveTestSuite:(NSArray *)testDataArray
+                                       symbologies:(NSArray *)symbologyArray
+                                    distortionTypes:(NSArray *)distortionTypes
+                                     intensityLevels:(NSArray *)intensityLevels
+                                       strengthLevels:(NSArray *)strengthLevels
+                                         sessionName:(NSString *)sessionName;
+
+/// Run the full matrix into an existing session (see BarcodeTestSession sinks)
+/// @param testDataArray Array of test data strings
+/// @param symbologyArray Array of symbology IDs
+/// @param distortionTypes Array of distortion type IDs
+/// @param intensityLevels Array of intensity values
+/// @param strengthLevels Array of strength values
+/// @param session Test session to add results to (ended when the run finishes)
+- (void)runComprehensiveTestSuite:(NSArray *)testDataArray
+                       symbologies:(NSArray *)symbologyArray
+                    distortionTypes:(NSArray *)distortionTypes
+                     intensityLevels:(NSArray *)intensityLevels
+                       strengthLevels:(NSArray *)strengthLevels
+                             session:(BarcodeTestSession *)session;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,374 @@
+//
+//  BarcodeTestExecutor.m
+//  SmallBarcodeReader
+//
+//  Parallel execution engine implementation
+//
+
+#import "BarcodeTestExecutor.h"
+#import "BarcodeTester.h"
+#import "BarcodeEncoder.h"
+#import "BarcodeDecoder.h"
+#import "BarcodeTestResult.h"
+#import "BarcodeRasterCache.h"
+#import <pthread.h>
+#import <stdlib.h>
+
+// Cells still owned by one worker: [head, tail)
+typedef struct {
+    pthread_mutex_t lock;
+    NSInteger head;
+    NSInteger tail;
+} CellRange;
+
+/// State for a single suite run, shared by all workers of that run
+@interface BarcodeTestExecutorRun : NSObject {
+    BarcodeEncoder *encoder;
+    BarcodeDecoder *decoder;
+    BarcodeRasterCache *rasterCache;
+    NSArray *testDataArray;
+    NSArray *symbologyArray;
+    NSArray *distortionTypes;
+    NSArray *intensityLevels;
+    NSArray *strengthLevels;
+    NSInteger cellCount;
+    NSUInteger workerCount;
+    CellRange *ranges;
+    id *results; // One retained BarcodeTestResult (or nil) per cell
+    unsigned char *finishedCells;
+    pthread_mutex_t emitLock; // Guards results, finishedCells, nextEmitCell, pendingResults and delivering
+    NSInteger nextEmitCell;   // First cell not yet queued for the session
+    NSMutableArray *pendingResults; // Next in serial order, not yet handed to the session
+    BOOL delivering;                // A worker is handing pendingResults to the session
+    BarcodeTestSession *session;
+    NSConditionLock *finishedWorkers;
+}
+
+- (instancetype)initWithEncoder:(BarcodeEncoder *)encoder
+                        decoder:(BarcodeDecoder *)decoder
+                       testData:(NSArray *)testDataArray
+                    symbologies:(NSArray *)symbologyArray
+                distortionTypes:(NSArray *)distortionTypes
+                intensityLevels:(NSArray *)intensityLevels
+                 strengthLevels:(NSArray *)strengthLevels
+                    workerCount:(NSUInteger)workerCount
+                    rasterCache:(BarcodeRasterCache *)rasterCache;
+- (void)runIntoSession:(BarcodeTestSession *)session;
+
+@end
+
+@implementation BarcodeTestExecutorRun
+
+- (instancetype)initWithEncoder:(BarcodeEncoder *)enc
+                        decoder:(BarcodeDecoder *)dec
+                       testData:(NSArray *)data
+                    symbologies:(NSArray *)symbologies
+                distortionTypes:(NSArray *)distortions
+                intensityLevels:(NSArray *)intensities
+                 strengthLevels:(NSArray *)strengths
+                    workerCount:(NSUInteger)count
+                    rasterCache:(BarcodeRasterCache *)cache {
+    self = [super init];
+    if (self) {
+        encoder = [enc retain];
+        decoder = [dec retain];
+        rasterCache = [cache retain];
+        testDataArray = [data retain];
+        symbologyArray = [symbologies retain];
+        distortionTypes = [distortions retain];
+        intensityLevels = [intensities retain];
+        strengthLevels = [strengths retain];
+        cellCount = data.count * symbologies.count * distortions.count * intensities.count * strengths.count;
+
+        // Never start more workers than there are cells
+        workerCount = count;
+        if ((NSInteger)workerCount > cellCount) workerCount = (NSUInteger)cellCount;
+        if (workerCount < 1) workerCount = 1;
+
+        results = (id *)calloc(cellCount > 0 ? cellCount : 1, sizeof(id));
+        finishedCells = (unsigned char *)calloc(cellCount > 0 ? cellCount : 1, 1);
+        pthread_mutex_init(&emitLock, NULL);
+        pendingResults = [[NSMutableArray alloc] init];
+        ranges = (CellRange *)calloc(workerCount, sizeof(CellRange));
+
+        // Contiguous initial split keeps neighbouring cells (same payload and
+        // symbology) on the same worker
+        NSUInteger i;
+        for (i = 0; i < workerCount; i++) {
+            pthread_mutex_init(&ranges[i].lock, NULL);
+            ranges[i].head = cellCount * (NSInteger)i / (NSInteger)workerCount;
+            ranges[i].tail = cellCount * (NSInteger)(i + 1) / (NSInteger)workerCount;
+        }
+
+        finishedWorkers = [[NSConditionLock alloc] initWithCondition:0];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    NSUInteger i;
+    for (i = 0; i < workerCount; i++) {
+        pthread_mutex_destroy(&ranges[i].lock);
+    }
+    free(ranges);
+    free(results);
+    free(finishedCells);
+    pthread_mutex_destroy(&emitLock);
+    [pendingResults release];
+    [encoder release];
+    [decoder release];
+    [rasterCache release];
+    [testDataArray release];
+    [symbologyArray release];
+    [distortionTypes release];
+    [intensityLevels release];
+    [strengthLevels release];
+    [finishedWorkers release];
+    [super dealloc];
+}
+
+// Take the next cell from this worker's range, stealing when it runs dry.
+// Returns -1 once no worker has cells left.
+- (NSInteger)nextCellForWorker:(NSUInteger)worker {
+    CellRange *own = &ranges[worker];
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) {
+        NSInteger cell = own->head++;
+        pthread_mutex_unlock(&own->lock);
+        return cell;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (;;) {
+        // Pick the worker with the most remaining cells; each range is read
+        // under its own lock, so the choice may be stale but never torn
+        NSUInteger victim = worker;
+        NSInteger mostRemaining = 0;
+        NSUInteger i;
+        for (i = 0; i < workerCount; i++) {
+            if (i == worker) continue;
+            pthread_mutex_lock(&ranges[i].lock);
+            NSInteger remaining = ranges[i].tail - ranges[i].head;
+            pthread_mutex_unlock(&ranges[i].lock);
+            if (remaining > mostRemaining) {
+                mostRemaining = remaining;
+                victim = i;
+            }
+        }
+        if (victim == worker) {
+            return -1;
+        }
+
+        // Steal the upper half of the victim's range
+        CellRange *other = &ranges[victim];
+        NSInteger stolenHead = 0, stolenTail = 0;
+        pthread_mutex_lock(&other->lock);
+        NSInteger remaining = other->tail - other->head;
+        if (remaining > 0) {
+            stolenTail = other->tail;
+            stolenHead = other->tail - (remaining + 1) / 2;
+            other->tail = stolenHead;
+        }
+        pthread_mutex_unlock(&other->lock);
+
+        if (stolenTail > stolenHead) {
+            pthread_mutex_lock(&own->lock);
+            own->head = stolenHead + 1;
+            own->tail = stolenTail;
+            pthread_mutex_unlock(&own->lock);
+            return stolenHead;
+        }
+        // Victim drained meanwhile; rescan
+    }
+}
+
+- (BarcodeTestResult *)runCell:(NSInteger)cell withTester:(BarcodeTester *)tester {
+    // Decode the cell index in the serial loop order (strength varies fastest)
+    NSInteger index = cell;
+    NSInteger strengthIdx = index % (NSInteger)strengthLevels.count;
+    index /= (NSInteger)strengthLevels.count;
+    NSInteger intensityIdx = index % (NSInteger)intensityLevels.count;
+    index /= (NSInteger)intensityLevels.count;
+    NSInteger distIdx = index % (NSInteger)distortionTypes.count;
+    index /= (NSInteger)distortionTypes.count;
+    NSInteger symbIdx = index % (NSInteger)symbologyArray.count;
+    NSInteger dataIdx = index / (NSInteger)symbologyArray.count;
+
+    NSString *testData = [testDataArray objectAtIndex:dataIdx];
+    int symbology = [[symbologyArray objectAtIndex:symbIdx] intValue];
+    NSInteger distType = [[distortionTypes objectAtIndex:distIdx] intValue];
+    float intensity = [[intensityLevels objectAtIndex:intensityIdx] floatValue];
+    float strength = [[strengthLevels objectAtIndex:strengthIdx] floatValue];
+
+    return [tester runTestWithData:testData
+                         symbology:symbology
+                     distortionType:distType
+                          intensity:intensity
+                           strength:strength];
+}
+
+// Record a finished cell and pass on every result that is now next in serial
+// order, so the session (and its sinks) see results while the run is going
+// and only cells finished out of order are held here. The session is called
+// outside emitLock, since its sinks may block on I/O: one worker at a time
+// delivers, in order, while the others only queue and go back to work.
+- (void)finishCell:(NSInteger)cell result:(BarcodeTestResult *)result {
+    pthread_mutex_lock(&emitLock);
+    results[cell] = [result retain];
+    finishedCells[cell] = 1;
+    while (nextEmitCell < cellCount && finishedCells[nextEmitCell]) {
+        if (results[nextEmitCell]) {
+            [pendingResults addObject:results[nextEmitCell]];
+            [results[nextEmitCell] release];
+            results[nextEmitCell] = nil;
+        }
+        nextEmitCell++;
+    }
+    if (delivering) {
+        // The delivering worker picks these up after its current batch
+        pthread_mutex_unlock(&emitLock);
+        return;
+    }
+
+    delivering = YES;
+    while (pendingResults.count > 0) {
+        NSArray *batch = [pendingResults copy];
+        [pendingResults removeAllObjects];
+        pthread_mutex_unlock(&emitLock);
+
+        NSUInteger i;
+        for (i = 0; i < batch.count; i++) {
+            [session addResult:[batch objectAtIndex:i]];
+        }
+        [batch release];
+
+        pthread_mutex_lock(&emitLock);
+    }
+    delivering = NO;
+    pthread_mutex_unlock(&emitLock);
+}
+
+- (void)workerMain:(NSNumber *)workerNumber {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger worker = [workerNumber unsignedIntegerValue];
+
+    // Private encoder so backend state is never shared; the tester decodes
+    // with its own copy of the decoder (restricted once per symbology group)
+    BarcodeEncoder *workerEncoder = [encoder copy];
+    BarcodeTester *tester = [[BarcodeTester alloc] initWithEncoder:workerEncoder decoder:decoder];
+    if (rasterCache) {
+        // Shared cache: each raster is encoded once for the whole run
+        tester.rasterCache = rasterCache;
+    }
+
+    NSInteger cell;
+    while ((cell = [self nextCellForWorker:worker]) >= 0) {
+        NSAutoreleasePool *cellPool = [[NSAutoreleasePool alloc] init];
+        BarcodeTestResult *result = [self runCell:cell withTester:tester];
+        [self finishCell:cell result:result];
+        [cellPool release];
+    }
+
+    [tester release];
+    [workerEncoder release];
+
+    [finishedWorkers lock];
+    [finishedWorkers unlockWithCondition:[finishedWorkers condition] + 1];
+    [pool release];
+}
+
+- (void)runIntoSession:(BarcodeTestSession *)targetSession {
+    if (cellCount <= 0) {
+        return;
+    }
+    session = targetSession;
+
+    NSUInteger i;
+    for (i = 0; i < workerCount; i++) {
+        [NSThread detachNewThreadSelector:@selector(workerMain:)
+                                 toTarget:self
+                               withObject:[NSNumber numberWithUnsignedInteger:i]];
+    }
+
+    [finishedWorkers lockWhenCondition:(NSInteger)workerCount];
+    [finishedWorkers unlock];
+
+    // Workers have handed every cell to the session in serial loop order
+    session = nil;
+}
+
+@end
+
+@implementation BarcodeTestExecutor
+
+@synthesize rasterCache;
+
++ (NSUInteger)defaultWorkerCount {
+    NSUInteger count = [[NSProcessInfo processInfo] activeProcessorCount];
+    return count > 0 ? count : 1;
+}
+
+- (instancetype)initWithEncoder:(BarcodeEncoder *)enc
+                        decoder:(BarcodeDecoder *)dec
+                    workerCount:(NSUInteger)count {
+    self = [super init];
+    if (self) {
+        encoder = [enc retain];
+        decoder = [dec retain];
+        workerCount = count > 0 ? count : [[self class] defaultWorkerCount];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [encoder release];
+    [decoder release];
+    [rasterCache release];
+    [super dealloc];
+}
+
+- (NSUInteger)workerCount {
+    return workerCount;
+}
+
+- (BarcodeTestSession *)runComprehensiveTestSuite:(NSArray *)testDataArray
+                                       symbologies:(NSArray *)symbologyArray
+                                    distortionTypes:(NSArray *)distortionTypes
+                                     intensityLevels:(NSArray *)intensityLevels
+                                       strengthLevels:(NSArray *)strengthLevels
+                                         sessionName:(NSString *)sessionName {
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:sessionName];
+    [self runComprehensiveTestSuite:testDataArray
+                        symbologies:symbologyArray
+                     distortionTypes:distortionTypes
+                      intensityLevels:intensityLevels
+                        strengthLevels:strengthLevels
+                              session:session];
+    return [session autorelease];
+}
+
+- (void)runComprehensiveTestSuite:(NSArray *)testDataArray
+                       symbologies:(NSArray *)symbologyArray
+                    distortionTypes:(NSArray *)distortionTypes
+                     intensityLevels:(NSArray *)intensityLevels
+                       strengthLevels:(NSArray *)strengthLevels
+                             session:(BarcodeTestSession *)session {
+    if (encoder && [encoder hasBackend] && decoder && [decoder hasBackend]) {
+        BarcodeTestExecutorRun *run = [[BarcodeTestExecutorRun alloc] initWithEncoder:encoder
+                                                                              decoder:decoder
+                                                                             testData:testDataArray
+                                                                          symbologies:symbologyArray
+                                                                      distortionTypes:distortionTypes
+                                                                      intensityLevels:intensityLevels
+                                                                       strengthLevels:strengthLevels
+                                                                          workerCount:workerCount
+                                                                          rasterCache:rasterCache];
+        [run runIntoSession:session];
+        [run release];
+    }
+
+    [session endSession];
+}
+
+@end
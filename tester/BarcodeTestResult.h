@@ -6,6 +6,10 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "BarcodeResultSink.h"
+#import "BarcodeTestStatistics.h"
+#import "BarcodeResultStore.h"
+#import <pthread.h>
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -20,6 +24,9 @@ NS_ASSUME_NONNULL_BEGIN
     NSInteger qualityScore;
     BOOL dataMatches;
     NSString *decodedData;
+    int symbology;
+    uint32_t distortionSeed;
+    double stageMilliseconds[BarcodeTestStageCount];
 }
 
 @property (retain, nonatomic) NSString *barcodeType;
@@ -31,6 +38,8 @@ NS_ASSUME_NONNULL_BEGIN
 @property (assign, nonatomic) NSInteger qualityScore;
 @property (assign, nonatomic) BOOL dataMatches;
 @property (retain, nonatomic) NSString *decodedData;
+@property (assign, nonatomic) int symbology; // Barcode symbology ID (0 if unknown)
+@property (assign, nonatomic) uint32_t distortionSeed; // DistortionParameters seed, to replay the cell
 
 + (instancetype)resultWithBarcodeType:(NSString *)type 
                               testData:(NSString *)data 
@@ -42,29 +51,106 @@ NS_ASSUME_NONNULL_BEGIN
                                 matches:(BOOL)matches 
                                 decoded:(NSString *)decoded;
 
+/// Time spent in a stage of this test. Sessions fold these into their
+/// per-stage moments and quantile sketches (BarcodeTestStatistics.h).
+/// @param stage Stage
+/// @return Milliseconds, or -1 if the stage was not timed
+- (double)millisecondsForStage:(BarcodeTestStage)stage;
+
+/// Record the time spent in a stage
+/// @param milliseconds Elapsed time (-1 for not timed)
+/// @param stage Stage
+- (void)setMilliseconds:(double)milliseconds forStage:(BarcodeTestStage)stage;
+
 @end
 
-/// Test session containing multiple test results
+/// Test session containing multiple test results.
+/// Retained results are kept in a columnar BarcodeResultStore; result objects
+/// are only rebuilt when the results array is read. Results are handed to
+/// every attached sink as they are added; with retainsResults set to NO the
+/// session keeps none of them, so memory stays flat however long the run is.
+/// Summary statistics are running aggregates kept in plain C counters, so
+/// reading them costs the same mid-run as at the end. Callers serialize
+/// addResult:; copyStatistics: may be called from any thread at any time.
 @interface BarcodeTestSession : NSObject {
-    NSMutableArray *results;
+    BarcodeResultStore *store;
+    NSArray *resultsView;                // Cached view over store, made on first read
     NSString *sessionName;
     NSDate *startTime;
     NSDate *endTime;
+    NSMutableArray *sinks;
+    BOOL retainsResults;
+    NSUInteger resultCount;
+    BarcodeTestStatistics *statistics;
+    NSMutableDictionary *symbologyNames; // Symbology ID -> barcode type name
+    NSMutableDictionary *typeCounters;   // Type name -> NSMutableData holding BarcodeOutcomeCounters, for symbology 0
+    pthread_mutex_t statisticsLock;      // Guards statistics, symbologyNames and typeCounters
 }
 
-@property (retain, nonatomic) NSMutableArray *results;
 @property (retain, nonatomic) NSString *sessionName;
 @property (retain, nonatomic) NSDate *startTime;
 @property (retain, nonatomic) NSDate *endTime;
+/// Keep results in the result store (default YES). The results array and
+/// the exportTo... methods only see retained results; summary statistics
+/// cover every result.
+@property (assign, nonatomic) BOOL retainsResults;
 
 - (instancetype)initWithName:(NSString *)name;
+
+/// Retained results, materialized lazily from the store on access. This
+/// used to be a mutable array property; it is now a read-only view, since the
+/// rows live in the store. Add results with addResult: (which also updates
+/// the statistics and sinks) rather than by mutating the array.
+- (NSArray *)results;
+
+/// Replace the retained results with the given ones. Only the stored rows
+/// change; statistics, resultCount and sinks are left as they are.
+/// @param results Array of BarcodeTestResult (empty to clear)
+- (void)setResults:(NSArray *)results;
+
+/// Columnar storage of the retained results (for filtered scans)
+- (BarcodeResultStore *)store;
+
 - (void)addResult:(BarcodeTestResult *)result;
 - (void)endSession;
+/// Summary of every result added so far, built from the running aggregates
+/// (totals, success and match rates, quality mean and standard deviation,
+/// per barcode type and per distortion type, and stage timing percentiles).
+/// Ends the session first. Results without a symbology ID are grouped by
+/// their barcode type name.
 - (NSDictionary *)summaryStatistics;
+
+/// Copy the running aggregates
+/// @param destination Receives a consistent snapshot
+- (void)copyStatistics:(BarcodeTestStatistics *)destination;
 - (NSString *)exportToCSV;
 - (NSString *)exportToJSON;
 - (NSString *)escapeJSONString:(NSString *)string;
 
+/// Stream every later result to a sink (retained until the session is released)
+/// @param sink Result sink
+- (void)addSink:(id<BarcodeResultSink>)sink;
+
+/// Attached sinks
+- (NSArray *)sinks;
+
+/// Number of results added, retained or not
+- (NSUInteger)resultCount;
+
+/// Write the retained results to a file descriptor without building the
+/// whole document in memory
+/// @param fd Destination (not closed)
+/// @param format Output format
+/// @return NO if a write failed
+- (BOOL)writeResultsToFileDescriptor:(int)fd format:(BarcodeResultFormat)format;
+
+/// Write the retained results as a binary session file (see BarcodeSessionFile.h).
+/// To write a file incrementally during a run, add a BarcodeSessionFileWriter
+/// as a sink instead.
+/// @param path Destination file
+/// @return NO if the file could not be written
+- (BOOL)writeSessionFileToPath:(NSString *)path;
+
 @end
 
 NS_ASSUME_NONNULL_END
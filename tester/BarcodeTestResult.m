@@ -6,6 +6,10 @@
 //
 
 #import "BarcodeTestResult.h"
+#import "BarcodeSessionFile.h"
+#import <math.h>
+#import <stdlib.h>
+#import <string.h>
 
 @implementation BarcodeTestResult
 
@@ -18,6 +22,19 @@
 @synthesize qualityScore;
 @synthesize dataMatches;
 @synthesize decodedData;
+@synthesize symbology;
+@synthesize distortionSeed;
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        NSInteger stage;
+        for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+            stageMilliseconds[stage] = -1.0;
+        }
+    }
+    return self;
+}
 
 + (instancetype)resultWithBarcodeType:(NSString *)type 
                               testData:(NSString *)data 
@@ -48,28 +65,56 @@
     [super dealloc];
 }
 
+- (double)millisecondsForStage:(BarcodeTestStage)stage {
+    if (stage < 0 || stage >= BarcodeTestStageCount) {
+        return -1.0;
+    }
+    return stageMilliseconds[stage];
+}
+
+- (void)setMilliseconds:(double)milliseconds forStage:(BarcodeTestStage)stage {
+    if (stage >= 0 && stage < BarcodeTestStageCount) {
+        stageMilliseconds[stage] = milliseconds;
+    }
+}
+
 @end
 
 @implementation BarcodeTestSession
 
-@synthesize results;
 @synthesize sessionName;
 @synthesize startTime;
 @synthesize endTime;
+@synthesize retainsResults;
 
 - (instancetype)initWithName:(NSString *)name {
     self = [super init];
     if (self) {
         sessionName = [name retain];
-        results = [[NSMutableArray alloc] init];
+        store = [[BarcodeResultStore alloc] init];
         startTime = [[NSDate date] retain];
         endTime = nil;
+        sinks = [[NSMutableArray alloc] init];
+        retainsResults = YES;
+        statistics = (BarcodeTestStatistics *)malloc(sizeof(BarcodeTestStatistics));
+        if (statistics) {
+            BarcodeTestStatisticsReset(statistics);
+        }
+        symbologyNames = [[NSMutableDictionary alloc] init];
+        typeCounters = [[NSMutableDictionary alloc] init];
+        pthread_mutex_init(&statisticsLock, NULL);
     }
     return self;
 }
 
 - (void)dealloc {
-    [results release];
+    free(statistics);
+    [symbologyNames release];
+    [typeCounters release];
+    pthread_mutex_destroy(&statisticsLock);
+    [sinks release];
+    [resultsView release];
+    [store release];
     [sessionName release];
     [startTime release];
     [endTime release];
@@ -77,89 +122,236 @@
 }
 
 - (void)addResult:(BarcodeTestResult *)result {
-    if (result) {
-        [results addObject:result];
+    if (!result) {
+        return;
+    }
+    
+    resultCount++;
+    
+    if (statistics) {
+        double milliseconds[BarcodeTestStageCount];
+        NSInteger stage;
+        for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+            milliseconds[stage] = [result millisecondsForStage:(BarcodeTestStage)stage];
+        }
+        int slot = (result.symbology > 0 && result.symbology < BarcodeTestStatisticsSymbologySlots) ? result.symbology : 0;
+        
+        NSString *typeName = result.barcodeType ? result.barcodeType : @"Unknown";
+        
+        pthread_mutex_lock(&statisticsLock);
+        if (slot == 0) {
+            // No usable symbology ID: slot 0 would lump unrelated types
+            // together, so these are grouped by type name instead
+            NSMutableData *counters = [typeCounters objectForKey:typeName];
+            if (!counters) {
+                counters = [NSMutableData dataWithLength:sizeof(BarcodeOutcomeCounters)];
+                [typeCounters setObject:counters forKey:typeName];
+            }
+            BarcodeOutcomeCountersAdd((BarcodeOutcomeCounters *)[counters mutableBytes], result.decodeSuccess,
+                                      result.dataMatches, result.qualityScore, milliseconds);
+        } else if (statistics->bySymbology[slot].total == 0) {
+            // First result of this symbology: remember its name for the summary
+            [symbologyNames setObject:typeName forKey:[NSNumber numberWithInt:slot]];
+        }
+        BarcodeTestStatisticsAdd(statistics, result.symbology, result.distortionType,
+                                 result.decodeSuccess, result.dataMatches, result.qualityScore, milliseconds);
+        pthread_mutex_unlock(&statisticsLock);
+    }
+    
+    if (retainsResults) {
+        [store appendResult:result];
+    }
+    
+    NSUInteger i;
+    for (i = 0; i < sinks.count; i++) {
+        [[sinks objectAtIndex:i] writeResult:result];
     }
 }
 
+- (NSArray *)results {
+    // One view per session, so repeated reads reuse the objects it built
+    if (!resultsView) {
+        resultsView = [[store results] retain];
+    }
+    return resultsView;
+}
+
+- (void)setResults:(NSArray *)results {
+    [resultsView release];
+    resultsView = nil;
+    [store removeAllResults];
+    NSUInteger i;
+    for (i = 0; i < results.count; i++) {
+        [store appendResult:[results objectAtIndex:i]];
+    }
+}
+
+- (BarcodeResultStore *)store {
+    return store;
+}
+
+// Hand every retained result to a sink, one autorelease pool per batch so
+// only a few materialized objects exist at a time
+- (void)writeStoredResultsToSink:(id<BarcodeResultSink>)sink {
+    NSUInteger total = [store count];
+    NSUInteger row = 0;
+    while (row < total) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        NSUInteger end = row + 1024 < total ? row + 1024 : total;
+        for (; row < end; row++) {
+            [sink writeResult:[store resultAtIndex:row]];
+        }
+        [pool release];
+    }
+}
+
+- (void)addSink:(id<BarcodeResultSink>)sink {
+    if (sink) {
+        [sinks addObject:sink];
+    }
+}
+
+- (NSArray *)sinks {
+    return sinks;
+}
+
+- (NSUInteger)resultCount {
+    return resultCount;
+}
+
 - (void)endSession {
     if (!endTime) {
         endTime = [[NSDate date] retain];
     }
+    
+    NSUInteger i;
+    for (i = 0; i < sinks.count; i++) {
+        [[sinks objectAtIndex:i] flush];
+    }
+}
+
+// Summary keys of the stages, in BarcodeTestStage order
+static NSString * const BarcodeTestStageNames[BarcodeTestStageCount] = {@"encode", @"distort", @"decode", @"total"};
+
+// Counters of one group as NSNumbers (same keys at every level)
+static void addOutcomeEntries(NSMutableDictionary *dictionary, const BarcodeOutcomeCounters *counters,
+                              NSString *totalKey, NSString *successKey, NSString *matchKey) {
+    [dictionary setObject:[NSNumber numberWithUnsignedLong:counters->total] forKey:totalKey];
+    [dictionary setObject:[NSNumber numberWithUnsignedLong:counters->successes] forKey:successKey];
+    [dictionary setObject:[NSNumber numberWithUnsignedLong:counters->matches] forKey:matchKey];
+    if (counters->quality.count > 0) {
+        [dictionary setObject:[NSNumber numberWithFloat:(float)counters->quality.mean] forKey:@"averageQuality"];
+        [dictionary setObject:[NSNumber numberWithFloat:(float)sqrt(BarcodeRunningMomentsVariance(&counters->quality))] forKey:@"qualityStdDev"];
+    }
+    if (counters->total > 0) {
+        [dictionary setObject:[NSNumber numberWithFloat:(float)counters->successes / counters->total * 100.0f] forKey:@"successRate"];
+        [dictionary setObject:[NSNumber numberWithFloat:(float)counters->matches / counters->total * 100.0f] forKey:@"matchRate"];
+    }
+    
+    // Per-stage time of the group; "total" is the wall time it took, which
+    // ranks the symbologies and distortions that dominate a sweep
+    NSMutableDictionary *stages = [NSMutableDictionary dictionary];
+    NSInteger stage;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        const BarcodeRunningMoments *moments = &counters->stageMilliseconds[stage];
+        if (moments->count == 0) continue;
+        [stages setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSNumber numberWithUnsignedLong:moments->count], @"count",
+                              [NSNumber numberWithDouble:moments->mean], @"mean",
+                              [NSNumber numberWithDouble:sqrt(BarcodeRunningMomentsVariance(moments))], @"stdDev",
+                              [NSNumber numberWithDouble:moments->mean * (double)moments->count], @"total",
+                              nil]
+                   forKey:BarcodeTestStageNames[stage]];
+    }
+    if (stages.count > 0) {
+        [dictionary setObject:stages forKey:@"stageMilliseconds"];
+    }
+}
+
+- (void)copyStatistics:(BarcodeTestStatistics *)destination {
+    if (!destination) {
+        return;
+    }
+    pthread_mutex_lock(&statisticsLock);
+    if (statistics) {
+        memcpy(destination, statistics, sizeof(BarcodeTestStatistics));
+    } else {
+        BarcodeTestStatisticsReset(destination);
+    }
+    pthread_mutex_unlock(&statisticsLock);
 }
 
 - (NSDictionary *)summaryStatistics {
     [self endSession];
     
-    NSInteger totalTests = results.count;
-    NSInteger successfulDecodes = 0;
-    NSInteger matchingDecodes = 0;
-    NSInteger totalQuality = 0;
-    NSInteger qualityCount = 0;
+    // Snapshot the counters so a running sweep is not held up
+    BarcodeTestStatistics *snapshot = (BarcodeTestStatistics *)malloc(sizeof(BarcodeTestStatistics));
+    if (!snapshot) {
+        return nil;
+    }
+    [self copyStatistics:snapshot];
+    pthread_mutex_lock(&statisticsLock);
+    NSDictionary *names = [[symbologyNames copy] autorelease];
+    NSMutableDictionary *namedCounters = [NSMutableDictionary dictionary];
+    NSEnumerator *typeEnumerator = [typeCounters keyEnumerator];
+    NSString *typeName;
+    while ((typeName = [typeEnumerator nextObject])) {
+        [namedCounters setObject:[NSData dataWithData:[typeCounters objectForKey:typeName]] forKey:typeName];
+    }
+    pthread_mutex_unlock(&statisticsLock);
     
-    NSMutableDictionary *byBarcodeType = [NSMutableDictionary dictionary];
-    NSMutableDictionary *byDistortionType = [NSMutableDictionary dictionary];
+    NSMutableDictionary *summary = [NSMutableDictionary dictionary];
+    addOutcomeEntries(summary, &snapshot->overall, @"totalTests", @"successfulDecodes", @"matchingDecodes");
     
+    NSMutableDictionary *byBarcodeType = [NSMutableDictionary dictionary];
     NSInteger i;
-    for (i = 0; i < results.count; i++) {
-        BarcodeTestResult *result = [results objectAtIndex:i];
-        
-        if (result.decodeSuccess) {
-            successfulDecodes++;
-            if (result.dataMatches) {
-                matchingDecodes++;
-            }
-            if (result.qualityScore >= 0) {
-                totalQuality += result.qualityScore;
-                qualityCount++;
-            }
-        }
-        
-        // Group by barcode type
-        NSString *type = result.barcodeType;
-        if (![byBarcodeType objectForKey:type]) {
-            [byBarcodeType setObject:[NSMutableDictionary dictionaryWithObjectsAndKeys:
-                [NSNumber numberWithInt:0], @"total",
-                [NSNumber numberWithInt:0], @"success",
-                nil] forKey:type];
-        }
-        NSMutableDictionary *typeStats = [byBarcodeType objectForKey:type];
-        NSInteger total = [[typeStats objectForKey:@"total"] intValue] + 1;
-        [typeStats setObject:[NSNumber numberWithInt:total] forKey:@"total"];
-        if (result.decodeSuccess) {
-            NSInteger success = [[typeStats objectForKey:@"success"] intValue] + 1;
-            [typeStats setObject:[NSNumber numberWithInt:success] forKey:@"success"];
-        }
-        
-        // Group by distortion type
-        NSString *distTypeKey = [NSString stringWithFormat:@"%ld", (long)result.distortionType];
-        if (![byDistortionType objectForKey:distTypeKey]) {
-            [byDistortionType setObject:[NSMutableDictionary dictionaryWithObjectsAndKeys:
-                [NSNumber numberWithInt:0], @"total",
-                [NSNumber numberWithInt:0], @"success",
-                nil] forKey:distTypeKey];
-        }
-        NSMutableDictionary *distStats = [byDistortionType objectForKey:distTypeKey];
-        total = [[distStats objectForKey:@"total"] intValue] + 1;
-        [distStats setObject:[NSNumber numberWithInt:total] forKey:@"total"];
-        if (result.decodeSuccess) {
-            NSInteger success = [[distStats objectForKey:@"success"] intValue] + 1;
-            [distStats setObject:[NSNumber numberWithInt:success] forKey:@"success"];
-        }
+    for (i = 1; i < BarcodeTestStatisticsSymbologySlots; i++) {
+        if (snapshot->bySymbology[i].total == 0) continue;
+        NSMutableDictionary *typeStats = [NSMutableDictionary dictionary];
+        addOutcomeEntries(typeStats, &snapshot->bySymbology[i], @"total", @"success", @"matches");
+        [typeStats setObject:[NSNumber numberWithInt:(int)i] forKey:@"symbology"];
+        NSString *name = [names objectForKey:[NSNumber numberWithInt:(int)i]];
+        [byBarcodeType setObject:typeStats forKey:name ? name : @"Unknown"];
+    }
+    typeEnumerator = [namedCounters keyEnumerator];
+    while ((typeName = [typeEnumerator nextObject])) {
+        NSMutableDictionary *typeStats = [NSMutableDictionary dictionary];
+        addOutcomeEntries(typeStats, (const BarcodeOutcomeCounters *)[[namedCounters objectForKey:typeName] bytes],
+                          @"total", @"success", @"matches");
+        // A numbered symbology of the same name keeps the plain key
+        NSString *key = [byBarcodeType objectForKey:typeName] ? [typeName stringByAppendingString:@" (no symbology)"] : typeName;
+        [byBarcodeType setObject:typeStats forKey:key];
     }
     
-    NSMutableDictionary *summary = [NSMutableDictionary dictionary];
-    [summary setObject:[NSNumber numberWithInt:totalTests] forKey:@"totalTests"];
-    [summary setObject:[NSNumber numberWithInt:successfulDecodes] forKey:@"successfulDecodes"];
-    [summary setObject:[NSNumber numberWithInt:matchingDecodes] forKey:@"matchingDecodes"];
-    if (qualityCount > 0) {
-        [summary setObject:[NSNumber numberWithFloat:(float)totalQuality / qualityCount] forKey:@"averageQuality"];
+    NSMutableDictionary *byDistortionType = [NSMutableDictionary dictionary];
+    for (i = 0; i < BarcodeTestStatisticsDistortionSlots; i++) {
+        if (snapshot->byDistortion[i].total == 0) continue;
+        NSMutableDictionary *distStats = [NSMutableDictionary dictionary];
+        addOutcomeEntries(distStats, &snapshot->byDistortion[i], @"total", @"success", @"matches");
+        [byDistortionType setObject:distStats forKey:[NSString stringWithFormat:@"%ld", (long)i]];
     }
-    if (totalTests > 0) {
-        [summary setObject:[NSNumber numberWithFloat:(float)successfulDecodes / totalTests * 100.0f] forKey:@"successRate"];
+    
+    // Stage timings in milliseconds
+    NSMutableDictionary *timings = [NSMutableDictionary dictionary];
+    for (i = 0; i < BarcodeTestStageCount; i++) {
+        const BarcodeStageTiming *timing = &snapshot->stages[i];
+        if (timing->moments.count == 0) continue;
+        NSMutableDictionary *stageStats = [NSMutableDictionary dictionary];
+        [stageStats setObject:[NSNumber numberWithUnsignedLong:timing->moments.count] forKey:@"count"];
+        [stageStats setObject:[NSNumber numberWithDouble:timing->moments.mean] forKey:@"mean"];
+        [stageStats setObject:[NSNumber numberWithDouble:sqrt(BarcodeRunningMomentsVariance(&timing->moments))] forKey:@"stdDev"];
+        NSInteger q;
+        for (q = 0; q < BarcodeQuantileCount; q++) {
+            NSString *key = [NSString stringWithFormat:@"p%g", BarcodeQuantiles[q] * 100.0];
+            [stageStats setObject:[NSNumber numberWithDouble:BarcodeQuantileSketchValue(&timing->quantiles[q])] forKey:key];
+        }
+        [timings setObject:stageStats forKey:BarcodeTestStageNames[i]];
     }
+    free(snapshot);
+    
     [summary setObject:byBarcodeType forKey:@"byBarcodeType"];
     [summary setObject:byDistortionType forKey:@"byDistortionType"];
+    [summary setObject:timings forKey:@"timings"];
     [summary setObject:startTime forKey:@"startTime"];
     [summary setObject:endTime ? endTime : [NSDate date] forKey:@"endTime"];
     
@@ -167,60 +359,40 @@
 }
 
 - (NSString *)exportToCSV {
-    NSMutableString *csv = [NSMutableString string];
+    NSMutableData *data = [NSMutableData data];
+    BarcodeStreamResultSink *sink = [[BarcodeStreamResultSink alloc] initWithMutableData:data format:BarcodeResultFormatCSV];
+    [self writeStoredResultsToSink:sink];
+    [sink close];
+    [sink release];
     
-    // Header
-    [csv appendString:@"Barcode Type,Test Data,Distortion Type,Intensity,Strength,Decode Success,Quality Score,Data Matches,Decoded Data\n"];
-    
-    // Data rows
-    NSInteger i;
-    for (i = 0; i < results.count; i++) {
-        BarcodeTestResult *result = [results objectAtIndex:i];
-        [csv appendFormat:@"%@,%@,%ld,%.2f,%.2f,%d,%ld,%d,%@\n",
-            result.barcodeType ? result.barcodeType : @"",
-            result.testData ? result.testData : @"",
-            (long)result.distortionType,
-            result.distortionIntensity,
-            result.distortionStrength,
-            result.decodeSuccess ? 1 : 0,
-            (long)result.qualityScore,
-            result.dataMatches ? 1 : 0,
-            result.decodedData ? result.decodedData : @""];
+    return [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
+}
+
+- (BOOL)writeResultsToFileDescriptor:(int)fd format:(BarcodeResultFormat)format {
+    BarcodeStreamResultSink *sink = [[BarcodeStreamResultSink alloc] initWithFileDescriptor:fd format:format closeWhenDone:NO];
+    [self writeStoredResultsToSink:sink];
+    BOOL success = [sink flush];
+    [sink release];
+    return success;
+}
+
+- (BOOL)writeSessionFileToPath:(NSString *)path {
+    BarcodeSessionFileWriter *writer = [[BarcodeSessionFileWriter alloc] initWithPath:path];
+    if (!writer) {
+        return NO;
     }
-    
-    return csv;
+    [self writeStoredResultsToSink:writer];
+    BOOL success = [writer close];
+    [writer release];
+    return success;
 }
 
 - (NSString *)exportToJSON {
-    NSMutableDictionary *json = [NSMutableDictionary dictionary];
-    [json setObject:sessionName ? sessionName : @"Test Session" forKey:@"sessionName"];
-    [json setObject:[startTime description] forKey:@"startTime"];
-    if (endTime) {
-        [json setObject:[endTime description] forKey:@"endTime"];
-    }
-    
-    NSMutableArray *resultsArray = [NSMutableArray array];
-    NSInteger i;
-    for (i = 0; i < results.count; i++) {
-        BarcodeTestResult *result = [results objectAtIndex:i];
-        NSMutableDictionary *resultDict = [NSMutableDictionary dictionary];
-        [resultDict setObject:result.barcodeType ? result.barcodeType : @"" forKey:@"barcodeType"];
-        [resultDict setObject:result.testData ? result.testData : @"" forKey:@"testData"];
-        [resultDict setObject:[NSNumber numberWithInt:(int)result.distortionType] forKey:@"distortionType"];
-        [resultDict setObject:[NSNumber numberWithFloat:result.distortionIntensity] forKey:@"intensity"];
-        [resultDict setObject:[NSNumber numberWithFloat:result.distortionStrength] forKey:@"strength"];
-        [resultDict setObject:[NSNumber numberWithBool:result.decodeSuccess] forKey:@"decodeSuccess"];
-        [resultDict setObject:[NSNumber numberWithInt:(int)result.qualityScore] forKey:@"qualityScore"];
-        [resultDict setObject:[NSNumber numberWithBool:result.dataMatches] forKey:@"dataMatches"];
-        [resultDict setObject:result.decodedData ? result.decodedData : @"" forKey:@"decodedData"];
-        [resultsArray addObject:resultDict];
-    }
-    [json setObject:resultsArray forKey:@"results"];
-    
-    [json setObject:[self summaryStatistics] forKey:@"summary"];
+    // Exporting ends the session, so the document carries its end time
+    [self endSession];
     
-    // Simple JSON serialization (for basic compatibility)
-    // In a real implementation, you might want to use NSJSONSerialization if available
+    // Simple JSON serialization (for basic compatibility), written straight
+    // from the results without intermediate dictionaries
     NSMutableString *jsonString = [NSMutableString string];
     [jsonString appendString:@"{\n"];
     [jsonString appendFormat:@"  \"sessionName\": \"%@\",\n", [self escapeJSONString:sessionName ? sessionName : @""]];
@@ -230,22 +402,36 @@
     }
     [jsonString appendString:@"  \"results\": [\n"];
     
-    for (i = 0; i < resultsArray.count; i++) {
-        NSDictionary *resultDict = [resultsArray objectAtIndex:i];
+    // Rows are read straight from the columns; no result objects are built
+    NSUInteger total = [store count];
+    NSUInteger i;
+    for (i = 0; i < total; i++) {
+        BarcodeResultRow row = [store rowAtIndex:i];
+        NSString *payload = [store stringAtIndex:row.testData];
+        NSString *decoded = row.decodedData == BarcodeResultStoreSameAsInput ? payload : [store stringAtIndex:row.decodedData];
         [jsonString appendString:@"    {\n"];
-        NSString *barcodeType = [resultDict objectForKey:@"barcodeType"];
-        NSString *testData = [resultDict objectForKey:@"testData"];
-        NSString *decodedData = [resultDict objectForKey:@"decodedData"];
-        [jsonString appendFormat:@"      \"barcodeType\": \"%@\",\n", [self escapeJSONString:barcodeType ? barcodeType : @""]];
-        [jsonString appendFormat:@"      \"testData\": \"%@\",\n", [self escapeJSONString:testData ? testData : @""]];
-        [jsonString appendFormat:@"      \"distortionType\": %d,\n", [[resultDict objectForKey:@"distortionType"] intValue]];
-        [jsonString appendFormat:@"      \"intensity\": %.2f,\n", [[resultDict objectForKey:@"intensity"] floatValue]];
-        [jsonString appendFormat:@"      \"strength\": %.2f,\n", [[resultDict objectForKey:@"strength"] floatValue]];
-        [jsonString appendFormat:@"      \"decodeSuccess\": %@,\n", [[resultDict objectForKey:@"decodeSuccess"] boolValue] ? @"true" : @"false"];
-        [jsonString appendFormat:@"      \"qualityScore\": %d,\n", [[resultDict objectForKey:@"qualityScore"] intValue]];
-        [jsonString appendFormat:@"      \"dataMatches\": %@,\n", [[resultDict objectForKey:@"dataMatches"] boolValue] ? @"true" : @"false"];
-        [jsonString appendFormat:@"      \"decodedData\": \"%@\"\n", [self escapeJSONString:decodedData ? decodedData : @""]];
-        [jsonString appendString:i < resultsArray.count - 1 ? @"    },\n" : @"    }\n"];
+        [jsonString appendFormat:@"      \"barcodeType\": \"%@\",\n", [self escapeJSONString:[store stringAtIndex:row.barcodeType]]];
+        [jsonString appendFormat:@"      \"testData\": \"%@\",\n", [self escapeJSONString:payload]];
+        [jsonString appendFormat:@"      \"distortionType\": %d,\n", (int)row.distortionType];
+        [jsonString appendFormat:@"      \"intensity\": %.2f,\n", row.intensity];
+        [jsonString appendFormat:@"      \"strength\": %.2f,\n", row.strength];
+        [jsonString appendFormat:@"      \"seed\": %u,\n", row.seed];
+        [jsonString appendFormat:@"      \"decodeSuccess\": %@,\n", row.decodeSuccess ? @"true" : @"false"];
+        [jsonString appendFormat:@"      \"qualityScore\": %d,\n", (int)row.qualityScore];
+        [jsonString appendFormat:@"      \"dataMatches\": %@,\n", row.dataMatches ? @"true" : @"false"];
+        [jsonString appendFormat:@"      \"decodedData\": \"%@\",\n", [self escapeJSONString:decoded]];
+        // Same stage fields as the JSON Lines sink; null when not timed
+        NSInteger stage;
+        for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+            float milliseconds = row.stageMilliseconds[stage];
+            NSString *separator = stage + 1 < BarcodeTestStageCount ? @"," : @"";
+            if (milliseconds >= 0.0f) {
+                [jsonString appendFormat:@"      \"%s\": %.3f%@\n", BarcodeTestStageJSONKeys[stage], milliseconds, separator];
+            } else {
+                [jsonString appendFormat:@"      \"%s\": null%@\n", BarcodeTestStageJSONKeys[stage], separator];
+            }
+        }
+        [jsonString appendString:i + 1 < total ? @"    },\n" : @"    }\n"];
     }
     
     [jsonString appendString:@"  ]\n"];
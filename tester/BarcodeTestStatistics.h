@@ -0,0 +1,121 @@
+//
+//  BarcodeTestStatistics.h
+//  SmallBarcodeReader
+//
+//  Running aggregates for test sessions (plain C, no allocation)
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Symbology IDs below this get their own counters; others share slot 0
+#define BarcodeTestStatisticsSymbologySlots 256
+
+/// Distortion types below this get their own counters; others only count overall
+#define BarcodeTestStatisticsDistortionSlots 32
+
+/// Quantiles tracked for every timed stage
+#define BarcodeQuantileCount 3
+extern const double BarcodeQuantiles[BarcodeQuantileCount]; // 0.5, 0.9, 0.99
+
+/// Timed stages of one test cell
+typedef NS_ENUM(NSInteger, BarcodeTestStage) {
+    BarcodeTestStageEncode = 0, // Encode or raster cache lookup
+    BarcodeTestStageDistort,
+    BarcodeTestStageDecode,
+    BarcodeTestStageTotal,
+    BarcodeTestStageCount
+};
+
+/// Keys of the stage times in exported JSON and JSON Lines, in stage order
+extern const char * const BarcodeTestStageJSONKeys[BarcodeTestStageCount];
+
+/// Count, mean and variance accumulated with Welford's method
+typedef struct {
+    unsigned long count;
+    double mean;
+    double m2; // Sum of squared differences from the mean
+} BarcodeRunningMoments;
+
+/// P-square estimate of one quantile: five markers, constant space and time
+typedef struct {
+    double probability;
+    unsigned long count;
+    double heights[5];
+    double positions[5];
+    double desired[5];
+} BarcodeQuantileSketch;
+
+/// Outcome counters for one group of results
+typedef struct {
+    unsigned long total;
+    unsigned long successes;
+    unsigned long matches;
+    BarcodeRunningMoments quality; // Successful decodes that reported a quality
+    BarcodeRunningMoments stageMilliseconds[BarcodeTestStageCount]; // Timed results only
+} BarcodeOutcomeCounters;
+
+/// Timing aggregates for one stage (milliseconds)
+typedef struct {
+    BarcodeRunningMoments moments;
+    BarcodeQuantileSketch quantiles[BarcodeQuantileCount];
+} BarcodeStageTiming;
+
+/// All running aggregates of a session; updated in O(1) per result
+typedef struct {
+    BarcodeOutcomeCounters overall;
+    BarcodeOutcomeCounters bySymbology[BarcodeTestStatisticsSymbologySlots];
+    BarcodeOutcomeCounters byDistortion[BarcodeTestStatisticsDistortionSlots];
+    BarcodeStageTiming stages[BarcodeTestStageCount];
+} BarcodeTestStatistics;
+
+/// Clear all aggregates
+/// @param statistics Statistics to reset
+void BarcodeTestStatisticsReset(BarcodeTestStatistics *statistics);
+
+/// Add one result
+/// @param statistics Statistics to update
+/// @param symbology Barcode symbology ID
+/// @param distortionType DistortionType value
+/// @param success Decode succeeded
+/// @param matches Decoded data matched the input
+/// @param quality Quality score (< 0 if not available)
+/// @param stageMilliseconds BarcodeTestStageCount stage times (negative entries were not timed)
+void BarcodeTestStatisticsAdd(BarcodeTestStatistics *statistics, int symbology, NSInteger distortionType,
+                              BOOL success, BOOL matches, NSInteger quality, const double *stageMilliseconds);
+
+/// Add one result to a single group's counters
+/// @param counters Counters to update
+/// @param success Decode succeeded
+/// @param matches Decoded data matched the input
+/// @param quality Quality score (< 0 if not available)
+/// @param stageMilliseconds BarcodeTestStageCount stage times (negative entries were not timed)
+void BarcodeOutcomeCountersAdd(BarcodeOutcomeCounters *counters, BOOL success, BOOL matches, NSInteger quality,
+                               const double *stageMilliseconds);
+
+/// Add a sample to running moments
+/// @param moments Moments to update
+/// @param value Sample
+void BarcodeRunningMomentsAdd(BarcodeRunningMoments *moments, double value);
+
+/// Sample variance (0 with fewer than two samples)
+/// @param moments Moments
+double BarcodeRunningMomentsVariance(const BarcodeRunningMoments *moments);
+
+/// Prepare a sketch for one quantile
+/// @param sketch Sketch to reset
+/// @param probability Quantile in (0, 1)
+void BarcodeQuantileSketchInit(BarcodeQuantileSketch *sketch, double probability);
+
+/// Add a sample to a sketch
+/// @param sketch Sketch to update
+/// @param value Sample
+void BarcodeQuantileSketchAdd(BarcodeQuantileSketch *sketch, double value);
+
+/// Current quantile estimate (exact for the first five samples)
+/// @param sketch Sketch
+/// @return Estimate, or 0 if empty
+double BarcodeQuantileSketchValue(const BarcodeQuantileSketch *sketch);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,181 @@
+//
+//  BarcodeTestStatistics.m
+//  SmallBarcodeReader
+//
+//  Running aggregates implementation
+//
+
+#import "BarcodeTestStatistics.h"
+#import <string.h>
+
+const double BarcodeQuantiles[BarcodeQuantileCount] = {0.5, 0.9, 0.99};
+
+const char * const BarcodeTestStageJSONKeys[BarcodeTestStageCount] = {
+    "encodeMilliseconds", "distortMilliseconds", "decodeMilliseconds", "totalMilliseconds"
+};
+
+void BarcodeRunningMomentsAdd(BarcodeRunningMoments *moments, double value) {
+    moments->count++;
+    double delta = value - moments->mean;
+    moments->mean += delta / (double)moments->count;
+    moments->m2 += delta * (value - moments->mean);
+}
+
+double BarcodeRunningMomentsVariance(const BarcodeRunningMoments *moments) {
+    if (moments->count < 2) {
+        return 0.0;
+    }
+    return moments->m2 / (double)(moments->count - 1);
+}
+
+void BarcodeQuantileSketchInit(BarcodeQuantileSketch *sketch, double probability) {
+    memset(sketch, 0, sizeof(*sketch));
+    sketch->probability = probability;
+}
+
+// Piecewise-parabolic prediction of marker i moved by direction (+1 or -1)
+static double parabolicHeight(const BarcodeQuantileSketch *sketch, int i, double direction) {
+    const double *q = sketch->heights;
+    const double *n = sketch->positions;
+    return q[i] + direction / (n[i + 1] - n[i - 1]) *
+        ((n[i] - n[i - 1] + direction) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+         (n[i + 1] - n[i] - direction) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+void BarcodeQuantileSketchAdd(BarcodeQuantileSketch *sketch, double value) {
+    double *q = sketch->heights;
+    double *n = sketch->positions;
+    double p = sketch->probability;
+    
+    // Keep the first five samples sorted; they become the initial markers
+    if (sketch->count < 5) {
+        int i = (int)sketch->count;
+        while (i > 0 && q[i - 1] > value) {
+            q[i] = q[i - 1];
+            i--;
+        }
+        q[i] = value;
+        sketch->count++;
+        if (sketch->count == 5) {
+            for (i = 0; i < 5; i++) {
+                n[i] = i;
+            }
+            sketch->desired[0] = 0.0;
+            sketch->desired[1] = 2.0 * p;
+            sketch->desired[2] = 4.0 * p;
+            sketch->desired[3] = 2.0 + 2.0 * p;
+            sketch->desired[4] = 4.0;
+        }
+        return;
+    }
+    
+    // Find the cell the sample falls in, extending the extremes if needed
+    int k;
+    if (value < q[0]) {
+        q[0] = value;
+        k = 0;
+    } else if (value >= q[4]) {
+        q[4] = value;
+        k = 3;
+    } else {
+        k = 0;
+        while (k < 3 && value >= q[k + 1]) {
+            k++;
+        }
+    }
+    
+    int i;
+    for (i = k + 1; i < 5; i++) {
+        n[i] += 1.0;
+    }
+    sketch->desired[1] += p / 2.0;
+    sketch->desired[2] += p;
+    sketch->desired[3] += (1.0 + p) / 2.0;
+    sketch->desired[4] += 1.0;
+    sketch->count++;
+    
+    // Nudge the middle markers towards their desired positions
+    for (i = 1; i <= 3; i++) {
+        double offset = sketch->desired[i] - n[i];
+        if ((offset >= 1.0 && n[i + 1] - n[i] > 1.0) || (offset <= -1.0 && n[i - 1] - n[i] < -1.0)) {
+            double direction = offset > 0.0 ? 1.0 : -1.0;
+            double height = parabolicHeight(sketch, i, direction);
+            if (q[i - 1] < height && height < q[i + 1]) {
+                q[i] = height;
+            } else {
+                int j = i + (int)direction;
+                q[i] += direction * (q[j] - q[i]) / (n[j] - n[i]);
+            }
+            n[i] += direction;
+        }
+    }
+}
+
+double BarcodeQuantileSketchValue(const BarcodeQuantileSketch *sketch) {
+    if (sketch->count == 0) {
+        return 0.0;
+    }
+    if (sketch->count < 5) {
+        // Nearest rank among the sorted samples
+        int rank = (int)(sketch->probability * (double)sketch->count);
+        if (rank >= (int)sketch->count) rank = (int)sketch->count - 1;
+        return sketch->heights[rank];
+    }
+    return sketch->heights[2];
+}
+
+void BarcodeTestStatisticsReset(BarcodeTestStatistics *statistics) {
+    memset(statistics, 0, sizeof(*statistics));
+    
+    int stage, i;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        for (i = 0; i < BarcodeQuantileCount; i++) {
+            BarcodeQuantileSketchInit(&statistics->stages[stage].quantiles[i], BarcodeQuantiles[i]);
+        }
+    }
+}
+
+void BarcodeOutcomeCountersAdd(BarcodeOutcomeCounters *counters, BOOL success, BOOL matches, NSInteger quality,
+                               const double *stageMilliseconds) {
+    counters->total++;
+    if (success) {
+        counters->successes++;
+        if (matches) {
+            counters->matches++;
+        }
+        if (quality >= 0) {
+            BarcodeRunningMomentsAdd(&counters->quality, (double)quality);
+        }
+    }
+    int stage;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        if (stageMilliseconds[stage] >= 0.0) {
+            BarcodeRunningMomentsAdd(&counters->stageMilliseconds[stage], stageMilliseconds[stage]);
+        }
+    }
+}
+
+void BarcodeTestStatisticsAdd(BarcodeTestStatistics *statistics, int symbology, NSInteger distortionType,
+                              BOOL success, BOOL matches, NSInteger quality, const double *stageMilliseconds) {
+    BarcodeOutcomeCountersAdd(&statistics->overall, success, matches, quality, stageMilliseconds);
+    
+    int slot = (symbology > 0 && symbology < BarcodeTestStatisticsSymbologySlots) ? symbology : 0;
+    BarcodeOutcomeCountersAdd(&statistics->bySymbology[slot], success, matches, quality, stageMilliseconds);
+    
+    if (distortionType >= 0 && distortionType < BarcodeTestStatisticsDistortionSlots) {
+        BarcodeOutcomeCountersAdd(&statistics->byDistortion[distortionType], success, matches, quality, stageMilliseconds);
+    }
+    
+    int stage, i;
+    for (stage = 0; stage < BarcodeTestStageCount; stage++) {
+        double milliseconds = stageMilliseconds[stage];
+        if (milliseconds < 0.0) {
+            continue;
+        }
+        BarcodeStageTiming *timing = &statistics->stages[stage];
+        BarcodeRunningMomentsAdd(&timing->moments, milliseconds);
+        for (i = 0; i < BarcodeQuantileCount; i++) {
+            BarcodeQuantileSketchAdd(&timing->quantiles[i], milliseconds);
+        }
+    }
+}
@@ -8,25 +8,48 @@
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #import "BarcodeTestResult.h"
+#import <pthread.h>
 
 @class BarcodeEncoder;
 @class BarcodeDecoder;
 @class ImageDistorter;
 @class BarcodeTestSession;
+@class BarcodeRasterCache;
 
 NS_ASSUME_NONNULL_BEGIN
 
-/// Automated barcode testing framework
+/// Automated barcode testing framework.
+/// A tester may be shared across threads: each test borrows its own decoder
+/// copy, so overlapping runs never scan with or reconfigure the same copy.
 @interface BarcodeTester : NSObject {
     BarcodeEncoder *encoder;
     BarcodeDecoder *decoder;
+    BarcodeDecoder *scanDecoder; // Idle private copy of decoder, restricted to scanSymbology
+    int scanSymbology;
+    unsigned long scanGeneration; // Bumped when copies must be taken afresh
+    pthread_mutex_t scanLock;     // Guards the three fields above
     ImageDistorter *distorter;
+    NSUInteger workerCount;
+    BarcodeRasterCache *rasterCache;
 }
 
-/// Initialize with encoder and decoder
+/// Worker threads used by runComprehensiveTestSuite. The default, 1, runs
+/// serially on the calling thread; set it to more (for example
+/// BarcodeTestExecutor's defaultWorkerCount) to spread cells across threads.
+@property (assign, nonatomic) NSUInteger workerCount;
+
+/// Cache of encoded rasters consulted before every encode, so a sweep encodes
+/// each (payload, symbology) once. Created by init; set to nil to disable.
+@property (retain, nonatomic) BarcodeRasterCache *rasterCache;
+
+/// Initialize with encoder and decoder. The decoder itself is never
+/// reconfigured: cells decode with a private copy restricted to the cell's
+/// symbology, taken again at the start of each suite, progressive test or
+/// threshold search.
 - (instancetype)initWithEncoder:(BarcodeEncoder *)encoder decoder:(BarcodeDecoder *)decoder;
 
-/// Run a single test
+/// Run a single test. Random distortions use a seed derived from the
+/// parameters, so repeating a call replays the same image.
 /// @param testData Data to encode
 /// @param symbology Barcode symbology ID
 /// @param distortionType Distortion type to apply
@@ -39,6 +62,22 @@ NS_ASSUME_NONNULL_BEGIN
                                intensity:(float)intensity
                                  strength:(float)strength;
 
+/// Run a single test with an explicit distortion seed, e.g. to replay a cell
+/// from its recorded BarcodeTestResult distortionSeed
+/// @param testData Data to encode
+/// @param symbology Barcode symbology ID
+/// @param distortionType Distortion type to apply
+/// @param intensity Distortion intensity (0.0 to 1.0)
+/// @param strength Distortion strength (0.0 to 1.0)
+/// @param seed Seed for noise distortions
+/// @return Test result
+- (BarcodeTestResult *)runTestWithData:(NSString *)testData
+                              symbology:(int)symbology
+                          distortionType:(NSInteger)distortionType
+                               intensity:(float)intensity
+                                 strength:(float)strength
+                                     seed:(uint32_t)seed;
+
 /// Run progressive distortion test (gradually increase intensity)
 /// @param testData Data to encode
 /// @param symbology Barcode symbology ID
@@ -57,6 +96,8 @@ NS_ASSUME_NONNULL_BEGIN
                                      session:(BarcodeTestSession *)session;
 
 /// Run comprehensive test suite
+/// Cells are spread across workerCount threads; results are added to the
+/// session in the same order as a serial run.
 /// @param testDataArray Array of test data strings
 /// @param symbologyArray Array of symbology IDs
 /// @param distortionTypes Array of distortion type IDs
@@ -71,12 +112,28 @@ NS_ASSUME_NONNULL_BEGIN
                                        strengthLevels:(NSArray *)strengthLevels
                                          sessionName:(NSString *)sessionName;
 
+/// Run comprehensive test suite into an existing session, e.g. one with
+/// result sinks attached and retainsResults set to NO for very large sweeps
+/// @param testDataArray Array of test data strings
+/// @param symbologyArray Array of symbology IDs
+/// @param distortionTypes Array of distortion type IDs
+/// @param intensityLevels Array of intensity values
+/// @param strengthLevels Array of strength values
+/// @param session Test session to add results to (ended when the run finishes)
+- (void)runComprehensiveTestSuite:(NSArray *)testDataArray
+                       symbologies:(NSArray *)symbologyArray
+                    distortionTypes:(NSArray *)distortionTypes
+                     intensityLevels:(NSArray *)intensityLevels
+                       strengthLevels:(NSArray *)strengthLevels
+                             session:(BarcodeTestSession *)session;
+
 /// Find minimum distortion level that causes failure
+/// Bisects intensity to a tolerance of maxIntensity / steps at strength 0.5.
 /// @param testData Data to encode
 /// @param symbology Barcode symbology ID
 /// @param distortionType Distortion type to apply
 /// @param maxIntensity Maximum intensity to test
-/// @param steps Number of steps
+/// @param steps Resolution: the result is within maxIntensity / steps of the threshold
 /// @return Minimum intensity that causes failure, or -1 if always succeeds
 - (float)findFailureThresholdWithData:(NSString *)testData
                               symbology:(int)symbology
@@ -84,6 +141,44 @@ NS_ASSUME_NONNULL_BEGIN
                             maxIntensity:(float)maxIntensity
                                    steps:(NSInteger)steps;
 
+/// Find minimum distortion intensity that causes failure by bisection.
+/// Assumes decoding fails monotonically as intensity grows; costs about
+/// 2 + log2(maxIntensity / tolerance) decodes.
+/// @param testData Data to encode
+/// @param symbology Barcode symbology ID
+/// @param distortionType Distortion type to apply
+/// @param strength Distortion strength (0.0 to 1.0)
+/// @param maxIntensity Maximum intensity to test (at most 1.0)
+/// @param tolerance Width of the final pass/fail bracket (e.g. 0.01)
+/// @return Midpoint of the final bracket, 0 if intensity 0 already fails,
+///         or -1 if maxIntensity still decodes
+- (float)findFailureThresholdWithData:(NSString *)testData
+                              symbology:(int)symbology
+                          distortionType:(NSInteger)distortionType
+                                strength:(float)strength
+                            maxIntensity:(float)maxIntensity
+                               tolerance:(float)tolerance;
+
+/// Map the pass/fail boundary over (intensity, strength).
+/// Thresholds are bisected at strengths 0, 0.5 and 1; an interval between two
+/// strengths is split again while their thresholds differ by more than
+/// tolerance, so samples concentrate where the boundary moves. Each new
+/// bisection starts from the bracket given by its neighbours when that
+/// bracket holds.
+/// @param testData Data to encode
+/// @param symbology Barcode symbology ID
+/// @param distortionType Distortion type to apply
+/// @param maxIntensity Maximum intensity to test (at most 1.0)
+/// @param tolerance Intensity resolution, also the smallest strength interval
+/// @return Array of NSDictionary sorted by strength, with NSNumber (float)
+///         values for @"strength" and @"threshold" (as returned by
+///         findFailureThresholdWithData:...tolerance:)
+- (NSArray *)mapFailureBoundaryWithData:(NSString *)testData
+                               symbology:(int)symbology
+                           distortionType:(NSInteger)distortionType
+                             maxIntensity:(float)maxIntensity
+                                tolerance:(float)tolerance;
+
 @end
 
 NS_ASSUME_NONNULL_END
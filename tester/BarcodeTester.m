@@ -10,15 +10,50 @@
 #import "BarcodeDecoder.h"
 #import "ImageDistorter.h"
 #import "BarcodeTestResult.h"
+#import "BarcodeTestExecutor.h"
+#import "BarcodeRasterCache.h"
+#import "ImageScratch.h"
+#import "BarcodeTiming.h"
+#import <math.h>
+#import <string.h>
+
+// FNV-1a over the cell's parameters: a cell always gets the same noise, and
+// neighbouring cells get unrelated streams
+static uint32_t seedForCell(NSString *testData, int symbology, NSInteger distortionType,
+                            float intensity, float strength) {
+    uint32_t hash = 2166136261u;
+    const unsigned char *text = (const unsigned char *)[testData UTF8String];
+    for (; text && *text; text++) {
+        hash = (hash ^ *text) * 16777619u;
+    }
+    uint32_t fields[4];
+    fields[0] = (uint32_t)symbology;
+    fields[1] = (uint32_t)distortionType;
+    memcpy(&fields[2], &intensity, sizeof(float));
+    memcpy(&fields[3], &strength, sizeof(float));
+    NSInteger i, shift;
+    for (i = 0; i < 4; i++) {
+        for (shift = 0; shift < 32; shift += 8) {
+            hash = (hash ^ ((fields[i] >> shift) & 0xFF)) * 16777619u;
+        }
+    }
+    return hash;
+}
 
 @implementation BarcodeTester
 
+@synthesize workerCount;
+@synthesize rasterCache;
+
 - (instancetype)initWithEncoder:(BarcodeEncoder *)enc decoder:(BarcodeDecoder *)dec {
     self = [super init];
     if (self) {
         encoder = [enc retain];
         decoder = [dec retain];
         distorter = [[ImageDistorter alloc] init];
+        workerCount = 1; // Serial unless the caller opts in
+        pthread_mutex_init(&scanLock, NULL);
+        rasterCache = [[BarcodeRasterCache alloc] init];
     }
     return self;
 }
@@ -26,36 +61,138 @@
 - (void)dealloc {
     [encoder release];
     [decoder release];
+    [scanDecoder release];
+    pthread_mutex_destroy(&scanLock);
     [distorter release];
+    [rasterCache release];
     [super dealloc];
 }
 
+// Encoded barcode for a payload, taken from the raster cache when possible.
+// Cells that miss on a payload another cell is encoding wait for its raster.
+// The returned buffer is owned by the caller.
+- (ImageBuffer)encodedBufferForData:(NSString *)testData symbology:(int)symbology {
+    BOOL claimed = NO;
+    ImageBuffer buffer = [rasterCache rasterForData:testData symbology:symbology options:nil claimed:&claimed];
+    if (!ImageBufferIsValid(buffer)) {
+        buffer = [encoder encodeBufferFromData:testData symbology:symbology options:nil];
+        if (ImageBufferIsValid(buffer)) {
+            [rasterCache setRaster:buffer forData:testData symbology:symbology options:nil];
+        } else if (claimed) {
+            [rasterCache abandonRasterForData:testData symbology:symbology options:nil];
+        }
+    }
+    return buffer;
+}
+
+// Borrow a decoder for one cell of a symbology. The caller's decoder is
+// copied and only the copy is restricted. A finished cell hands its copy
+// back, so consecutive cells of a symbology reuse one copy and its scanners
+// are reconfigured once per group, not per cell. A cell on another thread
+// finds no idle copy and takes its own. Returns a retained decoder.
+- (BarcodeDecoder *)borrowDecoderForSymbology:(int)symbology generation:(unsigned long *)generation {
+    pthread_mutex_lock(&scanLock);
+    BarcodeDecoder *borrowed = scanDecoder;
+    int borrowedSymbology = scanSymbology;
+    scanDecoder = nil;
+    *generation = scanGeneration;
+    pthread_mutex_unlock(&scanLock);
+
+    if (!borrowed) {
+        borrowed = [decoder copy];
+        borrowedSymbology = 0;
+    }
+    if (symbology != borrowedSymbology) {
+        [borrowed setEnabledSymbologies:[NSArray arrayWithObject:[NSNumber numberWithInt:symbology]]];
+    }
+    return borrowed;
+}
+
+// Hand a borrowed decoder back for the next cell, unless another cell already
+// did or the copies were reset since it was borrowed. Consumes the reference.
+- (void)returnDecoder:(BarcodeDecoder *)borrowed symbology:(int)symbology generation:(unsigned long)generation {
+    pthread_mutex_lock(&scanLock);
+    if (!scanDecoder && generation == scanGeneration) {
+        scanDecoder = borrowed;
+        scanSymbology = symbology;
+        borrowed = nil;
+    }
+    pthread_mutex_unlock(&scanLock);
+    [borrowed release];
+}
+
+// Take fresh copies from the next cell on, so configuration made on the
+// caller's decoder since the last run is picked up
+- (void)resetScanDecoder {
+    pthread_mutex_lock(&scanLock);
+    BarcodeDecoder *idle = scanDecoder;
+    scanDecoder = nil;
+    scanGeneration++;
+    pthread_mutex_unlock(&scanLock);
+    [idle release];
+}
+
 - (BarcodeTestResult *)runTestWithData:(NSString *)testData
                               symbology:(int)symbology
                           distortionType:(NSInteger)distortionType
                                intensity:(float)intensity
                                  strength:(float)strength {
+    return [self runTestWithData:testData
+                       symbology:symbology
+                   distortionType:distortionType
+                        intensity:intensity
+                         strength:strength
+                             seed:seedForCell(testData, symbology, distortionType, intensity, strength)];
+}
+
+- (BarcodeTestResult *)runTestWithData:(NSString *)testData
+                              symbology:(int)symbology
+                          distortionType:(NSInteger)distortionType
+                               intensity:(float)intensity
+                                 strength:(float)strength
+                                     seed:(uint32_t)seed {
     if (!encoder || ![encoder hasBackend] || !decoder || ![decoder hasBackend]) {
         return nil;
     }
     
-    // Encode barcode
-    NSImage *encodedImage = [encoder encodeBarcodeFromData:testData symbology:symbology];
-    if (!encodedImage) {
+    // Encode barcode (once per payload/symbology while it stays cached).
+    // With timing off no clock is read and the stages stay untimed.
+    BOOL timed = BarcodeTimingIsEnabled();
+    double started = timed ? BarcodeTimingNow() : 0.0;
+    ImageBuffer encoded = [self encodedBufferForData:testData symbology:symbology];
+    if (!ImageBufferIsValid(encoded)) {
         return nil;
     }
+    double encodedAt = timed ? BarcodeTimingNow() : 0.0;
     
     // Apply distortion
     DistortionParameters *params = [DistortionParameters parametersWithType:(DistortionType)distortionType 
                                                                    intensity:intensity 
                                                                      strength:strength];
-    NSImage *distortedImage = [ImageDistorter applyDistortion:params toImage:encodedImage];
-    if (!distortedImage) {
-        distortedImage = encodedImage; // Use original if distortion fails
+    params.seed = seed;
+    ImageBuffer distorted = [ImageDistorter applyDistortion:params toBuffer:encoded];
+    double distortedAt = timed ? BarcodeTimingNow() : 0.0;
+    
+    // Decode (use original if distortion fails); only the encoded
+    // symbology needs to be enabled
+    unsigned long generation;
+    BarcodeDecoder *cellDecoder = [self borrowDecoderForSymbology:symbology generation:&generation];
+    NSArray *results;
+    if (ImageBufferIsValid(distorted)) {
+        results = [cellDecoder decodeBarcodesFromBuffer:distorted originalInput:testData];
+    } else {
+        results = [cellDecoder decodeBarcodesFromBuffer:encoded originalInput:testData];
     }
+    [self returnDecoder:cellDecoder symbology:symbology generation:generation];
+    double decodedAt = timed ? BarcodeTimingNow() : 0.0;
+    
+    // Distorted may borrow the encoded pixels; free it first
+    ImageBufferFree(&distorted);
+    ImageBufferFree(&encoded);
     
-    // Decode
-    NSArray *results = [decoder decodeBarcodesFromImage:distortedImage originalInput:testData];
+    // End of the cell's pixel work: planes this cell did not reuse leave
+    // the thread's scratch pool
+    ImageScratchTrim();
     
     // Analyze results
     BOOL decodeSuccess = (results != nil && results.count > 0);
@@ -88,15 +225,24 @@
         barcodeTypeName = [NSString stringWithFormat:@"Symbology %d", targetSymbology];
     }
     
-    return [BarcodeTestResult resultWithBarcodeType:barcodeTypeName
-                                            testData:testData
-                                       distortionType:distortionType
-                                            intensity:intensity
-                                             strength:strength
-                                              success:decodeSuccess
-                                              quality:qualityScore
-                                              matches:dataMatches
-                                              decoded:decodedData];
+    BarcodeTestResult *testResult = [BarcodeTestResult resultWithBarcodeType:barcodeTypeName
+                                                                     testData:testData
+                                                                distortionType:distortionType
+                                                                     intensity:intensity
+                                                                      strength:strength
+                                                                       success:decodeSuccess
+                                                                       quality:qualityScore
+                                                                       matches:dataMatches
+                                                                       decoded:decodedData];
+    testResult.symbology = symbology;
+    testResult.distortionSeed = seed;
+    if (timed) {
+        [testResult setMilliseconds:encodedAt - started forStage:BarcodeTestStageEncode];
+        [testResult setMilliseconds:distortedAt - encodedAt forStage:BarcodeTestStageDistort];
+        [testResult setMilliseconds:decodedAt - distortedAt forStage:BarcodeTestStageDecode];
+        [testResult setMilliseconds:decodedAt - started forStage:BarcodeTestStageTotal];
+    }
+    return testResult;
 }
 
 - (NSArray *)runProgressiveTestWithData:(NSString *)testData
@@ -107,6 +253,7 @@
                                       steps:(NSInteger)steps
                                      session:(BarcodeTestSession *)session {
     if (steps < 1) steps = 1;
+    [self resetScanDecoder];
     
     NSMutableArray *testResults = [NSMutableArray array];
     float stepSize = (endIntensity - startIntensity) / (steps - 1);
@@ -117,6 +264,7 @@
         if (intensity > 1.0f) intensity = 1.0f;
         if (intensity < 0.0f) intensity = 0.0f;
         
+        NSAutoreleasePool *cellPool = [[NSAutoreleasePool alloc] init];
         BarcodeTestResult *result = [self runTestWithData:testData
                                                 symbology:symbology
                                             distortionType:distortionType
@@ -129,6 +277,7 @@
                 [session addResult:result];
             }
         }
+        [cellPool release];
     }
     
     return testResults;
@@ -141,8 +290,38 @@
                                        strengthLevels:(NSArray *)strengthLevels
                                          sessionName:(NSString *)sessionName {
     BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:sessionName];
+    [self runComprehensiveTestSuite:testDataArray
+                        symbologies:symbologyArray
+                     distortionTypes:distortionTypes
+                      intensityLevels:intensityLevels
+                        strengthLevels:strengthLevels
+                              session:session];
+    return [session autorelease];
+}
+
+- (void)runComprehensiveTestSuite:(NSArray *)testDataArray
+                       symbologies:(NSArray *)symbologyArray
+                    distortionTypes:(NSArray *)distortionTypes
+                     intensityLevels:(NSArray *)intensityLevels
+                       strengthLevels:(NSArray *)strengthLevels
+                             session:(BarcodeTestSession *)session {
+    if (workerCount > 1) {
+        BarcodeTestExecutor *executor = [[BarcodeTestExecutor alloc] initWithEncoder:encoder
+                                                                             decoder:decoder
+                                                                         workerCount:workerCount];
+        executor.rasterCache = rasterCache;
+        [executor runComprehensiveTestSuite:testDataArray
+                                symbologies:symbologyArray
+                             distortionTypes:distortionTypes
+                              intensityLevels:intensityLevels
+                                strengthLevels:strengthLevels
+                                      session:session];
+        [executor release];
+        return;
+    }
     
     NSInteger dataIdx, symbIdx, distIdx, intensityIdx, strengthIdx;
+    [self resetScanDecoder];
     
     for (dataIdx = 0; dataIdx < testDataArray.count; dataIdx++) {
         NSString *testData = [testDataArray objectAtIndex:dataIdx];
@@ -163,6 +342,9 @@
                         NSNumber *strengthNum = [strengthLevels objectAtIndex:strengthIdx];
                         float strength = [strengthNum floatValue];
                         
+                        // Encoder, decoder and result objects of one cell
+                        // must not outlive it in a sweep of thousands
+                        NSAutoreleasePool *cellPool = [[NSAutoreleasePool alloc] init];
                         BarcodeTestResult *result = [self runTestWithData:testData
                                                                  symbology:symbology
                                                              distortionType:distType
@@ -172,6 +354,7 @@
                         if (result) {
                             [session addResult:result];
                         }
+                        [cellPool release];
                     }
                 }
             }
@@ -179,7 +362,6 @@
     }
     
     [session endSession];
-    return [session autorelease];
 }
 
 - (float)findFailureThresholdWithData:(NSString *)testData
@@ -189,36 +371,214 @@
                                    steps:(NSInteger)steps {
     if (steps < 2) steps = 10;
     
-    float stepSize = maxIntensity / steps;
-    float lastSuccessIntensity = -1.0f;
-    
-    NSInteger i;
-    for (i = 0; i <= steps; i++) {
-        float intensity = stepSize * i;
-        if (intensity > 1.0f) intensity = 1.0f;
-        
-        BarcodeTestResult *result = [self runTestWithData:testData
-                                                  symbology:symbology
-                                              distortionType:distortionType
-                                                   intensity:intensity
-                                                     strength:0.5f];
-        
-        if (result && result.decodeSuccess) {
-            lastSuccessIntensity = intensity;
+    return [self findFailureThresholdWithData:testData
+                                    symbology:symbology
+                               distortionType:distortionType
+                                     strength:0.5f
+                                 maxIntensity:maxIntensity
+                                    tolerance:maxIntensity / steps];
+}
+
+// Single encode/distort/decode probe
+- (BOOL)decodesWithData:(NSString *)testData
+              symbology:(int)symbology
+         distortionType:(NSInteger)distortionType
+              intensity:(float)intensity
+               strength:(float)strength {
+    NSAutoreleasePool *cellPool = [[NSAutoreleasePool alloc] init];
+    BarcodeTestResult *result = [self runTestWithData:testData
+                                            symbology:symbology
+                                       distortionType:distortionType
+                                            intensity:intensity
+                                             strength:strength];
+    BOOL decoded = result && result.decodeSuccess;
+    [cellPool release];
+    return decoded;
+}
+
+// Bisect [passIntensity, failIntensity] down to tolerance; the ends must
+// already be known to pass and fail
+- (float)bisectThresholdWithData:(NSString *)testData
+                       symbology:(int)symbology
+                  distortionType:(NSInteger)distortionType
+                        strength:(float)strength
+                   passIntensity:(float)passIntensity
+                   failIntensity:(float)failIntensity
+                       tolerance:(float)tolerance {
+    while (failIntensity - passIntensity > tolerance) {
+        float intensity = (passIntensity + failIntensity) / 2.0f;
+        if ([self decodesWithData:testData symbology:symbology distortionType:distortionType
+                        intensity:intensity strength:strength]) {
+            passIntensity = intensity;
         } else {
-            // Found failure point
-            if (lastSuccessIntensity >= 0.0f) {
-                // Return midpoint between last success and first failure
-                return (lastSuccessIntensity + intensity) / 2.0f;
-            } else {
-                // Failed from the start
-                return 0.0f;
-            }
+            failIntensity = intensity;
         }
     }
     
-    // Never failed
-    return -1.0f;
+    // Midpoint between last success and first failure
+    return (passIntensity + failIntensity) / 2.0f;
+}
+
+- (float)findFailureThresholdWithData:(NSString *)testData
+                              symbology:(int)symbology
+                          distortionType:(NSInteger)distortionType
+                                strength:(float)strength
+                            maxIntensity:(float)maxIntensity
+                               tolerance:(float)tolerance {
+    if (maxIntensity > 1.0f) maxIntensity = 1.0f;
+    if (maxIntensity < 0.0f) maxIntensity = 0.0f;
+    if (tolerance <= 0.0f) tolerance = 0.01f;
+    [self resetScanDecoder];
+    
+    if (![self decodesWithData:testData symbology:symbology distortionType:distortionType
+                     intensity:0.0f strength:strength]) {
+        // Failed from the start
+        return 0.0f;
+    }
+    if ([self decodesWithData:testData symbology:symbology distortionType:distortionType
+                    intensity:maxIntensity strength:strength]) {
+        // Never failed
+        return -1.0f;
+    }
+    
+    return [self bisectThresholdWithData:testData
+                               symbology:symbology
+                          distortionType:distortionType
+                                strength:strength
+                           passIntensity:0.0f
+                           failIntensity:maxIntensity
+                               tolerance:tolerance];
+}
+
+// Threshold at a strength between two mapped neighbours. Their thresholds
+// (widened by tolerance) give a starting bracket; if either end of it does
+// not hold, fall back to the full range.
+- (float)thresholdWithData:(NSString *)testData
+                 symbology:(int)symbology
+            distortionType:(NSInteger)distortionType
+                  strength:(float)strength
+              maxIntensity:(float)maxIntensity
+                 tolerance:(float)tolerance
+            neighbourLower:(float)lower
+            neighbourUpper:(float)upper {
+    float passIntensity = (lower < upper ? lower : upper) - tolerance;
+    float failIntensity = (lower > upper ? lower : upper) + tolerance;
+    
+    if (passIntensity > 0.0f && failIntensity < maxIntensity &&
+        [self decodesWithData:testData symbology:symbology distortionType:distortionType
+                    intensity:passIntensity strength:strength] &&
+        ![self decodesWithData:testData symbology:symbology distortionType:distortionType
+                     intensity:failIntensity strength:strength]) {
+        return [self bisectThresholdWithData:testData
+                                   symbology:symbology
+                              distortionType:distortionType
+                                    strength:strength
+                               passIntensity:passIntensity
+                               failIntensity:failIntensity
+                                   tolerance:tolerance];
+    }
+    
+    return [self findFailureThresholdWithData:testData
+                                    symbology:symbology
+                               distortionType:distortionType
+                                     strength:strength
+                                 maxIntensity:maxIntensity
+                                    tolerance:tolerance];
+}
+
+// Split [lowStrength, highStrength] while the boundary moves across it
+- (void)refineBoundaryWithData:(NSString *)testData
+                     symbology:(int)symbology
+                distortionType:(NSInteger)distortionType
+                  maxIntensity:(float)maxIntensity
+                     tolerance:(float)tolerance
+                   lowStrength:(float)lowStrength
+                  lowThreshold:(float)lowThreshold
+                  highStrength:(float)highStrength
+                 highThreshold:(float)highThreshold
+                      boundary:(NSMutableArray *)boundary {
+    // "Never fails" sits just beyond the tested range
+    float low = lowThreshold < 0.0f ? maxIntensity + tolerance : lowThreshold;
+    float high = highThreshold < 0.0f ? maxIntensity + tolerance : highThreshold;
+    if (fabsf(high - low) <= tolerance || highStrength - lowStrength <= tolerance) {
+        return;
+    }
+    
+    float strength = (lowStrength + highStrength) / 2.0f;
+    float threshold;
+    if (lowThreshold < 0.0f || highThreshold < 0.0f) {
+        threshold = [self findFailureThresholdWithData:testData
+                                             symbology:symbology
+                                        distortionType:distortionType
+                                              strength:strength
+                                          maxIntensity:maxIntensity
+                                             tolerance:tolerance];
+    } else {
+        threshold = [self thresholdWithData:testData
+                                  symbology:symbology
+                             distortionType:distortionType
+                                   strength:strength
+                               maxIntensity:maxIntensity
+                                  tolerance:tolerance
+                             neighbourLower:lowThreshold
+                             neighbourUpper:highThreshold];
+    }
+    [boundary addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithFloat:strength], @"strength",
+        [NSNumber numberWithFloat:threshold], @"threshold",
+        nil]];
+    
+    [self refineBoundaryWithData:testData symbology:symbology distortionType:distortionType
+                    maxIntensity:maxIntensity tolerance:tolerance
+                     lowStrength:lowStrength lowThreshold:lowThreshold
+                    highStrength:strength highThreshold:threshold
+                        boundary:boundary];
+    [self refineBoundaryWithData:testData symbology:symbology distortionType:distortionType
+                    maxIntensity:maxIntensity tolerance:tolerance
+                     lowStrength:strength lowThreshold:threshold
+                    highStrength:highStrength highThreshold:highThreshold
+                        boundary:boundary];
+}
+
+- (NSArray *)mapFailureBoundaryWithData:(NSString *)testData
+                               symbology:(int)symbology
+                           distortionType:(NSInteger)distortionType
+                             maxIntensity:(float)maxIntensity
+                                tolerance:(float)tolerance {
+    if (maxIntensity > 1.0f) maxIntensity = 1.0f;
+    if (tolerance <= 0.0f) tolerance = 0.01f;
+    
+    NSMutableArray *boundary = [NSMutableArray array];
+    float strengths[3] = {0.0f, 0.5f, 1.0f};
+    float thresholds[3];
+    
+    NSInteger i;
+    for (i = 0; i < 3; i++) {
+        thresholds[i] = [self findFailureThresholdWithData:testData
+                                                 symbology:symbology
+                                            distortionType:distortionType
+                                                  strength:strengths[i]
+                                              maxIntensity:maxIntensity
+                                                 tolerance:tolerance];
+        [boundary addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithFloat:strengths[i]], @"strength",
+            [NSNumber numberWithFloat:thresholds[i]], @"threshold",
+            nil]];
+    }
+    
+    for (i = 0; i < 2; i++) {
+        [self refineBoundaryWithData:testData symbology:symbology distortionType:distortionType
+                        maxIntensity:maxIntensity tolerance:tolerance
+                         lowStrength:strengths[i] lowThreshold:thresholds[i]
+                        highStrength:strengths[i + 1] highThreshold:thresholds[i + 1]
+                            boundary:boundary];
+    }
+    
+    NSSortDescriptor *byStrength = [[NSSortDescriptor alloc] initWithKey:@"strength" ascending:YES];
+    [boundary sortUsingDescriptors:[NSArray arrayWithObject:byStrength]];
+    [byStrength release];
+    
+    return boundary;
 }
 
 @end
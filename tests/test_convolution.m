@@ -0,0 +1,201 @@
+//
+//  test_convolution.m
+//  Compare the fast convolution paths against the scalar reference
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImageMatrix.h"
+#import "image/ImageConvolution.h"
+#import <stdlib.h>
+
+// Largest per-pixel difference between two images
+static int maxDifference(const unsigned char *a, const unsigned char *b, int count) {
+    int worst = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        int difference = abs((int)a[i] - (int)b[i]);
+        if (difference > worst) worst = difference;
+    }
+    return worst;
+}
+
+// Convolve a random image every available way; returns number of failures
+static int checkKernel(NSString *name, ImageMatrix kernel, int width, int height, int tolerance) {
+    int failures = 0;
+    unsigned char *image = (unsigned char *)malloc((size_t)width * height);
+    int i;
+    for (i = 0; i < width * height; i++) {
+        image[i] = (unsigned char)(rand() % 256);
+    }
+    
+    unsigned char *reference = ImageConvolveDirect(image, width, height, kernel);
+    
+    NSInteger simd;
+    for (simd = ImageConvolutionSIMDNone; simd <= ImageConvolutionSIMDSupported(); simd++) {
+        unsigned char *fast = ImageConvolveFixedPoint(image, width, height, kernel, (ImageConvolutionSIMD)simd);
+        if (!fast) {
+            NSLog(@"FAIL: %@ %dx%d simd=%ld: no result", name, width, height, (long)simd);
+            failures++;
+            continue;
+        }
+        int difference = maxDifference(reference, fast, width * height);
+        if (difference > tolerance) {
+            NSLog(@"FAIL: %@ %dx%d simd=%ld: max difference %d", name, width, height, (long)simd, difference);
+            failures++;
+        }
+        free(fast);
+    }
+    
+    // Float spectra round differently from the float taps: one level
+    unsigned char *spectral = ImageConvolveFFT(image, width, height, kernel);
+    if (!spectral) {
+        NSLog(@"FAIL: %@ %dx%d FFT: no result", name, width, height);
+        failures++;
+    } else {
+        int difference = maxDifference(reference, spectral, width * height);
+        if (difference > 1) {
+            NSLog(@"FAIL: %@ %dx%d FFT: max difference %d", name, width, height, difference);
+            failures++;
+        }
+        free(spectral);
+    }
+    
+    // Rank-1 kernels through the two 1-D passes; float sums in another order
+    float *column = (float *)malloc(kernel.rows * sizeof(float));
+    float *row = (float *)malloc(kernel.cols * sizeof(float));
+    if (kernel.rows == kernel.cols && ImageMatrixSeparate(kernel, column, row)) {
+        unsigned char *separable = ImageConvolveSeparable(image, width, height, column, row, kernel.rows);
+        if (!separable) {
+            NSLog(@"FAIL: %@ %dx%d separable: no result", name, width, height);
+            failures++;
+        } else {
+            int difference = maxDifference(reference, separable, width * height);
+            if (difference > 1) {
+                NSLog(@"FAIL: %@ %dx%d separable: max difference %d", name, width, height, difference);
+                failures++;
+            }
+            free(separable);
+        }
+    }
+    free(column);
+    free(row);
+    
+    // Uniform kernels through the running sums
+    float value;
+    if (kernel.rows == kernel.cols && ImageMatrixIsUniform(kernel, &value)) {
+        unsigned char *box = ImageConvolveBox(image, width, height, kernel.rows, value);
+        if (!box) {
+            NSLog(@"FAIL: %@ %dx%d box: no result", name, width, height);
+            failures++;
+        } else {
+            int difference = maxDifference(reference, box, width * height);
+            if (difference > 1) {
+                NSLog(@"FAIL: %@ %dx%d box: max difference %d", name, width, height, difference);
+                failures++;
+            }
+            free(box);
+        }
+    }
+    
+    unsigned char *dispatched = ImageConvolve(image, width, height, kernel);
+    int difference = maxDifference(reference, dispatched, width * height);
+    if (difference > tolerance) {
+        NSLog(@"FAIL: %@ %dx%d ImageConvolve: max difference %d", name, width, height, difference);
+        failures++;
+    }
+    
+    free(dispatched);
+    free(reference);
+    free(image);
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    
+    NSLog(@"=== Convolution Test (SIMD level %ld) ===", (long)ImageConvolutionSIMDSupported());
+    srand(12345);
+    
+    // Odd sizes exercise the vector tails; tiny ones are all border
+    int sizes[][2] = {{1, 1}, {2, 3}, {7, 5}, {17, 9}, {64, 48}, {203, 77}};
+    int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+    int failures = 0;
+    
+    int s;
+    for (s = 0; s < sizeCount; s++) {
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        ImageMatrix kernel;
+        
+        // Integer weights must match exactly
+        kernel = ImageMatrixSharpen();
+        failures += checkKernel(@"Sharpen", kernel, width, height, 0);
+        ImageMatrixFree(&kernel);
+        
+        kernel = ImageMatrixLaplacian();
+        failures += checkKernel(@"Laplacian", kernel, width, height, 0);
+        ImageMatrixFree(&kernel);
+        
+        kernel = ImageMatrixEdgeDetection(0);
+        failures += checkKernel(@"Edge (horizontal)", kernel, width, height, 0);
+        ImageMatrixFree(&kernel);
+        
+        kernel = ImageMatrixEdgeDetection(1);
+        failures += checkKernel(@"Edge (vertical)", kernel, width, height, 0);
+        ImageMatrixFree(&kernel);
+        
+        // Fractional weights are rounded to fixed point: within one grey level
+        int length;
+        for (length = 3; length <= 13; length += 4) {
+            kernel = ImageMatrixMotionBlur(length, 37.0f * length);
+            failures += checkKernel([NSString stringWithFormat:@"Motion blur %d", length], kernel, width, height, 1);
+            ImageMatrixFree(&kernel);
+        }
+        
+        kernel = ImageMatrixGaussianBlur(11, 4.0f);
+        failures += checkKernel(@"Gaussian 11", kernel, width, height, 1);
+        ImageMatrixFree(&kernel);
+        
+        kernel = ImageMatrixBoxBlur(7);
+        failures += checkKernel(@"Box 7", kernel, width, height, 1);
+        ImageMatrixFree(&kernel);
+    }
+    
+    // Long blurs the distorter never built before the FFT path
+    ImageMatrix longBlur = ImageMatrixMotionBlur(41, 30.0f);
+    ImageMatrix gaussian = ImageMatrixGaussianBlur(3, 0.8f);
+    ImageMatrix dense = ImageMatrixCombineKernels(longBlur, gaussian);
+    failures += checkKernel(@"Motion blur 41", longBlur, 203, 77, 1);
+    failures += checkKernel(@"Defocused motion blur 43", dense, 203, 77, 1);
+    
+    // The cost model keeps the running sum for boxes and sends large dense
+    // kernels through the spectrum
+    ImageMatrix box = ImageMatrixBoxBlur(31);
+    ImageMatrix wide = ImageMatrixCombineKernels(dense, dense);
+    if (ImageConvolutionChooseStrategy(box, 512, 512) != ImageConvolutionStrategyBox) {
+        NSLog(@"FAIL: box blur 31 not run as a running sum");
+        failures++;
+    }
+    if (ImageConvolutionChooseStrategy(wide, 512, 512) != ImageConvolutionStrategyFFT) {
+        NSLog(@"FAIL: dense %dx%d kernel not run through the FFT", wide.rows, wide.cols);
+        failures++;
+    }
+    if (ImageConvolutionChooseStrategy(gaussian, 512, 512) == ImageConvolutionStrategyFFT) {
+        NSLog(@"FAIL: 3x3 kernel run through the FFT");
+        failures++;
+    }
+    ImageMatrixFree(&longBlur);
+    ImageMatrixFree(&gaussian);
+    ImageMatrixFree(&dense);
+    ImageMatrixFree(&box);
+    ImageMatrixFree(&wide);
+    
+    if (failures == 0) {
+        NSLog(@"SUCCESS: all convolution paths match the reference");
+    } else {
+        NSLog(@"ERROR: %d convolution checks failed", failures);
+    }
+    
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
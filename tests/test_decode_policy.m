@@ -0,0 +1,227 @@
+//
+//  test_decode_policy.m
+//  Check cascade ordering, race cancellation and consensus voting with
+//  scripted backends
+//
+
+#import <Foundation/Foundation.h>
+#import "decoder/BarcodeDecoder.h"
+#import "decoder/BarcodeDecoderBackend.h"
+#import "core/BarcodeTiming.h"
+#import <string.h>
+#import <unistd.h>
+
+// Backend that answers with a fixed payload (or nothing) after a delay.
+// While its gate is closed, scans wait for the test to open it.
+@interface ScriptedBackend : NSObject <BarcodeDecoderBackend> {
+    NSString *payload;
+    useconds_t delay;
+    NSCondition *gate;
+    BOOL closed;
+}
+- (instancetype)initWithPayload:(NSString *)answer delay:(useconds_t)microseconds;
+- (void)closeGate;
+- (void)openGate;
+@end
+
+@implementation ScriptedBackend
+
++ (BOOL)isAvailable {
+    return YES;
+}
+
++ (NSString *)backendName {
+    return @"Scripted";
+}
+
+- (instancetype)initWithPayload:(NSString *)answer delay:(useconds_t)microseconds {
+    self = [super init];
+    if (self) {
+        payload = [answer copy];
+        delay = microseconds;
+        gate = [[NSCondition alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [payload release];
+    [gate release];
+    [super dealloc];
+}
+
+- (void)closeGate {
+    [gate lock];
+    closed = YES;
+    [gate unlock];
+}
+
+- (void)openGate {
+    [gate lock];
+    closed = NO;
+    [gate broadcast];
+    [gate unlock];
+}
+
+- (NSArray *)decodeBarcodesFromData:(unsigned char *)data width:(unsigned)width height:(unsigned)height {
+    [gate lock];
+    while (closed) {
+        [gate wait];
+    }
+    [gate unlock];
+    usleep(delay);
+    if (!payload) {
+        return [NSArray array];
+    }
+    BarcodeResult *result = [[[BarcodeResult alloc] init] autorelease];
+    result.data = payload;
+    result.type = @"CODE-128";
+    return [NSArray arrayWithObject:result];
+}
+
+@end
+
+static ScriptedBackend *scripted(NSString *payload, useconds_t delay) {
+    return [[[ScriptedBackend alloc] initWithPayload:payload delay:delay] autorelease];
+}
+
+static NSString *decodedData(BarcodeDecoder *decoder, ImageBuffer frame) {
+    NSArray *results = [decoder decodeBarcodesFromBuffer:frame originalInput:nil];
+    return results.count == 1 ? [[results objectAtIndex:0] data] : nil;
+}
+
+// A failing primary is tried once, then the backend that succeeds goes first
+static int checkCascade(ImageBuffer frame) {
+    int failures = 0;
+    ScriptedBackend *failing = scripted(nil, 2000);
+    ScriptedBackend *working = scripted(@"CASCADE", 1000);
+    BarcodeDecoder *decoder = [[BarcodeDecoder alloc] initWithBackend:failing];
+    [decoder registerDynamicBackend:working];
+    decoder.decodePolicy = BarcodeDecodePolicyCascade;
+
+    int i;
+    for (i = 0; i < 5; i++) {
+        if (![decodedData(decoder, frame) isEqualToString:@"CASCADE"]) {
+            NSLog(@"FAIL: cascade decode %d missed the working backend", i);
+            failures++;
+        }
+    }
+    if ([[decoder backendsInDecodeOrder] objectAtIndex:0] != working) {
+        NSLog(@"FAIL: cascade still tries the failing backend first");
+        failures++;
+    }
+    if ([decoder statisticsForBackend:failing].scans != 1 || [decoder statisticsForBackend:working].wins != 5) {
+        NSLog(@"FAIL: failing backend scanned %lu times, working one won %lu times",
+              [decoder statisticsForBackend:failing].scans, [decoder statisticsForBackend:working].wins);
+        failures++;
+    }
+    [decoder release];
+    return failures;
+}
+
+// The fast backend's answer comes back without waiting for the slow one,
+// which finishes in the background as abandoned. The slow backend is held
+// at its gate, so it cannot finish until the race has returned.
+static int checkRace(ImageBuffer frame) {
+    int failures = 0;
+    ScriptedBackend *slow = scripted(@"SLOW", 0);
+    ScriptedBackend *fast = scripted(@"FAST", 0);
+    BarcodeDecoder *decoder = [[BarcodeDecoder alloc] initWithBackend:slow];
+    [decoder registerDynamicBackend:fast];
+    decoder.decodePolicy = BarcodeDecodePolicyRace;
+
+    [slow closeGate];
+    NSString *winner = decodedData(decoder, frame);
+    if (![winner isEqualToString:@"FAST"]) {
+        NSLog(@"FAIL: race returned %@", winner);
+        failures++;
+    }
+    if ([decoder statisticsForBackend:slow].scans != 0) {
+        NSLog(@"FAIL: race waited for the slow backend");
+        failures++;
+    }
+
+    [slow openGate];
+    [decoder waitUntilBackendsIdle];
+    BarcodeBackendStatistics statistics = [decoder statisticsForBackend:slow];
+    if (statistics.scans != 1 || statistics.abandoned != 1 || [decoder statisticsForBackend:fast].wins != 1) {
+        NSLog(@"FAIL: slow backend has %lu scans, %lu abandoned", statistics.scans, statistics.abandoned);
+        failures++;
+    }
+    [decoder release];
+    return failures;
+}
+
+// Only data that two of three backends report survives
+static int checkConsensus(ImageBuffer frame) {
+    int failures = 0;
+    BarcodeDecoder *decoder = [[BarcodeDecoder alloc] initWithBackend:scripted(@"AGREED", 1000)];
+    [decoder registerDynamicBackend:scripted(@"AGREED", 2000)];
+    [decoder registerDynamicBackend:scripted(@"ODD", 1000)];
+    decoder.decodePolicy = BarcodeDecodePolicyConsensus;
+
+    if (![decodedData(decoder, frame) isEqualToString:@"AGREED"]) {
+        NSLog(@"FAIL: consensus did not return the agreed symbol alone");
+        failures++;
+    }
+    decoder.consensusQuorum = 3;
+    NSArray *results = [decoder decodeBarcodesFromBuffer:frame originalInput:nil];
+    if (!results || results.count != 0) {
+        NSLog(@"FAIL: a quorum of 3 accepted %lu symbols", (unsigned long)results.count);
+        failures++;
+    }
+    [decoder release];
+    return failures;
+}
+
+// The primary backend is scanned without claiming it, and with timing off
+// its scans are counted but the clock is never read
+static int checkPrimaryUntimed(ImageBuffer frame) {
+    int failures = 0;
+    BarcodeDecoder *decoder = [[BarcodeDecoder alloc] initWithBackend:scripted(@"PRIMARY", 0)];
+
+    BarcodeTimingSetEnabled(NO);
+    NSString *data = decodedData(decoder, frame);
+    BarcodeTimingSetEnabled(YES);
+    BarcodeBackendStatistics statistics = [decoder statisticsForBackend:[[decoder allBackends] objectAtIndex:0]];
+    if (![data isEqualToString:@"PRIMARY"] || statistics.scans != 1 || statistics.successes != 1 ||
+        statistics.timedScans != 0 || statistics.totalMilliseconds != 0.0) {
+        NSLog(@"FAIL: untimed primary scan counted as %lu scans, %lu timed, %g ms",
+              statistics.scans, statistics.timedScans, statistics.totalMilliseconds);
+        failures++;
+    }
+
+    decodedData(decoder, frame);
+    statistics = [decoder statisticsForBackend:[[decoder allBackends] objectAtIndex:0]];
+    if (statistics.scans != 2 || statistics.timedScans != 1) {
+        NSLog(@"FAIL: timed primary scan counted as %lu scans, %lu timed", statistics.scans, statistics.timedScans);
+        failures++;
+    }
+    [decoder release];
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Decode Policy Test ===");
+
+    ImageBuffer frame = ImageBufferCreate(64, 64);
+    memset(frame.data, 255, 64 * 64);
+
+    int failures = 0;
+    failures += checkCascade(frame);
+    failures += checkRace(frame);
+    failures += checkConsensus(frame);
+    failures += checkPrimaryUntimed(frame);
+    ImageBufferFree(&frame);
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: cascade, race and consensus behave as documented");
+    } else {
+        NSLog(@"ERROR: %d decode policy checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
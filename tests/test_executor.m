@@ -0,0 +1,232 @@
+//
+//  test_executor.m
+//  Check that worker decoders keep their backend's configuration and that a
+//  parallel run gives the serial run's results, in the serial order
+//
+
+#import <Foundation/Foundation.h>
+#import "encoder/BarcodeEncoder.h"
+#import "encoder/BarcodeEncoderBackend.h"
+#import "decoder/BarcodeDecoder.h"
+#import "decoder/BarcodeDecoderBackend.h"
+#import "tester/BarcodeTester.h"
+#import "tester/BarcodeTestResult.h"
+#import "image/ImageDistorter.h"
+#import <string.h>
+
+// Encoder that draws a stripe pattern picked by the payload, straight into memory
+@interface StripeEncoder : NSObject <BarcodeEncoderBackend>
+@end
+
+@implementation StripeEncoder
+
++ (NSArray *)supportedSymbologies {
+    NSDictionary *code128 = [NSDictionary dictionaryWithObjectsAndKeys:
+                             [NSNumber numberWithInt:20], @"id", @"Code 128", @"name", @"Stripes", @"description", nil];
+    return [NSArray arrayWithObject:code128];
+}
+
++ (BOOL)isAvailable {
+    return YES;
+}
+
++ (NSString *)backendName {
+    return @"Stripes";
+}
+
+- (NSImage *)encodeBarcodeFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+    return nil;
+}
+
+- (ImageBuffer)encodeBufferFromData:(NSString *)data symbology:(int)symbology options:(NSDictionary *)options {
+    ImageBuffer buffer = ImageBufferCreate(48, 24);
+    if (!ImageBufferIsValid(buffer)) {
+        return buffer;
+    }
+    unsigned int pattern = (unsigned int)[data hash] | 1u;
+    int x, y;
+    for (y = 0; y < buffer.height; y++) {
+        for (x = 0; x < buffer.width; x++) {
+            buffer.data[y * buffer.stride + x] = (pattern >> ((x / 3) % 32)) & 1u ? 0 : 255;
+        }
+    }
+    return buffer;
+}
+
+@end
+
+// Decoder configured with a tag at init time. It reports the tag and a
+// checksum of the pixels it was given, so a worker that lost the
+// configuration or saw different pixels shows up in the results.
+@interface TaggedDecoder : NSObject <BarcodeDecoderBackend, NSCopying> {
+    NSString *tag;
+}
+- (instancetype)initWithTag:(NSString *)value;
+- (NSString *)tag;
+@end
+
+@implementation TaggedDecoder
+
++ (BOOL)isAvailable {
+    return YES;
+}
+
++ (NSString *)backendName {
+    return @"Tagged";
+}
+
+- (instancetype)init {
+    return [self initWithTag:@"default"];
+}
+
+- (instancetype)initWithTag:(NSString *)value {
+    self = [super init];
+    if (self) {
+        tag = [value copy];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [tag release];
+    [super dealloc];
+}
+
+- (NSString *)tag {
+    return tag;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return [[[self class] allocWithZone:zone] initWithTag:tag];
+}
+
+- (NSArray *)decodeBarcodesFromData:(unsigned char *)data width:(unsigned)width height:(unsigned)height {
+    unsigned long sum = 0;
+    unsigned long i;
+    for (i = 0; i < (unsigned long)width * height; i++) {
+        sum = sum * 31 + data[i];
+    }
+    if (sum % 5 == 0) {
+        return [NSArray array];
+    }
+    BarcodeResult *result = [[[BarcodeResult alloc] init] autorelease];
+    result.data = [NSString stringWithFormat:@"%@:%lu", tag, sum % 100000];
+    result.type = @"CODE-128";
+    return [NSArray arrayWithObject:result];
+}
+
+@end
+
+static int checkDecoderCopy(void) {
+    int failures = 0;
+    TaggedDecoder *backend = [[TaggedDecoder alloc] initWithTag:@"configured"];
+    BarcodeDecoder *decoder = [[BarcodeDecoder alloc] initWithBackend:backend];
+    BarcodeDecoder *copy = [decoder copy];
+
+    NSArray *backends = [copy allBackends];
+    TaggedDecoder *copied = backends.count > 0 ? [backends objectAtIndex:0] : nil;
+    if (!copied || copied == backend || ![[copied tag] isEqualToString:@"configured"]) {
+        NSLog(@"FAIL: Copied decoder's backend has tag %@", copied ? [copied tag] : @"(none)");
+        failures++;
+    } else {
+        NSLog(@"SUCCESS: Copied decoder keeps its backend's configuration");
+    }
+
+    [copy release];
+    [decoder release];
+    [backend release];
+    return failures;
+}
+
+static BarcodeTestSession *runMatrix(NSUInteger workers) {
+    StripeEncoder *encoderBackend = [[StripeEncoder alloc] init];
+    TaggedDecoder *decoderBackend = [[TaggedDecoder alloc] initWithTag:@"matrix"];
+    BarcodeEncoder *encoder = [[BarcodeEncoder alloc] initWithBackend:encoderBackend];
+    BarcodeDecoder *decoder = [[BarcodeDecoder alloc] initWithBackend:decoderBackend];
+    BarcodeTester *tester = [[BarcodeTester alloc] initWithEncoder:encoder decoder:decoder];
+    tester.workerCount = workers;
+
+    NSArray *payloads = [NSArray arrayWithObjects:@"alpha", @"bravo", @"charlie", @"delta", nil];
+    NSArray *symbologies = [NSArray arrayWithObject:[NSNumber numberWithInt:20]];
+    NSArray *distortions = [NSArray arrayWithObjects:
+                            [NSNumber numberWithInteger:DistortionTypeNone],
+                            [NSNumber numberWithInteger:DistortionTypeGaussianBlur],
+                            [NSNumber numberWithInteger:DistortionTypeNoise],
+                            [NSNumber numberWithInteger:DistortionTypeSaltAndPepperNoise], nil];
+    NSArray *intensities = [NSArray arrayWithObjects:[NSNumber numberWithFloat:0.25f], [NSNumber numberWithFloat:0.75f], nil];
+    NSArray *strengths = [NSArray arrayWithObjects:[NSNumber numberWithFloat:0.5f], [NSNumber numberWithFloat:1.0f], nil];
+
+    BarcodeTestSession *session = [tester runComprehensiveTestSuite:payloads
+                                                        symbologies:symbologies
+                                                     distortionTypes:distortions
+                                                      intensityLevels:intensities
+                                                        strengthLevels:strengths
+                                                          sessionName:@"executor"];
+    [session retain];
+
+    [tester release];
+    [decoder release];
+    [encoder release];
+    [decoderBackend release];
+    [encoderBackend release];
+    return [session autorelease];
+}
+
+static BOOL sameString(NSString *a, NSString *b) {
+    return a == b || [a isEqualToString:b];
+}
+
+static int checkParallelMatchesSerial(void) {
+    int failures = 0;
+    NSUInteger cells = 4 * 1 * 4 * 2 * 2;
+    NSArray *serial = [runMatrix(1) results];
+    NSArray *parallel = [runMatrix(4) results];
+
+    if (serial.count != cells || parallel.count != cells) {
+        NSLog(@"FAIL: Serial run gave %lu results and parallel %lu, expected %lu",
+              (unsigned long)serial.count, (unsigned long)parallel.count, (unsigned long)cells);
+        return 1;
+    }
+
+    NSUInteger i;
+    for (i = 0; i < cells; i++) {
+        BarcodeTestResult *a = [serial objectAtIndex:i];
+        BarcodeTestResult *b = [parallel objectAtIndex:i];
+        if (!sameString(a.barcodeType, b.barcodeType) || !sameString(a.testData, b.testData) ||
+            a.distortionType != b.distortionType || a.distortionIntensity != b.distortionIntensity ||
+            a.distortionStrength != b.distortionStrength || a.decodeSuccess != b.decodeSuccess ||
+            !sameString(a.decodedData, b.decodedData)) {
+            NSLog(@"FAIL: Cell %lu differs: serial %@ %@ %ld -> %@, parallel %@ %@ %ld -> %@", (unsigned long)i,
+                  a.barcodeType, a.testData, (long)a.distortionType, a.decodedData,
+                  b.barcodeType, b.testData, (long)b.distortionType, b.decodedData);
+            failures++;
+        } else if (a.decodeSuccess && ![a.decodedData hasPrefix:@"matrix:"]) {
+            NSLog(@"FAIL: Cell %lu was decoded by an unconfigured backend (%@)", (unsigned long)i, a.decodedData);
+            failures++;
+        }
+    }
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: Parallel run matches the serial run cell for cell");
+    }
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Executor Test ===");
+
+    int failures = 0;
+    failures += checkDecoderCopy();
+    failures += checkParallelMatchesSerial();
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: executor copies backends and keeps serial order");
+    } else {
+        NSLog(@"ERROR: %d executor checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+//
+//  test_library_probe.m
+//  Check that library lookups are answered from the probe index until a
+//  search directory changes
+//
+
+#import <Foundation/Foundation.h>
+#import "core/DynamicLibraryLoader.h"
+#import "decoder/BarcodeDecoder.h"
+#import "decoder/BarcodeDecoderZBarDynamic.h"
+#import <sys/time.h>
+#import <unistd.h>
+
+// Give a directory a known mtime, so the test does not depend on timestamp
+// resolution
+static void setDirectoryTime(NSString *directory, long seconds) {
+    struct timeval times[2];
+    times[0].tv_sec = times[1].tv_sec = seconds;
+    times[0].tv_usec = times[1].tv_usec = 0;
+    utimes([directory fileSystemRepresentation], times);
+}
+
+static int checkProbeIndex(void) {
+    int failures = 0;
+    NSFileManager *manager = [NSFileManager defaultManager];
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                           [NSString stringWithFormat:@"library-probe-%d", (int)getpid()]];
+    NSString *library = [directory stringByAppendingPathComponent:@"libsbrprobe.so.0"];
+    NSArray *directories = [NSArray arrayWithObject:directory];
+    [manager createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    setDirectoryTime(directory, 1000000);
+    if ([DynamicLibraryLoader findLibrary:@"sbrprobe" inDirectories:directories]) {
+        NSLog(@"FAIL: found a library in an empty directory");
+        failures++;
+    }
+
+    // Installing the library changes the directory, so the miss is re-probed
+    [manager createFileAtPath:library contents:[NSData data] attributes:nil];
+    setDirectoryTime(directory, 2000000);
+    if (![[DynamicLibraryLoader findLibrary:@"sbrprobe" inDirectories:directories] isEqualToString:library]) {
+        NSLog(@"FAIL: soname-only library not found after install");
+        failures++;
+    }
+    NSDictionary *saved = [NSDictionary dictionaryWithContentsOfFile:[DynamicLibraryLoader probeIndexPath]];
+    if (![[[saved objectForKey:@"sbrprobe"] objectForKey:@"path"] isEqualToString:library]) {
+        NSLog(@"FAIL: probe index at %@ does not hold the lookup", [DynamicLibraryLoader probeIndexPath]);
+        failures++;
+    }
+
+    // With the directory time unchanged the index answers without probing
+    [manager removeItemAtPath:library error:NULL];
+    setDirectoryTime(directory, 2000000);
+    if (![[DynamicLibraryLoader findLibrary:@"sbrprobe" inDirectories:directories] isEqualToString:library]) {
+        NSLog(@"FAIL: unchanged directory was probed again");
+        failures++;
+    }
+
+    // Any change to it invalidates the entry
+    setDirectoryTime(directory, 3000000);
+    if ([DynamicLibraryLoader findLibrary:@"sbrprobe" inDirectories:directories]) {
+        NSLog(@"FAIL: removed library still reported");
+        failures++;
+    }
+
+    [manager removeItemAtPath:directory error:NULL];
+    return failures;
+}
+
+// Asking whether ZBar can be used must not open it
+static int checkDeferredLoad(void) {
+    int failures = 0;
+    [BarcodeDecoderZBarDynamic isAvailable];
+    BarcodeDecoderZBarDynamic *backend = [[BarcodeDecoderZBarDynamic alloc] init];
+    if ([BarcodeDecoderZBarDynamic isLoaded]) {
+        NSLog(@"FAIL: libzbar opened before the first decode");
+        failures++;
+    }
+    [backend release];
+    return failures;
+}
+
+// A default decoder only searches for libzbar, and so only touches the
+// probe index, once the fallback is enabled
+static int checkFallbackOptIn(NSString *indexPath) {
+    int failures = 0;
+    NSFileManager *manager = [NSFileManager defaultManager];
+    [manager removeItemAtPath:indexPath error:NULL];
+    [DynamicLibraryLoader setProbeIndexPath:indexPath];
+
+    BarcodeDecoder *decoder = [[BarcodeDecoder alloc] init];
+    if ([manager fileExistsAtPath:indexPath]) {
+        NSLog(@"FAIL: default decoder searched for libzbar without opting in");
+        failures++;
+    }
+    [decoder release];
+
+    [BarcodeDecoder setDynamicFallbackEnabled:YES];
+    decoder = [[BarcodeDecoder alloc] init];
+    if (![manager fileExistsAtPath:indexPath] && ![decoder hasBackend]) {
+        NSLog(@"FAIL: enabled fallback did not search for libzbar");
+        failures++;
+    }
+    [decoder release];
+    [BarcodeDecoder setDynamicFallbackEnabled:NO];
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Library Probe Test ===");
+
+    // Keep the index out of the user's cache; the lookups below, the ZBar
+    // availability check included, save their answers to it
+    NSString *indexPath = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                           [NSString stringWithFormat:@"library-probe-%d.plist", (int)getpid()]];
+    [DynamicLibraryLoader setProbeIndexPath:indexPath];
+
+    int failures = 0;
+    failures += checkProbeIndex();
+    failures += checkDeferredLoad();
+    failures += checkFallbackOptIn(indexPath);
+
+    [[NSFileManager defaultManager] removeItemAtPath:indexPath error:NULL];
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: probe index follows directory changes and ZBar loads lazily");
+    } else {
+        NSLog(@"ERROR: %d library probe checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
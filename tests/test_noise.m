@@ -0,0 +1,119 @@
+//
+//  test_noise.m
+//  Check that seeded noise is reproducible and independent of threading
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImageNoise.h"
+#import "image/ImageParallel.h"
+#import <math.h>
+#import <stdlib.h>
+#import <string.h>
+
+// Noise one image several ways that must agree; returns number of failures
+static int checkType(NSString *name, ImageNoiseType type, int width, int height) {
+    size_t size = (size_t)width * height;
+    unsigned char *source = (unsigned char *)malloc(size);
+    unsigned char *first = (unsigned char *)malloc(size);
+    unsigned char *second = (unsigned char *)malloc(size);
+    unsigned char *other = (unsigned char *)malloc(size);
+    size_t i;
+    for (i = 0; i < size; i++) {
+        source[i] = (unsigned char)(rand() % 256);
+    }
+    
+    int failures = 0;
+    
+    // Single-threaded, then tiny bands on every processor
+    ImageParallelSetMaximumThreads(1);
+    ImageAddNoise(source, first, width, height, type, 0.6f, 1234);
+    ImageParallelSetMaximumThreads(0);
+    ImageParallelSetMinimumTilePixels(1);
+    ImageAddNoise(source, second, width, height, type, 0.6f, 1234);
+    ImageParallelSetMinimumTilePixels(262144);
+    if (memcmp(first, second, size) != 0) {
+        NSLog(@"FAIL: %@ %dx%d: output depends on the band split", name, width, height);
+        failures++;
+    }
+    
+    // Another seed must give another image
+    ImageAddNoise(source, other, width, height, type, 0.6f, 1235);
+    if (size > 64 && memcmp(first, other, size) == 0) {
+        NSLog(@"FAIL: %@ %dx%d: seeds 1234 and 1235 gave the same noise", name, width, height);
+        failures++;
+    }
+    
+    // Zero amount leaves the image alone
+    ImageAddNoise(source, other, width, height, type, 0.0f, 1234);
+    if (memcmp(source, other, size) != 0) {
+        NSLog(@"FAIL: %@ %dx%d: zero amount changed pixels", name, width, height);
+        failures++;
+    }
+    
+    free(source);
+    free(first);
+    free(second);
+    free(other);
+    return failures;
+}
+
+// Mean and standard deviation of noise added to flat gray
+static int checkSpread(NSString *name, ImageNoiseType type, double minDeviation, double maxDeviation) {
+    int width = 256, height = 256;
+    size_t size = (size_t)width * height;
+    unsigned char *source = (unsigned char *)malloc(size);
+    unsigned char *noisy = (unsigned char *)malloc(size);
+    memset(source, 128, size);
+    ImageAddNoise(source, noisy, width, height, type, 0.5f, 99);
+    
+    double sum = 0.0, squares = 0.0;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        sum += noisy[i];
+        squares += (double)noisy[i] * noisy[i];
+    }
+    double mean = sum / size;
+    double deviation = sqrt(squares / size - mean * mean);
+    free(source);
+    free(noisy);
+    
+    if (fabs(mean - 128.0) > 3.0 || deviation < minDeviation || deviation > maxDeviation) {
+        NSLog(@"FAIL: %@ mean %.2f, standard deviation %.2f", name, mean, deviation);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    
+    NSLog(@"=== Noise Test ===");
+    srand(12345);
+    
+    // Widths around the 64-pixel generation block exercise the tails
+    int widths[] = {1, 7, 63, 64, 65, 203, 1024};
+    int widthCount = sizeof(widths) / sizeof(widths[0]);
+    int failures = 0;
+    
+    int w;
+    for (w = 0; w < widthCount; w++) {
+        failures += checkType(@"Uniform", ImageNoiseTypeUniform, widths[w], 37);
+        failures += checkType(@"Gaussian", ImageNoiseTypeGaussian, widths[w], 37);
+        failures += checkType(@"SaltAndPepper", ImageNoiseTypeSaltAndPepper, widths[w], 37);
+    }
+    
+    // Uniform and Gaussian share a spread (73.9 * amount); half the pixels
+    // of salt and pepper are black or white
+    failures += checkSpread(@"Uniform", ImageNoiseTypeUniform, 34.0, 40.0);
+    failures += checkSpread(@"Gaussian", ImageNoiseTypeGaussian, 34.0, 40.0);
+    failures += checkSpread(@"SaltAndPepper", ImageNoiseTypeSaltAndPepper, 85.0, 95.0);
+    
+    if (failures == 0) {
+        NSLog(@"SUCCESS: noise is reproducible and independent of threading");
+    } else {
+        NSLog(@"ERROR: %d noise checks failed", failures);
+    }
+    
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+//
+//  test_parallel.m
+//  Check that row bands cover every row once and that the banded
+//  convolutions give the same bytes as unsplit processing
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImageMatrix.h"
+#import "image/ImageConvolution.h"
+#import "image/ImageParallel.h"
+#import <stdlib.h>
+#import <string.h>
+
+// Count visits per row; bands never overlap, so no locking is needed
+static void countRows(void *context, int rowStart, int rowEnd) {
+    int *visits = (int *)context;
+    int y;
+    for (y = rowStart; y < rowEnd; y++) {
+        visits[y]++;
+    }
+}
+
+static int checkCoverage(int width, int height) {
+    int *visits = (int *)calloc(height, sizeof(int));
+    ImageParallelForRows(height, width, countRows, visits);
+
+    int failures = 0;
+    int y;
+    for (y = 0; y < height; y++) {
+        if (visits[y] != 1) {
+            NSLog(@"FAIL: %dx%d: row %d visited %d times", width, height, y, visits[y]);
+            failures++;
+            break;
+        }
+    }
+    free(visits);
+    return failures;
+}
+
+// The three banded convolutions on one image, unsplit and then in tiny bands
+static int checkConvolutions(int width, int height) {
+    size_t size = (size_t)width * height;
+    unsigned char *image = (unsigned char *)malloc(size);
+    size_t i;
+    for (i = 0; i < size; i++) {
+        image[i] = (unsigned char)(rand() % 256);
+    }
+
+    ImageMatrix gaussian = ImageMatrixGaussianBlur(7, 1.5f);
+    ImageMatrix sharpen = ImageMatrixSharpen();
+    float column[7];
+    float row[7];
+    ImageMatrixSeparate(gaussian, column, row);
+
+    unsigned char *whole[3];
+    unsigned char *banded[3];
+    int pass;
+    for (pass = 0; pass < 2; pass++) {
+        unsigned char **outputs = pass == 0 ? whole : banded;
+        if (pass == 0) {
+            ImageParallelSetMaximumThreads(1);
+        } else {
+            ImageParallelSetMaximumThreads(0);
+            ImageParallelSetMinimumTilePixels(1);
+        }
+        outputs[0] = ImageConvolveBox(image, width, height, 5, 1.0f / 25.0f);
+        outputs[1] = ImageConvolveSeparable(image, width, height, column, row, 7);
+        outputs[2] = ImageConvolveFixedPoint(image, width, height, sharpen, ImageConvolutionSIMDSupported());
+    }
+    ImageParallelSetMinimumTilePixels(262144);
+
+    static NSString *names[3] = {@"box", @"separable", @"fixed-point"};
+    int failures = 0;
+    int k;
+    for (k = 0; k < 3; k++) {
+        if (!whole[k] || !banded[k]) {
+            NSLog(@"FAIL: %@ %dx%d: no result", names[k], width, height);
+            failures++;
+        } else if (memcmp(whole[k], banded[k], size) != 0) {
+            NSLog(@"FAIL: %@ %dx%d: output depends on the band split", names[k], width, height);
+            failures++;
+        }
+        free(whole[k]);
+        free(banded[k]);
+    }
+
+    ImageMatrixFree(&gaussian);
+    ImageMatrixFree(&sharpen);
+    free(image);
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Row Band Test ===");
+    srand(4321);
+
+    int failures = 0;
+
+    // Default tiles keep small images whole; tiny tiles split everything
+    failures += checkCoverage(640, 1031);
+    ImageParallelSetMinimumTilePixels(1);
+    failures += checkCoverage(3, 1031);
+    failures += checkCoverage(1, 1);
+    ImageParallelSetMinimumTilePixels(262144);
+
+    failures += checkConvolutions(131, 97);
+    failures += checkConvolutions(7, 64);
+    failures += checkConvolutions(3, 2);
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: banded processing matches unsplit processing");
+    } else {
+        NSLog(@"ERROR: %d row band checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+//
+//  test_pipeline.m
+//  Check that compiled pipelines fuse stages and match running them one by one
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImagePipeline.h"
+#import "image/ImageConvolution.h"
+#import "image/ImageParallel.h"
+#import <stdlib.h>
+#import <string.h>
+
+static ImageBuffer randomImage(int width, int height) {
+    ImageBuffer image = ImageBufferCreate(width, height);
+    size_t i;
+    for (i = 0; i < (size_t)width * height; i++) {
+        image.data[i] = (unsigned char)(rand() % 256);
+    }
+    return image;
+}
+
+// Largest difference between two images of one size, skipping a border
+static int largestDifference(const unsigned char *a, const unsigned char *b, int width, int height, int border) {
+    int x, y, largest = 0;
+    for (y = border; y < height - border; y++) {
+        for (x = border; x < width - border; x++) {
+            int difference = abs(a[y * width + x] - b[y * width + x]);
+            if (difference > largest) largest = difference;
+        }
+    }
+    return largest;
+}
+
+static int checkPasses(NSString *name, ImagePipeline *pipeline, int expected) {
+    int passes = ImagePipelinePassCount(pipeline);
+    if (passes != expected) {
+        NSLog(@"FAIL: %@ compiled to %d passes, expected %d", name, passes, expected);
+        return 1;
+    }
+    return 0;
+}
+
+// Blur, blur, noise, levels, noise: two passes, and away from the clamped
+// edges the merged kernel only differs by the intermediate rounding
+static int checkFusedBlurs(int width, int height) {
+    int failures = 0;
+    ImageBuffer source = randomImage(width, height);
+    ImageMatrix gaussian = ImageMatrixGaussianBlur(5, 1.5f);
+    ImageMatrix box = ImageMatrixBoxBlur(3);
+    unsigned char table[256];
+    int i;
+    for (i = 0; i < 256; i++) {
+        table[i] = (unsigned char)(255 - i);
+    }
+    
+    ImagePipeline *pipeline = ImagePipelineCreate();
+    ImagePipelineAddConvolution(pipeline, gaussian);
+    ImagePipelineAddConvolution(pipeline, box);
+    ImagePipelineAddNoise(pipeline, ImageNoiseTypeGaussian, 0.3f, 7);
+    ImagePipelineAddLookup(pipeline, table);
+    ImagePipelineAddNoise(pipeline, ImageNoiseTypeUniform, 0.2f, 8);
+    failures += checkPasses(@"Blur pipeline", pipeline, 2);
+    ImageBuffer fused = ImagePipelineRun(pipeline, source);
+    
+    size_t size = (size_t)width * height;
+    unsigned char *first = ImageConvolve(source.data, width, height, gaussian);
+    unsigned char *second = ImageConvolve(first, width, height, box);
+    ImageAddNoise(second, first, width, height, ImageNoiseTypeGaussian, 0.3f, 7);
+    for (i = 0; i < (int)size; i++) {
+        first[i] = table[first[i]];
+    }
+    ImageAddNoise(first, second, width, height, ImageNoiseTypeUniform, 0.2f, 8);
+    
+    // Each convolution path is within a level of exact, and rounding once
+    // instead of twice moves at most one more; the per-pixel stages carry it
+    int difference = largestDifference(fused.data, second, width, height, 3);
+    if (difference > 2) {
+        NSLog(@"FAIL: fused blurs %dx%d differ from staged blurs by %d", width, height, difference);
+        failures++;
+    }
+    
+    free(first);
+    free(second);
+    ImageBufferFree(&fused);
+    ImagePipelineFree(pipeline);
+    ImageMatrixFree(&gaussian);
+    ImageMatrixFree(&box);
+    ImageBufferFree(&source);
+    return failures;
+}
+
+// Stages that cannot merge must give exactly what running them one by one does
+static int checkUnmerged(int width, int height) {
+    int failures = 0;
+    ImageBuffer source = randomImage(width, height);
+    ImageMatrix edges = ImageMatrixEdgeDetection(1);
+    ImageMatrix box = ImageMatrixBoxBlur(3);
+    ImageMatrix sharpen = ImageMatrixSharpen();
+    size_t size = (size_t)width * height;
+    
+    // Edge detection clamps negative responses, so the blur stays separate;
+    // the sharpen blend and noise share the pass after the sharpen kernel
+    ImagePipeline *pipeline = ImagePipelineCreate();
+    ImagePipelineAddConvolution(pipeline, edges);
+    ImagePipelineAddConvolution(pipeline, box);
+    ImagePipelineAddBlendedConvolution(pipeline, sharpen, 0.4f);
+    ImagePipelineAddNoise(pipeline, ImageNoiseTypeSaltAndPepper, 0.1f, 3);
+    failures += checkPasses(@"Edge pipeline", pipeline, 4);
+    
+    // A strided view exercises the packing copy
+    ImageBuffer padded = ImageBufferCreate(width + 5, height);
+    int y;
+    for (y = 0; y < height; y++) {
+        memcpy(padded.data + (size_t)y * padded.stride, source.data + (size_t)y * width, width);
+    }
+    ImageBuffer view = ImageBufferWrap(padded.data, width, height, padded.stride);
+    ImageBuffer fused = ImagePipelineRun(pipeline, view);
+    
+    unsigned char *edged = ImageConvolve(source.data, width, height, edges);
+    unsigned char *blurred = ImageConvolve(edged, width, height, box);
+    unsigned char *sharpened = ImageConvolve(blurred, width, height, sharpen);
+    size_t i;
+    for (i = 0; i < size; i++) {
+        float blended = blurred[i] * (1.0f - 0.4f) + sharpened[i] * 0.4f;
+        sharpened[i] = (unsigned char)(blended + 0.5f);
+    }
+    ImageAddNoise(sharpened, edged, width, height, ImageNoiseTypeSaltAndPepper, 0.1f, 3);
+    
+    if (!ImageBufferIsValid(fused) || memcmp(fused.data, edged, size) != 0) {
+        NSLog(@"FAIL: unmerged pipeline %dx%d differs from staged filters", width, height);
+        failures++;
+    }
+    
+    free(edged);
+    free(blurred);
+    free(sharpened);
+    ImageBufferFree(&fused);
+    ImageBufferFree(&padded);
+    ImagePipelineFree(pipeline);
+    ImageMatrixFree(&edges);
+    ImageMatrixFree(&box);
+    ImageMatrixFree(&sharpen);
+    ImageBufferFree(&source);
+    return failures;
+}
+
+// Transforms compose into one resampling; empty pipelines borrow the source
+static int checkTransforms(void) {
+    int failures = 0;
+    ImageBuffer source = randomImage(60, 20);
+    ImageMatrix rotation = ImageMatrixRotation(90.0f);
+    ImageMatrix scaling = ImageMatrixScaling(2.0f, 0.5f);
+    
+    ImagePipeline *pipeline = ImagePipelineCreate();
+    ImageBuffer borrowed = ImagePipelineRun(pipeline, source);
+    if (borrowed.data != source.data || borrowed.owned) {
+        NSLog(@"FAIL: empty pipeline did not borrow its source");
+        failures++;
+    }
+    
+    ImagePipelineAddTransform(pipeline, rotation, ImageInterpolationBilinear);
+    ImagePipelineAddTransform(pipeline, scaling, ImageInterpolationBilinear);
+    failures += checkPasses(@"Transform pipeline", pipeline, 1);
+    ImageBuffer warped = ImagePipelineRun(pipeline, source);
+    if (warped.width != 40 || warped.height != 30) {
+        NSLog(@"FAIL: rotated and scaled 60x20 gave %dx%d, expected 40x30", warped.width, warped.height);
+        failures++;
+    }
+    
+    ImageBufferFree(&warped);
+    ImagePipelineFree(pipeline);
+    ImageMatrixFree(&rotation);
+    ImageMatrixFree(&scaling);
+    ImageBufferFree(&source);
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    
+    NSLog(@"=== Pipeline Test ===");
+    srand(12345);
+    ImageParallelSetMinimumTilePixels(1);
+    
+    int failures = 0;
+    failures += checkFusedBlurs(97, 41);
+    failures += checkFusedBlurs(8, 8);
+    failures += checkUnmerged(97, 41);
+    failures += checkUnmerged(5, 3);
+    failures += checkTransforms();
+    
+    if (failures == 0) {
+        NSLog(@"SUCCESS: pipelines fuse stages and match staged filters");
+    } else {
+        NSLog(@"ERROR: %d pipeline checks failed", failures);
+    }
+    
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
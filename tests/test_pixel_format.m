@@ -0,0 +1,104 @@
+//
+//  test_pixel_format.m
+//  Compare the vectorized grayscale conversion against the luma formula
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImageBuffer.h"
+#import "image/ImagePixelFormat.h"
+#import <stdlib.h>
+
+// Expected luma of one pixel, straight from the documented formula
+static unsigned char expectedGray(const unsigned char *pixel, ImagePixelFormat format) {
+    int r = 0, g = 0, b = 0;
+    switch (format) {
+        case ImagePixelFormatGray8:
+            return pixel[0];
+        case ImagePixelFormatRGB24:
+        case ImagePixelFormatRGBA32:
+            r = pixel[0]; g = pixel[1]; b = pixel[2];
+            break;
+        case ImagePixelFormatBGRA32:
+            b = pixel[0]; g = pixel[1]; r = pixel[2];
+            break;
+        case ImagePixelFormatARGB32:
+            r = pixel[1]; g = pixel[2]; b = pixel[3];
+            break;
+    }
+    return (unsigned char)((4899 * r + 9617 * g + 1868 * b + 8192) >> 14);
+}
+
+// Convert a random padded image; returns number of failures
+static int checkFormat(NSString *name, ImagePixelFormat format, int width, int height) {
+    int bytesPerPixel = ImagePixelFormatBytesPerPixel(format);
+    int stride = width * bytesPerPixel + 7; // Padding must be skipped
+    unsigned char *pixels = (unsigned char *)malloc((size_t)stride * height);
+    int i;
+    for (i = 0; i < stride * height; i++) {
+        pixels[i] = (unsigned char)(rand() % 256);
+    }
+    
+    int failures = 0;
+    ImageBuffer gray = ImageBufferFromPixels(pixels, width, height, stride, format);
+    if (!ImageBufferIsValid(gray)) {
+        NSLog(@"FAIL: %@ %dx%d: no result", name, width, height);
+        free(pixels);
+        return 1;
+    }
+    
+    int x, y;
+    for (y = 0; y < height && failures == 0; y++) {
+        for (x = 0; x < width; x++) {
+            unsigned char expected = expectedGray(pixels + (size_t)y * stride + x * bytesPerPixel, format);
+            unsigned char actual = gray.data[(size_t)y * gray.stride + x];
+            if (actual != expected) {
+                NSLog(@"FAIL: %@ %dx%d: pixel (%d, %d) is %d, expected %d", name, width, height, x, y, actual, expected);
+                failures++;
+                break;
+            }
+        }
+    }
+    
+    ImageBufferFree(&gray);
+    free(pixels);
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    
+    NSLog(@"=== Pixel Format Test ===");
+    srand(12345);
+    
+    // Widths around the 16-pixel vector step exercise the scalar tails
+    int widths[] = {1, 5, 15, 16, 17, 18, 31, 33, 64, 203};
+    int widthCount = sizeof(widths) / sizeof(widths[0]);
+    int failures = 0;
+    
+    int w;
+    for (w = 0; w < widthCount; w++) {
+        failures += checkFormat(@"Gray8", ImagePixelFormatGray8, widths[w], 9);
+        failures += checkFormat(@"RGB24", ImagePixelFormatRGB24, widths[w], 9);
+        failures += checkFormat(@"RGBA32", ImagePixelFormatRGBA32, widths[w], 9);
+        failures += checkFormat(@"BGRA32", ImagePixelFormatBGRA32, widths[w], 9);
+        failures += checkFormat(@"ARGB32", ImagePixelFormatARGB32, widths[w], 9);
+    }
+    
+    // White must stay white
+    unsigned char white[4] = {255, 255, 255, 255};
+    ImageBuffer gray = ImageBufferFromPixels(white, 1, 1, 4, ImagePixelFormatRGBA32);
+    if (!ImageBufferIsValid(gray) || gray.data[0] != 255) {
+        NSLog(@"FAIL: white RGBA pixel did not convert to 255");
+        failures++;
+    }
+    ImageBufferFree(&gray);
+    
+    if (failures == 0) {
+        NSLog(@"SUCCESS: all pixel formats match the luma formula");
+    } else {
+        NSLog(@"ERROR: %d pixel format checks failed", failures);
+    }
+    
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
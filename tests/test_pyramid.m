@@ -0,0 +1,127 @@
+//
+//  test_pyramid.m
+//  Check the 2x box reduction, pyramid sizing and textured-region search
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImageBuffer.h"
+#import "image/ImagePyramid.h"
+#import <stdlib.h>
+
+// Every reduced pixel is the rounded mean of its 2x2 block, for widths that
+// exercise both the vector steps and the scalar tail
+static int checkDownsample(int width, int height) {
+    int stride = width + 5; // Padding must be skipped
+    unsigned char *pixels = (unsigned char *)malloc((size_t)stride * height);
+    int i, x, y, failures = 0;
+    for (i = 0; i < stride * height; i++) {
+        pixels[i] = (unsigned char)(rand() % 256);
+    }
+    ImageBuffer source = ImageBufferWrap(pixels, width, height, stride);
+    ImageBuffer half = ImageBufferCreate(width / 2, height / 2);
+    if (!ImageDownsampleInto(source, half)) {
+        NSLog(@"FAIL: %dx%d reduction refused", width, height);
+        failures++;
+    }
+    for (y = 0; y < half.height && failures == 0; y++) {
+        for (x = 0; x < half.width; x++) {
+            const unsigned char *top = pixels + (size_t)(2 * y) * stride + 2 * x;
+            int expected = (top[0] + top[1] + top[stride] + top[stride + 1] + 2) >> 2;
+            if (half.data[(size_t)y * half.stride + x] != expected) {
+                NSLog(@"FAIL: %dx%d pixel (%d, %d) is %d, expected %d",
+                      width, height, x, y, half.data[(size_t)y * half.stride + x], expected);
+                failures++;
+                break;
+            }
+        }
+    }
+    ImageBufferFree(&half);
+    free(pixels);
+    return failures;
+}
+
+// Levels halve until one fits the coarse budget
+static int checkPyramid(void) {
+    int failures = 0;
+    ImageBuffer frame = ImageBufferCreate(2000, 1500);
+    ImagePyramid pyramid = ImagePyramidCreate(frame, 200000);
+    if (pyramid.count != 3 || pyramid.levels[2].width != 500 || pyramid.levels[2].height != 375) {
+        NSLog(@"FAIL: 2000x1500 pyramid has %d levels, coarsest %dx%d", pyramid.count,
+              pyramid.levels[pyramid.count - 1].width, pyramid.levels[pyramid.count - 1].height);
+        failures++;
+    }
+    if (pyramid.levels[0].data != frame.data) {
+        NSLog(@"FAIL: level 0 does not borrow the source");
+        failures++;
+    }
+    ImagePyramidFree(&pyramid);
+    ImageBufferFree(&frame);
+    return failures;
+}
+
+// Two bar patches on a flat page are found, the larger first, each inside
+// a box that covers it with some quiet zone
+static int checkRegions(void) {
+    int failures = 0, x, y;
+    ImageBuffer page = ImageBufferCreate(640, 480);
+    for (y = 0; y < page.height; y++) {
+        for (x = 0; x < page.width; x++) {
+            int bars = (x >= 100 && x < 260 && y >= 200 && y < 280) ||
+                       (x >= 480 && x < 560 && y >= 48 && y < 96);
+            page.data[(size_t)y * page.stride + x] = bars && (x / 3) % 2 ? 20 : 230;
+        }
+    }
+    ImageRegion regions[8];
+    int count = ImageFindTexturedRegions(page, 8.0f, 2, regions, 8);
+    if (count != 2) {
+        NSLog(@"FAIL: found %d regions, expected 2", count);
+        failures++;
+    } else {
+        ImageRegion large = regions[0], small = regions[1];
+        if (large.x > 100 - 8 || large.y > 200 - 8 || large.x + large.width < 260 + 8 ||
+            large.y + large.height < 280 + 8 || large.width > 160 + 64) {
+            NSLog(@"FAIL: large patch region is %d,%d %dx%d", large.x, large.y, large.width, large.height);
+            failures++;
+        }
+        if (small.x > 480 - 8 || small.y > 48 - 8 || small.x + small.width < 560 + 8 || small.y + small.height < 96 + 8) {
+            NSLog(@"FAIL: small patch region is %d,%d %dx%d", small.x, small.y, small.width, small.height);
+            failures++;
+        }
+    }
+
+    // A flat page has nothing to scan
+    for (y = 0; y < page.height; y++) {
+        for (x = 0; x < page.width; x++) {
+            page.data[(size_t)y * page.stride + x] = 200;
+        }
+    }
+    if (ImageFindTexturedRegions(page, 8.0f, 2, regions, 8) != 0) {
+        NSLog(@"FAIL: flat page has textured regions");
+        failures++;
+    }
+    ImageBufferFree(&page);
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Image Pyramid Test ===");
+
+    int failures = 0;
+    failures += checkDownsample(64, 32);
+    failures += checkDownsample(67, 31);
+    failures += checkDownsample(2, 2);
+    failures += checkDownsample(1001, 77);
+    failures += checkPyramid();
+    failures += checkRegions();
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: pyramid levels and textured regions match");
+    } else {
+        NSLog(@"ERROR: %d pyramid checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
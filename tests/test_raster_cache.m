@@ -0,0 +1,162 @@
+//
+//  test_raster_cache.m
+//  Check that a thread missing on a raster another thread is encoding waits
+//  for it instead of encoding the symbol again
+//
+
+#import <Foundation/Foundation.h>
+#import "tester/BarcodeRasterCache.h"
+#import <string.h>
+#import <unistd.h>
+
+// Looks up one payload on its own thread and records what it got
+@interface RasterWaiter : NSObject {
+    BarcodeRasterCache *cache;
+    NSString *payload;
+    NSCondition *condition;
+    BOOL done;
+    BOOL gotRaster;
+    BOOL claimed;
+}
+- (instancetype)initWithCache:(BarcodeRasterCache *)aCache payload:(NSString *)aPayload;
+- (void)run;
+- (BOOL)isDone;
+- (BOOL)waitUntilDone;
+- (BOOL)gotRaster;
+- (BOOL)claimed;
+@end
+
+@implementation RasterWaiter
+
+- (instancetype)initWithCache:(BarcodeRasterCache *)aCache payload:(NSString *)aPayload {
+    self = [super init];
+    if (self) {
+        cache = [aCache retain];
+        payload = [aPayload copy];
+        condition = [[NSCondition alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [cache release];
+    [payload release];
+    [condition release];
+    [super dealloc];
+}
+
+- (void)run {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BOOL claim = NO;
+    ImageBuffer raster = [cache rasterForData:payload symbology:20 options:nil claimed:&claim];
+    [condition lock];
+    gotRaster = ImageBufferIsValid(raster);
+    claimed = claim;
+    done = YES;
+    [condition broadcast];
+    [condition unlock];
+    ImageBufferFree(&raster);
+    [pool release];
+}
+
+- (BOOL)isDone {
+    [condition lock];
+    BOOL value = done;
+    [condition unlock];
+    return value;
+}
+
+- (BOOL)waitUntilDone {
+    NSDate *limit = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    [condition lock];
+    while (!done && [condition waitUntilDate:limit]) {
+    }
+    BOOL value = done;
+    [condition unlock];
+    return value;
+}
+
+- (BOOL)gotRaster {
+    return gotRaster;
+}
+
+- (BOOL)claimed {
+    return claimed;
+}
+
+@end
+
+// Claim a payload, start a second lookup of it, and settle the claim
+static int checkWaiter(BOOL store) {
+    int failures = 0;
+    BarcodeRasterCache *cache = [[BarcodeRasterCache alloc] initWithCapacity:4];
+    NSString *payload = store ? @"stored" : @"abandoned";
+
+    BOOL claimed = NO;
+    ImageBuffer raster = [cache rasterForData:payload symbology:20 options:nil claimed:&claimed];
+    if (ImageBufferIsValid(raster) || !claimed) {
+        NSLog(@"FAIL: first lookup of %@ did not claim it", payload);
+        ImageBufferFree(&raster);
+        [cache release];
+        return 1;
+    }
+
+    RasterWaiter *waiter = [[RasterWaiter alloc] initWithCache:cache payload:payload];
+    [NSThread detachNewThreadSelector:@selector(run) toTarget:waiter withObject:nil];
+    usleep(100000);
+    if ([waiter isDone]) {
+        NSLog(@"FAIL: second lookup of %@ did not wait for the claim", payload);
+        failures++;
+    }
+
+    if (store) {
+        ImageBuffer encoded = ImageBufferCreate(16, 8);
+        memset(encoded.data, 0, (size_t)encoded.stride * encoded.height);
+        [cache setRaster:encoded forData:payload symbology:20 options:nil];
+        ImageBufferFree(&encoded);
+    } else {
+        [cache abandonRasterForData:payload symbology:20 options:nil];
+    }
+
+    if (![waiter waitUntilDone]) {
+        NSLog(@"FAIL: second lookup of %@ still waiting after the claim was settled", payload);
+        [waiter release];
+        [cache release];
+        return failures + 1;
+    }
+    if (store && (![waiter gotRaster] || [waiter claimed] || [cache hits] != 1 || [cache misses] != 1)) {
+        NSLog(@"FAIL: waiter did not get the stored raster (hits %lu, misses %lu)",
+              (unsigned long)[cache hits], (unsigned long)[cache misses]);
+        failures++;
+    }
+    if (!store && ([waiter gotRaster] || ![waiter claimed])) {
+        NSLog(@"FAIL: waiter did not take over the abandoned claim");
+        failures++;
+    }
+    if (!store) {
+        [cache abandonRasterForData:payload symbology:20 options:nil];
+    }
+
+    [waiter release];
+    [cache release];
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Raster Cache Test ===");
+
+    int failures = 0;
+    failures += checkWaiter(YES);
+    failures += checkWaiter(NO);
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: concurrent misses wait for the encode in progress");
+    } else {
+        NSLog(@"ERROR: %d raster cache checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+//
+//  test_result_sink.m
+//  Check CSV and JSON Lines escaping, buffered file output and streaming
+//  through a session
+//
+
+#import <Foundation/Foundation.h>
+#import "tester/BarcodeTestResult.h"
+#import "tester/BarcodeResultSink.h"
+#import <unistd.h>
+
+static BarcodeTestResult *quotedResult(void) {
+    BarcodeTestResult *result = [BarcodeTestResult resultWithBarcodeType:@"Code, 128"
+                                                                testData:@"say \"hi\""
+                                                          distortionType:2
+                                                               intensity:0.5f
+                                                                strength:0.25f
+                                                                 success:YES
+                                                                 quality:80
+                                                                 matches:NO
+                                                                 decoded:@"line1\nline2"];
+    result.distortionSeed = 7;
+    return result;
+}
+
+static BarcodeTestResult *controlResult(void) {
+    BarcodeTestResult *result = [BarcodeTestResult resultWithBarcodeType:@"QR"
+                                                                testData:@"plain"
+                                                          distortionType:0
+                                                               intensity:0.0f
+                                                                strength:1.0f
+                                                                 success:NO
+                                                                 quality:-1
+                                                                 matches:NO
+                                                                 decoded:@"tab\there\\back\x01"];
+    [result setMilliseconds:1.5 forStage:BarcodeTestStageEncode];
+    [result setMilliseconds:2.25 forStage:BarcodeTestStageTotal];
+    return result;
+}
+
+static NSString *sinkOutput(BarcodeResultFormat format) {
+    NSMutableData *data = [NSMutableData data];
+    BarcodeStreamResultSink *sink = [[BarcodeStreamResultSink alloc] initWithMutableData:data format:format];
+    [sink writeResult:quotedResult()];
+    [sink writeResult:controlResult()];
+    [sink flush];
+    [sink release];
+    return [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
+}
+
+static int checkEscaping(void) {
+    int failures = 0;
+    NSString *expectedCSV =
+        @"Barcode Type,Test Data,Distortion Type,Intensity,Strength,Decode Success,Quality Score,Data Matches,Decoded Data,Seed,"
+        @"Encode ms,Distort ms,Decode ms,Total ms\n"
+        @"\"Code, 128\",\"say \"\"hi\"\"\",2,0.50,0.25,1,80,0,\"line1\nline2\",7,,,,\n"
+        @"QR,plain,0,0.00,1.00,0,-1,0,tab\there\\back\x01,0,1.500,,,2.250\n";
+    NSString *csv = sinkOutput(BarcodeResultFormatCSV);
+    if (![csv isEqualToString:expectedCSV]) {
+        NSLog(@"FAIL: CSV output\n%@", csv);
+        failures++;
+    }
+
+    NSString *expectedJSON =
+        @"{\"barcodeType\":\"Code, 128\",\"testData\":\"say \\\"hi\\\"\",\"distortionType\":2,\"intensity\":0.50,"
+        @"\"strength\":0.25,\"decodeSuccess\":true,\"qualityScore\":80,\"dataMatches\":false,"
+        @"\"decodedData\":\"line1\\nline2\",\"seed\":7,"
+        @"\"encodeMilliseconds\":null,\"distortMilliseconds\":null,\"decodeMilliseconds\":null,\"totalMilliseconds\":null}\n"
+        @"{\"barcodeType\":\"QR\",\"testData\":\"plain\",\"distortionType\":0,\"intensity\":0.00,"
+        @"\"strength\":1.00,\"decodeSuccess\":false,\"qualityScore\":-1,\"dataMatches\":false,"
+        @"\"decodedData\":\"tab\\there\\\\back\\u0001\",\"seed\":0,"
+        @"\"encodeMilliseconds\":1.500,\"distortMilliseconds\":null,\"decodeMilliseconds\":null,\"totalMilliseconds\":2.250}\n";
+    NSString *json = sinkOutput(BarcodeResultFormatJSONLines);
+    if (![json isEqualToString:expectedJSON]) {
+        NSLog(@"FAIL: JSON Lines output\n%@", json);
+        failures++;
+    }
+    return failures;
+}
+
+// More output than the 64 KiB buffer reaches the file whole, and a session
+// that keeps no results still streams every one of them
+static int checkStreaming(void) {
+    int failures = 0;
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"result-sink-%d.jsonl", (int)getpid()]];
+    BarcodeStreamResultSink *sink = [[BarcodeStreamResultSink alloc] initWithPath:path format:BarcodeResultFormatJSONLines];
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:@"streaming"];
+    session.retainsResults = NO;
+    [session addSink:sink];
+
+    NSInteger i;
+    for (i = 0; i < 2000; i++) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        [session addResult:quotedResult()];
+        [pool release];
+    }
+    [session endSession];
+
+    NSString *written = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+    NSUInteger lines = [[written componentsSeparatedByString:@"\n"] count] - 1;
+    if (lines != 2000 || [sink resultCount] != 2000 || [sink hasFailed]) {
+        NSLog(@"FAIL: %lu of 2000 lines streamed", (unsigned long)lines);
+        failures++;
+    }
+    if ([session resultCount] != 2000 || [[session results] count] != 0) {
+        NSLog(@"FAIL: session retained results it was told to drop");
+        failures++;
+    }
+    if (!session.endTime || [[session exportToJSON] rangeOfString:@"\"endTime\""].location == NSNotFound) {
+        NSLog(@"FAIL: ended session exports no end time");
+        failures++;
+    }
+
+    [session release];
+    [sink close];
+    [sink release];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+    return failures;
+}
+
+// Exporting an open session ends it, as it always has
+static int checkExportEndsSession(void) {
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:@"export"];
+    [session addResult:quotedResult()];
+    NSString *json = [session exportToJSON];
+    int failures = 0;
+    if (!session.endTime || [json rangeOfString:@"\"endTime\""].location == NSNotFound) {
+        NSLog(@"FAIL: JSON export of an open session has no end time");
+        failures++;
+    }
+    [session release];
+    return failures;
+}
+
+// The JSON document carries the same stage fields as JSON Lines
+static int checkExportTimings(void) {
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:@"timings"];
+    BarcodeTestResult *result = quotedResult();
+    [result setMilliseconds:1.5 forStage:BarcodeTestStageEncode];
+    [result setMilliseconds:-1.0 forStage:BarcodeTestStageDistort];
+    [session addResult:result];
+    NSData *json = [[session exportToJSON] dataUsingEncoding:NSUTF8StringEncoding];
+    NSDictionary *document = [NSJSONSerialization JSONObjectWithData:json options:0 error:NULL];
+    NSDictionary *row = [[document objectForKey:@"results"] lastObject];
+    int failures = 0;
+    if (!row || [[row objectForKey:@"encodeMilliseconds"] doubleValue] != 1.5 ||
+        [row objectForKey:@"distortMilliseconds"] != [NSNull null] || ![row objectForKey:@"totalMilliseconds"]) {
+        NSLog(@"FAIL: JSON export stage times are %@", row);
+        failures++;
+    }
+    [session release];
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Result Sink Test ===");
+
+    int failures = 0;
+    failures += checkEscaping();
+    failures += checkStreaming();
+    failures += checkExportEndsSession();
+    failures += checkExportTimings();
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: sinks escape, buffer and stream results");
+    } else {
+        NSLog(@"ERROR: %d result sink checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
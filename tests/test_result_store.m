@@ -0,0 +1,176 @@
+//
+//  test_result_store.m
+//  Check that the columnar result store gives back what was put in, keeps
+//  nil decoded data apart from empty strings and filters rows
+//
+
+#import <Foundation/Foundation.h>
+#import "tester/BarcodeResultStore.h"
+#import "tester/BarcodeTestResult.h"
+
+static BarcodeTestResult *storeResult(NSString *type, NSString *payload, NSInteger distortion, BOOL success,
+                                      NSInteger quality, NSString *decoded) {
+    return [BarcodeTestResult resultWithBarcodeType:type
+                                           testData:payload
+                                     distortionType:distortion
+                                          intensity:0.75f
+                                           strength:0.5f
+                                            success:success
+                                            quality:quality
+                                            matches:success && decoded && [decoded isEqualToString:payload]
+                                            decoded:decoded];
+}
+
+static int checkRoundTrip(void) {
+    int failures = 0;
+    BarcodeResultStore *store = [[BarcodeResultStore alloc] init];
+
+    // Values past the old 8- and 16-bit columns
+    BarcodeTestResult *wide = storeResult(@"Wide", @"payload", 300, YES, 70000, @"payload");
+    wide.symbology = 40000;
+    wide.distortionSeed = 0xDEADBEEFu;
+    [wide setMilliseconds:3.5 forStage:BarcodeTestStageDecode];
+    [store appendResult:wide];
+    [store appendResult:storeResult(@"QR", @"abc", 1, NO, -1, nil)];
+    [store appendResult:storeResult(@"QR", @"abc", 1, YES, 10, @"")];
+
+    BarcodeTestResult *first = [store resultAtIndex:0];
+    if (first.symbology != 40000 || first.distortionType != 300 || first.qualityScore != 70000 ||
+        first.distortionSeed != 0xDEADBEEFu || ![first.decodedData isEqualToString:@"payload"] ||
+        [first millisecondsForStage:BarcodeTestStageDecode] != 3.5 ||
+        [first millisecondsForStage:BarcodeTestStageEncode] >= 0.0) {
+        NSLog(@"FAIL: Wide row came back as symbology %d distortion %ld quality %ld seed %u",
+              first.symbology, (long)first.distortionType, (long)first.qualityScore, first.distortionSeed);
+        failures++;
+    }
+    if ([store rowAtIndex:0].decodedData != BarcodeResultStoreSameAsInput) {
+        NSLog(@"FAIL: Decoded data equal to the payload was stored as a string");
+        failures++;
+    }
+
+    BarcodeTestResult *missing = [store resultAtIndex:1];
+    BarcodeTestResult *empty = [store resultAtIndex:2];
+    if (missing.decodedData != nil || [store rowAtIndex:1].decodedData != BarcodeResultStoreNoString) {
+        NSLog(@"FAIL: nil decoded data came back as \"%@\"", missing.decodedData);
+        failures++;
+    }
+    if (!empty.decodedData || empty.decodedData.length != 0) {
+        NSLog(@"FAIL: Empty decoded data came back as %@", empty.decodedData);
+        failures++;
+    }
+
+    // "Wide", "payload", "QR", "abc", ""
+    if ([store stringCount] != 5) {
+        NSLog(@"FAIL: %lu strings interned, expected 5", (unsigned long)[store stringCount]);
+        failures++;
+    }
+    [store release];
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: Stored rows round-trip");
+    }
+    return failures;
+}
+
+static int checkFilter(void) {
+    int failures = 0;
+    BarcodeResultStore *store = [[BarcodeResultStore alloc] init];
+    NSInteger i;
+    for (i = 0; i < 100; i++) {
+        BarcodeTestResult *result = storeResult(@"Code128", @"data", i % 4, i % 3 == 0, 50, @"data");
+        result.symbology = 20;
+        [store appendResult:result];
+    }
+
+    BarcodeResultFilter filter = BarcodeResultFilterAny();
+    filter.distortionType = 2;
+    filter.success = 1;
+    NSUInteger expected = 0;
+    for (i = 0; i < 100; i++) {
+        if (i % 4 == 2 && i % 3 == 0) expected++;
+    }
+    NSUInteger counted = [store countOfRowsMatchingFilter:&filter];
+    NSUInteger walked = 0;
+    NSUInteger row;
+    for (row = [store nextRowMatchingFilter:&filter fromRow:0]; row != NSNotFound;
+         row = [store nextRowMatchingFilter:&filter fromRow:row + 1]) {
+        if (row % 4 != 2 || row % 3 != 0) {
+            NSLog(@"FAIL: Row %lu passed the filter", (unsigned long)row);
+            failures++;
+        }
+        walked++;
+    }
+    if (counted != expected || walked != expected) {
+        NSLog(@"FAIL: Filter counted %lu and walked %lu rows, expected %lu",
+              (unsigned long)counted, (unsigned long)walked, (unsigned long)expected);
+        failures++;
+    }
+    filter = BarcodeResultFilterAny();
+    filter.symbology = 21;
+    if ([store countOfRowsMatchingFilter:&filter] != 0) {
+        NSLog(@"FAIL: Symbology filter matched rows of another symbology");
+        failures++;
+    }
+    [store release];
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: Filtered scans find the right rows");
+    }
+    return failures;
+}
+
+static int checkSessionView(void) {
+    int failures = 0;
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:@"view"];
+    [session addResult:storeResult(@"QR", @"one", 0, YES, 90, @"one")];
+
+    // Rows are not cached by the view: each read builds its own object
+    NSArray *results = [session results];
+    BarcodeTestResult *first = [results objectAtIndex:0];
+    BarcodeTestResult *again = [results objectAtIndex:0];
+    if (first == again || ![first.decodedData isEqualToString:again.decodedData] || [session results] != results) {
+        NSLog(@"FAIL: Reading a row twice did not build two equal objects");
+        failures++;
+    }
+
+    // The view follows rows added after it was made
+    [session addResult:storeResult(@"QR", @"two", 0, NO, -1, nil)];
+    if (results.count != 2 || ![[[results objectAtIndex:1] testData] isEqualToString:@"two"]) {
+        NSLog(@"FAIL: View did not pick up a new row");
+        failures++;
+    }
+
+    [session setResults:[NSArray arrayWithObject:storeResult(@"EAN-8", @"three", 0, YES, 50, @"three")]];
+    results = [session results];
+    if (results.count != 1 || ![[[results objectAtIndex:0] barcodeType] isEqualToString:@"EAN-8"] ||
+        [session resultCount] != 2) {
+        NSLog(@"FAIL: setResults: left %lu rows", (unsigned long)results.count);
+        failures++;
+    }
+    [session release];
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: Session results view follows the store");
+    }
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Result Store Test ===");
+
+    int failures = 0;
+    failures += checkRoundTrip();
+    failures += checkFilter();
+    failures += checkSessionView();
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: result store round-trips, filters and views rows");
+    } else {
+        NSLog(@"ERROR: %d result store checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+//
+//  test_scratch.m
+//  Check that scratch blocks are reused, bounded and trimmed per cell
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImageScratch.h"
+#import "image/ImageBuffer.h"
+#import <pthread.h>
+#import <string.h>
+
+// Same-size requests come back from the pool; much smaller ones do not tie
+// up a large block
+static int checkReuse(void) {
+    int failures = 0;
+    ImageScratchStatistics before = ImageScratchGetStatistics();
+
+    unsigned char *first = (unsigned char *)ImageScratchAlloc(640 * 480);
+    memset(first, 1, 640 * 480);
+    ImageScratchFree(first);
+    unsigned char *second = (unsigned char *)ImageScratchAlloc(640 * 479);
+    if (second != first) {
+        NSLog(@"FAIL: near-equal request did not reuse the cached block");
+        failures++;
+    }
+    ImageScratchFree(second);
+
+    unsigned char *small = (unsigned char *)ImageScratchAlloc(100);
+    if (small == first) {
+        NSLog(@"FAIL: 100-byte request took a 300 KB block");
+        failures++;
+    }
+    ImageScratchFree(small);
+
+    ImageScratchStatistics after = ImageScratchGetStatistics();
+    if (after.hits - before.hits != 1 || after.misses - before.misses != 2) {
+        NSLog(@"FAIL: expected 1 hit and 2 misses, got %llu and %llu",
+              (unsigned long long)(after.hits - before.hits), (unsigned long long)(after.misses - before.misses));
+        failures++;
+    }
+    return failures;
+}
+
+// Blocks reused in a cell survive its trim; blocks idle for a whole cell go
+static int checkTrim(void) {
+    int failures = 0;
+    ImageScratchTrim();
+    ImageScratchTrim();
+    if (ImageScratchGetStatistics().cachedBlocks != 0) {
+        NSLog(@"FAIL: two idle trims left %d blocks", ImageScratchGetStatistics().cachedBlocks);
+        failures++;
+    }
+
+    void *block = ImageScratchAlloc(4096);
+    ImageScratchFree(block);
+    ImageScratchTrim();
+    if (ImageScratchGetStatistics().cachedBlocks != 1) {
+        NSLog(@"FAIL: block used in the cell did not survive its trim");
+        failures++;
+    }
+    ImageScratchTrim();
+    if (ImageScratchGetStatistics().cachedBlocks != 0) {
+        NSLog(@"FAIL: block idle for a cell was not trimmed");
+        failures++;
+    }
+    return failures;
+}
+
+// However many blocks come back, the pool stays within its limits
+static int checkBounds(void) {
+    int failures = 0;
+    void *blocks[ImageScratchMaximumCachedBlocks + 8];
+    int count = ImageScratchMaximumCachedBlocks + 8, i;
+    for (i = 0; i < count; i++) {
+        blocks[i] = ImageScratchAlloc(8192 + i * 4096);
+    }
+    for (i = 0; i < count; i++) {
+        ImageScratchFree(blocks[i]);
+    }
+    void *huge = ImageScratchAlloc(ImageScratchMaximumCachedBytes + 1);
+    ImageScratchFree(huge);
+
+    ImageScratchStatistics statistics = ImageScratchGetStatistics();
+    if (statistics.cachedBlocks > ImageScratchMaximumCachedBlocks ||
+        statistics.cachedBytes > ImageScratchMaximumCachedBytes) {
+        NSLog(@"FAIL: pool holds %d blocks, %lu bytes", statistics.cachedBlocks, (unsigned long)statistics.cachedBytes);
+        failures++;
+    }
+    ImageScratchTrim();
+    ImageScratchTrim();
+    return failures;
+}
+
+static void *freeOnOtherThread(void *block) {
+    ImageScratchFree(block);
+    ImageScratchStatistics statistics = ImageScratchGetStatistics();
+    return (void *)(intptr_t)statistics.cachedBlocks;
+}
+
+// A block may be returned by another thread; it joins that thread's pool,
+// which is released when the thread exits
+static int checkCrossThread(void) {
+    void *block = ImageScratchAlloc(10000);
+    pthread_t thread;
+    void *cached = NULL;
+    if (pthread_create(&thread, NULL, freeOnOtherThread, block) != 0) {
+        ImageScratchFree(block);
+        return 0;
+    }
+    pthread_join(thread, &cached);
+    if ((intptr_t)cached != 1) {
+        NSLog(@"FAIL: block returned on another thread was not cached there");
+        return 1;
+    }
+    return 0;
+}
+
+// Many cells of buffer churn allocate once
+static int checkBufferChurn(void) {
+    ImageScratchStatistics before = ImageScratchGetStatistics();
+    int cell;
+    for (cell = 0; cell < 1000; cell++) {
+        ImageBuffer raster = ImageBufferCreate(300, 120);
+        ImageBuffer copy = ImageBufferCopy(raster);
+        ImageBufferFree(&copy);
+        ImageBufferFree(&raster);
+        ImageScratchTrim();
+    }
+    ImageScratchStatistics after = ImageScratchGetStatistics();
+    if (after.misses - before.misses > 2) {
+        NSLog(@"FAIL: 1000 cells went to malloc %llu times", (unsigned long long)(after.misses - before.misses));
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Scratch Pool Test ===");
+
+    int failures = 0;
+    failures += checkReuse();
+    failures += checkTrim();
+    failures += checkBounds();
+    failures += checkCrossThread();
+    failures += checkBufferChurn();
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: scratch blocks are reused, bounded and trimmed");
+    } else {
+        NSLog(@"ERROR: %d scratch pool checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+//
+//  test_session_file.m
+//  Write a binary session file, read it back through the mapping, and check
+//  that damaged files are refused
+//
+
+#import <Foundation/Foundation.h>
+#import "tester/BarcodeTestResult.h"
+#import "tester/BarcodeSessionFile.h"
+#import <string.h>
+#import <unistd.h>
+
+static NSString *temporaryPath(NSString *name) {
+    return [NSTemporaryDirectory() stringByAppendingPathComponent:
+            [NSString stringWithFormat:@"%@-%d.sbrs", name, (int)getpid()]];
+}
+
+static BarcodeTestResult *result(NSString *type, int symbology, NSInteger distortion, float intensity,
+                                 BOOL success, NSString *decoded) {
+    BarcodeTestResult *testResult = [BarcodeTestResult resultWithBarcodeType:type
+                                                                    testData:@"PAYLOAD"
+                                                              distortionType:distortion
+                                                                   intensity:intensity
+                                                                    strength:0.5f
+                                                                     success:success
+                                                                     quality:success ? 80 : 0
+                                                                     matches:success && [decoded isEqualToString:@"PAYLOAD"]
+                                                                     decoded:decoded];
+    testResult.symbology = symbology;
+    return testResult;
+}
+
+// Every record, string and group comes back as written
+static int checkRoundTrip(NSString *path) {
+    int failures = 0;
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:@"round trip"];
+    [session addResult:result(@"QR Code", 58, 1, 0.5f, NO, nil)];
+    [session addResult:result(@"Code 128", 20, 2, 0.25f, YES, @"PAYLOAD")];
+    [session addResult:result(@"QR Code", 58, 1, 0.0f, YES, @"PAYLOAD")];
+    [session addResult:result(@"QR Code", 58, 1, 0.0f, YES, @"OTHER")];
+    if (![session writeSessionFileToPath:path]) {
+        NSLog(@"FAIL: session file not written");
+        [session release];
+        return 1;
+    }
+    [session release];
+
+    BarcodeSessionFile file;
+    if (!BarcodeSessionFileOpen([path fileSystemRepresentation], &file)) {
+        NSLog(@"FAIL: written session file refused");
+        return 1;
+    }
+    if (file.header->recordCount != 4 || file.header->groupCount != 2) {
+        NSLog(@"FAIL: %llu records in %llu groups", (unsigned long long)file.header->recordCount,
+              (unsigned long long)file.header->groupCount);
+        failures++;
+    }
+    size_t length = 0;
+    const char *type = BarcodeSessionFileString(&file, file.records[1].barcodeType, &length);
+    if (!type || length != 8 || memcmp(type, "Code 128", 8) != 0 ||
+        file.records[1].decodedData != BarcodeSessionSameAsInput) {
+        NSLog(@"FAIL: second record does not read back");
+        failures++;
+    }
+    if (file.records[0].decodedData != BarcodeSessionNoString ||
+        BarcodeSessionFileString(&file, file.records[0].decodedData, &length) || length != 0) {
+        NSLog(@"FAIL: missing decoded data does not read back as no string");
+        failures++;
+    }
+    const char *other = BarcodeSessionFileString(&file, file.records[3].decodedData, &length);
+    if (!other || length != 5 || memcmp(other, "OTHER", 5) != 0) {
+        NSLog(@"FAIL: differing decoded data lost");
+        failures++;
+    }
+    const BarcodeSessionGroup *group = BarcodeSessionFileFindGroup(&file, 58, 1);
+    if (!group || group->rowCount != 3 || group->successes != 2 || group->matches != 1 ||
+        BarcodeSessionFileGroupThreshold(&file, group) != 0.5f) {
+        NSLog(@"FAIL: QR Code group index or threshold wrong");
+        failures++;
+    }
+    if (BarcodeSessionFileFindGroup(&file, 20, 1)) {
+        NSLog(@"FAIL: found a group that was never written");
+        failures++;
+    }
+    if (BarcodeSessionFileString(&file, (uint32_t)file.header->stringCount, &length)) {
+        NSLog(@"FAIL: string index past the table accepted");
+        failures++;
+    }
+    BarcodeSessionFileClose(&file);
+    return failures;
+}
+
+// Write a damaged copy of the file and expect the reader to refuse it
+static int expectRefused(NSData *original, NSString *description, size_t keep,
+                         size_t patchOffset, const void *patch, size_t patchLength) {
+    NSMutableData *damaged = [NSMutableData dataWithData:[original subdataWithRange:NSMakeRange(0, keep)]];
+    if (patch) {
+        [damaged replaceBytesInRange:NSMakeRange(patchOffset, patchLength) withBytes:patch];
+    }
+    NSString *path = temporaryPath(@"session-damaged");
+    [damaged writeToFile:path atomically:NO];
+    BarcodeSessionFile file;
+    int opened = BarcodeSessionFileOpen([path fileSystemRepresentation], &file);
+    if (opened) {
+        BarcodeSessionFileClose(&file);
+        NSLog(@"FAIL: %@ accepted", description);
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+    return opened ? 1 : 0;
+}
+
+static int checkDamagedFiles(NSString *path) {
+    int failures = 0;
+    NSData *original = [NSData dataWithContentsOfFile:path];
+    BarcodeSessionFileHeader header;
+    memcpy(&header, [original bytes], sizeof(header));
+
+    failures += expectRefused(original, @"truncated file", original.length - 4, 0, NULL, 0);
+
+    uint64_t groupCount = 1ULL << 61; // groupCount * sizeof(group) wraps
+    failures += expectRefused(original, @"huge group count", original.length,
+                              offsetof(BarcodeSessionFileHeader, groupCount), &groupCount, sizeof(groupCount));
+
+    uint64_t groupsOffset = header.stringsOffset; // Before the string bytes
+    failures += expectRefused(original, @"group table inside the string offsets", original.length,
+                              offsetof(BarcodeSessionFileHeader, groupsOffset), &groupsOffset, sizeof(groupsOffset));
+
+    uint64_t pastEnd = 1ULL << 40; // An intermediate offset beyond the final one
+    failures += expectRefused(original, @"string offset past the string bytes", original.length,
+                              (size_t)header.stringsOffset + sizeof(uint64_t), &pastEnd, sizeof(pastEnd));
+
+    uint32_t incomplete = 0;
+    failures += expectRefused(original, @"incomplete file", original.length,
+                              offsetof(BarcodeSessionFileHeader, complete), &incomplete, sizeof(incomplete));
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSLog(@"=== Session File Test ===");
+
+    NSString *path = temporaryPath(@"session");
+    int failures = checkRoundTrip(path);
+    if (failures == 0) {
+        failures += checkDamagedFiles(path);
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: session files round-trip and damaged files are refused");
+    } else {
+        NSLog(@"ERROR: %d session file checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
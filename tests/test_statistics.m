@@ -0,0 +1,186 @@
+//
+//  test_statistics.m
+//  Check the running moments, the P-square quantile sketch and the session
+//  summary built from them
+//
+
+#import <Foundation/Foundation.h>
+#import "tester/BarcodeTestStatistics.h"
+#import "tester/BarcodeTestResult.h"
+#import <math.h>
+#import <string.h>
+
+// Deterministic samples in [0, 1)
+static double nextSample(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return (double)((*state >> 8) & 0xFFFF) / 65536.0;
+}
+
+static int checkMoments(void) {
+    int failures = 0;
+    BarcodeRunningMoments moments;
+    memset(&moments, 0, sizeof(moments));
+
+    if (BarcodeRunningMomentsVariance(&moments) != 0.0) {
+        NSLog(@"FAIL: Empty moments have nonzero variance");
+        failures++;
+    }
+    BarcodeRunningMomentsAdd(&moments, 4.0);
+    if (moments.mean != 4.0 || BarcodeRunningMomentsVariance(&moments) != 0.0) {
+        NSLog(@"FAIL: One sample gives mean %g variance %g", moments.mean, BarcodeRunningMomentsVariance(&moments));
+        failures++;
+    }
+
+    // Large offset with a small spread, where a naive sum of squares loses
+    // every significant digit; compare against a two-pass computation
+    double samples[1000];
+    unsigned int state = 1;
+    double sum = 0.0;
+    int i;
+    memset(&moments, 0, sizeof(moments));
+    for (i = 0; i < 1000; i++) {
+        samples[i] = 1.0e9 + nextSample(&state);
+        sum += samples[i];
+        BarcodeRunningMomentsAdd(&moments, samples[i]);
+    }
+    double mean = sum / 1000.0;
+    double squares = 0.0;
+    for (i = 0; i < 1000; i++) {
+        squares += (samples[i] - mean) * (samples[i] - mean);
+    }
+    double variance = squares / 999.0;
+    if (moments.count != 1000 || fabs(moments.mean - mean) > 1e-6 ||
+        fabs(BarcodeRunningMomentsVariance(&moments) - variance) > variance * 1e-6) {
+        NSLog(@"FAIL: Moments mean %.9f variance %.9g, expected %.9f %.9g",
+              moments.mean, BarcodeRunningMomentsVariance(&moments), mean, variance);
+        failures++;
+    } else {
+        NSLog(@"SUCCESS: Running moments match a two-pass computation");
+    }
+    return failures;
+}
+
+static int checkQuantiles(void) {
+    int failures = 0;
+    BarcodeQuantileSketch sketch;
+
+    // Fewer than five samples: nearest rank among them
+    BarcodeQuantileSketchInit(&sketch, 0.5);
+    if (BarcodeQuantileSketchValue(&sketch) != 0.0) {
+        NSLog(@"FAIL: Empty sketch is not 0");
+        failures++;
+    }
+    BarcodeQuantileSketchAdd(&sketch, 30.0);
+    BarcodeQuantileSketchAdd(&sketch, 10.0);
+    BarcodeQuantileSketchAdd(&sketch, 20.0);
+    if (BarcodeQuantileSketchValue(&sketch) != 20.0) {
+        NSLog(@"FAIL: Median of three samples is %g, expected 20", BarcodeQuantileSketchValue(&sketch));
+        failures++;
+    }
+
+    // Uniform samples: every tracked quantile lands near its probability
+    NSInteger q;
+    for (q = 0; q < BarcodeQuantileCount; q++) {
+        unsigned int state = 7;
+        int i;
+        BarcodeQuantileSketchInit(&sketch, BarcodeQuantiles[q]);
+        for (i = 0; i < 20000; i++) {
+            BarcodeQuantileSketchAdd(&sketch, nextSample(&state));
+        }
+        double estimate = BarcodeQuantileSketchValue(&sketch);
+        if (fabs(estimate - BarcodeQuantiles[q]) > 0.02) {
+            NSLog(@"FAIL: p%g of uniform samples is %g", BarcodeQuantiles[q] * 100.0, estimate);
+            failures++;
+        }
+    }
+
+    // Sorted input is the usual worst case for marker adjustment
+    BarcodeQuantileSketchInit(&sketch, 0.9);
+    int i;
+    for (i = 1; i <= 1000; i++) {
+        BarcodeQuantileSketchAdd(&sketch, (double)i);
+    }
+    if (fabs(BarcodeQuantileSketchValue(&sketch) - 900.0) > 20.0) {
+        NSLog(@"FAIL: p90 of 1..1000 is %g", BarcodeQuantileSketchValue(&sketch));
+        failures++;
+    }
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: Quantile sketch estimates are within tolerance");
+    }
+    return failures;
+}
+
+static BarcodeTestResult *sessionResult(NSString *type, int symbology, BOOL success) {
+    BarcodeTestResult *result = [BarcodeTestResult resultWithBarcodeType:type
+                                                                testData:@"data"
+                                                          distortionType:1
+                                                               intensity:0.5f
+                                                                strength:0.5f
+                                                                 success:success
+                                                                 quality:success ? 50 : -1
+                                                                 matches:success
+                                                                 decoded:success ? @"data" : nil];
+    result.symbology = symbology;
+    return result;
+}
+
+static int checkSessionSummary(void) {
+    int failures = 0;
+    BarcodeTestSession *session = [[BarcodeTestSession alloc] initWithName:@"summary"];
+    [session addResult:sessionResult(@"QR", 0, YES)];
+    [session addResult:sessionResult(@"QR", 0, NO)];
+    [session addResult:sessionResult(@"Code128", 0, YES)];
+    [session addResult:sessionResult(@"EAN-13", 13, YES)];
+
+    if (session.endTime) {
+        NSLog(@"FAIL: Session ended before its summary was read");
+        failures++;
+    }
+    NSDictionary *summary = [session summaryStatistics];
+    if (!session.endTime) {
+        NSLog(@"FAIL: summaryStatistics did not end the session");
+        failures++;
+    }
+    if ([[summary objectForKey:@"totalTests"] intValue] != 4) {
+        NSLog(@"FAIL: totalTests is %@", [summary objectForKey:@"totalTests"]);
+        failures++;
+    }
+
+    // Results without a symbology ID are split by type name
+    NSDictionary *byType = [summary objectForKey:@"byBarcodeType"];
+    NSDictionary *qr = [byType objectForKey:@"QR"];
+    NSDictionary *code128 = [byType objectForKey:@"Code128"];
+    NSDictionary *ean = [byType objectForKey:@"EAN-13"];
+    if (byType.count != 3 || [[qr objectForKey:@"total"] intValue] != 2 || [[qr objectForKey:@"success"] intValue] != 1 ||
+        [[code128 objectForKey:@"total"] intValue] != 1 || [[ean objectForKey:@"total"] intValue] != 1 ||
+        [[ean objectForKey:@"symbology"] intValue] != 13) {
+        NSLog(@"FAIL: byBarcodeType is %@", byType);
+        failures++;
+    }
+    [session release];
+
+    if (failures == 0) {
+        NSLog(@"SUCCESS: Session summary groups results and ends the session");
+    }
+    return failures;
+}
+
+int main(int argc, const char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    int failures = 0;
+
+    NSLog(@"=== Statistics Tests ===");
+    failures += checkMoments();
+    failures += checkQuantiles();
+    failures += checkSessionSummary();
+
+    if (failures == 0) {
+        NSLog(@"All statistics checks passed");
+    } else {
+        NSLog(@"ERROR: %d statistics checks failed", failures);
+    }
+
+    [pool release];
+    return failures == 0 ? 0 : 1;
+}
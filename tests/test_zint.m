@@ -89,6 +89,19 @@ int main(int argc, const char *argv[]) {
         return 1;
     }
     
+    // In-memory rendering path (no temporary files)
+    BarcodeEncoderZInt *backend = [[BarcodeEncoderZInt alloc] init];
+    ImageBuffer buffer = [backend encodeBufferFromData:testData symbology:qrCodeSymbology options:nil];
+    [backend release];
+    if (!ImageBufferIsValid(buffer)) {
+        NSLog(@"ERROR: In-memory encoding failed");
+        [encoder release];
+        [pool release];
+        return 1;
+    }
+    NSLog(@"In-memory raster: %d x %d", buffer.width, buffer.height);
+    ImageBufferFree(&buffer);
+    
     [encoder release];
     [pool release];
     return 0;
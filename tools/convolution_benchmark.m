@@ -0,0 +1,172 @@
+//
+//  convolution_benchmark.m
+//  Time every convolution path across kernel sizes and report where the FFT
+//  path starts to win, next to what the cost model picks
+//
+//  Usage: convolution_benchmark [-s WIDTHxHEIGHT] [-r repeats] [-t threads]
+//
+
+#import <Foundation/Foundation.h>
+#import "image/ImageMatrix.h"
+#import "image/ImageConvolution.h"
+#import "image/ImageParallel.h"
+#import <stdio.h>
+#import <stdlib.h>
+#import <time.h>
+#import <unistd.h>
+
+// Direct is K*K float taps per pixel; past this size one run takes minutes
+#define BenchmarkDirectMaximumSize 25
+
+typedef NS_ENUM(NSInteger, BenchmarkFamily) {
+    BenchmarkFamilyMotion = 0,      // Sparse line (ImageMatrixMotionBlur)
+    BenchmarkFamilyDefocusedMotion, // Motion blur merged with a 3x3 Gaussian: dense
+    BenchmarkFamilyGaussian,        // Rank 1
+    BenchmarkFamilyCount
+};
+
+static const char *familyNames[] = {"motion", "motion+gauss", "gaussian"};
+static const char *strategyNames[] = {"box", "separable", "fixed", "fft", "direct"};
+
+static ImageMatrix makeKernel(BenchmarkFamily family, int size) {
+    switch (family) {
+        case BenchmarkFamilyMotion:
+            return ImageMatrixMotionBlur(size, 30.0f);
+        case BenchmarkFamilyDefocusedMotion: {
+            ImageMatrix motion = ImageMatrixMotionBlur(size - 2, 30.0f);
+            ImageMatrix gaussian = ImageMatrixGaussianBlur(3, 0.8f);
+            ImageMatrix combined = ImageMatrixCombineKernels(motion, gaussian);
+            ImageMatrixFree(&motion);
+            ImageMatrixFree(&gaussian);
+            return combined;
+        }
+        default:
+            return ImageMatrixGaussianBlur(size, size / 6.0f);
+    }
+}
+
+static double nowMilliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+// Best of repeats, or -1 if the path cannot run the kernel
+static double timeStrategy(const unsigned char *image, unsigned char *dest, int width, int height,
+                           ImageMatrix kernel, ImageConvolutionStrategy strategy, int repeats) {
+    double best = -1.0;
+    int r;
+    for (r = 0; r < repeats; r++) {
+        double start = nowMilliseconds();
+        if (!ImageConvolveWithStrategyInto(image, dest, width, height, kernel, strategy)) {
+            return -1.0;
+        }
+        double elapsed = nowMilliseconds() - start;
+        if (best < 0.0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "usage: %s [-s WIDTHxHEIGHT] [-r repeats] [-t threads]\n", program);
+    fprintf(stderr, "  -s  image size (default 1024x768)\n");
+    fprintf(stderr, "  -r  runs per measurement, best kept (default 3)\n");
+    fprintf(stderr, "  -t  threads (default 1, which is what the cost model predicts; 0 for all)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int width = 1024, height = 768, repeats = 3, threads = 1;
+    int option;
+    while ((option = getopt(argc, argv, "s:r:t:")) != -1) {
+        if (option == 's' && sscanf(optarg, "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+            continue;
+        } else if (option == 'r' && (repeats = atoi(optarg)) > 0) {
+            continue;
+        } else if (option == 't' && (threads = atoi(optarg)) >= 0) {
+            continue;
+        }
+        printUsage(argv[0]);
+        return 2;
+    }
+    ImageParallelSetMaximumThreads(threads);
+
+    size_t pixels = (size_t)width * height;
+    unsigned char *image = (unsigned char *)malloc(pixels);
+    unsigned char *dest = (unsigned char *)malloc(pixels);
+    if (!image || !dest) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    srand(12345);
+    size_t i;
+    for (i = 0; i < pixels; i++) {
+        image[i] = (unsigned char)(rand() % 256);
+    }
+
+    int sizes[] = {3, 5, 9, 15, 21, 31, 41, 61, 81, 101, 131};
+    int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+    int agreements = 0, measurements = 0;
+
+    printf("%dx%d, %d thread(s), SIMD level %ld; milliseconds, best of %d\n",
+           width, height, threads, (long)ImageConvolutionSIMDSupported(), repeats);
+    printf("%-13s %5s %9s %9s %9s %9s   %-9s %-9s\n",
+           "kernel", "size", "separable", "fixed", "fft", "direct", "chosen", "fastest");
+
+    NSInteger family;
+    for (family = 0; family < BenchmarkFamilyCount; family++) {
+        int crossover = -1;
+        int s;
+        for (s = 0; s < sizeCount; s++) {
+            ImageMatrix kernel = makeKernel((BenchmarkFamily)family, sizes[s]);
+            double times[ImageConvolutionStrategyDirect + 1];
+            NSInteger strategy;
+            for (strategy = ImageConvolutionStrategyBox; strategy <= ImageConvolutionStrategyDirect; strategy++) {
+                times[strategy] = -1.0;
+                if (strategy == ImageConvolutionStrategyDirect && kernel.rows > BenchmarkDirectMaximumSize) {
+                    continue;
+                }
+                times[strategy] = timeStrategy(image, dest, width, height, kernel,
+                                               (ImageConvolutionStrategy)strategy, repeats);
+            }
+
+            NSInteger fastest = -1;
+            for (strategy = ImageConvolutionStrategyBox; strategy <= ImageConvolutionStrategyDirect; strategy++) {
+                if (times[strategy] >= 0.0 && (fastest < 0 || times[strategy] < times[fastest])) {
+                    fastest = strategy;
+                }
+            }
+            ImageConvolutionStrategy chosen = ImageConvolutionChooseStrategy(kernel, width, height);
+            if (fastest == ImageConvolutionStrategyFFT && crossover < 0) {
+                crossover = kernel.rows;
+            }
+            measurements++;
+            if (chosen == fastest) {
+                agreements++;
+            }
+
+            printf("%-13s %5d", familyNames[family], kernel.rows);
+            for (strategy = ImageConvolutionStrategySeparable; strategy <= ImageConvolutionStrategyDirect; strategy++) {
+                if (times[strategy] >= 0.0) {
+                    printf(" %9.2f", times[strategy]);
+                } else {
+                    printf(" %9s", "-");
+                }
+            }
+            printf("   %-9s %-9s\n", strategyNames[chosen], fastest >= 0 ? strategyNames[fastest] : "-");
+            ImageMatrixFree(&kernel);
+        }
+
+        if (crossover > 0) {
+            printf("%s: FFT fastest from %dx%d\n\n", familyNames[family], crossover, crossover);
+        } else {
+            printf("%s: FFT never fastest up to %dx%d\n\n", familyNames[family], sizes[sizeCount - 1], sizes[sizeCount - 1]);
+        }
+    }
+
+    printf("cost model picked the fastest path in %d of %d cases\n", agreements, measurements);
+    free(image);
+    free(dest);
+    return 0;
+}
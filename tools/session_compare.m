@@ -0,0 +1,142 @@
+//
+//  session_compare.m
+//  Diff two binary session files per (symbology, distortion) pair
+//
+//  Usage: session_compare [-t tolerance] baseline.sbrs candidate.sbrs
+//  Exits 1 if any pair regressed, 2 if a file could not be read.
+//
+
+#import <Foundation/Foundation.h>
+#import "tester/BarcodeSessionFile.h"
+#import <stdio.h>
+#import <stdlib.h>
+#import <unistd.h>
+
+// Per-group figures compared between the two files
+typedef struct {
+    double successRate;        // 0..1
+    float threshold;           // Failure threshold intensity, -1 if none
+    double decodeMilliseconds; // Mean timed decode, -1 if untimed
+} GroupSummary;
+
+static GroupSummary summarizeGroup(const BarcodeSessionFile *file, const BarcodeSessionGroup *group) {
+    GroupSummary summary;
+    summary.successRate = group->rowCount > 0 ? (double)group->successes / (double)group->rowCount : 0.0;
+    summary.threshold = BarcodeSessionFileGroupThreshold(file, group);
+
+    double total = 0.0;
+    uint64_t timed = 0;
+    uint64_t row;
+    for (row = group->firstRow; row < group->firstRow + group->rowCount; row++) {
+        float milliseconds = file->records[file->rows[row]].stageMilliseconds[BarcodeTestStageDecode];
+        if (milliseconds >= 0.0f) {
+            total += milliseconds;
+            timed++;
+        }
+    }
+    summary.decodeMilliseconds = timed > 0 ? total / (double)timed : -1.0;
+    return summary;
+}
+
+// Barcode type name of a group's first row
+static void printGroupName(const BarcodeSessionFile *file, const BarcodeSessionGroup *group) {
+    size_t length = 0;
+    const char *name = BarcodeSessionFileString(file, file->records[file->rows[group->firstRow]].barcodeType, &length);
+    if (name && length > 0) {
+        printf("%.*s (%d)", (int)length, name, group->symbology);
+    } else {
+        printf("symbology %d", group->symbology);
+    }
+    printf(" / distortion %d", group->distortionType);
+}
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "usage: %s [-t tolerance] baseline candidate\n", program);
+    fprintf(stderr, "  -t  success rate or threshold drop that counts as a regression (default 0.01)\n");
+}
+
+int main(int argc, char *argv[]) {
+    double tolerance = 0.01;
+    int option;
+    while ((option = getopt(argc, argv, "t:")) != -1) {
+        if (option == 't') {
+            tolerance = atof(optarg);
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    BarcodeSessionFile baseline;
+    BarcodeSessionFile candidate;
+    if (!BarcodeSessionFileOpen(argv[optind], &baseline)) {
+        fprintf(stderr, "%s: not a complete session file\n", argv[optind]);
+        return 2;
+    }
+    if (!BarcodeSessionFileOpen(argv[optind + 1], &candidate)) {
+        fprintf(stderr, "%s: not a complete session file\n", argv[optind + 1]);
+        BarcodeSessionFileClose(&baseline);
+        return 2;
+    }
+
+    printf("baseline:  %llu results, %llu groups\n",
+           (unsigned long long)baseline.header->recordCount, (unsigned long long)baseline.header->groupCount);
+    printf("candidate: %llu results, %llu groups\n",
+           (unsigned long long)candidate.header->recordCount, (unsigned long long)candidate.header->groupCount);
+
+    // Both group tables are sorted by (symbology, distortion), so one merge
+    // pass pairs them up
+    uint64_t regressions = 0;
+    uint64_t left = 0, right = 0;
+    while (left < baseline.header->groupCount || right < candidate.header->groupCount) {
+        const BarcodeSessionGroup *oldGroup = left < baseline.header->groupCount ? &baseline.groups[left] : NULL;
+        const BarcodeSessionGroup *newGroup = right < candidate.header->groupCount ? &candidate.groups[right] : NULL;
+
+        if (!newGroup || (oldGroup && (oldGroup->symbology < newGroup->symbology ||
+                                   (oldGroup->symbology == newGroup->symbology && oldGroup->distortionType < newGroup->distortionType)))) {
+            printGroupName(&baseline, oldGroup);
+            printf(": missing from candidate\n");
+            left++;
+            continue;
+        }
+        if (!oldGroup || oldGroup->symbology != newGroup->symbology || oldGroup->distortionType != newGroup->distortionType) {
+            printGroupName(&candidate, newGroup);
+            printf(": new in candidate\n");
+            right++;
+            continue;
+        }
+
+        GroupSummary before = summarizeGroup(&baseline, oldGroup);
+        GroupSummary after = summarizeGroup(&candidate, newGroup);
+
+        // A threshold of -1 means the pair never failed; falling from that
+        // to any threshold is a regression. Otherwise the threshold (an
+        // intensity in 0..1) must fall by more than the tolerance, so one
+        // noisy cell at the boundary does not flag the pair.
+        BOOL rateRegressed = after.successRate < before.successRate - tolerance;
+        BOOL thresholdRegressed = after.threshold >= 0.0f &&
+            (before.threshold < 0.0f || after.threshold < before.threshold - tolerance);
+
+        if (rateRegressed || thresholdRegressed) {
+            regressions++;
+            printGroupName(&baseline, oldGroup);
+            printf(": success %.4f -> %.4f, threshold %.4f -> %.4f",
+                   before.successRate, after.successRate, before.threshold, after.threshold);
+            if (before.decodeMilliseconds >= 0.0 && after.decodeMilliseconds >= 0.0) {
+                printf(", decode %.3f -> %.3f ms", before.decodeMilliseconds, after.decodeMilliseconds);
+            }
+            printf("\n");
+        }
+        left++;
+        right++;
+    }
+
+    printf("%llu regression(s)\n", (unsigned long long)regressions);
+    BarcodeSessionFileClose(&baseline);
+    BarcodeSessionFileClose(&candidate);
+    return regressions > 0 ? 1 : 0;
+}
@@ -73,6 +73,7 @@
 - (instancetype)init {
     self = [super init];
     if (self) {
+        [BarcodeDecoder setDynamicFallbackEnabled:YES];
         decoder = [[BarcodeDecoder alloc] init];
         encoder = [[BarcodeEncoder alloc] init];
         distorter = [[ImageDistorter alloc] init];